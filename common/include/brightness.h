@@ -0,0 +1,60 @@
+/**
+ * @file brightness.h
+ * @brief Header for brightness.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef BRIGHTNESS_H_
+#define BRIGHTNESS_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define BRIGHTNESS_MAX 255            /*!< Maximum brightness, as the one of the RGB LED */
+#define BRIGHTNESS_MAX_POINTS 8       /*!< Maximum number of points of the curve */
+#define BRIGHTNESS_RATE_DEFAULT 128   /*!< Default maximum change of the brightness, in levels per second: a full swing takes 2 s */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define a point of the curve of the brightness. The brightness is interpolated linearly between points, and held beyond the first and the last ones.
+typedef struct
+{
+    uint16_t light;     /*!< Value of the light sensor, from 0 (full light) to its maximum (darkness) */
+    uint8_t brightness; /*!< Brightness at this value of the light, from 0 to #BRIGHTNESS_MAX */
+} brightness_point_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Set the default curve and rate, and the brightness to #BRIGHTNESS_MAX.
+void brightness_init(void);
+
+/// @brief Set the curve of the brightness. The points are copied.
+/// @param p_points Pointer to the points, with increasing values of the light.
+/// @param num Number of points, from 2 to #BRIGHTNESS_MAX_POINTS.
+/// @return true
+/// @return false if the curve is not valid
+bool brightness_set_curve(const brightness_point_t *p_points, uint8_t num);
+
+/// @brief Set the maximum change of the brightness, so a passing shadow or a flash of light does not make the LED flicker.
+/// @param levels_per_s Maximum change in levels per second. Not 0.
+/// @return true
+/// @return false if the rate is 0
+bool brightness_set_rate(uint32_t levels_per_s);
+
+/// @brief Move the brightness towards the one of the curve for a value of the light, no faster than the rate.
+/// @param light Value of the light sensor.
+/// @param elapsed_us Time since the previous update, in us.
+/// @return true if the brightness has changed
+/// @return false
+bool brightness_update(uint32_t light, uint32_t elapsed_us);
+
+/// @brief Return the current brightness.
+/// @return uint8_t Brightness, from 0 to #BRIGHTNESS_MAX
+uint8_t brightness_get(void);
+
+#endif
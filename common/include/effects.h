@@ -0,0 +1,71 @@
+/**
+ * @file effects.h
+ * @brief Header for effects.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef EFFECTS_H_
+#define EFFECTS_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define EFFECTS_TICK_MS 10 /*!< Period of the tick that advances the effects. The durations of the keyframes are multiples of it */
+
+/* Enums */
+/// @brief Light effects of the RGB LED.
+typedef enum
+{
+    EFFECT_FLASH = 0, /*!< Jump between red, green, blue and white */
+    EFFECT_STROBE,    /*!< Fast white blink */
+    EFFECT_FADE,      /*!< White breathing: fade in and fade out */
+    EFFECT_SMOOTH,    /*!< Smooth color cycle: red, green, blue */
+    EFFECT_EMERGENCY, /*!< Slow white blink of the emergency signal */
+    EFFECT_NUM        /*!< Number of effects */
+} effects_id_t;
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define a keyframe of an effect. The effects are const tables of keyframes, played in a loop.
+typedef struct
+{
+    uint8_t r;            /*!< Level of the RED LED, from 0 to #RGB_LEVEL_MAX */
+    uint8_t g;            /*!< Level of the GREEN LED */
+    uint8_t b;            /*!< Level of the BLUE LED */
+    bool ramp;            /*!< true to interpolate linearly towards the next keyframe, false to hold the color */
+    uint16_t duration_ms; /*!< Duration of the keyframe, multiple of #EFFECTS_TICK_MS */
+} effects_keyframe_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Configure the tick timer of the effects. No effect is played until `effects_start()`.
+/// @param rgb_id RGB LED ID on which the effects are played.
+void effects_init(uint8_t rgb_id);
+
+/// @brief Start an effect from its first keyframe, replacing the one playing if any. The frames are computed in the interrupt of the tick timer, so the effect costs no time of the main loop.
+/// @param effect_id Effect.
+/// @return true
+/// @return false if the effect does not exist
+bool effects_start(effects_id_t effect_id);
+
+/// @brief Stop the effect playing. The LED keeps the last frame until a color is set.
+void effects_stop(void);
+
+/// @brief Check if an effect is playing. The system must not enter stop mode while it plays, since the tick timer stops.
+/// @return true
+/// @return false
+bool effects_check_activity(void);
+
+/// @brief Set the brightness of the RGB LED of the effects. The interrupt of the tick timer writes the LED too, so it is masked meanwhile; a frame due then is delayed until the brightness is written.
+/// @param brightness Brightness, from 0 to #RGB_LEVEL_MAX.
+void effects_set_brightness(uint8_t brightness);
+
+/// @brief Advance the effect playing one tick and write the frame in the RGB LED. It is called by the interrupt of the tick timer every #EFFECTS_TICK_MS.
+void effects_tick(void);
+
+#endif
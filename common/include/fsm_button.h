@@ -18,6 +18,25 @@
 /* Other includes */
 #include "fsm.h"
 
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define BUTTON_CLICK_WINDOW_MS 400 /*!< Default time after a release to press again and count one more click */
+#define BUTTON_LONG_PRESS_MS 600   /*!< Default duration from which a press is long instead of a click */
+#define BUTTON_HOLD_MS 1500        /*!< Default duration from which the button is held, reported before the release */
+#define BUTTON_MAX_CLICKS 3        /*!< Clicks of the longest gesture, reported at once without waiting for the click window */
+
+/* Enums */
+/// @brief Gestures recognized by the button FSM.
+typedef enum
+{
+    BUTTON_EVENT_NONE = 0,     /*!< No gesture since the last reset */
+    BUTTON_EVENT_SINGLE_CLICK, /*!< One short press and no other one within the click window */
+    BUTTON_EVENT_DOUBLE_CLICK, /*!< Two short presses, each one within the click window of the previous one */
+    BUTTON_EVENT_TRIPLE_CLICK, /*!< Three short presses, reported on the third release */
+    BUTTON_EVENT_LONG_PRESS,   /*!< A press released between the long press and the hold durations, reported on the release */
+    BUTTON_EVENT_HOLD          /*!< A press that reaches the hold duration, reported while the button is still pressed */
+} fsm_button_event_t;
+
 /* Function prototypes and explanation -------------------------------------------------*/
 
 /// @brief Return the duration of the last button press.
@@ -25,23 +44,45 @@
 /// @return uint32_t Duration of the last button press.
 uint32_t fsm_button_get_duration(fsm_t * p_this); 
 
-/// @brief Initialize a button FSM. 
+/// @brief Initialize a button FSM. The button is debounced by the scan of the port, so the FSM has no debounce of its own.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
-/// @param debounce_time Anti-debounce time in milliseconds.
 /// @param button_id Unique button identifier number.
-void fsm_button_init(fsm_t * p_this, uint32_t debounce_time, uint32_t button_id);
+void fsm_button_init(fsm_t * p_this, uint32_t button_id);
 
 /// @brief Create a new button FSM.
-/// @param debounce_time Anti-debounce time in milliseconds.
 /// @param button_id Unique button identifier number.
 /// @return A pointer to the button FSM.
-fsm_t* fsm_button_new(uint32_t 	debounce_time, uint32_t button_id);
+fsm_t* fsm_button_new(uint32_t button_id);
 
 /// @brief Reset the duration of the last button press.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 void fsm_button_reset_duration(fsm_t * p_this);
 
 
+/// @brief Return the last gesture recognized. The gestures are recognized by the transitions of the FSM, so reading it never waits.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @return fsm_button_event_t Last gesture, or #BUTTON_EVENT_NONE if there is none since the last reset
+fsm_button_event_t fsm_button_get_event(fsm_t *p_this);
+
+/// @brief Reset the last gesture recognized, and discard the clicks being counted, so they are not reported.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+void fsm_button_reset_event(fsm_t *p_this);
+
+/// @brief Set the times that tell the gestures apart.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @param click_window_ms Time after a release to press again and count one more click. Not 0.
+/// @param long_press_ms Duration from which a press is long instead of a click.
+/// @param hold_ms Duration from which the button is held. Longer than `long_press_ms`.
+/// @return true
+/// @return false if the times are not valid
+bool fsm_button_set_gesture_times(fsm_t *p_this, uint32_t click_window_ms, uint32_t long_press_ms, uint32_t hold_ms);
+
+/// @brief Check if the button is being held down. It is true from the press is detected until it is released, before the duration is available.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @return true
+/// @return false
+bool fsm_button_is_pressed(fsm_t *p_this);
+
 /// @brief Check if the button FSM is active, or not.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 /// @return true
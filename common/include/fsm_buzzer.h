@@ -0,0 +1,90 @@
+/**
+ * @file fsm_buzzer.h
+ * @brief Header for fsm_buzzer.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef FSM_BUZZER_H_
+#define FSM_BUZZER_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Other includes */
+#include "fsm.h"
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+/* Packed melody format. Each note is one byte, followed by a second byte only if its duration is not the default one of the melody:
+ * | bits 7-4: note (0: rest, 1-12: C, C#, D, D#, E, F, F#, G, G#, A, A#, B) | bits 3-2: octave - 4 | bit 1: dotted | bit 0: explicit duration |
+ * The second byte is the duration as a divisor of the whole note (1, 2, 4, 8, 16 or 32), as in RTTTL.
+ * The tables are generated from RTTTL strings with tools/rtttl2c.py. */
+#define BUZZER_NOTE_POS 4           /*!< Position of the note in the first byte */
+#define BUZZER_NOTE_MSK 0xF0        /*!< Mask of the note in the first byte */
+#define BUZZER_NOTE_REST 0          /*!< Note index of a rest */
+#define BUZZER_OCTAVE_POS 2         /*!< Position of the octave in the first byte */
+#define BUZZER_OCTAVE_MSK 0x0C      /*!< Mask of the octave in the first byte */
+#define BUZZER_OCTAVE_MIN 4         /*!< Octave encoded as 0 */
+#define BUZZER_DOTTED_MSK 0x02      /*!< Mask of the dotted flag: the duration is 1.5 times longer */
+#define BUZZER_DURATION_MSK 0x01    /*!< Mask of the flag that indicates that the next byte is the duration */
+
+/* Enums */
+/// @brief Priorities of the melodies. A melody only interrupts another one of the same or lower priority.
+typedef enum
+{
+    BUZZER_PRIORITY_MUSIC = 0, /*!< Melodies played as the action of a command */
+    BUZZER_PRIORITY_ALARM      /*!< Emergency tones */
+} fsm_buzzer_priority_t;
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define a melody in the packed format. The data are meant to be a const table, so they stay in flash.
+typedef struct
+{
+    const uint8_t *p_data;    /*!< Pointer to the packed notes */
+    uint16_t size;            /*!< Number of bytes of the packed notes */
+    uint16_t bpm;             /*!< Tempo in quarter notes per minute */
+    uint8_t default_duration; /*!< Duration of the notes without explicit duration, as a divisor of the whole note */
+} fsm_buzzer_melody_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Create a new buzzer FSM. The FSM plays a melody note by note, checking the system tick, so playing never blocks the main loop.
+/// @param buzzer_id Unique buzzer identifier number.
+/// @return A pointer to the buzzer FSM.
+fsm_t *fsm_buzzer_new(uint8_t buzzer_id);
+
+/// @brief Initialize a buzzer FSM.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @param buzzer_id Unique buzzer identifier number.
+void fsm_buzzer_init(fsm_t *p_this, uint8_t buzzer_id);
+
+/// @brief Start playing a melody. It returns immediately; the notes are played while the FSM is fired. If another melody is playing, it is interrupted at once unless it has a higher priority.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @param p_melody Pointer to the melody. It must remain valid while it is played.
+/// @param priority Priority of the melody.
+/// @return true if the melody is going to be played
+/// @return false if a melody with a higher priority is playing
+bool fsm_buzzer_play(fsm_t *p_this, const fsm_buzzer_melody_t *p_melody, fsm_buzzer_priority_t priority);
+
+/// @brief Stop the melody that is playing, if any.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+void fsm_buzzer_stop(fsm_t *p_this);
+
+/// @brief Check if the buzzer FSM is playing a melody. The system must not enter stop mode while it plays, since the timers stop.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @return true
+/// @return false
+bool fsm_buzzer_check_activity(fsm_t *p_this);
+
+/// @brief Return the system tick at which the buzzer FSM has to play the next note, if it only waits for it. Meanwhile the system may sleep, keeping the clocks of the timers, until that deadline.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @param p_deadline_ms Pointer to store the system tick of the end of the note playing.
+/// @return true if a melody is playing and there is no request to start or stop one
+/// @return false if the buzzer is idle, or if the FSM has to run at once
+bool fsm_buzzer_get_deadline(fsm_t *p_this, uint32_t *p_deadline_ms);
+
+#endif
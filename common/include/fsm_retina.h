@@ -16,6 +16,8 @@
 
 /* Other includes */
 #include "fsm.h"
+#include "melodies.h"
+#include "port_system.h"
 
 
 /* Function prototypes and explanation ---------------------------------------*/
@@ -26,10 +28,10 @@
 /// @param p_fsm_tx Infrared transmitter FSM.
 /// @param p_fsm_rx Pointer to an fsm_t struct than contains an fsm_rx_t. Added in Version 3.
 /// @param rgb_id 	Unique RGB identifier number. Added in Version 3.
-/// @param buzzer_id 	Unique RGB identifier number. Added in MEJORAS.
+/// @param p_fsm_buzzer 	Pointer to an fsm_t struct than contains an fsm_buzzer_t. Added in MEJORAS.
 /// @param p_fsm_sensor 	Pointer to an fsm_t struct than contains an fsm_sensor_t.
 /// @return A pointer to the Retina FSM.
-fsm_t *fsm_retina_new(fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, uint8_t buzzer_id, fsm_t *p_fsm_sensor);
+fsm_t *fsm_retina_new(fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, fsm_t *p_fsm_buzzer, fsm_t *p_fsm_sensor);
 
 /// @brief Initialize the infrared transmitter FSM.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
@@ -38,8 +40,56 @@ fsm_t *fsm_retina_new(fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_
 /// @param p_fsm_tx Pointer to an fsm_t struct than contains an fsm_tx_t.
 /// @param p_fsm_rx Pointer to an fsm_t struct than contains an fsm_rx_t. Added in Version 3.
 /// @param rgb_id Unique RGB identifier number. Added in Version 3.
-/// @param buzzer_id 	Unique RGB identifier number. Added in MEJORAS.
+/// @param p_fsm_buzzer 	Pointer to an fsm_t struct than contains an fsm_buzzer_t. Added in MEJORAS.
 /// @param p_fsm_sensor 	Pointer to an fsm_t struct than contains an fsm_sensor_t.
-void fsm_retina_init(fsm_t *p_this, fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, uint8_t buzzer_id, fsm_t *p_fsm_sensor);
+void fsm_retina_init(fsm_t *p_this, fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, fsm_t *p_fsm_buzzer, fsm_t *p_fsm_sensor);
+
+/// @brief Store a code in the memory of codes sent by the transmitter. The transmitter cache is updated with the new code.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param index Position of the memory of codes, from 0 to the number of codes stored minus 1.
+/// @param code Code of the NEC command.
+void fsm_retina_set_tx_code(fsm_t *p_this, uint8_t index, uint32_t code);
+
+/// @brief Enable or disable the hold-to-repeat mode of the transmitter. When enabled, the next code is sent as soon as the button is pressed and NEC repetition frames follow every 108 ms while it is held.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param enable true to enable the hold-to-repeat mode. false to send the code when the button is released.
+void fsm_retina_set_hold_to_repeat(fsm_t *p_this, bool enable);
+
+/// @brief Enable or disable the automatic brightness of the RGB LED. When enabled, every color and light effect is scaled by a brightness that follows the ambient light; when disabled, the LED is lit at the maximum brightness. The emergency signal is always at the maximum brightness.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param enable true to follow the ambient light. false for the maximum brightness.
+void fsm_retina_set_auto_brightness(fsm_t *p_this, bool enable);
+
+/// @brief Update the automatic brightness of the RGB LED with the latest value of the light sensor. It only does work when the sensor has filtered new samples, and the brightness changes no faster than the rate of `brightness_set_rate()`.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+void fsm_retina_update_brightness(fsm_t *p_this);
+
+/// @brief Select the melody played with the FADE command among the melodies stored in flash.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param melody_id Melody identifier.
+/// @return true
+/// @return false if the melody does not exist
+bool fsm_retina_set_fade_melody(fsm_t *p_this, melody_id_t melody_id);
+
+/// @brief Set the clocks of the system: one while it is awake and handling events, and a slower one while it sleeps, which the timers of the RGB LED, the effects and the buzzer keep running. The work clock is set at once, or the idle clock in the EMERGENCY state. By default the system works at 84 MHz, or at 64 MHz with the WS2812 LEDs, and sleeps at 16 MHz.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param work_clock Clock while the system is awake.
+/// @param idle_clock Clock while the system sleeps.
+/// @return true
+/// @return false if the RGB LEDs cannot run with one of the clocks (see `port_rgb_check_clock()`), which are not changed
+bool fsm_retina_set_clocks(fsm_t *p_this, port_system_clock_t work_clock, port_system_clock_t idle_clock);
+
+/// @brief Set the system tick at which the application needs the system awake, e.g. to time out a wait. The sleeps end at the deadline in any mode, also in stop mode, until it is cleared. Once it has passed, the system does not sleep.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @param deadline_ms System tick of the deadline.
+void fsm_retina_set_wake_deadline(fsm_t *p_this, uint32_t deadline_ms);
+
+/// @brief Clear the deadline of the application, so the system sleeps until an interrupt.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+void fsm_retina_clear_wake_deadline(fsm_t *p_this);
+
+/// @brief Switch the system to receiver mode without a long press of the button. Used by the loopback benchmark, where the codes sent by the transmitter are executed by the receiver of the same system.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+void fsm_retina_set_rx_mode(fsm_t *p_this);
 
 #endif
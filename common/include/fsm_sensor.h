@@ -22,7 +22,8 @@
 
 /// @brief Return the light of the sensor.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
-/// @return bool
+/// @return true if there is no light
+/// @return false if there is light
 bool fsm_sensor_get_light(fsm_t * p_this);
 
 /// @brief Initialize a sensor FSM. 
@@ -42,6 +43,38 @@ fsm_t* fsm_sensor_new(uint32_t sensor_id);
 /// @return false
 bool fsm_sensor_check_activity(fsm_t *p_this);
 
+/// @brief Prepare the sensor for stop mode, where the light is only watched by the EXTI of its pin, or restart sampling after it.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @param enable true before entering stop mode, false after waking up.
+/// @return true
+/// @return false if the sensor cannot watch the light in stop mode, so the system must only sleep the CPU
+bool fsm_sensor_set_low_power(fsm_t *p_this, bool enable);
+
+/// @brief Set the thresholds of the light, with hysteresis: there is no light from a value of the sensor, and there is light again below a lower one.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @param no_light_enter Value of the sensor from which there is no light, up to #SENSOR_VALUE_MAX.
+/// @param no_light_exit Value of the sensor below which there is light again. Lower than `no_light_enter`.
+/// @return true
+/// @return false if the thresholds are not valid
+bool fsm_sensor_set_thresholds(fsm_t *p_this, uint32_t no_light_enter, uint32_t no_light_exit);
+
+/// @brief Return the latest filtered value of the light.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @return uint32_t Value of the sensor, from 0 (full light) to #SENSOR_VALUE_MAX
+uint32_t fsm_sensor_get_value(fsm_t *p_this);
+
+/// @brief Return the time covered by the samples of the light filtered, which advances while the CPU sleeps.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @return uint32_t Time in us
+uint32_t fsm_sensor_get_sampled_us(fsm_t *p_this);
+
+/// @brief Set the sample rate of the sensor.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @param rate_hz Sample rate in Hz.
+/// @return true
+/// @return false if the sample rate is not valid
+bool fsm_sensor_set_sample_rate(fsm_t *p_this, uint32_t rate_hz);
+
 
 #endif
 
@@ -16,11 +16,12 @@
 
 /* Other includes */
 #include "fsm.h"
+#include "ir_encoder.h"
 
 /* Defines and enums ----------------------------------------------------------*/
 /* Defines */
 /* NEC transmission macros */
-#define NEC_TX_TIMER_TICK_BASE_US 56.25 /*!< Time base in microseconds to create the ticks for the timer of symbols */
+#define NEC_TX_TIMER_TICK_BASE_NS 56250 /*!< Time base in nanoseconds to create the ticks for the timer of symbols (56.25 us) */
 #define NEC_TX_PROLOGUE_TICKS_ON 160    /*!< Number of time base ticks for prologue ON in transmission  */
 #define NEC_TX_PROLOGUE_TICKS_OFF 80    /*!< Number of time base ticks for prologue OFF in transmission  */
 #define NEC_TX_SYM_0_TICKS_ON 10        /*!< Number of time base ticks for symbol 0 ON in transmission  */
@@ -29,9 +30,24 @@
 #define NEC_TX_SYM_1_TICKS_OFF 30       /*!< Number of time base ticks for symbol 1 OFF in transmission  */
 #define NEC_TX_EPILOGUE_TICKS_ON 10     /*!< Number of time base ticks for epilogue ON in transmission  */
 #define NEC_TX_EPILOGUE_TICKS_OFF 3560  /*!< Number of time base ticks for epilogue OFF in transmission ~200 miliseconds */
+#define NEC_TX_REPEAT_TICKS_OFF 40      /*!< Number of time base ticks for the silence after the prologue ON of a repetition frame (2.25 ms) */
+#define NEC_TX_REPEAT_DURATIONS 4       /*!< Number of ON and OFF durations of a NEC repetition frame: prologue and epilogue */
+#define NEC_TX_CACHE_SIZE 8             /*!< Number of precomputed burst schedules that the transmitter keeps in cache */
+#define NEC_TX_QUEUE_SIZE 8             /*!< Maximum number of frames waiting to be sent */
+#define NEC_TX_FRAME_PERIOD_TICKS 1920  /*!< Number of time base ticks of the NEC frame period (108 ms): minimum time between the start of two frames */
+#define NEC_TX_GAP_MIN 0                /*!< Inter-frame gap that pads each frame up to the frame period of its protocol (#NEC_TX_FRAME_PERIOD_TICKS for NEC), the minimum allowed */
 
-#define NEC_PWM_FREQ_HZ 38000 /*!< PWM timer frequency in Hz */
-#define NEC_PWM_DC 0.5        /*!< PWM duty cycle 0-1  */
+#define NEC_PWM_FREQ_HZ 38000   /*!< PWM timer frequency in Hz */
+#define NEC_PWM_DC_PERCENT 50   /*!< PWM duty cycle 0-100 */
+
+/* Enums */
+/// @brief Policies to apply when a code is queued and the queue of frames is full.
+typedef enum
+{
+    TX_QUEUE_OVERWRITE = 0, /*!< Discard the oldest frame waiting in the queue to make room for the new one */
+    TX_QUEUE_DROP,          /*!< Discard the new frame */
+    TX_QUEUE_BLOCK          /*!< Wait, firing the transmitter FSM, until there is room for the new frame */
+} fsm_tx_queue_policy_t;
 
 /* Function prototypes and explanation ----------------------------------------*/
 
@@ -45,17 +61,72 @@ fsm_t *fsm_tx_new(uint8_t tx_id);
 /// @param tx_id Unique infrared transmitter identifier number.
 void fsm_tx_init(fsm_t *p_this, uint8_t tx_id);
 
-/// @brief Set the code given.
-/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @brief Queue the code given to be transmitted after the global inter-frame gap.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
 /// @param code Code of the NEC command to be transmitted.
 void fsm_tx_set_code(fsm_t *p_this, uint32_t code);
 
-/// @brief Start the process to transmit the code stored.
-/// @param tx_id Unique infrared transmitter identifier number.
+/// @brief Queue the code given to be transmitted with its own inter-frame gap.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
 /// @param code Code of the NEC command to be transmitted.
-void fsm_send_NEC_code(uint8_t tx_id, uint32_t code);
+/// @param gap_ticks Silence after the epilogue burst, in ticks of the symbol timer. Use #NEC_TX_GAP_MIN to send frames back-to-back at the NEC frame period.
+/// @return true if the frame has been queued
+/// @return false if the frame has been dropped
+bool fsm_tx_queue_code(fsm_t *p_this, uint32_t code, uint16_t gap_ticks);
+
+/// @brief Queue the code given to be transmitted with a protocol of the registry of encoders. The carrier of the protocol is loaded when the frame starts.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param protocol Protocol of the frame.
+/// @param code Code to be transmitted, as described in `ir_protocol_t`.
+/// @param gap_ticks Silence after the last burst, in ticks of the symbol timer. Use #NEC_TX_GAP_MIN to send frames back-to-back at the frame period of the protocol.
+/// @return true if the frame has been queued
+/// @return false if the frame has been dropped
+bool fsm_tx_queue_protocol_code(fsm_t *p_this, ir_protocol_t protocol, uint32_t code, uint16_t gap_ticks);
+
+/// @brief Queue a NEC repetition frame (9 ms burst, 2.25 ms silence and a 562.5 us burst), used to signal that the last command is still held.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param gap_ticks Silence after the final burst, in ticks of the symbol timer. Use #NEC_TX_GAP_MIN to keep the standard 108 ms cadence.
+/// @return true if the frame has been queued
+/// @return false if the frame has been dropped
+bool fsm_tx_queue_repetition(fsm_t *p_this, uint16_t gap_ticks);
+
+/// @brief Set the global inter-frame gap used by `fsm_tx_set_code()`. By default it is #NEC_TX_EPILOGUE_TICKS_OFF, long enough for the message timeout of the infrared receiver FSM.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param gap_ticks Silence after the epilogue burst, in ticks of the symbol timer, or #NEC_TX_GAP_MIN.
+void fsm_tx_set_gap(fsm_t *p_this, uint16_t gap_ticks);
+
+/// @brief Set the protocol used by `fsm_tx_set_code()`, `fsm_tx_queue_code()` and `fsm_tx_cache_code()`. By default it is `IR_PROTOCOL_NEC`.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param protocol Protocol of the registry of encoders.
+void fsm_tx_set_protocol(fsm_t *p_this, ir_protocol_t protocol);
+
+/// @brief Set the policy to apply when a code is queued and the queue of frames is full. By default it is `TX_QUEUE_DROP`.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param policy Policy of the queue of frames.
+void fsm_tx_set_queue_policy(fsm_t *p_this, fsm_tx_queue_policy_t policy);
+
+/// @brief Return the number of frames waiting in the queue (the frame on air is not counted).
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @return uint32_t Number of frames queued.
+uint32_t fsm_tx_get_queue_depth(fsm_t *p_this);
+
+/// @brief Return the maximum number of frames that have been waiting in the queue at the same time.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @return uint32_t Maximum number of frames queued.
+uint32_t fsm_tx_get_queue_max_depth(fsm_t *p_this);
+
+/// @brief Return the number of frames discarded because the queue was full.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @return uint32_t Number of frames dropped or overwritten.
+uint32_t fsm_tx_get_queue_drops(fsm_t *p_this);
+
+/// @brief Precompute and store in the cache the burst schedule of a code that is going to be sent often. Sending a cached code only streams the stored schedule into the symbol timer.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param slot Cache position, from 0 to #NEC_TX_CACHE_SIZE - 1. The schedule previously stored in this position is discarded.
+/// @param code Code of the NEC command to be cached. A value of '0x00' just empties the position.
+void fsm_tx_cache_code(fsm_t *p_this, uint8_t slot, uint32_t code);
 
-/// @brief Check if the transmitter FSM is active, or not. As the system is the one controlling the output (PWM and symbol timer), this FSM will always be inactive and will wake up at each interruption of the symbol timer or PWM timer.
+/// @brief Check if the transmitter FSM is active, or not. The FSM is active while a frame is being sent by the symbol timer interrupts, so the system must not enter low power mode until it is back to idle.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_rx_t.
 /// @return true
 /// @return false
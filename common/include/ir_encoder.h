@@ -0,0 +1,88 @@
+/**
+ * @file ir_encoder.h
+ * @brief Header for ir_encoder.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+#ifndef IR_ENCODER_H_
+#define IR_ENCODER_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define IR_ENCODER_MAX_DURATIONS 68 /*!< Size of the array that stores a burst schedule. It is the longest frame of the registry (NEC: prologue, 32 symbols and epilogue) */
+#define IR_NO_DOUBLE_BIT 0xFF       /*!< Value of `double_bit` for the protocols without a double-width bit */
+#define IR_ENCODER_MIN_TICKS 2      /*!< Shortest duration of a burst schedule. The symbol timer counts each duration with its auto-reload register set to the duration minus 1, and it does not count with 0 */
+
+/* Enums */
+/// @brief Protocols of the registry of encoders.
+typedef enum
+{
+    IR_PROTOCOL_NEC = 0,  /*!< NEC, 32-bit code sent as it is (address, ~address, command, ~command), 38 kHz */
+    IR_PROTOCOL_NEC_EXT,  /*!< Extended NEC, 24-bit code (16-bit address and 8-bit command). The inverted command is appended, 38 kHz */
+    IR_PROTOCOL_SAMSUNG,  /*!< Samsung, 32-bit code with a 4.5 ms header burst, 38 kHz */
+    IR_PROTOCOL_SIRC,     /*!< Sony SIRC, 12-bit code (7-bit command and 5-bit address) sent LSB first with pulse width encoding, 40 kHz */
+    IR_PROTOCOL_RC5,      /*!< Philips RC5, 13-bit code (field, toggle, 5-bit address and 6-bit command). The start bit is added, 36 kHz */
+    IR_PROTOCOL_RC6,      /*!< Philips RC6 mode 0, 20-bit code (3-bit mode, toggle, 8-bit address and 8-bit command). The start bit is added, 36 kHz */
+    IR_PROTOCOL_NUM       /*!< Number of protocols of the registry */
+} ir_protocol_t;
+
+/// @brief How the bits of a code are turned into bursts.
+typedef enum
+{
+    IR_ENCODING_PULSE = 0, /*!< Each bit is a burst and a silence whose lengths depend on the bit (pulse distance and pulse width protocols) */
+    IR_ENCODING_BIPHASE    /*!< Each bit is two half-bits of opposite level (Manchester protocols) */
+} ir_encoding_t;
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to describe the timing of an infrared protocol. All the lengths are in ticks of the symbol timer.
+typedef struct
+{
+    uint32_t carrier_hz;            /*!< Frequency of the carrier (PWM) in Hz */
+    uint8_t duty_percent;           /*!< Duty cycle of the carrier, 0-100 */
+    ir_encoding_t encoding;         /*!< Encoding of the bits */
+    uint8_t num_bits;               /*!< Number of bits sent, after `p_pack()` */
+    bool msb_first;                 /*!< Order of the bits: true to send the most significant bit first */
+    uint16_t header_on;             /*!< Header burst. 0 if the protocol has no header */
+    uint16_t header_off;            /*!< Silence after the header burst */
+    uint16_t zero_on;               /*!< IR_ENCODING_PULSE: burst of a bit 0 */
+    uint16_t zero_off;              /*!< IR_ENCODING_PULSE: silence of a bit 0 */
+    uint16_t one_on;                /*!< IR_ENCODING_PULSE: burst of a bit 1 */
+    uint16_t one_off;               /*!< IR_ENCODING_PULSE: silence of a bit 1 */
+    uint16_t half_bit;              /*!< IR_ENCODING_BIPHASE: length of a half-bit */
+    bool one_starts_on;             /*!< IR_ENCODING_BIPHASE: true if a bit 1 is a burst followed by a silence (RC6), false if it is a silence followed by a burst (RC5) */
+    uint8_t double_bit;             /*!< IR_ENCODING_BIPHASE: position, in order of transmission, of the bit that lasts twice (RC6 toggle bit), or #IR_NO_DOUBLE_BIT */
+    uint16_t trailer_on;            /*!< Burst after the last bit. 0 if the protocol has no trailer */
+    uint16_t frame_period;          /*!< Minimum time between the start of two frames */
+    uint16_t gap_min;               /*!< Minimum silence after the last burst, longer than any silence inside a frame, so the receiver finds the end of the frame */
+    uint32_t (*p_pack)(uint32_t);   /*!< Function to turn the code given into the bits sent (fixed bits, checksums...). NULL if the code is sent as it is */
+} ir_protocol_desc_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Get the description of a protocol of the registry.
+/// @param protocol Protocol of the registry.
+/// @return Pointer to the description of the protocol, or NULL if the protocol is not in the registry.
+const ir_protocol_desc_t *ir_encoder_get_protocol(ir_protocol_t protocol);
+
+/// @brief Compute the burst schedule of a frame. Even positions are bursts (carrier ON) and odd positions are silences. The last position is the silence after the last burst; it is meant to be set by `ir_encoder_set_gap()`.
+/// @param protocol Protocol of the registry.
+/// @param code Code to be transmitted.
+/// @param p_durations Pointer to an array of #IR_ENCODER_MAX_DURATIONS elements where the schedule is stored.
+/// @return uint32_t Number of durations of the schedule, 0 if the protocol is not in the registry.
+uint32_t ir_encoder_build_schedule(ir_protocol_t protocol, uint32_t code, uint16_t *p_durations);
+
+/// @brief Set the silence after the last burst of a burst schedule. The silence is never shorter than the `gap_min` of the protocol, whatever the schedule held before, so a schedule can be reused with another gap.
+/// @param p_desc Pointer to the description of the protocol of the schedule.
+/// @param p_durations Pointer to the burst schedule.
+/// @param num_durations Number of durations of the burst schedule.
+/// @param gap_ticks Silence in ticks of the symbol timer, or 0 to pad the frame up to the `frame_period` of the protocol.
+void ir_encoder_set_gap(const ir_protocol_desc_t *p_desc, uint16_t *p_durations, uint32_t num_durations, uint16_t gap_ticks);
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file keyscan.h
+ * @brief Header for keyscan.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+#ifndef KEYSCAN_H_
+#define KEYSCAN_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define KEYSCAN_MAX_KEYS 32 /*!< Keys debounced together: one bit of a word each */
+#define KEYSCAN_SAMPLES 4   /*!< Consecutive equal samples to accept a change of a key: 2-bit vertical counters */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define the debounce of a group of keys. Bit i of each word is key i. Each key has a 2-bit counter of the samples that differ from its state, stored in two words (vertical counters), so all the keys are debounced in a few word operations.
+typedef struct
+{
+    uint32_t state;    /*!< Debounced state of the keys: 1 if pressed */
+    uint32_t cnt0;     /*!< Bit 0 of the counters */
+    uint32_t cnt1;     /*!< Bit 1 of the counters */
+} keyscan_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Initialize the debounce of a group of keys with their current state.
+/// @param p_keys Pointer to the group of keys.
+/// @param raw Raw state of the keys: 1 if pressed.
+void keyscan_init(keyscan_t *p_keys, uint32_t raw);
+
+/// @brief Debounce a sample of the keys. A key changes its state when #KEYSCAN_SAMPLES consecutive samples differ from it.
+/// @param p_keys Pointer to the group of keys.
+/// @param raw Raw state of the keys: 1 if pressed.
+/// @return uint32_t Keys whose state has changed in this sample
+uint32_t keyscan_update(keyscan_t *p_keys, uint32_t raw);
+
+/// @brief Check if the debounce of all the keys has finished: the raw state is the debounced one, so no more samples are needed until a key changes.
+/// @param p_keys Pointer to the group of keys.
+/// @param raw Raw state of the keys: 1 if pressed.
+/// @return true
+/// @return false
+bool keyscan_check_settled(const keyscan_t *p_keys, uint32_t raw);
+
+#endif
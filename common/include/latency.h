@@ -0,0 +1,66 @@
+/**
+ * @file latency.h
+ * @brief Header for latency.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#ifndef LATENCY_BENCH
+#define LATENCY_BENCH 0 /*!< Set to 1 (`make LATENCY_BENCH=1`) to build the TX->RX loopback benchmark and the stage marks */
+#endif
+
+#define LATENCY_MAX_SAMPLES 64 /*!< Number of commands kept to compute the percentiles. The oldest ones are overwritten */
+
+#if LATENCY_BENCH
+#define LATENCY_MARK(stage) latency_mark(stage) /*!< Take the timestamp of a stage of the command in flight */
+#else
+#define LATENCY_MARK(stage) /*!< Stage marks are removed when the benchmark is not built */
+#endif
+
+/* Enums */
+/// @brief Stages of a command, from the code given to the transmitter to the action of the receiver.
+typedef enum
+{
+    LATENCY_SET_CODE = 0, /*!< The code is queued in the transmitter FSM. Start of the command */
+    LATENCY_FIRST_BURST,  /*!< The symbol timer starts the first burst of the frame */
+    LATENCY_LAST_EDGE,    /*!< Last edge stored by the receiver */
+    LATENCY_DECODED,      /*!< The receiver FSM has parsed the code */
+    LATENCY_EXECUTED,     /*!< The Retina FSM has executed the code. End of the command */
+    LATENCY_NUM_STAGES    /*!< Number of stages */
+} latency_stage_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Discard all the samples and the command in flight.
+void latency_init(void);
+
+/// @brief Take the timestamp of a stage of the command in flight. `LATENCY_SET_CODE` starts a new command and `LATENCY_EXECUTED` stores it as a sample if all its stages were marked. It can be called from an ISR.
+/// @param stage Stage reached.
+void latency_mark(latency_stage_t stage);
+
+/// @brief Return the number of commands measured since `latency_init()`.
+/// @return uint32_t Number of commands.
+uint32_t latency_get_num_commands(void);
+
+/// @brief Return a percentile of the time from `LATENCY_SET_CODE` to a stage, over the last #LATENCY_MAX_SAMPLES commands.
+/// @param stage Stage of the command.
+/// @param percentile Percentile, from 0 (minimum) to 100 (maximum).
+/// @return uint32_t Time in microseconds, 0 if there are no samples.
+uint32_t latency_get_percentile_us(latency_stage_t stage, uint8_t percentile);
+
+/// @brief Return the command rate measured from the first `LATENCY_SET_CODE` to the last `LATENCY_EXECUTED`. If the commands are sent back-to-back, this is the maximum sustainable rate.
+/// @return uint32_t Commands per minute, 0 if less than two commands have been measured.
+uint32_t latency_get_commands_per_min(void);
+
+#endif
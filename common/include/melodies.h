@@ -0,0 +1,37 @@
+/**
+ * @file melodies.h
+ * @brief Header for melodies.c file. Generated by tools/rtttl2c.py from tools/melodies.rtttl, do not edit.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef MELODIES_H_
+#define MELODIES_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Other includes */
+#include "fsm_buzzer.h"
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Enums */
+/// @brief Melodies stored in flash.
+typedef enum
+{
+    MELODY_FADE = 0, /*!< Melody `fade` */
+    MELODY_EMERGENCY, /*!< Melody `emergency` */
+    MELODY_NO_EMERGENCY, /*!< Melody `no_emergency` */
+    MELODY_TWINKLE, /*!< Melody `twinkle` */
+    MELODY_ODE_TO_JOY, /*!< Melody `ode_to_joy` */
+    MELODY_BEEP, /*!< Melody `beep` */
+    MELODY_NUM /*!< Number of melodies */
+} melody_id_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Return a melody stored in flash.
+/// @param melody_id Melody identifier.
+/// @return Pointer to the melody, NULL if the identifier is not valid.
+const fsm_buzzer_melody_t *melodies_get(melody_id_t melody_id);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file synth.h
+ * @brief Header for synth.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef SYNTH_H_
+#define SYNTH_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define SYNTH_SAMPLE_RATE_HZ 32000 /*!< Sample rate of the synthesizer in Hz */
+#define SYNTH_NUM_VOICES 4         /*!< Number of voices that can sound at the same time */
+#define SYNTH_NUM_NOTES 48         /*!< Number of notes. Note 0 is C4, as in the table of notes of the buzzer */
+#define SYNTH_VOLUME_MAX 255       /*!< Maximum volume of a voice */
+#define SYNTH_SAMPLE_MID 2048      /*!< Sample value of the silence: middle of the 12-bit range of the DAC */
+#define SYNTH_SAMPLE_MAX 4095      /*!< Maximum sample value: 12-bit DAC */
+
+#define SYNTH_ATTACK_MS 5    /*!< Time of the envelope to rise from 0 to the maximum level */
+#define SYNTH_DECAY_MS 150   /*!< Time of the envelope to fall from the maximum level to the sustain level */
+#define SYNTH_SUSTAIN_PERCENT 60 /*!< Level of the envelope while the note is held, in % of the maximum level */
+#define SYNTH_RELEASE_MS 40  /*!< Time of the envelope to fall from the maximum level to 0 after the note off */
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Silence all the voices.
+void synth_init(void);
+
+/// @brief Start a note in a voice. The envelope starts with the attack, so the voice can be retriggered without clicks.
+/// @param voice Voice, from 0 to #SYNTH_NUM_VOICES - 1.
+/// @param note Index of the note: semitones from C4, up to #SYNTH_NUM_NOTES - 1.
+/// @param volume Volume of the voice, from 0 to #SYNTH_VOLUME_MAX.
+/// @return true
+/// @return false if the voice or the note are not valid
+bool synth_note_on(uint8_t voice, uint8_t note, uint8_t volume);
+
+/// @brief Release the note of a voice. The voice fades out during #SYNTH_RELEASE_MS.
+/// @param voice Voice, from 0 to #SYNTH_NUM_VOICES - 1.
+void synth_note_off(uint8_t voice);
+
+/// @brief Check if any voice is sounding, including the release of the notes.
+/// @return true
+/// @return false
+bool synth_check_activity(void);
+
+/// @brief Mix all the voices into a block of samples. It is called by the audio backend each time the DMA has played half of its buffer, and by the host renderer.
+/// @param p_samples Pointer to the block, in 12-bit unsigned DAC format.
+/// @param num_samples Number of samples of the block.
+void synth_render(uint16_t *p_samples, uint32_t num_samples);
+
+#endif
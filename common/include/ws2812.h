@@ -0,0 +1,38 @@
+/**
+ * @file ws2812.h
+ * @brief Header for ws2812.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 18/04/2023
+ */
+
+#ifndef WS2812_H_
+#define WS2812_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+/* Each bit of a WS2812/SK6812 LED is sent as 5 bits of a 4 MHz SPI: 1.25 us per bit, the period of the datasheet.
+ * Bit 0: 11000 -> 0.50 us high, 0.75 us low. Bit 1: 11100 -> 0.75 us high, 0.50 us low. */
+#define WS2812_SPI_CLOCK_HZ 4000000 /*!< Clock of the SPI that generates the bitstream */
+#define WS2812_SPI_BITS_PER_BIT 5   /*!< SPI bits per bit of the LEDs */
+#define WS2812_CODE_0 0x18          /*!< SPI bits of a bit 0 (11000) */
+#define WS2812_CODE_1 0x1C          /*!< SPI bits of a bit 1 (11100) */
+#define WS2812_BITS_PER_LED 24      /*!< Bits of the color of a LED: green, red and blue, MSB first */
+#define WS2812_BYTES_PER_LED ((WS2812_BITS_PER_LED * WS2812_SPI_BITS_PER_BIT) / 8) /*!< SPI bytes of a LED: 15 */
+#define WS2812_RESET_US 300         /*!< Low time that latches the colors. 50 us for the WS2812, 280 us for the WS2812B and SK6812 */
+#define WS2812_RESET_BYTES (((WS2812_RESET_US * (WS2812_SPI_CLOCK_HZ / 1000000)) + 7) / 8) /*!< SPI bytes at 0 of the reset: 150 */
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Encode the color of a LED into its SPI bytes, in the order of the LEDs: green, red and blue.
+/// @param p_out Pointer to the #WS2812_BYTES_PER_LED bytes of the LED in the buffer of the SPI.
+/// @param r Level of the RED LED.
+/// @param g Level of the GREEN LED.
+/// @param b Level of the BLUE LED.
+void ws2812_encode_led(uint8_t *p_out, uint8_t r, uint8_t g, uint8_t b);
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file brightness.c
+ * @brief Automatic brightness of the RGB LED: the light of the sensor is mapped to a brightness through a curve of points, and the brightness follows it with a limited rate. It has no dependencies on the HW, so it also runs on the host.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "brightness.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define BRIGHTNESS_US_PER_S 1000000 /*!< Microseconds in a second */
+
+/* Global variables ------------------------------------------------------------*/
+/// @brief Default curve: full brightness in sunlight, dimmed indoors and at dusk, and a dim light in the dark, where it is still well visible.
+static const brightness_point_t default_curve_arr[] = {
+    {0, 255},
+    {1500, 160},
+    {2600, 48},
+    {4095, 16},
+};
+
+static brightness_point_t curve_arr[BRIGHTNESS_MAX_POINTS]; /*!< Points of the curve */
+static uint8_t num_points;                                   /*!< Number of points of the curve */
+static uint32_t rate;                                        /*!< Maximum change in levels per second */
+static uint8_t brightness;                                   /*!< Current brightness */
+static uint64_t budget;                                      /*!< Change allowed and not used yet, in levels * us. It keeps the fractions of a level between updates */
+
+/* Private functions */
+
+/// @brief Return the brightness of the curve for a value of the light.
+/// @param light Value of the light sensor.
+/// @return uint8_t Brightness.
+static uint8_t _map(uint32_t light)
+{
+    if (light <= curve_arr[0].light)
+    {
+        return curve_arr[0].brightness;
+    }
+    for (uint8_t i = 1; i < num_points; i++)
+    {
+        if (light <= curve_arr[i].light)
+        {
+            const brightness_point_t *p_from = &curve_arr[i - 1];
+            const brightness_point_t *p_to = &curve_arr[i];
+            return (uint8_t)(p_from->brightness + (((int32_t)p_to->brightness - p_from->brightness) * (int32_t)(light - p_from->light)) / (int32_t)(p_to->light - p_from->light));
+        }
+    }
+    return curve_arr[num_points - 1].brightness;
+}
+
+/* Public functions */
+
+void brightness_init(void)
+{
+    brightness_set_curve(default_curve_arr, sizeof(default_curve_arr) / sizeof(default_curve_arr[0]));
+    rate = BRIGHTNESS_RATE_DEFAULT;
+    brightness = BRIGHTNESS_MAX;
+    budget = 0;
+}
+
+bool brightness_set_curve(const brightness_point_t *p_points, uint8_t num)
+{
+    if ((num < 2) || (num > BRIGHTNESS_MAX_POINTS))
+    {
+        return false;
+    }
+    for (uint8_t i = 1; i < num; i++)
+    {
+        if (p_points[i].light <= p_points[i - 1].light)
+        {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < num; i++)
+    {
+        curve_arr[i] = p_points[i];
+    }
+    num_points = num;
+    return true;
+}
+
+bool brightness_set_rate(uint32_t levels_per_s)
+{
+    if (levels_per_s == 0)
+    {
+        return false;
+    }
+    rate = levels_per_s;
+    return true;
+}
+
+bool brightness_update(uint32_t light, uint32_t elapsed_us)
+{
+    uint8_t target = _map(light);
+    if (target == brightness)
+    {
+        budget = 0;
+        return false;
+    }
+    budget += (uint64_t)rate * elapsed_us;
+    uint32_t diff = (target > brightness) ? (uint32_t)(target - brightness) : (uint32_t)(brightness - target);
+    uint64_t step = budget / BRIGHTNESS_US_PER_S;
+    if (step == 0)
+    {
+        return false;
+    }
+    if (step >= diff)
+    {
+        brightness = target;
+        budget = 0;
+    }
+    else
+    {
+        brightness = (target > brightness) ? (uint8_t)(brightness + step) : (uint8_t)(brightness - step);
+        budget -= step * BRIGHTNESS_US_PER_S;
+    }
+    return true;
+}
+
+uint8_t brightness_get(void)
+{
+    return brightness;
+}
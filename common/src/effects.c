@@ -0,0 +1,154 @@
+/**
+ * @file effects.c
+ * @brief Light effects engine: keyframe tables of the RGB LED played from a periodic timer tick.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "effects.h"
+#include <stddef.h>
+#include "port_effects.h"
+#include "port_rgb.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define EFFECTS_NUM_KEYFRAMES(arr) (sizeof(arr) / sizeof((arr)[0])) /*!< Number of keyframes of a table */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define an effect: its table of keyframes.
+typedef struct
+{
+    const effects_keyframe_t *p_keyframes; /*!< Pointer to the keyframes */
+    uint8_t size;                          /*!< Number of keyframes */
+} effects_effect_t;
+
+/* Global variables ------------------------------------------------------------*/
+static const effects_keyframe_t flash_arr[] = {
+    {255, 0, 0, false, 500},
+    {0, 255, 0, false, 500},
+    {0, 0, 255, false, 500},
+    {255, 255, 255, false, 500},
+}; /*!< Keyframes of the FLASH effect */
+
+static const effects_keyframe_t strobe_arr[] = {
+    {255, 255, 255, false, 50},
+    {0, 0, 0, false, 50},
+}; /*!< Keyframes of the STROBE effect */
+
+static const effects_keyframe_t fade_arr[] = {
+    {0, 0, 0, true, 1500},
+    {255, 255, 255, true, 1500},
+}; /*!< Keyframes of the FADE effect */
+
+static const effects_keyframe_t smooth_arr[] = {
+    {255, 0, 0, true, 2000},
+    {0, 255, 0, true, 2000},
+    {0, 0, 255, true, 2000},
+}; /*!< Keyframes of the SMOOTH effect */
+
+static const effects_keyframe_t emergency_arr[] = {
+    {255, 255, 255, false, 250},
+    {0, 0, 0, false, 250},
+}; /*!< Keyframes of the EMERGENCY effect */
+
+/// @brief Array of the effects, indexed by `effects_id_t`.
+static const effects_effect_t effects_arr[EFFECT_NUM] = {
+    [EFFECT_FLASH] = {flash_arr, EFFECTS_NUM_KEYFRAMES(flash_arr)},
+    [EFFECT_STROBE] = {strobe_arr, EFFECTS_NUM_KEYFRAMES(strobe_arr)},
+    [EFFECT_FADE] = {fade_arr, EFFECTS_NUM_KEYFRAMES(fade_arr)},
+    [EFFECT_SMOOTH] = {smooth_arr, EFFECTS_NUM_KEYFRAMES(smooth_arr)},
+    [EFFECT_EMERGENCY] = {emergency_arr, EFFECTS_NUM_KEYFRAMES(emergency_arr)},
+};
+
+static const effects_effect_t *volatile p_effect; /*!< Effect playing, NULL if none. Read by the interrupt of the tick timer */
+static uint8_t effect_rgb_id;                     /*!< RGB LED ID on which the effects are played */
+static uint8_t key_idx;                           /*!< Index of the keyframe playing */
+static uint16_t tick_idx;                         /*!< Ticks elapsed in the keyframe playing */
+
+/* Private functions */
+
+/// @brief Interpolate linearly a level between two keyframes.
+/// @param from Level of the keyframe playing.
+/// @param to Level of the next keyframe.
+/// @param tick Ticks elapsed in the keyframe.
+/// @param num_ticks Ticks of the keyframe.
+/// @return uint8_t Level of the frame.
+static uint8_t _interpolate(uint8_t from, uint8_t to, uint16_t tick, uint16_t num_ticks)
+{
+    return (uint8_t)(from + (((int32_t)to - from) * tick) / num_ticks);
+}
+
+/* Public functions */
+
+void effects_init(uint8_t rgb_id)
+{
+    effect_rgb_id = rgb_id;
+    p_effect = NULL;
+    port_effects_init(EFFECTS_TICK_MS);
+}
+
+bool effects_start(effects_id_t effect_id)
+{
+    if (effect_id >= EFFECT_NUM)
+    {
+        return false;
+    }
+    port_effects_stop();
+    key_idx = 0;
+    tick_idx = 0;
+    p_effect = &effects_arr[effect_id];
+    effects_tick(); /* The first frame is shown now, not one tick later. The timer is stopped, so there is no race with its interrupt */
+    port_effects_start();
+    return true;
+}
+
+void effects_stop(void)
+{
+    port_effects_stop();
+    p_effect = NULL;
+}
+
+bool effects_check_activity(void)
+{
+    return (p_effect != NULL);
+}
+
+void effects_set_brightness(uint8_t brightness)
+{
+    port_effects_lock();
+    port_rgb_set_brightness(effect_rgb_id, brightness);
+    port_effects_unlock();
+}
+
+void effects_tick(void)
+{
+    const effects_effect_t *p_playing = p_effect;
+    if (p_playing == NULL)
+    {
+        return;
+    }
+    const effects_keyframe_t *p_from = &p_playing->p_keyframes[key_idx];
+    uint16_t num_ticks = p_from->duration_ms / EFFECTS_TICK_MS;
+    if (num_ticks == 0)
+    {
+        num_ticks = 1;
+    }
+
+    if (p_from->ramp)
+    {
+        const effects_keyframe_t *p_to = &p_playing->p_keyframes[(key_idx + 1) % p_playing->size];
+        port_rgb_set_level(effect_rgb_id, _interpolate(p_from->r, p_to->r, tick_idx, num_ticks), _interpolate(p_from->g, p_to->g, tick_idx, num_ticks), _interpolate(p_from->b, p_to->b, tick_idx, num_ticks));
+    }
+    else if (tick_idx == 0)
+    {
+        port_rgb_set_level(effect_rgb_id, p_from->r, p_from->g, p_from->b); /* A held color is only written once */
+    }
+
+    tick_idx++;
+    if (tick_idx >= num_ticks)
+    {
+        tick_idx = 0;
+        key_idx = (key_idx + 1) % p_playing->size;
+    }
+}
@@ -18,15 +18,27 @@ typedef struct fsm_button
 {
     fsm_t f; /*!<Button FSM*/
 
-    uint32_t debounce_time; /*!<Button debounce time in ms*/
+    uint64_t tick_pressed; /*!<Time when the button was pressed, in us of `port_button_get_time_us()`*/
 
-    uint32_t next_timeout; /*!<Next timeout for the anti-debounce in ms*/
+    uint32_t duration; /*!<How much time the button has been pressed, in ms*/
 
-    uint32_t tick_pressed; /*!<Number of ticks when the button was pressed*/
+    uint32_t button_id; /*!<Button ID. Must be unique.*/
 
-    uint32_t duration; /*!<How much time the button has been pressed*/
+    fsm_button_event_t event; /*!<Last gesture recognized, until it is reset*/
 
-    uint32_t button_id; /*!<Button ID. Must be unique.*/
+    uint8_t clicks; /*!<Short presses counted in the current gesture*/
+
+    uint64_t tick_released; /*!<Time when the button was released, in us, start of the window for the next click*/
+
+    uint32_t click_window_ms; /*!<Time after a release to press again and count one more click*/
+
+    uint32_t long_press_ms; /*!<Duration from which a press is long instead of a click*/
+
+    uint32_t hold_ms; /*!<Duration from which the button is held, reported before the release*/
+
+    port_button_event_t next_event; /*!<Debounced event taken from the port and not handled yet*/
+
+    bool event_pending; /*!<Flag to indicate that next_event is valid*/
 
 } fsm_button_t;
 
@@ -34,14 +46,32 @@ typedef struct fsm_button
 /* Enums */
 enum
 {
-    BUTTON_RELEASED = 0,  /*!<Starting state. Also comes here when the button has been released*/
-    BUTTON_RELEASED_WAIT, /*!<State to perform the anti-debounce mechanism for a falling edge*/
-    BUTTON_PRESSED,       /*!<State while the button is being pressed*/
-    BUTTON_PRESSED_WAIT   /*!<State to perform the anti-debounce mechanism for a rising edge*/
+    BUTTON_RELEASED = 0, /*!<Starting state. Also comes here when the button has been released*/
+    BUTTON_PRESSED,      /*!<State while the button is being pressed*/
+    BUTTON_CLICK_WAIT,   /*!<State after a release, waiting for the next click within the click window*/
+    BUTTON_HELD          /*!<State while the button is being pressed after the hold event*/
 };
 
 /* State machine input or transition functions */
 
+/// @brief Check if the next debounced event of the button is a press or a release. The event is taken from the port and kept until an action handles it. An event of the other kind can only be left by a full queue of the port: the FSM is already at its level, so it is discarded.
+/// @param p_fsm Pointer to the button FSM.
+/// @param pressed true to check a press, false to check a release.
+/// @return true
+/// @return false
+static bool _check_event(fsm_button_t *p_fsm, bool pressed)
+{
+    if (p_fsm->event_pending && (p_fsm->next_event.pressed != pressed))
+    {
+        p_fsm->event_pending = false;
+    }
+    if (!p_fsm->event_pending)
+    {
+        p_fsm->event_pending = port_button_pop_event(p_fsm->button_id, &p_fsm->next_event);
+    }
+    return p_fsm->event_pending && (p_fsm->next_event.pressed == pressed);
+}
+
 /// @brief Check if button has been pressed.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 /// @return true
@@ -49,7 +79,7 @@ enum
 static bool check_button_pressed(fsm_t *p_this)
 {
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // casteo de p_this
-    return port_button_is_pressed(p_fsm->button_id);
+    return _check_event(p_fsm, true);
 }
 
 /// @brief Check if button has been released
@@ -59,48 +89,119 @@ static bool check_button_pressed(fsm_t *p_this)
 static bool check_button_released(fsm_t *p_this)
 {
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
-    return !(port_button_is_pressed(p_fsm->button_id));
+    return _check_event(p_fsm, false);
 }
 
-/// @brief Check if the debounce-time has passed.
+/// @brief Check if the last release ended the gesture, so there are no clicks to wait for: it was a long press, a hold or the last click.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 /// @return true
 /// @return false
-static bool check_timeout(fsm_t *p_this)
+static bool check_no_clicks(fsm_t *p_this)
 {
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
-    uint32_t aux = port_button_get_tick();
-    return (aux > p_fsm->next_timeout);
+    return (p_fsm->clicks == 0);
+}
+
+/// @brief Check if the click window has passed without a new press.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @return true
+/// @return false
+static bool check_click_window_end(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    return ((port_button_get_time_us() - p_fsm->tick_released) >= (p_fsm->click_window_ms * 1000ULL));
+}
+
+/// @brief Check if the button has been pressed long enough to be held.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+/// @return true
+/// @return false
+static bool check_hold(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    return ((port_button_get_time_us() - p_fsm->tick_pressed) >= (p_fsm->hold_ms * 1000ULL));
 }
 
 /* State machine output or action functions */
 
-/// @brief Store the system tick when the button was pressed. Update tick_pressed and next_timeout.
+/// @brief Report the clicks counted as a single, double or triple click and start a new gesture.
+/// @param p_fsm Pointer to the button FSM.
+static void _emit_clicks(fsm_button_t *p_fsm)
+{
+    static const fsm_button_event_t click_events_arr[] = {BUTTON_EVENT_NONE, BUTTON_EVENT_SINGLE_CLICK, BUTTON_EVENT_DOUBLE_CLICK, BUTTON_EVENT_TRIPLE_CLICK};
+    if (p_fsm->clicks > 0)
+    {
+        p_fsm->event = click_events_arr[p_fsm->clicks];
+    }
+    p_fsm->clicks = 0;
+}
+
+/// @brief Store the time of the press, the one of its first edge, and handle the event.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 static void do_store_tick_pressed(fsm_t *p_this)
 {
-    fsm_button_t *p_fsm = (fsm_button_t *)(p_this);                   // cast p_this
-    p_fsm->tick_pressed = port_button_get_tick();                     // update tick_pressed to current tick
-    p_fsm->next_timeout = p_fsm->tick_pressed + p_fsm->debounce_time; // update next_timeout considering current tick and the debounce time of the button
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this);   // cast p_this
+    p_fsm->tick_pressed = p_fsm->next_event.time_us;  // update tick_pressed to the time of the edge
+    p_fsm->event_pending = false;
 }
 
-/// @brief Store the duration of the button press.
+/// @brief Store the duration of the button press, between the times of the first edges of the press and the release, so it does not depend on the debounce nor on the latency of the main loop. Handle the event.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
 static void do_set_duration(fsm_t *p_this)
 {
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
-    uint32_t actual_tick = port_button_get_tick();
-    p_fsm->duration = (actual_tick - (p_fsm->tick_pressed));      // update duration to current tick - tick when pressed
-    p_fsm->next_timeout = (actual_tick + (p_fsm->debounce_time)); // update next_timeout considering current tick and the debounce time of the button
+    uint64_t release_us = p_fsm->next_event.time_us;
+    p_fsm->duration = (uint32_t)((release_us - p_fsm->tick_pressed) / 1000U); // update duration to time of the release - time when pressed, in ms
+    p_fsm->tick_released = release_us;
+    p_fsm->event_pending = false;
+}
+
+/// @brief Store the duration of the button press and count it in the gesture: a long press is reported at once, and a click is reported when the click window passes, or at once if it is the third one.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+static void do_count_click(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    do_set_duration(p_this);
+    if (p_fsm->duration >= p_fsm->long_press_ms)
+    {
+        p_fsm->clicks = 0;
+        p_fsm->event = BUTTON_EVENT_LONG_PRESS;
+        return;
+    }
+    p_fsm->clicks++;
+    if (p_fsm->clicks == BUTTON_MAX_CLICKS)
+    {
+        _emit_clicks(p_fsm);
+    }
+}
+
+/// @brief Report the clicks counted when the click window passes.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+static void do_end_clicks(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    _emit_clicks(p_fsm);
+}
+
+/// @brief Report that the button is held. The clicks counted before are discarded, and the release reports nothing else.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_button_t.
+static void do_hold(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    p_fsm->clicks = 0;
+    p_fsm->event = BUTTON_EVENT_HOLD;
 }
 
 /// @brief Array representing the transitions table of the FSM button.
 static fsm_trans_t fsm_trans_button[] = {
     //{EstadoIni, FuncCompruebaCondicion, EstadoSig, FuncAccionesSiTransicion}
-    {BUTTON_RELEASED, check_button_pressed, BUTTON_PRESSED_WAIT, do_store_tick_pressed},
-    {BUTTON_PRESSED_WAIT, check_timeout, BUTTON_PRESSED, NULL},
-    {BUTTON_PRESSED, check_button_released, BUTTON_RELEASED_WAIT, do_set_duration},
-    {BUTTON_RELEASED_WAIT, check_timeout, BUTTON_RELEASED, NULL},
+    {BUTTON_RELEASED, check_button_pressed, BUTTON_PRESSED, do_store_tick_pressed},
+    {BUTTON_PRESSED, check_button_released, BUTTON_CLICK_WAIT, do_count_click},
+    {BUTTON_PRESSED, check_hold, BUTTON_HELD, do_hold},
+    {BUTTON_HELD, check_button_released, BUTTON_RELEASED, do_set_duration},
+    {BUTTON_CLICK_WAIT, check_no_clicks, BUTTON_RELEASED, NULL},
+    {BUTTON_CLICK_WAIT, check_button_pressed, BUTTON_PRESSED, do_store_tick_pressed},
+    {BUTTON_CLICK_WAIT, check_click_window_end, BUTTON_RELEASED, do_end_clicks},
     {-1, NULL, -1, NULL}};
 
 /* Other auxiliary functions */
@@ -117,28 +218,67 @@ void fsm_button_reset_duration(fsm_t *p_this)
     p_fsm->duration = 0;                            // Set duration to 0ms
 }
 
-fsm_t *fsm_button_new(uint32_t debounce_time, uint32_t button_id)
+fsm_button_event_t fsm_button_get_event(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    return (p_fsm->event);
+}
+
+void fsm_button_reset_event(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    p_fsm->event = BUTTON_EVENT_NONE;
+    p_fsm->clicks = 0;
+}
+
+bool fsm_button_set_gesture_times(fsm_t *p_this, uint32_t click_window_ms, uint32_t long_press_ms, uint32_t hold_ms)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this); // cast p_this
+    if ((click_window_ms == 0) || (long_press_ms >= hold_ms))
+    {
+        return false;
+    }
+    p_fsm->click_window_ms = click_window_ms;
+    p_fsm->long_press_ms = long_press_ms;
+    p_fsm->hold_ms = hold_ms;
+    return true;
+}
+
+fsm_t *fsm_button_new(uint32_t button_id)
 {
     fsm_t *p_fsm = malloc(sizeof(fsm_button_t)); /* Do malloc to reserve memory of all other FSM elements, although it is interpreted as fsm_t (the first element of the structure) */
-    fsm_button_init(p_fsm, debounce_time, button_id);
+    fsm_button_init(p_fsm, button_id);
     return p_fsm;
 }
 
-void fsm_button_init(fsm_t *p_this, uint32_t debounce_time, uint32_t button_id)
+void fsm_button_init(fsm_t *p_this, uint32_t button_id)
 {
 
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this);
     fsm_init(p_this, fsm_trans_button);
 
-    p_fsm->debounce_time = debounce_time;
     p_fsm->button_id = button_id;
 
     p_fsm->tick_pressed = 0;
     p_fsm->duration = 0;
 
+    p_fsm->event = BUTTON_EVENT_NONE;
+    p_fsm->clicks = 0;
+    p_fsm->tick_released = 0;
+    p_fsm->click_window_ms = BUTTON_CLICK_WINDOW_MS;
+    p_fsm->long_press_ms = BUTTON_LONG_PRESS_MS;
+    p_fsm->hold_ms = BUTTON_HOLD_MS;
+    p_fsm->event_pending = false;
+
     port_button_init(button_id);
 }
 
+bool fsm_button_is_pressed(fsm_t *p_this)
+{
+    fsm_button_t *p_fsm = (fsm_button_t *)(p_this);
+    return ((p_fsm->f.current_state == BUTTON_PRESSED) || (p_fsm->f.current_state == BUTTON_HELD));
+}
+
 bool fsm_button_check_activity(fsm_t *p_this)
 {
     fsm_button_t *p_fsm = (fsm_button_t *)(p_this);
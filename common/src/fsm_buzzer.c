@@ -0,0 +1,213 @@
+/**
+ * @file fsm_buzzer.c
+ * @brief Buzzer FSM main file. Melody sequencer.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "fsm_buzzer.h"
+#include <stdlib.h>
+#include "port_buzzer.h"
+#include "port_system.h"
+
+/* Typedefs --------------------------------------------------------------------*/
+
+/// @brief Structure to define the buzzer FSM.
+typedef struct
+{
+    fsm_t f;                               /*!< Buzzer FSM */
+    const fsm_buzzer_melody_t *p_melody;   /*!< Melody playing, NULL if none */
+    const fsm_buzzer_melody_t *p_request;  /*!< Melody requested by `fsm_buzzer_play()`, waiting to be started by the FSM */
+    fsm_buzzer_priority_t priority;        /*!< Priority of the melody playing (or requested) */
+    uint16_t data_idx;                     /*!< Index of the byte of the next note in the packed data */
+    uint32_t note_end_ms;                  /*!< System tick at which the note playing ends */
+    bool stop_request;                     /*!< Flag to stop the melody playing */
+    uint8_t buzzer_id;                     /*!< Buzzer ID. Must be unique */
+
+} fsm_buzzer_t;
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Enums */
+enum FSM_BUZZER
+{
+    IDLE_BUZZER = 0, /*!< Starting state. Silent, waiting for a melody */
+    PLAYING_BUZZER   /*!< State while a melody is being played */
+};
+
+/* Private functions */
+
+/// @brief Decode the next note of the packed data of the melody and play it.
+/// @param p_fsm Pointer to the buzzer FSM.
+static void _start_note(fsm_buzzer_t *p_fsm)
+{
+    const fsm_buzzer_melody_t *p_melody = p_fsm->p_melody;
+    uint8_t packed = p_melody->p_data[p_fsm->data_idx++];
+    uint8_t note = (packed & BUZZER_NOTE_MSK) >> BUZZER_NOTE_POS;
+    uint8_t octave = BUZZER_OCTAVE_MIN + ((packed & BUZZER_OCTAVE_MSK) >> BUZZER_OCTAVE_POS);
+    uint8_t divisor = p_melody->default_duration;
+    if ((packed & BUZZER_DURATION_MSK) && (p_fsm->data_idx < p_melody->size))
+    {
+        divisor = p_melody->p_data[p_fsm->data_idx++];
+    }
+
+    uint32_t duration_ms = (4 * 60000U) / ((uint32_t)p_melody->bpm * divisor); /* A whole note lasts 4 beats */
+    if (packed & BUZZER_DOTTED_MSK)
+    {
+        duration_ms += duration_ms / 2;
+    }
+
+    uint8_t port_note = BUZZER_NOTE_SILENCE;
+    if ((note != BUZZER_NOTE_REST) && (note <= BUZZER_NOTES_PER_OCTAVE))
+    {
+        port_note = (octave - BUZZER_OCTAVE_MIN) * BUZZER_NOTES_PER_OCTAVE + (note - 1); /* Index of the table of notes of the port, which starts at C4 */
+    }
+    port_buzzer_set_note(p_fsm->buzzer_id, port_note);
+    p_fsm->note_end_ms = port_system_get_millis() + duration_ms;
+}
+
+/* State machine input or transition functions */
+
+/// @brief Check if a new melody has been requested.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @return true
+/// @return false
+static bool check_new_melody(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    return (p_fsm->p_request != NULL);
+}
+
+/// @brief Check if the melody must be stopped.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @return true
+/// @return false
+static bool check_stop(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    return p_fsm->stop_request;
+}
+
+/// @brief Check if the last note of the melody has finished.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @return true
+/// @return false
+static bool check_melody_end(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    return ((int32_t)(port_system_get_millis() - p_fsm->note_end_ms) >= 0) && (p_fsm->data_idx >= p_fsm->p_melody->size);
+}
+
+/// @brief Check if the note playing has finished and there are more notes.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+/// @return true
+/// @return false
+static bool check_note_end(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    return ((int32_t)(port_system_get_millis() - p_fsm->note_end_ms) >= 0);
+}
+
+/* State machine output or action functions */
+
+/// @brief Start the melody requested, interrupting the one playing if any.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+static void do_start_melody(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    p_fsm->p_melody = p_fsm->p_request;
+    p_fsm->p_request = NULL;
+    p_fsm->stop_request = false;
+    p_fsm->data_idx = 0;
+    _start_note(p_fsm);
+}
+
+/// @brief Play the next note of the melody.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+static void do_next_note(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    _start_note(p_fsm);
+}
+
+/// @brief Silence the buzzer and release the melody.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_buzzer_t.
+static void do_stop(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    port_buzzer_set_note(p_fsm->buzzer_id, BUZZER_NOTE_SILENCE);
+    p_fsm->p_melody = NULL;
+    p_fsm->stop_request = false;
+    p_fsm->priority = BUZZER_PRIORITY_MUSIC;
+}
+
+/// @brief Array representing the transitions table of the FSM buzzer.
+static fsm_trans_t fsm_trans_buzzer[] = {
+    {IDLE_BUZZER, check_new_melody, PLAYING_BUZZER, do_start_melody},
+    {PLAYING_BUZZER, check_new_melody, PLAYING_BUZZER, do_start_melody},
+    {PLAYING_BUZZER, check_stop, IDLE_BUZZER, do_stop},
+    {PLAYING_BUZZER, check_melody_end, IDLE_BUZZER, do_stop},
+    {PLAYING_BUZZER, check_note_end, PLAYING_BUZZER, do_next_note},
+    {-1, NULL, -1, NULL}};
+
+/* Other auxiliary functions */
+
+bool fsm_buzzer_play(fsm_t *p_this, const fsm_buzzer_melody_t *p_melody, fsm_buzzer_priority_t priority)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    bool busy = (p_fsm->p_melody != NULL) || (p_fsm->p_request != NULL);
+    if ((p_melody == NULL) || (p_melody->size == 0) || (p_melody->bpm == 0) || (p_melody->default_duration == 0) || (busy && (priority < p_fsm->priority)))
+    {
+        return false;
+    }
+    p_fsm->priority = priority;
+    p_fsm->p_request = p_melody;
+    return true;
+}
+
+void fsm_buzzer_stop(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    p_fsm->p_request = NULL;
+    p_fsm->stop_request = true;
+}
+
+fsm_t *fsm_buzzer_new(uint8_t buzzer_id)
+{
+    fsm_t *p_fsm = malloc(sizeof(fsm_buzzer_t)); /* Do malloc to reserve memory of all other FSM elements, although it is interpreted as fsm_t (the first element of the structure) */
+    fsm_buzzer_init(p_fsm, buzzer_id);
+    return p_fsm;
+}
+
+void fsm_buzzer_init(fsm_t *p_this, uint8_t buzzer_id)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this);
+    fsm_init(p_this, fsm_trans_buzzer);
+
+    p_fsm->buzzer_id = buzzer_id;
+    p_fsm->p_melody = NULL;
+    p_fsm->p_request = NULL;
+    p_fsm->priority = BUZZER_PRIORITY_MUSIC;
+    p_fsm->data_idx = 0;
+    p_fsm->note_end_ms = 0;
+    p_fsm->stop_request = false;
+    port_buzzer_init(buzzer_id);
+}
+
+bool fsm_buzzer_check_activity(fsm_t *p_this)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this);
+    return (p_fsm->f.current_state != IDLE_BUZZER) || (p_fsm->p_request != NULL);
+}
+
+bool fsm_buzzer_get_deadline(fsm_t *p_this, uint32_t *p_deadline_ms)
+{
+    fsm_buzzer_t *p_fsm = (fsm_buzzer_t *)(p_this); // cast p_this
+    if ((p_fsm->f.current_state != PLAYING_BUZZER) || (p_fsm->p_request != NULL) || p_fsm->stop_request)
+    {
+        return false;
+    }
+    *p_deadline_ms = p_fsm->note_end_ms;
+    return true;
+}
@@ -15,15 +15,22 @@
 #include "fsm_rx.h"
 
 #include "port_rgb.h"
+#include "port_button.h"
 #include "port_buzzer.h"
+#include "fsm_buzzer.h"
 #include "port_system.h"
 #include "port_sensor.h"
 #include "fsm_sensor.h"
+#include "latency.h"
+#include "effects.h"
+#include "brightness.h"
+#include "synth.h"
 #include <stdio.h>
 
 /* Defines and enums ----------------------------------------------------------*/
 /* Defines */
 #define COMMANDS_MEMORY_SIZE 8 /*!< Number of NEC commands stored in the memory of the system Retina */
+#define IDLE_CLOCK_DELAY_MS 100 /*!< Time after a wakeup in which the light sleeps keep the work clock, so a burst of events does not relock the PLL at each one */
 
 /* Enums */
 enum
@@ -32,7 +39,8 @@ enum
     WAIT_RX,     /*!< **Single state in Version 2**. State to wait in reception mode */
     SLEEP_RX,    /*!< **Single state in Version 4**. State to sleep in transmission mode */
     SLEEP_TX,    /*!< **Single state in Version 4**. State to sleep in reception mode */
-    EMERGENCY    /*!< **Single state in MEJORAS**. State of EMERGENCY when low light is detected */
+    EMERGENCY,   /*!< **Single state in MEJORAS**. State of EMERGENCY when low light is detected */
+    HOLD_TX      /*!< State while the button is held in hold-to-repeat mode, sending NEC repetition frames */
 };
 
 /* Typedefs --------------------------------------------------------------------*/
@@ -50,168 +58,131 @@ typedef struct
     fsm_t *p_fsm_rx;                             /*!<Pointer to the FSM of the infrared receiver*/
     uint32_t rx_code;                            /*!<Code received to be processed*/
     uint8_t rgb_id;                              /*!<Unique RGB LED Identifier*/
-    uint8_t buzzer_id;                           /*!<Unique BUZZER Identifier*/
+    fsm_t *p_fsm_buzzer;                         /*!<Pointer to the FSM of the buzzer*/
     fsm_t *p_fsm_sensor;                         /*!<Pointer to the FSM of the sensor*/
+    bool hold_to_repeat;                         /*!<Flag to send the code on press and repetition frames while the button is held*/
+    melody_id_t fade_melody_id;                  /*!<Melody played with the FADE command*/
+    bool auto_brightness;                        /*!<Flag to follow the ambient light with the brightness of the RGB LED*/
+    uint32_t brightness_sampled_us;              /*!<Time of the light sensor at the last update of the brightness*/
+    port_system_clock_t work_clock;              /*!<Clock of the system while it is awake*/
+    port_system_clock_t idle_clock;              /*!<Clock of the system while it sleeps, which the peripherals still running keep*/
+    bool has_wake_deadline;                      /*!<Flag to indicate that the application needs the system awake at wake_deadline_ms*/
+    uint32_t wake_deadline_ms;                   /*!<System tick at which the application needs the system awake*/
+    uint32_t wake_ms;                            /*!<System tick of the last wakeup with activity*/
 
 } fsm_retina_t;
 
 /* Private functions */
 
-/// @brief Identify the command and light the corresponding color.
+/// @brief Stop the light effect playing, if any, and set a color on the RGB LED.
+/// @param rgb_id 	RGB LED ID. Must be unique.
+/// @param r Intensity level of the RED LED: on (`HIGH`) or off (`LOW`)
+/// @param g Intensity level of the GREEN LED: on (`HIGH`) or off (`LOW`)
+/// @param b Intensity level of the BLUE LED: on (`HIGH`) or off (`LOW`)
+static void _set_color(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
+{
+    effects_stop();
+    port_rgb_set_color(rgb_id, r, g, b);
+}
+
+/// @brief Set the brightness of the RGB LED: the one of the ambient light if the automatic brightness is on, or the maximum. The emergency signal is always at the maximum, since it is shown in the dark, where the curve dims the LED the most.
+/// @param p_fsm_retina Pointer to the retina FSM.
+static void _apply_brightness(fsm_retina_t *p_fsm_retina)
+{
+    bool dimmed = p_fsm_retina->auto_brightness && (p_fsm_retina->f.current_state != EMERGENCY);
+    effects_set_brightness(dimmed ? brightness_get() : RGB_LEVEL_MAX); /* Masks the tick of the effects, which writes the LED from its interrupt */
+}
+
+/// @brief Identify the command and light the corresponding color or start the corresponding light effect.
 /// @param rgb_id 	RGB LED ID. Must be unique.
 /// @param code Code parsed that identifies a color.
-/// @param buzzer_id BUZZER ID. Must be unique.
-void _process_rgb_code(uint8_t rgb_id, uint32_t code, uint32_t buzzer_id)
+/// @param p_fsm_buzzer Pointer to the FSM of the buzzer, which plays the melody of the FADE command.
+/// @param fade_melody_id Melody played with the FADE command.
+void _process_rgb_code(uint8_t rgb_id, uint32_t code, fsm_t *p_fsm_buzzer, melody_id_t fade_melody_id)
 {
     if (code == LIL_RED_BUTTON)
     {
-        port_rgb_set_color(rgb_id, HIGH, LOW, LOW);
+        _set_color(rgb_id, HIGH, LOW, LOW);
     }
     if (code == LIL_GREEN_BUTTON)
     {
-        port_rgb_set_color(rgb_id, LOW, HIGH, LOW);
+        _set_color(rgb_id, LOW, HIGH, LOW);
     }
     if (code == LIL_BLUE_BUTTON)
     {
-        port_rgb_set_color(rgb_id, LOW, LOW, HIGH);
+        _set_color(rgb_id, LOW, LOW, HIGH);
     }
     if (code == LIL_CYAN_BUTTON)
     {
-        port_rgb_set_color(rgb_id, LOW, HIGH, HIGH);
+        _set_color(rgb_id, LOW, HIGH, HIGH);
     }
     if (code == LIL_MAGENTA_BUTTON)
     {
-        port_rgb_set_color(rgb_id, HIGH, LOW, HIGH);
+        _set_color(rgb_id, HIGH, LOW, HIGH);
     }
     if (code == LIL_YELLOW_BUTTON)
     {
-        port_rgb_set_color(rgb_id, HIGH, HIGH, LOW);
+        _set_color(rgb_id, HIGH, HIGH, LOW);
     }
     if (code == LIL_WHITE_BUTTON || code == LIL_ON_BUTTON)
     {
-        port_rgb_set_color(rgb_id, HIGH, HIGH, HIGH);
+        _set_color(rgb_id, HIGH, HIGH, HIGH);
     }
     if (code == LIL_OFF_BUTTON)
     {
-        port_rgb_set_color(rgb_id, LOW, LOW, LOW);
+        _set_color(rgb_id, LOW, LOW, LOW);
+        fsm_buzzer_stop(p_fsm_buzzer);
+    }
+    if (code == LIL_FLASH_BUTTON)
+    {
+        effects_start(EFFECT_FLASH);
+    }
+    if (code == LIL_STROBE_BUTTON)
+    {
+        effects_start(EFFECT_STROBE);
+    }
+    if (code == LIL_SMOOTH_BUTTON)
+    {
+        effects_start(EFFECT_SMOOTH);
     }
     if (code == LIL_FADE_BUTTON)
     {
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SIB);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SIB);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA2);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA2);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA2);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_FA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MIB);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_RE);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_LA);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_DO);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_MI);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
-        port_buzzer_pwm_timer_set(buzzer_id, NOTA_SOL);
+        effects_start(EFFECT_FADE);
+        fsm_buzzer_play(p_fsm_buzzer, melodies_get(fade_melody_id), BUZZER_PRIORITY_MUSIC);
     }
 }
 
 /* State machine input or transition functions */
 
-/// @brief Check if the button has been pressed fast to send a new command.
+/// @brief Check if the button has been clicked once, or released before the duration to change modes. A long press and a hold released before that duration count too, as any shorter press did before the gestures. In transmitter mode the gesture sends a new command. A single click is only reported when the click window (#BUTTON_CLICK_WINDOW_MS) closes without a second one, since double and triple clicks have actions too, so the command leaves that time after the release.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @return true
+/// @return false
+static bool check_short_gesture(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    fsm_button_event_t event = fsm_button_get_event(p_fsm_retina->p_fsm_button);
+    int cond1 = (event == BUTTON_EVENT_SINGLE_CLICK);
+    int cond2 = (event == BUTTON_EVENT_LONG_PRESS) || ((event == BUTTON_EVENT_HOLD) && !fsm_button_is_pressed(p_fsm_retina->p_fsm_button)); /* The hold is reported while pressed: wait for the release to know its duration */
+    int cond3 = (fsm_button_get_duration(p_fsm_retina->p_fsm_button) < p_fsm_retina->long_button_press_ms);
+    return cond1 || (cond2 && cond3);
+}
+
+/// @brief Check if the button has been pressed to send a new command, as in `check_short_gesture()`. In hold-to-repeat mode the command is sent on press, so the gesture is ignored.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
 /// @return true
 /// @return false
 static bool check_short_pressed(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    return !p_fsm_retina->hold_to_repeat && check_short_gesture(p_this);
+}
+
+/// @brief Check if the button has been released at the end of the hold-to-repeat sequence, before the duration to change modes.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @return true
+/// @return false
+static bool check_hold_released(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     int cond1 = (fsm_button_get_duration(p_fsm_retina->p_fsm_button) != 0);
@@ -219,15 +190,47 @@ static bool check_short_pressed(fsm_t *p_this)
     return cond1 && cond2;
 }
 
-/// @brief Check if the button has been pressed long to change between transmitter and receiver modes.
+/// @brief Check if the button has been double clicked, or pressed long, to change between transmitter and receiver modes.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
 /// @return true
 /// @return false
 static bool check_long_pressed(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
-    int cond1 = (fsm_button_get_duration(p_fsm_retina->p_fsm_button) != 0);
+    int cond1 = (fsm_button_get_event(p_fsm_retina->p_fsm_button) == BUTTON_EVENT_DOUBLE_CLICK);
     int cond2 = (fsm_button_get_duration(p_fsm_retina->p_fsm_button) >= p_fsm_retina->long_button_press_ms);
+    return cond1 || cond2;
+}
+
+/// @brief Check if the button has been triple clicked to switch the automatic brightness on or off.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @return true
+/// @return false
+static bool check_triple_click(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    return (fsm_button_get_event(p_fsm_retina->p_fsm_button) == BUTTON_EVENT_TRIPLE_CLICK);
+}
+
+/// @brief Check if the button has just been pressed in hold-to-repeat mode.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @return true
+/// @return false
+static bool check_hold_start(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    return p_fsm_retina->hold_to_repeat && fsm_button_is_pressed(p_fsm_retina->p_fsm_button);
+}
+
+/// @brief Check if the button is still held and the transmitter has finished the previous frame, including its padding up to the frame period, so the next repetition frame must be queued. Queuing it only then keeps a quick press to a single frame: a repetition queued while the previous frame is on air would still be sent after the release.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+/// @return true
+/// @return false
+static bool check_repetition_due(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    int cond1 = fsm_button_is_pressed(p_fsm_retina->p_fsm_button);
+    int cond2 = !fsm_tx_check_activity(p_fsm_retina->p_fsm_tx) && (fsm_tx_get_queue_depth(p_fsm_retina->p_fsm_tx) == 0);
     return cond1 && cond2;
 }
 
@@ -282,7 +285,9 @@ static bool check_activity(fsm_t *p_this)
     bool cond2 = fsm_tx_check_activity(p_fsm_retina->p_fsm_tx);
     bool cond3 = fsm_rx_check_activity(p_fsm_retina->p_fsm_rx);
     bool cond4 = fsm_sensor_check_activity(p_fsm_retina->p_fsm_sensor);
-    return (cond1 | cond2 | cond3 | cond4);
+    uint32_t deadline_ms;
+    bool cond5 = (fsm_buzzer_check_activity(p_fsm_retina->p_fsm_buzzer) || synth_check_activity()) && !fsm_buzzer_get_deadline(p_fsm_retina->p_fsm_buzzer, &deadline_ms); /* A melody only waiting for the end of a note lets the system sleep until then. The release of the last note of the DAC backend keeps it awake until it fades out */
+    return (cond1 | cond2 | cond3 | cond4 | cond5);
 }
 
 /// @brief Check if all the is system active.
@@ -324,16 +329,44 @@ static void do_send_next_msg(fsm_t *p_this)
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     fsm_tx_set_code(p_fsm_retina->p_fsm_tx, p_fsm_retina->tx_codes_arr[p_fsm_retina->tx_codes_index]);
     fsm_button_reset_duration(p_fsm_retina->p_fsm_button);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
     p_fsm_retina->tx_codes_index = (p_fsm_retina->tx_codes_index + 1) % COMMANDS_MEMORY_SIZE;
 }
 
+/// @brief Transmit the next code stored in memory as soon as the button is pressed in hold-to-repeat mode. The frame is padded to the NEC frame period so the first repetition follows it at the standard 108 ms.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_send_first_frame(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    fsm_tx_queue_code(p_fsm_retina->p_fsm_tx, p_fsm_retina->tx_codes_arr[p_fsm_retina->tx_codes_index], NEC_TX_GAP_MIN);
+    p_fsm_retina->tx_codes_index = (p_fsm_retina->tx_codes_index + 1) % COMMANDS_MEMORY_SIZE;
+}
+
+/// @brief Queue a NEC repetition frame while the button is held.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_send_repetition(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    fsm_tx_queue_repetition(p_fsm_retina->p_fsm_tx, NEC_TX_GAP_MIN);
+}
+
+/// @brief Finish the hold-to-repeat sequence when the button is released. The code was already sent on press, so the click being counted is discarded too: otherwise two quick presses would be reported as a double click and change modes.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_end_hold(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    fsm_button_reset_duration(p_fsm_retina->p_fsm_button);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
+}
+
 /// @brief Actuate according to the code received. This function can be used to act on the RGB LED or any other hardware.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_retina_t.
 static void do_execute_code(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
-    _process_rgb_code(p_fsm_retina->rgb_id, p_fsm_retina->rx_code, p_fsm_retina->buzzer_id);
+    _process_rgb_code(p_fsm_retina->rgb_id, p_fsm_retina->rx_code, p_fsm_retina->p_fsm_buzzer, p_fsm_retina->fade_melody_id);
     fsm_rx_reset_code(p_fsm_retina->p_fsm_rx);
+    LATENCY_MARK(LATENCY_EXECUTED);
 }
 
 /// @brief Switch the system to transmitter mode.
@@ -342,7 +375,10 @@ static void do_rx_off_tx_on(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     fsm_rx_set_rx_status(p_fsm_retina->p_fsm_rx, false);
-    port_rgb_set_color(p_fsm_retina->rgb_id, 0, 0, 0);
+    _set_color(p_fsm_retina->rgb_id, 0, 0, 0);
+    fsm_buzzer_stop(p_fsm_retina->p_fsm_buzzer);
+    fsm_button_reset_duration(p_fsm_retina->p_fsm_button);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
 }
 
 /// @brief Switch the system to receiver mode.
@@ -351,8 +387,27 @@ static void do_tx_off_rx_on(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     fsm_rx_set_rx_status(p_fsm_retina->p_fsm_rx, true);
-    _process_rgb_code(p_fsm_retina->rgb_id, p_fsm_retina->rx_code, p_fsm_retina->buzzer_id);
+    _process_rgb_code(p_fsm_retina->rgb_id, p_fsm_retina->rx_code, p_fsm_retina->p_fsm_buzzer, p_fsm_retina->fade_melody_id);
+    fsm_button_reset_duration(p_fsm_retina->p_fsm_button);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
+}
+
+/// @brief Discard a gesture that has no action in receiver mode, so it is not taken as a command to send when the system goes back to transmitter mode.
+/// @param p_this 	Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_discard_gesture(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     fsm_button_reset_duration(p_fsm_retina->p_fsm_button);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
+}
+
+/// @brief Switch the automatic brightness of the RGB LED on or off.
+/// @param p_this 	Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_toggle_auto_brightness(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    fsm_retina_set_auto_brightness(p_this, !p_fsm_retina->auto_brightness);
+    fsm_button_reset_event(p_fsm_retina->p_fsm_button);
 }
 
 /// @brief Actuate accordingly when receiving a repetition.
@@ -371,20 +426,95 @@ static void do_discard_rx_and_reset(fsm_t *p_this)
     fsm_rx_reset_code(p_fsm_retina->p_fsm_rx);
 }
 
-/// @brief Start the low power mode.
+/// @brief Wake the system up: the work clock is set back before the events are handled.
+/// @param p_this 	Pointer to an fsm_t struct than contains an fsm_retina_t.
+static void do_wake(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->wake_ms = port_system_get_millis();
+    port_system_set_clock(p_fsm_retina->work_clock);
+}
+
+/// @brief Bring a deadline forward to another one, if it is earlier.
+/// @param p_has_deadline Pointer to the flag of the deadline, set if there was none.
+/// @param p_deadline_ms Pointer to the system tick of the deadline.
+/// @param other_ms System tick of the other deadline.
+static void _merge_deadline(bool *p_has_deadline, uint32_t *p_deadline_ms, uint32_t other_ms)
+{
+    if (!(*p_has_deadline) || ((int32_t)(other_ms - *p_deadline_ms) < 0))
+    {
+        *p_deadline_ms = other_ms;
+    }
+    *p_has_deadline = true;
+}
+
+/// @brief Sleep until an interrupt, or until a deadline if there is one.
+/// @param stop true for stop mode, false for sleep mode.
+/// @param has_deadline true to wake the system up at the deadline.
+/// @param deadline_ms System tick of the deadline.
+static void _sleep(bool stop, bool has_deadline, uint32_t deadline_ms)
+{
+    if (stop && has_deadline)
+    {
+        port_system_sleep_until(deadline_ms);
+    }
+    else if (stop)
+    {
+        port_system_sleep();
+    }
+    else if (has_deadline)
+    {
+        port_system_sleep_light_until(deadline_ms);
+    }
+    else
+    {
+        port_system_sleep_light();
+    }
+}
+
+/// @brief Start the low power mode. If the RGB LED is dimmed, a light effect is playing, the buttons are being debounced or a melody or the release of its last note is playing, the PWM, the tick of the effects, the scan of the buttons and the buzzer need the timers, which stop in stop mode, so only the CPU sleeps. The tick wakes it up, runs the frame in its interrupt and the CPU sleeps again; the melody wakes it up with the wakeup timer at the end of each note. In stop mode the ADC of the light sensor is off, and the EXTI of its pin wakes the system up when the light changes. A deadline of the application wakes the system up in any mode.
+/// The idle clock, which the timers keep in sleep mode, is set before the sleep. Within #IDLE_CLOCK_DELAY_MS of the last wakeup the light sleeps keep the work clock instead, until then, since each change to and from the PLL waits for it to lock with the interrupts masked.
 /// @param p_this 	Pointer to an fsm_t struct than contains an fsm_retina_t.
 static void do_sleep(fsm_t *p_this)
 {
-    port_system_sleep();
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    bool has_deadline = p_fsm_retina->has_wake_deadline;
+    uint32_t deadline_ms = p_fsm_retina->wake_deadline_ms;
+    uint32_t buzzer_deadline_ms;
+    bool stop = false;
+    if (fsm_buzzer_get_deadline(p_fsm_retina->p_fsm_buzzer, &buzzer_deadline_ms))
+    {
+        _merge_deadline(&has_deadline, &deadline_ms, buzzer_deadline_ms);
+    }
+    else if (!port_rgb_check_pwm_activity(p_fsm_retina->rgb_id) && !effects_check_activity() && !port_button_check_scanning() && !synth_check_activity())
+    {
+        stop = fsm_sensor_set_low_power(p_fsm_retina->p_fsm_sensor, true);
+    }
+    uint32_t awake_ms = port_system_get_millis() - p_fsm_retina->wake_ms;
+    if (!stop && (awake_ms < IDLE_CLOCK_DELAY_MS))
+    {
+        _merge_deadline(&has_deadline, &deadline_ms, p_fsm_retina->wake_ms + IDLE_CLOCK_DELAY_MS);
+    }
+    else
+    {
+        port_system_set_clock(p_fsm_retina->idle_clock);
+    }
+    _sleep(stop, has_deadline, deadline_ms);
+    if (stop)
+    {
+        fsm_sensor_set_low_power(p_fsm_retina->p_fsm_sensor, false);
+    }
 }
 
-/// @brief Start the emergency signal.
+/// @brief Start the emergency signal: the white blink of the emergency effect and the emergency tone. The system does not sleep in this state, so it waits with the idle clock.
 /// @param p_this 	Pointer to an fsm_t struct than contains an fsm_retina_t.
 static void do_emergency(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
-    port_rgb_set_color(p_fsm_retina->rgb_id, HIGH, HIGH, HIGH);
-    port_buzzer_pwm_timer_set(p_fsm_retina->rgb_id, 261.63);
+    port_system_set_clock(p_fsm_retina->idle_clock);
+    _apply_brightness(p_fsm_retina);
+    effects_start(EFFECT_EMERGENCY);
+    fsm_buzzer_play(p_fsm_retina->p_fsm_buzzer, melodies_get(MELODY_EMERGENCY), BUZZER_PRIORITY_ALARM);
 }
 
 /// @brief Start the emergency signal.
@@ -392,22 +522,31 @@ static void do_emergency(fsm_t *p_this)
 static void do_no_emergency(fsm_t *p_this)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
-    port_rgb_set_color(p_fsm_retina->rgb_id, LOW, HIGH, LOW);
-    port_buzzer_pwm_timer_set(p_fsm_retina->rgb_id, 392);
+    port_system_set_clock(p_fsm_retina->work_clock);
+    _set_color(p_fsm_retina->rgb_id, LOW, HIGH, LOW);
+    _apply_brightness(p_fsm_retina);
+    fsm_buzzer_play(p_fsm_retina->p_fsm_buzzer, melodies_get(MELODY_NO_EMERGENCY), BUZZER_PRIORITY_ALARM);
 }
 
 /// @brief Array representing the transitions table of the FSM Retina.
 static fsm_trans_t fsm_trans_retina[] = {
     {WAIT_TX, check_short_pressed, WAIT_TX, do_send_next_msg},
     {WAIT_TX, check_long_pressed, WAIT_RX, do_tx_off_rx_on},
+    {WAIT_TX, check_triple_click, WAIT_TX, do_toggle_auto_brightness},
+    {WAIT_TX, check_hold_start, HOLD_TX, do_send_first_frame},
+    {HOLD_TX, check_repetition_due, HOLD_TX, do_send_repetition},
+    {HOLD_TX, check_long_pressed, WAIT_RX, do_tx_off_rx_on},
+    {HOLD_TX, check_hold_released, WAIT_TX, do_end_hold},
     {WAIT_RX, check_code, WAIT_RX, do_execute_code},
     {WAIT_RX, check_repetition, WAIT_RX, do_execute_repetition},
     {WAIT_RX, check_error, WAIT_RX, do_discard_rx_and_reset},
     {WAIT_RX, check_long_pressed, WAIT_TX, do_rx_off_tx_on},
-    {SLEEP_RX, check_activity, WAIT_RX, NULL},
+    {WAIT_RX, check_triple_click, WAIT_RX, do_toggle_auto_brightness},
+    {WAIT_RX, check_short_gesture, WAIT_RX, do_discard_gesture},
+    {SLEEP_RX, check_activity, WAIT_RX, do_wake},
     {SLEEP_RX, check_no_activity, SLEEP_RX, do_sleep},
     {WAIT_RX, check_no_activity, SLEEP_RX, do_sleep},
-    {SLEEP_TX, check_activity, WAIT_TX, NULL},
+    {SLEEP_TX, check_activity, WAIT_TX, do_wake},
     {SLEEP_TX, check_no_activity, SLEEP_TX, do_sleep},
     {WAIT_TX, check_no_activity, SLEEP_TX, do_sleep},
 
@@ -422,14 +561,14 @@ static fsm_trans_t fsm_trans_retina[] = {
 
 /* Other auxiliary functions */
 
-fsm_t *fsm_retina_new(fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, uint8_t buzzer_id, fsm_t *p_fsm_sensor)
+fsm_t *fsm_retina_new(fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, fsm_t *p_fsm_buzzer, fsm_t *p_fsm_sensor)
 {
     fsm_t *p_fsm = malloc(sizeof(fsm_retina_t)); /* Do malloc to reserve memory of all other FSM elements, although it is interpreted as fsm_t (the first element of the structure) */
-    fsm_retina_init(p_fsm, p_fsm_button, button_press_time, p_fsm_tx, p_fsm_rx, rgb_id, buzzer_id, p_fsm_sensor);
+    fsm_retina_init(p_fsm, p_fsm_button, button_press_time, p_fsm_tx, p_fsm_rx, rgb_id, p_fsm_buzzer, p_fsm_sensor);
     return p_fsm;
 }
 
-void fsm_retina_init(fsm_t *p_this, fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, uint8_t buzzer_id, fsm_t *p_fsm_sensor)
+void fsm_retina_init(fsm_t *p_this, fsm_t *p_fsm_button, uint32_t button_press_time, fsm_t *p_fsm_tx, fsm_t *p_fsm_rx, uint8_t rgb_id, fsm_t *p_fsm_buzzer, fsm_t *p_fsm_sensor)
 {
     fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
     fsm_init(p_this, fsm_trans_retina);
@@ -437,19 +576,114 @@ void fsm_retina_init(fsm_t *p_this, fsm_t *p_fsm_button, uint32_t button_press_t
     p_fsm_retina->p_fsm_tx = p_fsm_tx;
     p_fsm_retina->long_button_press_ms = button_press_time;
     p_fsm_retina->tx_codes_index = 0;
-    p_fsm_retina->tx_codes_arr[0] = LIL_RED_BUTTON;
-    p_fsm_retina->tx_codes_arr[1] = LIL_GREEN_BUTTON;
-    p_fsm_retina->tx_codes_arr[2] = LIL_BLUE_BUTTON;
-    p_fsm_retina->tx_codes_arr[3] = LIL_CYAN_BUTTON;
-    p_fsm_retina->tx_codes_arr[4] = LIL_MAGENTA_BUTTON;
-    p_fsm_retina->tx_codes_arr[5] = LIL_YELLOW_BUTTON;
-    p_fsm_retina->tx_codes_arr[6] = LIL_WHITE_BUTTON;
-    p_fsm_retina->tx_codes_arr[7] = LIL_OFF_BUTTON;
+    fsm_retina_set_tx_code(p_this, 0, LIL_RED_BUTTON);
+    fsm_retina_set_tx_code(p_this, 1, LIL_GREEN_BUTTON);
+    fsm_retina_set_tx_code(p_this, 2, LIL_BLUE_BUTTON);
+    fsm_retina_set_tx_code(p_this, 3, LIL_CYAN_BUTTON);
+    fsm_retina_set_tx_code(p_this, 4, LIL_MAGENTA_BUTTON);
+    fsm_retina_set_tx_code(p_this, 5, LIL_YELLOW_BUTTON);
+    fsm_retina_set_tx_code(p_this, 6, LIL_WHITE_BUTTON);
+    fsm_retina_set_tx_code(p_this, 7, LIL_OFF_BUTTON);
     p_fsm_retina->p_fsm_rx = p_fsm_rx;
     p_fsm_retina->rx_code = 0x00;
     p_fsm_retina->rgb_id = rgb_id;
-    p_fsm_retina->buzzer_id = buzzer_id;
+    p_fsm_retina->p_fsm_buzzer = p_fsm_buzzer;
     p_fsm_retina->p_fsm_sensor = p_fsm_sensor;
+    p_fsm_retina->hold_to_repeat = false;
+    p_fsm_retina->fade_melody_id = MELODY_FADE;
+    p_fsm_retina->auto_brightness = true;
+    p_fsm_retina->brightness_sampled_us = fsm_sensor_get_sampled_us(p_fsm_sensor);
+    p_fsm_retina->has_wake_deadline = false;
+    p_fsm_retina->wake_deadline_ms = 0;
+    p_fsm_retina->wake_ms = port_system_get_millis();
     port_rgb_init(rgb_id);
-    port_buzzer_init(buzzer_id);
-}
\ No newline at end of file
+    effects_init(rgb_id);
+    brightness_init();
+    if (!fsm_retina_set_clocks(p_this, PORT_SYSTEM_CLOCK_PLL_84MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ))
+    {
+        fsm_retina_set_clocks(p_this, PORT_SYSTEM_CLOCK_PLL_64MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ); /* The SPI of the WS2812 LEDs cannot run at 84 MHz */
+    }
+}
+
+void fsm_retina_set_tx_code(fsm_t *p_this, uint8_t index, uint32_t code)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    if (index < COMMANDS_MEMORY_SIZE)
+    {
+        p_fsm_retina->tx_codes_arr[index] = code;
+        fsm_tx_cache_code(p_fsm_retina->p_fsm_tx, index, code); // keep the transmitter cache in sync with the memory of codes
+    }
+}
+
+bool fsm_retina_set_clocks(fsm_t *p_this, port_system_clock_t work_clock, port_system_clock_t idle_clock)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    if (!port_rgb_check_clock(work_clock) || !port_rgb_check_clock(idle_clock))
+    {
+        return false;
+    }
+    p_fsm_retina->work_clock = work_clock;
+    p_fsm_retina->idle_clock = idle_clock;
+    port_system_set_clock((p_this->current_state == EMERGENCY) ? idle_clock : work_clock);
+    return true;
+}
+
+void fsm_retina_set_wake_deadline(fsm_t *p_this, uint32_t deadline_ms)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->wake_deadline_ms = deadline_ms;
+    p_fsm_retina->has_wake_deadline = true;
+}
+
+void fsm_retina_clear_wake_deadline(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->has_wake_deadline = false;
+}
+
+void fsm_retina_set_rx_mode(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->f.current_state = WAIT_RX;
+    fsm_rx_set_rx_status(p_fsm_retina->p_fsm_rx, true);
+}
+
+void fsm_retina_set_hold_to_repeat(fsm_t *p_this, bool enable)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->hold_to_repeat = enable;
+}
+
+void fsm_retina_set_auto_brightness(fsm_t *p_this, bool enable)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    p_fsm_retina->auto_brightness = enable;
+    _apply_brightness(p_fsm_retina);
+}
+
+void fsm_retina_update_brightness(fsm_t *p_this)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    uint32_t sampled_us = fsm_sensor_get_sampled_us(p_fsm_retina->p_fsm_sensor);
+    uint32_t elapsed_us = sampled_us - p_fsm_retina->brightness_sampled_us;
+    if (elapsed_us == 0)
+    {
+        return; /* No new value of the light */
+    }
+    p_fsm_retina->brightness_sampled_us = sampled_us;
+    if (brightness_update(fsm_sensor_get_value(p_fsm_retina->p_fsm_sensor), elapsed_us) && p_fsm_retina->auto_brightness && (p_fsm_retina->f.current_state != EMERGENCY))
+    {
+        _apply_brightness(p_fsm_retina);
+    }
+}
+
+bool fsm_retina_set_fade_melody(fsm_t *p_this, melody_id_t melody_id)
+{
+    fsm_retina_t *p_fsm_retina = (fsm_retina_t *)(p_this); // cast p_this
+    if (melodies_get(melody_id) == NULL)
+    {
+        return false;
+    }
+    p_fsm_retina->fade_melody_id = melody_id;
+    return true;
+}
@@ -16,6 +16,7 @@
 #include "fsm_rx_nec.h"
 #include "port_system.h"
 #include "port_rx.h"
+#include "latency.h"
 
 /* Typedefs --------------------------------------------------------------------*/
 
@@ -25,7 +26,6 @@ typedef struct
   fsm_t f;                     // Infrared receiver FSM
   fsm_t *p_fsm_rx_nec;         // Pointer to the FSM to parse NEC protocol codes
   uint32_t message_timeout_ms; // Time in milliseconds after which, if no edge is detected, the processing process begins
-  uint32_t last_tick;          // Time-tick when of last edge detected.
   uint32_t num_edges_detected; // Number of edges detected
   uint32_t code;               // Code received once it is parsed
   bool is_repetition;          // Indicate if the received code is a repetition code or not
@@ -75,14 +75,14 @@ static bool check_edge_detection(fsm_t *p_this)
   return (edges != p_fsm->num_edges_detected);
 }
 
-/// @brief Checks if a timeout has elapsed without detecting any change in infrared reception.
+/// @brief Checks if a timeout has elapsed without detecting any change in infrared reception. It is counted from the time of the last edge taken in the interrupt of the receiver, not from when the FSM saw it.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_rx_t.
 /// @return TRUE if there has been a timeout without detecting anything
 static bool check_timeout(fsm_t *p_this)
 {
-  uint32_t ticks = port_system_get_millis();
   fsm_rx_t *p_fsm = (fsm_rx_t *)(p_this);
-  return ((ticks - p_fsm->last_tick) > p_fsm->message_timeout_ms);
+  uint64_t now_us = port_system_get_micros64();
+  return ((now_us - port_rx_get_last_edge_us(p_fsm->rx_id)) > (p_fsm->message_timeout_ms * 1000ULL));
 }
 
 /* State machine output or action functions */
@@ -119,16 +119,16 @@ static void do_store_data(fsm_t *p_this)
   uint32_t *p_code = (uint32_t *)(&(p_fsm->code));
   p_fsm->is_repetition = fsm_rx_NEC_parse_code(p_fsm->p_fsm_rx_nec, buffer_edges, num_edges, p_code);
   p_fsm->is_error = (p_fsm->code == 0x00) && (!p_fsm->is_repetition);
+  LATENCY_MARK(LATENCY_DECODED);
   p_fsm->num_edges_detected = 0;
   port_rx_clean_buffer(p_fsm->rx_id);
 }
 
-/// @brief Update the time of the last tick and the number of edges detected.
+/// @brief Update the number of edges detected. The timeout restarts with each edge, whose time is kept by the receiver.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_rx_t.
 static void do_update_len_and_timeout(fsm_t *p_this)
 {
   fsm_rx_t *p_fsm = (fsm_rx_t *)(p_this);
-  p_fsm->last_tick = port_system_get_millis();
   p_fsm->num_edges_detected = port_rx_get_num_edges(p_fsm->rx_id);
 }
 
@@ -183,7 +183,6 @@ void fsm_rx_init(fsm_t *p_this, uint8_t rx_id)
   p_fsm->rx_id = rx_id;
   p_fsm->code = 0;
   p_fsm->num_edges_detected = 0;
-  p_fsm->last_tick = 0;
   p_fsm->is_error = false;
   p_fsm->is_repetition = false;
   p_fsm->status = true;
@@ -16,9 +16,9 @@
  */
 typedef struct fsm_sensor
 {
-    fsm_t f;            /*!<Sensor FSM*/
-    bool light;         /*!<If there is light or not*/
-    uint32_t sensor_id; /*!<Sensor ID. Must be unique.*/
+    fsm_t f;                   /*!<Sensor FSM*/
+    bool no_light;             /*!<If there is no light*/
+    uint32_t sensor_id;        /*!<Sensor ID. Must be unique.*/
 
 } fsm_sensor_t;
 
@@ -26,25 +26,54 @@ typedef struct fsm_sensor
 /* Enums */
 enum
 {
-    LIGHT, /*!< State where the system checks the presence of light.*/
+    LIGHT = 0, /*!< State while there is light.*/
+    NO_LIGHT   /*!< State while there is no light.*/
 };
 
 /* State machine input or transition functions */
 
-/// @brief Check if there is no light
+/// @brief Check if the light has fallen below the threshold to enter the no light state. The state is debounced by the interrupts of the port, so this is only a read while the light is stable.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
 /// @return true
 /// @return false
 static bool check_no_light(fsm_t *p_this)
 {
-    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // casteo de p_this
-    p_fsm->light = (port_sensor_get_value(p_fsm->sensor_id) > SENSOR_LIMIT);
-    return (p_fsm->light);
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_get_no_light(p_fsm->sensor_id);
+}
+
+/// @brief Check if the light has risen above the threshold to exit the no light state. The threshold is lower than the one to enter, so the noise around one of them does not make the state bounce.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+/// @return true
+/// @return false
+static bool check_light(fsm_t *p_this)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return !port_sensor_get_no_light(p_fsm->sensor_id);
+}
+
+/* State machine output or action functions */
+
+/// @brief Store that there is no light.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+static void do_set_no_light(fsm_t *p_this)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    p_fsm->no_light = true;
+}
+
+/// @brief Store that there is light.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_sensor_t.
+static void do_set_light(fsm_t *p_this)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    p_fsm->no_light = false;
 }
 
 /// @brief Array representing the transitions table of the FSM sensor.
 static fsm_trans_t fsm_trans_sensor[] = {
-    {LIGHT, check_no_light, LIGHT, NULL},
+    {LIGHT, check_no_light, NO_LIGHT, do_set_no_light},
+    {NO_LIGHT, check_light, LIGHT, do_set_light},
     {-1, NULL, -1, NULL}};
 
 /* Other auxiliary functions */
@@ -52,7 +81,7 @@ static fsm_trans_t fsm_trans_sensor[] = {
 bool fsm_sensor_get_light(fsm_t *p_this)
 {
     fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
-    return (p_fsm->light);
+    return (p_fsm->no_light);
 }
 
 fsm_t *fsm_sensor_new(uint32_t sensor_id)
@@ -69,6 +98,7 @@ void fsm_sensor_init(fsm_t *p_this, uint32_t sensor_id)
     fsm_init(p_this, fsm_trans_sensor);
 
     p_fsm->sensor_id = sensor_id;
+    p_fsm->no_light = false;
 
     port_sensor_init(sensor_id);
 }
@@ -76,5 +106,35 @@ void fsm_sensor_init(fsm_t *p_this, uint32_t sensor_id)
 bool fsm_sensor_check_activity(fsm_t *p_this)
 {
     fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this);
-    return (port_sensor_get_value(p_fsm->sensor_id) != 0);
+    return (p_fsm->no_light);
+}
+
+bool fsm_sensor_set_low_power(fsm_t *p_this, bool enable)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_set_low_power(p_fsm->sensor_id, enable);
+}
+
+bool fsm_sensor_set_thresholds(fsm_t *p_this, uint32_t no_light_enter, uint32_t no_light_exit)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_set_thresholds(p_fsm->sensor_id, no_light_enter, no_light_exit);
+}
+
+uint32_t fsm_sensor_get_value(fsm_t *p_this)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_get_value(p_fsm->sensor_id);
+}
+
+uint32_t fsm_sensor_get_sampled_us(fsm_t *p_this)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_get_sampled_us(p_fsm->sensor_id);
+}
+
+bool fsm_sensor_set_sample_rate(fsm_t *p_this, uint32_t rate_hz)
+{
+    fsm_sensor_t *p_fsm = (fsm_sensor_t *)(p_this); // cast p_this
+    return port_sensor_set_sample_rate(p_fsm->sensor_id, rate_hz);
 }
@@ -11,15 +11,49 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "port_tx.h"
+#include "ir_encoder.h"
+#include "latency.h"
 
 /* Typedefs --------------------------------------------------------------------*/
 
+/// @brief Structure to define a precomputed burst schedule of the cache.
+typedef struct
+{
+    ir_protocol_t protocol;                       /*!< Protocol of the schedule */
+    uint32_t code;                                /*!< Code of the schedule. '0x00' if the position is empty */
+    uint16_t durations[IR_ENCODER_MAX_DURATIONS]; /*!< ON and OFF durations in ticks of the symbol timer */
+    uint32_t num_durations;                       /*!< Number of durations of the schedule */
+    bool valid;                                   /*!< Flag to indicate that the durations match the code */
+} fsm_tx_cache_t;
+
+/// @brief Structure to define a frame waiting in the queue of the transmitter.
+typedef struct
+{
+    ir_protocol_t protocol; /*!< Protocol of the frame */
+    uint32_t code;      /*!< Code to be sent. Ignored for repetition frames */
+    uint16_t gap_ticks; /*!< Silence after the epilogue burst in ticks of the symbol timer, or #NEC_TX_GAP_MIN */
+    bool is_repetition; /*!< Flag to indicate that the frame is a NEC repetition frame */
+} fsm_tx_frame_t;
+
 /// @brief Structure to define the Infrared transmitter FSM.
 typedef struct
 {
-    fsm_t f;       /*!< Infrared transmitter FSM */
-    uint32_t code; /*!< NEC code to be sent */
-    uint8_t tx_id; /*!< Transmitter ID. Must be unique */
+    fsm_t f;                                    /*!< Infrared transmitter FSM */
+    fsm_tx_frame_t queue[NEC_TX_QUEUE_SIZE];    /*!< Circular queue of frames to be sent */
+    uint8_t queue_head;                         /*!< Index of the next frame to be sent */
+    uint8_t queue_count;                        /*!< Number of frames in the queue */
+    uint8_t queue_max_count;                    /*!< Maximum number of frames that have been in the queue at the same time */
+    fsm_tx_queue_policy_t queue_policy;         /*!< Policy to apply when the queue is full */
+    uint32_t queue_drops;                       /*!< Number of frames discarded because the queue was full */
+    uint16_t gap_ticks;                         /*!< Global inter-frame gap used by `fsm_tx_set_code()` */
+    ir_protocol_t protocol;                     /*!< Protocol used by `fsm_tx_set_code()`, `fsm_tx_queue_code()` and `fsm_tx_cache_code()` */
+    ir_protocol_t carrier_protocol;             /*!< Protocol whose carrier is loaded in the PWM timer */
+    uint16_t durations[IR_ENCODER_MAX_DURATIONS]; /*!< Burst schedule of a frame not found in the cache: ON and OFF durations in ticks of the symbol timer */
+    uint32_t num_durations;                     /*!< Number of durations of the burst schedule in `durations` */
+    uint16_t repeat_durations[NEC_TX_REPEAT_DURATIONS]; /*!< Burst schedule of the repetition frame */
+    fsm_tx_cache_t cache[NEC_TX_CACHE_SIZE];    /*!< Precomputed burst schedules of the codes sent more often */
+    const uint16_t *p_sending;                  /*!< Pointer to the burst schedule being sent */
+    uint8_t tx_id;                              /*!< Transmitter ID. Must be unique */
 
 } fsm_tx_t;
 
@@ -27,59 +61,169 @@ typedef struct
 /* Enums */
 enum FSM_TX
 {
-    WAIT_TX
-}; /*!< Unique state of the FSM waiting to receive a code. */
+    IDLE_TX = 0, /*!< Starting state. Waiting to receive a code to send */
+    SENDING_TX   /*!< State while the symbol timer interrupts are sending the frame */
+};
 
 /* NEC private functions */
 
-/// @brief Wait for some ticks. Each tick if the symbol timer lasts for NEC_TX_TIMER_TICK_BASE_US microseconds.
-/// @param ticks Number of ticks to wait.
-static void _wait_for_tx_ticks(uint32_t ticks)
+/// @brief Append a PWM burst and its following silence to a burst schedule.
+/// @param p_durations Pointer to the position of the schedule where the burst is stored.
+/// @param ticks_ON Number of ticks of the active PWM burst.
+/// @param ticks_OFF Number of ticks of the silence.
+/// @return Pointer to the next free position of the schedule.
+static uint16_t *_add_NEC_burst(uint16_t *p_durations, uint16_t ticks_ON, uint16_t ticks_OFF)
 {
-    int tickstart = port_tx_tmr_get_tick();
-    while ((port_tx_tmr_get_tick() - tickstart) < ticks)
+    *p_durations++ = ticks_ON;
+    *p_durations++ = ticks_OFF;
+    return p_durations;
+}
+
+/// @brief Find the burst schedule of a code, either in the cache or computing it in the scratch buffer of the FSM.
+/// @param p_fsm Pointer to the infrared transmitter FSM.
+/// @param protocol Protocol of the frame.
+/// @param code Code to be transmitted.
+/// @param p_num_durations Pointer to store the number of durations of the schedule.
+/// @return Pointer to the burst schedule of the code.
+static uint16_t *_get_schedule(fsm_tx_t *p_fsm, ir_protocol_t protocol, uint32_t code, uint32_t *p_num_durations)
+{
+    for (uint8_t i = 0; i < NEC_TX_CACHE_SIZE; i++)
     {
+        fsm_tx_cache_t *p_entry = &p_fsm->cache[i];
+        if ((p_entry->code == code) && (p_entry->protocol == protocol))
+        {
+            if (!p_entry->valid)
+            {
+                p_entry->num_durations = ir_encoder_build_schedule(protocol, code, p_entry->durations);
+                p_entry->valid = true;
+            }
+            *p_num_durations = p_entry->num_durations;
+            return p_entry->durations;
+        }
     }
+    p_fsm->num_durations = ir_encoder_build_schedule(protocol, code, p_fsm->durations);
+    *p_num_durations = p_fsm->num_durations;
+    return p_fsm->durations;
 }
 
-/// @brief Send a PWM burst and wait for a silence.
-/// @param tx_id Unique transmitter identifier number.
-/// @param ticks_ON Number of ticks to wait for an active PWM burst.
-/// @param ticks_OFF Number of ticks to wait for a silence.
-static void _send_NEC_burst(uint8_t tx_id, uint32_t ticks_ON, uint32_t ticks_OFF)
+/// @brief Compute the burst schedule of a NEC repetition frame: prologue ON, a 2.25 ms silence and the epilogue.
+/// @param p_durations Pointer to an array of #NEC_TX_REPEAT_DURATIONS elements where the schedule is stored.
+static void _build_NEC_repeat_schedule(uint16_t *p_durations)
 {
-    port_tx_pwm_timer_set(tx_id, true);
-    _wait_for_tx_ticks(ticks_ON);
-    port_tx_pwm_timer_set(tx_id, false);
-    _wait_for_tx_ticks(ticks_OFF);
+    p_durations = _add_NEC_burst(p_durations, NEC_TX_PROLOGUE_TICKS_ON, NEC_TX_REPEAT_TICKS_OFF);
+    _add_NEC_burst(p_durations, NEC_TX_EPILOGUE_TICKS_ON, NEC_TX_EPILOGUE_TICKS_OFF);
+}
+
+/* Queue private functions */
+
+/// @brief Remove the oldest frame of the queue.
+/// @param p_fsm Pointer to the infrared transmitter FSM.
+/// @return The frame removed.
+static fsm_tx_frame_t _dequeue_frame(fsm_tx_t *p_fsm)
+{
+    fsm_tx_frame_t frame = p_fsm->queue[p_fsm->queue_head];
+    p_fsm->queue_head = (p_fsm->queue_head + 1) % NEC_TX_QUEUE_SIZE;
+    p_fsm->queue_count--;
+    return frame;
+}
+
+/// @brief Add a frame at the end of the queue, applying the policy of the queue if it is full.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @param frame Frame to be queued.
+/// @return true if the frame has been queued
+/// @return false if the frame has been dropped
+static bool _enqueue_frame(fsm_t *p_this, fsm_tx_frame_t frame)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    if (p_fsm->queue_count == NEC_TX_QUEUE_SIZE)
+    {
+        if (p_fsm->queue_policy == TX_QUEUE_DROP)
+        {
+            p_fsm->queue_drops++;
+            return false;
+        }
+        else if (p_fsm->queue_policy == TX_QUEUE_OVERWRITE)
+        {
+            _dequeue_frame(p_fsm);
+            p_fsm->queue_drops++;
+        }
+        else
+        {
+            while (p_fsm->queue_count == NEC_TX_QUEUE_SIZE) /* TX_QUEUE_BLOCK: keep the transmission going until a frame leaves the queue */
+            {
+                fsm_fire(p_this);
+            }
+        }
+    }
+    uint8_t tail = (p_fsm->queue_head + p_fsm->queue_count) % NEC_TX_QUEUE_SIZE;
+    p_fsm->queue[tail] = frame;
+    p_fsm->queue_count++;
+    if (p_fsm->queue_count > p_fsm->queue_max_count)
+    {
+        p_fsm->queue_max_count = p_fsm->queue_count;
+    }
+    return true;
 }
 
 /* State machine input or transition functions */
 
-/// @brief Check if it has been received a code other than '0x00'.
+/// @brief Check if there is any frame waiting in the queue.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
 /// @return true
 /// @return false
 static bool check_tx_start(fsm_t *p_this)
 {
     fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
-    return (p_fsm->code != 0x00);
+    return (p_fsm->queue_count > 0);
+}
+
+/// @brief Check if the symbol timer has finished sending the burst schedule.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+/// @return true
+/// @return false
+static bool check_tx_end(fsm_t *p_this)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    return !port_tx_is_busy(p_fsm->tx_id);
 }
 
 /* State machine output or action functions */
 
-/// @brief Start the transmission of the received NEC code.
+/// @brief Start the transmission of the oldest frame of the queue. It only looks up (or computes) the burst schedule and hands it to the symbol timer, so it returns immediately.
 /// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
 static void do_tx_start(fsm_t *p_this)
 {
     fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
-    fsm_send_NEC_code(p_fsm->tx_id, p_fsm->code);
-    p_fsm->code = 0x00;
+    fsm_tx_frame_t frame = _dequeue_frame(p_fsm);
+    const ir_protocol_desc_t *p_desc = ir_encoder_get_protocol(frame.protocol);
+    uint16_t *p_durations = p_fsm->repeat_durations;
+    uint32_t num_durations = NEC_TX_REPEAT_DURATIONS;
+    if (!frame.is_repetition)
+    {
+        p_durations = _get_schedule(p_fsm, frame.protocol, frame.code, &num_durations);
+    }
+    if (frame.protocol != p_fsm->carrier_protocol) /* The PWM timer is only reprogrammed when the protocol changes */
+    {
+        port_tx_set_carrier(p_fsm->tx_id, p_desc->carrier_hz, p_desc->duty_percent);
+        p_fsm->carrier_protocol = frame.protocol;
+    }
+    ir_encoder_set_gap(p_desc, p_durations, num_durations, frame.gap_ticks);
+    p_fsm->p_sending = p_durations;
+    port_tx_send_bursts(p_fsm->tx_id, p_fsm->p_sending, num_durations);
+}
+
+/// @brief Release the burst schedule once the frame has been sent.
+/// @param p_this Pointer to an fsm_t struct than contains an fsm_tx_t.
+static void do_tx_end(fsm_t *p_this)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    p_fsm->p_sending = NULL;
 }
 
 /// @brief Array representing the transitions table of the FSM infrared transmitter.
 fsm_trans_t fsm_trans_tx[] = {
-    {WAIT_TX, check_tx_start, WAIT_TX, do_tx_start},
+    {IDLE_TX, check_tx_start, SENDING_TX, do_tx_start},
+    {SENDING_TX, check_tx_end, IDLE_TX, do_tx_end},
     {-1, NULL, -1, NULL}};
 
 /* Other auxiliary functions */
@@ -87,33 +231,87 @@ fsm_trans_t fsm_trans_tx[] = {
 void fsm_tx_set_code(fsm_t *p_this, uint32_t code)
 {
     fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
-    if (code != 0X00)
+    fsm_tx_queue_code(p_this, code, p_fsm->gap_ticks);
+}
+
+bool fsm_tx_queue_code(fsm_t *p_this, uint32_t code, uint16_t gap_ticks)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    return fsm_tx_queue_protocol_code(p_this, p_fsm->protocol, code, gap_ticks);
+}
+
+bool fsm_tx_queue_protocol_code(fsm_t *p_this, ir_protocol_t protocol, uint32_t code, uint16_t gap_ticks)
+{
+    if ((code == 0X00) || (protocol >= IR_PROTOCOL_NUM))
     {
-        p_fsm->code = code;
+        return false;
     }
+    fsm_tx_frame_t frame = {.protocol = protocol, .code = code, .gap_ticks = gap_ticks, .is_repetition = false};
+    LATENCY_MARK(LATENCY_SET_CODE);
+    return _enqueue_frame(p_this, frame);
 }
 
-void fsm_send_NEC_code(uint8_t tx_id, uint32_t code)
+bool fsm_tx_queue_repetition(fsm_t *p_this, uint16_t gap_ticks)
 {
-    uint32_t bit_mask = 0x80000000;
-    port_tx_symbol_tmr_start();                                                  // Start the symbol timer of the transmitter
-    _send_NEC_burst(tx_id, NEC_TX_PROLOGUE_TICKS_ON, NEC_TX_PROLOGUE_TICKS_OFF); // Send the NEC burst of the prologue
+    fsm_tx_frame_t frame = {.protocol = IR_PROTOCOL_NEC, .code = 0x00, .gap_ticks = gap_ticks, .is_repetition = true};
+    return _enqueue_frame(p_this, frame);
+}
 
-    while (bit_mask > 0)
+void fsm_tx_set_gap(fsm_t *p_this, uint16_t gap_ticks)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    p_fsm->gap_ticks = gap_ticks;
+}
+
+void fsm_tx_set_protocol(fsm_t *p_this, ir_protocol_t protocol)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    if (protocol < IR_PROTOCOL_NUM)
     {
-        if (code & bit_mask)
-        {
-            _send_NEC_burst(tx_id, NEC_TX_SYM_1_TICKS_ON, NEC_TX_SYM_1_TICKS_OFF);
-        }
-        else
-        {
-            _send_NEC_burst(tx_id, NEC_TX_SYM_0_TICKS_ON, NEC_TX_SYM_0_TICKS_OFF);
-        }
-        bit_mask >>= 1;
+        p_fsm->protocol = protocol;
     }
+}
 
-    _send_NEC_burst(tx_id, NEC_TX_EPILOGUE_TICKS_ON, NEC_TX_EPILOGUE_TICKS_OFF); // Send the NEC burst of the epilogue
-    port_tx_symbol_tmr_stop();                                                   // Stop the symbol timer of the transmitter
+void fsm_tx_set_queue_policy(fsm_t *p_this, fsm_tx_queue_policy_t policy)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    p_fsm->queue_policy = policy;
+}
+
+uint32_t fsm_tx_get_queue_depth(fsm_t *p_this)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    return p_fsm->queue_count;
+}
+
+uint32_t fsm_tx_get_queue_max_depth(fsm_t *p_this)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    return p_fsm->queue_max_count;
+}
+
+uint32_t fsm_tx_get_queue_drops(fsm_t *p_this)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    return p_fsm->queue_drops;
+}
+
+void fsm_tx_cache_code(fsm_t *p_this, uint8_t slot, uint32_t code)
+{
+    fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this); // cast p_this
+    if (slot >= NEC_TX_CACHE_SIZE)
+    {
+        return;
+    }
+    fsm_tx_cache_t *p_entry = &p_fsm->cache[slot];
+    p_entry->protocol = p_fsm->protocol;
+    p_entry->code = code;
+    p_entry->valid = false;
+    if ((code != 0x00) && (p_fsm->p_sending != p_entry->durations)) /* If the position is on air, it is rebuilt on its next use */
+    {
+        p_entry->num_durations = ir_encoder_build_schedule(p_entry->protocol, code, p_entry->durations);
+        p_entry->valid = true;
+    }
 }
 
 fsm_t *fsm_tx_new(uint8_t tx_id)
@@ -129,12 +327,29 @@ void fsm_tx_init(fsm_t *p_this, uint8_t tx_id)
     fsm_init(p_this, fsm_trans_tx);
 
     p_fsm->tx_id = tx_id;
-    p_fsm->code = 0x00;
+    p_fsm->queue_head = 0;
+    p_fsm->queue_count = 0;
+    p_fsm->queue_max_count = 0;
+    p_fsm->queue_policy = TX_QUEUE_DROP;
+    p_fsm->queue_drops = 0;
+    p_fsm->gap_ticks = NEC_TX_EPILOGUE_TICKS_OFF;
+    p_fsm->protocol = IR_PROTOCOL_NEC;
+    p_fsm->carrier_protocol = IR_PROTOCOL_NEC; /* port_tx_init() loads the NEC carrier */
+    p_fsm->num_durations = 0;
+    p_fsm->p_sending = NULL;
+    _build_NEC_repeat_schedule(p_fsm->repeat_durations);
+    for (uint8_t i = 0; i < NEC_TX_CACHE_SIZE; i++)
+    {
+        p_fsm->cache[i].protocol = IR_PROTOCOL_NEC;
+        p_fsm->cache[i].code = 0x00;
+        p_fsm->cache[i].num_durations = 0;
+        p_fsm->cache[i].valid = false;
+    }
     port_tx_init(tx_id, false);
 }
 
 bool fsm_tx_check_activity(fsm_t *p_this)
 {
     fsm_tx_t *p_fsm = (fsm_tx_t *)(p_this);
-    return (p_fsm->f.current_state != WAIT_TX); // it will always be false
+    return (p_fsm->f.current_state != IDLE_TX);
 }
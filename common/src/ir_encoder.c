@@ -0,0 +1,197 @@
+/**
+ * @file ir_encoder.c
+ * @brief Registry of infrared protocol encoders. It turns a code into the burst schedule sent by the symbol timer.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ir_encoder.h"
+#include <stdlib.h>
+#include "fsm_tx.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define IR_US_TO_TICKS(us) ((uint16_t)((((uint32_t)(us) * 1000U) + (NEC_TX_TIMER_TICK_BASE_NS / 2)) / NEC_TX_TIMER_TICK_BASE_NS)) /*!< Convert microseconds into the nearest number of ticks of the symbol timer */
+
+/* NEC timing in microseconds */
+#define NEC_GAP_MIN_US 5000 /*!< NEC minimum silence after a frame, longer than the 4.5 ms silence of the header */
+
+/* Samsung timing in microseconds */
+#define SAMSUNG_HEADER_US 4500  /*!< Samsung header burst and silence */
+#define SAMSUNG_BURST_US 560    /*!< Samsung burst of the symbols and trailer */
+#define SAMSUNG_ZERO_OFF_US 560 /*!< Samsung silence of a bit 0 */
+#define SAMSUNG_ONE_OFF_US 1690 /*!< Samsung silence of a bit 1 */
+#define SAMSUNG_PERIOD_US 108000 /*!< Samsung frame period */
+#define SAMSUNG_GAP_MIN_US 5000  /*!< Samsung minimum silence after a frame, longer than the silence of the header */
+
+/* SIRC timing in microseconds */
+#define SIRC_HEADER_US 2400 /*!< SIRC header burst */
+#define SIRC_UNIT_US 600    /*!< SIRC silences and burst of a bit 0 */
+#define SIRC_ONE_US 1200    /*!< SIRC burst of a bit 1 */
+#define SIRC_PERIOD_US 45000 /*!< SIRC frame period */
+#define SIRC_BITS 12         /*!< SIRC 12-bit version */
+#define SIRC_GAP_MIN_US 2400 /*!< SIRC minimum silence after a frame, as long as the header burst */
+
+/* RC5 timing in microseconds */
+#define RC5_HALF_BIT_US 889     /*!< RC5 half-bit */
+#define RC5_PERIOD_US 113778    /*!< RC5 frame period (128 bits) */
+#define RC5_BITS 14             /*!< RC5 bits sent: start bit and 13-bit code */
+#define RC5_GAP_MIN_US 3556     /*!< RC5 minimum silence after a frame, two bits */
+
+/* RC6 timing in microseconds */
+#define RC6_HALF_BIT_US 444     /*!< RC6 half-bit (unit) */
+#define RC6_PERIOD_US 106700    /*!< RC6 frame period */
+#define RC6_BITS 21             /*!< RC6 bits sent: start bit and 20-bit code */
+#define RC6_TOGGLE_POSITION 4   /*!< Position of the RC6 toggle bit: start bit, 3-bit mode and toggle */
+#define RC6_GAP_MIN_US 2666     /*!< RC6 signal free time after a frame (6 units) */
+
+/* Private functions */
+
+/// @brief Append the inverted command to an extended NEC code.
+/// @param code 24-bit code: 16-bit address and 8-bit command.
+/// @return 32-bit code sent.
+static uint32_t _pack_NEC_ext(uint32_t code)
+{
+    uint32_t command = code & 0xFF;
+    return ((code & 0xFFFFFF) << 8) | ((~command) & 0xFF);
+}
+
+/// @brief Add the start bit to a RC5 code.
+/// @param code 13-bit code.
+/// @return 14-bit code sent.
+static uint32_t _pack_RC5(uint32_t code)
+{
+    return (1UL << (RC5_BITS - 1)) | (code & ((1UL << (RC5_BITS - 1)) - 1));
+}
+
+/// @brief Add the start bit to a RC6 code.
+/// @param code 20-bit code.
+/// @return 21-bit code sent.
+static uint32_t _pack_RC6(uint32_t code)
+{
+    return (1UL << (RC6_BITS - 1)) | (code & ((1UL << (RC6_BITS - 1)) - 1));
+}
+
+/* Global variables ------------------------------------------------------------*/
+
+/// @brief Array of elements that describes the timing of each protocol of the registry.
+static const ir_protocol_desc_t protocols_arr[] = {
+    [IR_PROTOCOL_NEC] = {.carrier_hz = NEC_PWM_FREQ_HZ, .duty_percent = NEC_PWM_DC_PERCENT, .encoding = IR_ENCODING_PULSE, .num_bits = 32, .msb_first = true, .header_on = NEC_TX_PROLOGUE_TICKS_ON, .header_off = NEC_TX_PROLOGUE_TICKS_OFF, .zero_on = NEC_TX_SYM_0_TICKS_ON, .zero_off = NEC_TX_SYM_0_TICKS_OFF, .one_on = NEC_TX_SYM_1_TICKS_ON, .one_off = NEC_TX_SYM_1_TICKS_OFF, .double_bit = IR_NO_DOUBLE_BIT, .trailer_on = NEC_TX_EPILOGUE_TICKS_ON, .frame_period = NEC_TX_FRAME_PERIOD_TICKS, .gap_min = IR_US_TO_TICKS(NEC_GAP_MIN_US), .p_pack = NULL},
+    [IR_PROTOCOL_NEC_EXT] = {.carrier_hz = NEC_PWM_FREQ_HZ, .duty_percent = NEC_PWM_DC_PERCENT, .encoding = IR_ENCODING_PULSE, .num_bits = 32, .msb_first = true, .header_on = NEC_TX_PROLOGUE_TICKS_ON, .header_off = NEC_TX_PROLOGUE_TICKS_OFF, .zero_on = NEC_TX_SYM_0_TICKS_ON, .zero_off = NEC_TX_SYM_0_TICKS_OFF, .one_on = NEC_TX_SYM_1_TICKS_ON, .one_off = NEC_TX_SYM_1_TICKS_OFF, .double_bit = IR_NO_DOUBLE_BIT, .trailer_on = NEC_TX_EPILOGUE_TICKS_ON, .frame_period = NEC_TX_FRAME_PERIOD_TICKS, .gap_min = IR_US_TO_TICKS(NEC_GAP_MIN_US), .p_pack = _pack_NEC_ext},
+    [IR_PROTOCOL_SAMSUNG] = {.carrier_hz = 38000, .duty_percent = 33, .encoding = IR_ENCODING_PULSE, .num_bits = 32, .msb_first = true, .header_on = IR_US_TO_TICKS(SAMSUNG_HEADER_US), .header_off = IR_US_TO_TICKS(SAMSUNG_HEADER_US), .zero_on = IR_US_TO_TICKS(SAMSUNG_BURST_US), .zero_off = IR_US_TO_TICKS(SAMSUNG_ZERO_OFF_US), .one_on = IR_US_TO_TICKS(SAMSUNG_BURST_US), .one_off = IR_US_TO_TICKS(SAMSUNG_ONE_OFF_US), .double_bit = IR_NO_DOUBLE_BIT, .trailer_on = IR_US_TO_TICKS(SAMSUNG_BURST_US), .frame_period = IR_US_TO_TICKS(SAMSUNG_PERIOD_US), .gap_min = IR_US_TO_TICKS(SAMSUNG_GAP_MIN_US), .p_pack = NULL},
+    [IR_PROTOCOL_SIRC] = {.carrier_hz = 40000, .duty_percent = 33, .encoding = IR_ENCODING_PULSE, .num_bits = SIRC_BITS, .msb_first = false, .header_on = IR_US_TO_TICKS(SIRC_HEADER_US), .header_off = IR_US_TO_TICKS(SIRC_UNIT_US), .zero_on = IR_US_TO_TICKS(SIRC_UNIT_US), .zero_off = IR_US_TO_TICKS(SIRC_UNIT_US), .one_on = IR_US_TO_TICKS(SIRC_ONE_US), .one_off = IR_US_TO_TICKS(SIRC_UNIT_US), .double_bit = IR_NO_DOUBLE_BIT, .trailer_on = 0, .frame_period = IR_US_TO_TICKS(SIRC_PERIOD_US), .gap_min = IR_US_TO_TICKS(SIRC_GAP_MIN_US), .p_pack = NULL},
+    [IR_PROTOCOL_RC5] = {.carrier_hz = 36000, .duty_percent = 25, .encoding = IR_ENCODING_BIPHASE, .num_bits = RC5_BITS, .msb_first = true, .header_on = 0, .header_off = 0, .half_bit = IR_US_TO_TICKS(RC5_HALF_BIT_US), .one_starts_on = false, .double_bit = IR_NO_DOUBLE_BIT, .trailer_on = 0, .frame_period = IR_US_TO_TICKS(RC5_PERIOD_US), .gap_min = IR_US_TO_TICKS(RC5_GAP_MIN_US), .p_pack = _pack_RC5},
+    [IR_PROTOCOL_RC6] = {.carrier_hz = 36000, .duty_percent = 25, .encoding = IR_ENCODING_BIPHASE, .num_bits = RC6_BITS, .msb_first = true, .header_on = 6 * IR_US_TO_TICKS(RC6_HALF_BIT_US), .header_off = 2 * IR_US_TO_TICKS(RC6_HALF_BIT_US), .half_bit = IR_US_TO_TICKS(RC6_HALF_BIT_US), .one_starts_on = true, .double_bit = RC6_TOGGLE_POSITION, .trailer_on = 0, .frame_period = IR_US_TO_TICKS(RC6_PERIOD_US), .gap_min = IR_US_TO_TICKS(RC6_GAP_MIN_US), .p_pack = _pack_RC6},
+};
+
+/* Schedule private functions */
+
+/// @brief Append a level to a burst schedule. If it is the same level as the last duration, the duration is lengthened instead. Silences before the first burst are ignored, since the transmitter is already silent.
+/// @param p_durations Pointer to the burst schedule.
+/// @param p_num_durations Pointer to the number of durations of the schedule, updated by this function.
+/// @param on true for a burst, false for a silence.
+/// @param ticks Length of the level in ticks of the symbol timer.
+static void _add_level(uint16_t *p_durations, uint32_t *p_num_durations, bool on, uint16_t ticks)
+{
+    uint32_t n = *p_num_durations;
+    if (n == 0)
+    {
+        if (!on)
+        {
+            return;
+        }
+    }
+    else if ((((n - 1) & 1) == 0) == on) /* Even positions are bursts */
+    {
+        p_durations[n - 1] += ticks;
+        return;
+    }
+    if (n < IR_ENCODER_MAX_DURATIONS)
+    {
+        p_durations[n] = ticks;
+        *p_num_durations = n + 1;
+    }
+}
+
+/* Public functions */
+
+const ir_protocol_desc_t *ir_encoder_get_protocol(ir_protocol_t protocol)
+{
+    if (protocol >= IR_PROTOCOL_NUM)
+    {
+        return NULL;
+    }
+    return &protocols_arr[protocol];
+}
+
+uint32_t ir_encoder_build_schedule(ir_protocol_t protocol, uint32_t code, uint16_t *p_durations)
+{
+    const ir_protocol_desc_t *p_desc = ir_encoder_get_protocol(protocol);
+    if (p_desc == NULL)
+    {
+        return 0;
+    }
+    if (p_desc->p_pack != NULL)
+    {
+        code = p_desc->p_pack(code);
+    }
+
+    uint32_t num_durations = 0;
+    if (p_desc->header_on > 0)
+    {
+        _add_level(p_durations, &num_durations, true, p_desc->header_on);
+        _add_level(p_durations, &num_durations, false, p_desc->header_off);
+    }
+
+    for (uint8_t i = 0; i < p_desc->num_bits; i++)
+    {
+        uint8_t bit_pos = p_desc->msb_first ? (p_desc->num_bits - 1 - i) : i;
+        bool bit = (code >> bit_pos) & 1;
+        if (p_desc->encoding == IR_ENCODING_PULSE)
+        {
+            _add_level(p_durations, &num_durations, true, bit ? p_desc->one_on : p_desc->zero_on);
+            _add_level(p_durations, &num_durations, false, bit ? p_desc->one_off : p_desc->zero_off);
+        }
+        else
+        {
+            uint16_t half_bit = (i == p_desc->double_bit) ? (2 * p_desc->half_bit) : p_desc->half_bit;
+            bool first_on = (bit == p_desc->one_starts_on);
+            _add_level(p_durations, &num_durations, first_on, half_bit);
+            _add_level(p_durations, &num_durations, !first_on, half_bit);
+        }
+    }
+
+    if (p_desc->trailer_on > 0)
+    {
+        _add_level(p_durations, &num_durations, true, p_desc->trailer_on);
+    }
+    if ((num_durations & 1) == 1) /* Always finish with a silence, where the gap is set */
+    {
+        _add_level(p_durations, &num_durations, false, 0);
+    }
+    return num_durations;
+}
+
+void ir_encoder_set_gap(const ir_protocol_desc_t *p_desc, uint16_t *p_durations, uint32_t num_durations, uint16_t gap_ticks)
+{
+    if ((p_desc == NULL) || (num_durations == 0))
+    {
+        return;
+    }
+    uint32_t last = num_durations - 1;
+    if (gap_ticks == 0)
+    {
+        uint32_t frame_ticks = 0;
+        for (uint32_t i = 0; i < last; i++)
+        {
+            frame_ticks += p_durations[i];
+        }
+        gap_ticks = (frame_ticks < p_desc->frame_period) ? (p_desc->frame_period - frame_ticks) : 0;
+    }
+    if (gap_ticks < p_desc->gap_min) /* Never shorter than the silence of the protocol. The last position may hold the gap of a previous use of the schedule, so it is not taken into account */
+    {
+        gap_ticks = p_desc->gap_min;
+    }
+    p_durations[last] = (gap_ticks > IR_ENCODER_MIN_TICKS) ? gap_ticks : IR_ENCODER_MIN_TICKS;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file keyscan.c
+ * @brief Debounce of up to 32 keys at once with vertical counters: the cost of a sample does not depend on the number of keys.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "keyscan.h"
+
+/* Public functions */
+
+void keyscan_init(keyscan_t *p_keys, uint32_t raw)
+{
+    p_keys->state = raw;
+    p_keys->cnt0 = 0;
+    p_keys->cnt1 = 0;
+}
+
+uint32_t keyscan_update(keyscan_t *p_keys, uint32_t raw)
+{
+    uint32_t delta = raw ^ p_keys->state;
+    p_keys->cnt1 = (p_keys->cnt1 ^ p_keys->cnt0) & delta; /* Count the keys that differ, reset the others */
+    p_keys->cnt0 = ~p_keys->cnt0 & delta;
+    uint32_t toggle = delta & ~(p_keys->cnt0 | p_keys->cnt1); /* The counter has rolled over: KEYSCAN_SAMPLES samples differ */
+    p_keys->state ^= toggle;
+    return toggle;
+}
+
+bool keyscan_check_settled(const keyscan_t *p_keys, uint32_t raw)
+{
+    return (raw == p_keys->state);
+}
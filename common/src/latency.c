@@ -0,0 +1,114 @@
+/**
+ * @file latency.c
+ * @brief Latency instrumentation of the commands: timestamps of each stage, percentiles and command rate.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 23/03/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "latency.h"
+#include "port_system.h"
+
+/* Global variables ------------------------------------------------------------*/
+static volatile uint32_t marks_arr[LATENCY_NUM_STAGES]; /*!< Timestamps, in us, of the stages of the command in flight. The low word of the microsecond clock is enough for the differences */
+static volatile uint8_t marked_mask;                  /*!< Stages of the command in flight that have been marked, one bit per stage */
+static uint32_t samples_arr[LATENCY_NUM_STAGES][LATENCY_MAX_SAMPLES]; /*!< Time from LATENCY_SET_CODE to each stage, in microseconds, of the last commands */
+static uint32_t num_commands;                         /*!< Number of commands measured */
+static uint64_t first_start_us;                       /*!< Timestamp of the start of the first command measured */
+static uint64_t elapsed_us;                           /*!< Time from the start of the first command to the end of the last one */
+
+/* Private functions */
+
+/// @brief Sort an array in ascending order. The arrays are short, so insertion sort is enough.
+/// @param p_arr Pointer to the array.
+/// @param len Number of elements.
+static void _sort(uint32_t *p_arr, uint32_t len)
+{
+    for (uint32_t i = 1; i < len; i++)
+    {
+        uint32_t value = p_arr[i];
+        uint32_t j = i;
+        while ((j > 0) && (p_arr[j - 1] > value))
+        {
+            p_arr[j] = p_arr[j - 1];
+            j--;
+        }
+        p_arr[j] = value;
+    }
+}
+
+/* Public functions */
+
+void latency_init(void)
+{
+    marked_mask = 0;
+    num_commands = 0;
+    first_start_us = 0;
+    elapsed_us = 0;
+}
+
+void latency_mark(latency_stage_t stage)
+{
+    uint64_t now = port_system_get_micros64(); /* Unlike the cycles, it spans the changes of the clock and the sleeps between the stages */
+    if (stage == LATENCY_SET_CODE)
+    {
+        marked_mask = 0;
+    }
+    else if ((marked_mask & (1U << LATENCY_SET_CODE)) == 0) /* No command in flight */
+    {
+        return;
+    }
+    marks_arr[stage] = (uint32_t)now;
+    marked_mask |= (1U << stage);
+
+    if ((stage == LATENCY_EXECUTED) && (marked_mask == ((1U << LATENCY_NUM_STAGES) - 1)))
+    {
+        uint32_t idx = num_commands % LATENCY_MAX_SAMPLES;
+        for (uint8_t i = 0; i < LATENCY_NUM_STAGES; i++)
+        {
+            samples_arr[i][idx] = marks_arr[i] - marks_arr[LATENCY_SET_CODE];
+        }
+        if (num_commands == 0)
+        {
+            first_start_us = now - samples_arr[LATENCY_EXECUTED][idx];
+        }
+        elapsed_us = now - first_start_us;
+        num_commands++;
+        marked_mask = 0;
+    }
+}
+
+uint32_t latency_get_num_commands(void)
+{
+    return num_commands;
+}
+
+uint32_t latency_get_percentile_us(latency_stage_t stage, uint8_t percentile)
+{
+    uint32_t len = (num_commands < LATENCY_MAX_SAMPLES) ? num_commands : LATENCY_MAX_SAMPLES;
+    if ((len == 0) || (stage >= LATENCY_NUM_STAGES))
+    {
+        return 0;
+    }
+    uint32_t sorted[LATENCY_MAX_SAMPLES];
+    for (uint32_t i = 0; i < len; i++)
+    {
+        sorted[i] = samples_arr[stage][i];
+    }
+    _sort(sorted, len);
+    if (percentile > 100)
+    {
+        percentile = 100;
+    }
+    return sorted[((len - 1) * percentile) / 100];
+}
+
+uint32_t latency_get_commands_per_min(void)
+{
+    if ((num_commands < 2) || (elapsed_us == 0))
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)num_commands * 60000000U) / elapsed_us);
+}
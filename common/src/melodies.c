@@ -0,0 +1,71 @@
+/**
+ * @file melodies.c
+ * @brief Melodies of the buzzer in the packed format. Generated by tools/rtttl2c.py from tools/melodies.rtttl, do not edit.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "melodies.h"
+#include <stdlib.h>
+
+/* Global variables ------------------------------------------------------------*/
+
+/// @brief Packed notes of the melody `fade`: 105 notes in 105 bytes.
+static const uint8_t fade_data_arr[] = {
+    0x50, 0x50, 0x50, 0x10, 0x50, 0x80, 0x80, 0x10, 0x80, 0x50, 0xA0, 0xC0, 0xB0, 0xA0, 0x80, 0x50,
+    0x80, 0xA0, 0x60, 0x80, 0x50, 0x10, 0x30, 0xC0, 0x10, 0x80, 0x50, 0xA0, 0xC0, 0xB0, 0xA0, 0x80,
+    0x50, 0x80, 0xA0, 0x60, 0x80, 0x50, 0x10, 0x30, 0xC0, 0x80, 0x70, 0x60, 0x30, 0x50, 0x80, 0xA0,
+    0xC0, 0xA0, 0x10, 0x30, 0x80, 0x70, 0x60, 0x30, 0x50, 0x10, 0x10, 0x10, 0x80, 0x70, 0x60, 0x30,
+    0x50, 0x80, 0xA0, 0xC0, 0xA0, 0x10, 0x30, 0x40, 0x30, 0x10, 0x10, 0x10, 0x10, 0x10, 0x30, 0x50,
+    0x10, 0xA0, 0x80, 0x10, 0x10, 0x10, 0x10, 0x30, 0x50, 0x10, 0x10, 0x10, 0x10, 0x30, 0x50, 0x10,
+    0xA0, 0x80, 0x50, 0x50, 0x50, 0x10, 0x50, 0x80, 0x80,
+};
+
+/// @brief Packed notes of the melody `emergency`: 1 notes in 1 bytes.
+static const uint8_t emergency_data_arr[] = {
+    0x10,
+};
+
+/// @brief Packed notes of the melody `no_emergency`: 1 notes in 1 bytes.
+static const uint8_t no_emergency_data_arr[] = {
+    0x80,
+};
+
+/// @brief Packed notes of the melody `twinkle`: 14 notes in 16 bytes.
+static const uint8_t twinkle_data_arr[] = {
+    0x14, 0x14, 0x84, 0x84, 0xA4, 0xA4, 0x85, 0x02, 0x64, 0x64, 0x54, 0x54, 0x34, 0x34, 0x15, 0x02,
+};
+
+/// @brief Packed notes of the melody `ode_to_joy`: 15 notes in 17 bytes.
+static const uint8_t ode_to_joy_data_arr[] = {
+    0x54, 0x54, 0x64, 0x84, 0x84, 0x64, 0x54, 0x34, 0x14, 0x14, 0x34, 0x54, 0x56, 0x35, 0x08, 0x35,
+    0x02,
+};
+
+/// @brief Packed notes of the melody `beep`: 5 notes in 5 bytes.
+static const uint8_t beep_data_arr[] = {
+    0x18, 0x00, 0x18, 0x00, 0x18,
+};
+
+/// @brief Array of elements that describes each melody.
+static const fsm_buzzer_melody_t melodies_arr[] = {
+    [MELODY_FADE] = {.p_data = fade_data_arr, .size = sizeof(fade_data_arr), .bpm = 120, .default_duration = 4},
+    [MELODY_EMERGENCY] = {.p_data = emergency_data_arr, .size = sizeof(emergency_data_arr), .bpm = 120, .default_duration = 4},
+    [MELODY_NO_EMERGENCY] = {.p_data = no_emergency_data_arr, .size = sizeof(no_emergency_data_arr), .bpm = 120, .default_duration = 4},
+    [MELODY_TWINKLE] = {.p_data = twinkle_data_arr, .size = sizeof(twinkle_data_arr), .bpm = 120, .default_duration = 4},
+    [MELODY_ODE_TO_JOY] = {.p_data = ode_to_joy_data_arr, .size = sizeof(ode_to_joy_data_arr), .bpm = 140, .default_duration = 4},
+    [MELODY_BEEP] = {.p_data = beep_data_arr, .size = sizeof(beep_data_arr), .bpm = 180, .default_duration = 16},
+};
+
+/* Public functions */
+
+const fsm_buzzer_melody_t *melodies_get(melody_id_t melody_id)
+{
+    if (melody_id >= MELODY_NUM)
+    {
+        return NULL;
+    }
+    return &melodies_arr[melody_id];
+}
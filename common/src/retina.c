@@ -20,8 +20,39 @@
 #include "port_buzzer.h"
 #include "port_sensor.h"
 #include "fsm_sensor.h"
+#include "fsm_buzzer.h"
+#include "latency.h"
+#if LATENCY_BENCH
+#include <stdio.h>
+#include "commands.h"
+#include "port_effects.h"
+#endif
 
-#define CHANGE_MODE_BUTTON_TIME 3000 /*!< Time in ms needed to change between modes using the botton */
+#define CHANGE_MODE_BUTTON_TIME 3000 /*!< Time in ms needed to change between modes using the botton. A double click also changes modes */
+#define TX_HOLD_TO_REPEAT false      /*!< Send the code on press and NEC repetition frames while the button is held. Off by default, so each click sends the next code */
+#define BENCH_NUM_COMMANDS 200       /*!< Number of commands sent through the loopback before printing the report */
+#define BENCH_TIMEOUT_MS 1000        /*!< Time to wait for a command to be executed before sending the next one */
+
+#if LATENCY_BENCH
+/// @brief Structure to define a clock policy of the benchmark: the clock of the system awake and asleep.
+typedef struct
+{
+    port_system_clock_t work_clock; /*!< Clock while the system is awake */
+    port_system_clock_t idle_clock; /*!< Clock while the system sleeps */
+    const char *p_name;             /*!< Name printed in the report */
+} bench_policy_t;
+
+/// @brief Array of the clock policies compared by the benchmark, one per report.
+static const bench_policy_t bench_policies_arr[] = {
+    {PORT_SYSTEM_CLOCK_HSI_16MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ, "16/16 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_64MHZ, PORT_SYSTEM_CLOCK_PLL_64MHZ, "64/64 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_84MHZ, PORT_SYSTEM_CLOCK_PLL_84MHZ, "84/84 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_180MHZ, PORT_SYSTEM_CLOCK_PLL_180MHZ, "180/180 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_64MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ, "64/16 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_84MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ, "84/16 MHz"},
+    {PORT_SYSTEM_CLOCK_PLL_180MHZ, PORT_SYSTEM_CLOCK_HSI_16MHZ, "180/16 MHz"},
+};
+#endif
 
 /* Variable initialization functions */
 
@@ -30,6 +61,74 @@
 /* State machine output or action functions */
 
 /* Other auxiliary functions */
+#if LATENCY_BENCH
+/**
+ * @brief Step of the TX->RX loopback benchmark. It sends the next command as soon as the previous one has been executed (or lost), so the rate measured is the maximum sustainable one. After #BENCH_NUM_COMMANDS commands it prints the latency of each stage, the time spent in each power mode and with each clock, the energy per command estimated from the typical currents of #PORT_SYSTEM_CLOCKS_MAP (not measured on the board) and the error of the millisecond tick against the RTC through the SWO, and starts again with the next clock policy of `bench_policies_arr[]`. The policies with a clock that the RGB LEDs cannot run with are skipped.
+ *
+ * @param p_fsm_tx Pointer to the FSM of the infrared transmitter.
+ * @param p_fsm_retina Pointer to the FSM of the system Retina, whose clocks are set by the policy.
+ */
+static void bench_step(fsm_t *p_fsm_tx, fsm_t *p_fsm_retina)
+{
+    static const char *stage_names[LATENCY_NUM_STAGES] = {"set_code", "first_burst", "last_edge", "decoded", "executed"};
+#define _CLOCK_NAME(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) #name,
+    static const char *clock_names[PORT_SYSTEM_NUM_CLOCKS] = {PORT_SYSTEM_CLOCKS_MAP(_CLOCK_NAME)};
+#undef _CLOCK_NAME
+    static uint32_t measured = 0;
+    static uint32_t sent = 0;
+    static uint32_t sent_ms = 0;
+    static uint32_t policy = 0;
+
+    uint32_t now = port_system_get_millis();
+    bool done = (latency_get_num_commands() != measured);
+    if (!done && (sent > 0) && ((now - sent_ms) < BENCH_TIMEOUT_MS))
+    {
+        return;
+    }
+    measured = latency_get_num_commands();
+    fsm_retina_clear_wake_deadline(p_fsm_retina);
+    if (sent == 0)
+    {
+        while (!fsm_retina_set_clocks(p_fsm_retina, bench_policies_arr[policy].work_clock, bench_policies_arr[policy].idle_clock))
+        {
+            printf("Clocks %s (awake/asleep): skipped, the RGB LEDs cannot run with them\n", bench_policies_arr[policy].p_name);
+            policy = (policy + 1) % (sizeof(bench_policies_arr) / sizeof(bench_policies_arr[0]));
+        }
+        port_effects_reset_latency();
+        port_system_reset_sleep_stats();
+        latency_init();
+        measured = 0;
+    }
+    if (sent == BENCH_NUM_COMMANDS)
+    {
+        printf("Clocks %s (awake/asleep)\n", bench_policies_arr[policy].p_name);
+        printf("Loopback: %lu/%lu commands, %lu commands/min\n", (unsigned long)measured, (unsigned long)sent, (unsigned long)latency_get_commands_per_min());
+        for (uint8_t i = LATENCY_FIRST_BURST; i < LATENCY_NUM_STAGES; i++)
+        {
+            printf("  %-12s p50 %6lu us  p90 %6lu us  p99 %6lu us  max %6lu us\n", stage_names[i],
+                   (unsigned long)latency_get_percentile_us(i, 50), (unsigned long)latency_get_percentile_us(i, 90),
+                   (unsigned long)latency_get_percentile_us(i, 99), (unsigned long)latency_get_percentile_us(i, 100));
+        }
+        printf("Effects tick: max latency %lu us\n", (unsigned long)port_effects_get_max_latency_us());
+        port_system_sleep_stats_t stats;
+        port_system_get_sleep_stats(&stats);
+        printf("Residency: run %lu ms, sleep %lu ms, stop %lu ms, %lu sleeps (%lu to a deadline), millis error %ld ms\n", (unsigned long)stats.run_ms, (unsigned long)stats.sleep_ms,
+               (unsigned long)stats.stop_ms, (unsigned long)stats.num_sleeps, (unsigned long)stats.num_deadline_wakeups, (long)stats.millis_error_ms);
+        for (uint32_t i = 0; i < PORT_SYSTEM_NUM_CLOCKS; i++)
+        {
+            printf("  %-10s run %6lu ms  sleep %6lu ms\n", clock_names[i], (unsigned long)stats.clock_run_ms[i], (unsigned long)stats.clock_sleep_ms[i]);
+        }
+        printf("Energy (estimated): %lu uJ, %lu uJ/command, %lu clock changes\n", (unsigned long)stats.energy_uj, (unsigned long)(measured ? (stats.energy_uj / measured) : 0), (unsigned long)stats.num_clock_changes);
+        policy = (policy + 1) % (sizeof(bench_policies_arr) / sizeof(bench_policies_arr[0]));
+        sent = 0;
+        return; /* The next policy starts at the next step, once the last command is printed */
+    }
+    fsm_tx_set_code(p_fsm_tx, (sent & 1) ? LIL_RED_BUTTON : LIL_GREEN_BUTTON);
+    sent++;
+    sent_ms = now;
+    fsm_retina_set_wake_deadline(p_fsm_retina, now + BENCH_TIMEOUT_MS); /* A lost command must not leave the system in stop mode without a wakeup */
+}
+#endif
 
 /**
  * @brief  The application entry point.
@@ -40,24 +139,37 @@ int main(void)
 {
     port_system_init();
 
-    fsm_t *p_fsm_user_button = fsm_button_new(BUTTON_0_DEBOUNCE_TIME_MS, BUTTON_0_ID);
+    fsm_t *p_fsm_user_button = fsm_button_new(BUTTON_0_ID);
     fsm_t *p_fsm_tx = fsm_tx_new(IR_TX_0_ID);
     fsm_t *p_fsm_rx = fsm_rx_new(IR_RX_0_ID);
     fsm_t *p_fsm_sensor = fsm_sensor_new(SENSOR_0_ID);
-    fsm_t *p_fsm_retina = fsm_retina_new(p_fsm_user_button, CHANGE_MODE_BUTTON_TIME, p_fsm_tx, p_fsm_rx, IR_RX_0_ID, BUZZER_0_ID, p_fsm_sensor);
+    fsm_t *p_fsm_buzzer = fsm_buzzer_new(BUZZER_0_ID);
+    fsm_t *p_fsm_retina = fsm_retina_new(p_fsm_user_button, CHANGE_MODE_BUTTON_TIME, p_fsm_tx, p_fsm_rx, IR_RX_0_ID, p_fsm_buzzer, p_fsm_sensor);
+    fsm_retina_set_hold_to_repeat(p_fsm_retina, TX_HOLD_TO_REPEAT);
+#if LATENCY_BENCH
+    latency_init();
+    port_tx_set_loopback(IR_TX_0_ID, true);
+    fsm_retina_set_rx_mode(p_fsm_retina);
+#endif
 
     /* Infinite loop */
     while (1)
     {
+#if LATENCY_BENCH
+        bench_step(p_fsm_tx, p_fsm_retina);
+#endif
         fsm_fire(p_fsm_user_button);
         fsm_fire(p_fsm_tx);
         fsm_fire(p_fsm_rx);
         fsm_fire(p_fsm_sensor);
         fsm_fire(p_fsm_retina);
+        fsm_fire(p_fsm_buzzer);
+        fsm_retina_update_brightness(p_fsm_retina);
     }
     fsm_destroy(p_fsm_user_button);
     fsm_destroy(p_fsm_tx);
     fsm_destroy(p_fsm_rx);
     fsm_destroy(p_fsm_sensor);
+    fsm_destroy(p_fsm_buzzer);
     fsm_destroy(p_fsm_retina);
 }
@@ -0,0 +1,185 @@
+/**
+ * @file synth.c
+ * @brief Wavetable synthesizer: polyphonic sine voices with volume envelopes, mixed in blocks for the DAC.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "synth.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define SYNTH_WAVETABLE_BITS 8                          /*!< The wavetable has 2^8 samples */
+#define SYNTH_PHASE_SHIFT (32 - SYNTH_WAVETABLE_BITS)   /*!< Shift of the 32-bit phase to index the wavetable */
+#define SYNTH_ENV_MAX 32767                             /*!< Maximum level of the envelope (Q15) */
+#define SYNTH_ENV_SUSTAIN ((SYNTH_ENV_MAX * SYNTH_SUSTAIN_PERCENT) / 100) /*!< Sustain level of the envelope */
+#define SYNTH_ENV_STEP(ms, delta) ((delta) / (((ms) * SYNTH_SAMPLE_RATE_HZ) / 1000) + 1) /*!< Change of the envelope per sample to cover `delta` in `ms` */
+#define SYNTH_MIX_SHIFT 6 /*!< Shift of the mix to the 12-bit range: 4 voices at full volume (4 x 2^15 x 255 / 256) fit in +-2047 */
+#define SYNTH_PHASE_INC(centi_hz) ((uint32_t)((((uint64_t)(centi_hz) << 32) + (100ULL * SYNTH_SAMPLE_RATE_HZ / 2)) / (100ULL * SYNTH_SAMPLE_RATE_HZ))) /*!< Phase increment per sample of a frequency in hundredths of Hz */
+#define SYNTH_NOTES_PER_OCTAVE 12 /*!< Notes of an octave */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief States of the envelope of a voice.
+typedef enum
+{
+    ENV_OFF = 0, /*!< Silent voice */
+    ENV_ATTACK,  /*!< Rising to the maximum level */
+    ENV_DECAY,   /*!< Falling to the sustain level, where it stays while the note is held */
+    ENV_RELEASE  /*!< Falling to 0 after the note off */
+} synth_env_t;
+
+/// @brief Structure to define a voice of the synthesizer.
+typedef struct
+{
+    uint32_t phase;              /*!< Phase of the wavetable, the 8 MSBs index the table */
+    uint32_t phase_inc;          /*!< Phase increment per sample: frequency of the note */
+    int32_t env;                 /*!< Level of the envelope (Q15) */
+    uint8_t volume;              /*!< Volume of the voice */
+    volatile synth_env_t state;  /*!< State of the envelope. Written last by `synth_note_on()`, since the voices are mixed in an ISR */
+} synth_voice_t;
+
+/* Global variables ------------------------------------------------------------*/
+/// @brief One period of a sine (Q15).
+static const int16_t sine_arr[1 << SYNTH_WAVETABLE_BITS] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285, 32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+    30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+    12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179, 6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+    0, -804, -1608, -2410, -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790, -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+    -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+    -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683, -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+    -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011, -3212, -2410, -1608, -804,
+};
+
+/// @brief Phase increments of the notes of octave 4, from C to B. Higher octaves double them.
+static const uint32_t phase_inc_arr[SYNTH_NOTES_PER_OCTAVE] = {
+    SYNTH_PHASE_INC(26163), SYNTH_PHASE_INC(27718), SYNTH_PHASE_INC(29366), SYNTH_PHASE_INC(31113), SYNTH_PHASE_INC(32963), SYNTH_PHASE_INC(34923),
+    SYNTH_PHASE_INC(36999), SYNTH_PHASE_INC(39200), SYNTH_PHASE_INC(41530), SYNTH_PHASE_INC(44000), SYNTH_PHASE_INC(46616), SYNTH_PHASE_INC(49388),
+};
+
+static synth_voice_t voices_arr[SYNTH_NUM_VOICES]; /*!< Voices of the synthesizer */
+
+/* Private functions */
+
+/// @brief Advance the envelope of a voice one sample.
+/// @param p_voice Pointer to the voice.
+static void _update_envelope(synth_voice_t *p_voice)
+{
+    switch (p_voice->state)
+    {
+    case ENV_ATTACK:
+        p_voice->env += SYNTH_ENV_STEP(SYNTH_ATTACK_MS, SYNTH_ENV_MAX);
+        if (p_voice->env >= SYNTH_ENV_MAX)
+        {
+            p_voice->env = SYNTH_ENV_MAX;
+            p_voice->state = ENV_DECAY;
+        }
+        break;
+    case ENV_DECAY:
+        if (p_voice->env > SYNTH_ENV_SUSTAIN)
+        {
+            p_voice->env -= SYNTH_ENV_STEP(SYNTH_DECAY_MS, SYNTH_ENV_MAX - SYNTH_ENV_SUSTAIN);
+            if (p_voice->env < SYNTH_ENV_SUSTAIN)
+            {
+                p_voice->env = SYNTH_ENV_SUSTAIN;
+            }
+        }
+        break;
+    case ENV_RELEASE:
+        p_voice->env -= SYNTH_ENV_STEP(SYNTH_RELEASE_MS, SYNTH_ENV_MAX);
+        if (p_voice->env <= 0)
+        {
+            p_voice->env = 0;
+            p_voice->state = ENV_OFF;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Public functions */
+
+void synth_init(void)
+{
+    for (uint8_t i = 0; i < SYNTH_NUM_VOICES; i++)
+    {
+        voices_arr[i].state = ENV_OFF;
+        voices_arr[i].phase = 0;
+        voices_arr[i].phase_inc = 0;
+        voices_arr[i].env = 0;
+        voices_arr[i].volume = 0;
+    }
+}
+
+bool synth_note_on(uint8_t voice, uint8_t note, uint8_t volume)
+{
+    if ((voice >= SYNTH_NUM_VOICES) || (note >= SYNTH_NUM_NOTES))
+    {
+        return false;
+    }
+    synth_voice_t *p_voice = &voices_arr[voice];
+    p_voice->phase_inc = phase_inc_arr[note % SYNTH_NOTES_PER_OCTAVE] << (note / SYNTH_NOTES_PER_OCTAVE);
+    p_voice->volume = volume;
+    p_voice->state = ENV_ATTACK; /* The envelope rises from its current level, so a retriggered voice does not click */
+    return true;
+}
+
+void synth_note_off(uint8_t voice)
+{
+    if ((voice < SYNTH_NUM_VOICES) && (voices_arr[voice].state != ENV_OFF))
+    {
+        voices_arr[voice].state = ENV_RELEASE;
+    }
+}
+
+bool synth_check_activity(void)
+{
+    for (uint8_t i = 0; i < SYNTH_NUM_VOICES; i++)
+    {
+        if (voices_arr[i].state != ENV_OFF)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void synth_render(uint16_t *p_samples, uint32_t num_samples)
+{
+    for (uint32_t n = 0; n < num_samples; n++)
+    {
+        int32_t mix = 0;
+        for (uint8_t i = 0; i < SYNTH_NUM_VOICES; i++)
+        {
+            synth_voice_t *p_voice = &voices_arr[i];
+            if (p_voice->state == ENV_OFF)
+            {
+                continue;
+            }
+            int32_t sample = sine_arr[p_voice->phase >> SYNTH_PHASE_SHIFT];
+            mix += (((sample * p_voice->env) >> 15) * p_voice->volume) >> 8;
+            p_voice->phase += p_voice->phase_inc;
+            _update_envelope(p_voice);
+        }
+        mix = SYNTH_SAMPLE_MID + (mix >> SYNTH_MIX_SHIFT);
+        if (mix < 0)
+        {
+            mix = 0;
+        }
+        else if (mix > SYNTH_SAMPLE_MAX)
+        {
+            mix = SYNTH_SAMPLE_MAX;
+        }
+        p_samples[n] = (uint16_t)mix;
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * @file ws2812.c
+ * @brief Encoder of the bitstream of WS2812/SK6812 addressable LEDs into SPI bytes, sent by the DMA without CPU bit-banging.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 18/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ws2812.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define WS2812_CODE(bit) ((bit) ? WS2812_CODE_1 : WS2812_CODE_0) /*!< SPI bits of a bit of the LEDs */
+#define WS2812_NIBBLE(n) ((WS2812_CODE((n) & 0x8) << 15) | (WS2812_CODE((n) & 0x4) << 10) | (WS2812_CODE((n) & 0x2) << 5) | WS2812_CODE((n) & 0x1)) /*!< 20 SPI bits of a nibble */
+
+_Static_assert(WS2812_SPI_BITS_PER_BIT == 5, "The table of nibbles is computed for 5 SPI bits per bit");
+
+/* Global variables ------------------------------------------------------------*/
+/// @brief SPI bits of each nibble, computed at compile time. A byte of color is two table loads and five stores.
+static const uint32_t nibbles_arr[16] = {
+    WS2812_NIBBLE(0), WS2812_NIBBLE(1), WS2812_NIBBLE(2), WS2812_NIBBLE(3),
+    WS2812_NIBBLE(4), WS2812_NIBBLE(5), WS2812_NIBBLE(6), WS2812_NIBBLE(7),
+    WS2812_NIBBLE(8), WS2812_NIBBLE(9), WS2812_NIBBLE(10), WS2812_NIBBLE(11),
+    WS2812_NIBBLE(12), WS2812_NIBBLE(13), WS2812_NIBBLE(14), WS2812_NIBBLE(15)};
+
+/* Private functions */
+
+/// @brief Encode a byte of color into 5 SPI bytes, MSB first.
+/// @param p_out Pointer to the 5 SPI bytes.
+/// @param value Byte of color.
+static void _encode_byte(uint8_t *p_out, uint8_t value)
+{
+    uint32_t high = nibbles_arr[value >> 4];
+    uint32_t low = nibbles_arr[value & 0x0F];
+    p_out[0] = (uint8_t)(high >> 12);
+    p_out[1] = (uint8_t)(high >> 4);
+    p_out[2] = (uint8_t)((high << 4) | (low >> 16));
+    p_out[3] = (uint8_t)(low >> 8);
+    p_out[4] = (uint8_t)low;
+}
+
+/* Public functions */
+
+void ws2812_encode_led(uint8_t *p_out, uint8_t r, uint8_t g, uint8_t b)
+{
+    _encode_byte(&p_out[0], g);
+    _encode_byte(&p_out[5], r);
+    _encode_byte(&p_out[10], b);
+}
@@ -22,7 +22,16 @@
 #define BUTTON_0_ID 0                 /*!< Button identifier */
 #define BUTTON_0_GPIO GPIOC           /*!< Button GPIO port */
 #define BUTTON_0_PIN 13               /*!< Button GPIO pin */
-#define BUTTON_0_DEBOUNCE_TIME_MS 150 /*!< Button debounce time */
+#define BUTTON_SCAN_PERIOD_MS 5       /*!< Period of the scan of all the buttons while one of them is changing. A change is accepted after 4 equal samples, 20 ms. It is the only debounce of the buttons */
+#define BUTTON_EVENTS_QUEUE_SIZE 8    /*!< Debounced events stored by the scan until the FSM reads them. Power of 2 */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define a debounced event of a button: a press or a release accepted by the scan, with the time of its first edge.
+typedef struct
+{
+    uint64_t time_us; /*!< Time of the first edge of the change, taken by the EXTI interrupt, as `port_system_get_micros64()` */
+    bool pressed;     /*!< true for a press, false for a release */
+} port_button_event_t;
 
 /* Function prototypes and explanation -------------------------------------------------*/
 
@@ -30,14 +39,26 @@
 /// @param button_id Button ID. This index is used to select the element of the buttons_arr[] array.
 void port_button_init(uint32_t button_id);
 
-/// @brief Return the status of the button (pressed or not)
+/// @brief Return the status of the button (pressed or not), debounced by the scan of all the buttons. A change is seen #KEYSCAN_SAMPLES scan periods after the edge; its time is the one of the edge, taken with `port_button_pop_event()`.
 /// @param button_id Button ID. This index is used to select the element of the buttons_arr[] array.
 /// @return true If the button has been pressed
 /// @return false If the button has not been pressed
 bool port_button_is_pressed(uint32_t button_id);
 
-/// @brief Return the count of the System tick in milliseconds.
-/// @return uint32_t
-uint32_t port_button_get_tick();
+/// @brief Take the oldest debounced event of the button. The events are produced by the scan of all the buttons, so the bounces are already filtered, and each button has its own queue. The time of the event is the one of the first edge of the change, so it does not depend on the debounce nor on when the main loop reads it. Presses and releases alternate, unless the queue was full.
+/// @param button_id Button ID. This index is used to select the element of the buttons_arr[] array.
+/// @param p_event Pointer to store the event.
+/// @return true
+/// @return false if there is no event stored
+bool port_button_pop_event(uint32_t button_id, port_button_event_t *p_event);
+
+/// @brief Check if the buttons are being scanned. The scan timer stops in stop mode, so the system must only sleep the CPU.
+/// @return true
+/// @return false
+bool port_button_check_scanning(void);
+
+/// @brief Return the time base of the buttons: the microsecond clock of the system, which does not wrap around.
+/// @return uint64_t Time in us
+uint64_t port_button_get_time_us(void);
 
 #endif
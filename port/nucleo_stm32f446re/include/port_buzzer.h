@@ -19,26 +19,39 @@
 
 /* Defines and enums ----------------------------------------------------------*/
 /* Defines */
+#ifndef BUZZER_DAC
+#define BUZZER_DAC 0 /*!< Audio backend of the buzzer: 0 for square-wave PWM, 1 (`make BUZZER_DAC=1`) for wavetable synthesis on the DAC */
+#endif
+
 #define BUZZER_0_ID 0       /*!< Buzzer identifier */
 #define BUZZER_0_GPIO GPIOB /*!< Buzzer GPIO port */
-#define BUZZER_0_PIN 3      /*!< Buzzer GPIO pin */
-#define BUZZER_PWM_DC 0.9   /*!< PWM DC level */
-
-/* Musical notes frequencies */
-#define NOTA_DO 261.63
-#define NOTA_DO2 277.18
-#define NOTA_RE 293.66
-#define NOTA_RE2 311.13
-#define NOTA_MI 329.63
-#define NOTA_FA 349.23
-#define NOTA_FA2 369.99
-#define NOTA_SOL 392
-#define NOTA_SOL2 415.3
-#define NOTA_LA 440
-#define NOTA_LA2 466
-#define NOTA_SI 493.88
-#define NOTA_SIB 466.16
-#define NOTA_MIB 311.13
+#define BUZZER_0_PIN 7      /*!< Buzzer GPIO pin. TIM4_CH2, see the timer map of port_system.h */
+#define BUZZER_PWM_DC_PERCENT 90 /*!< PWM DC level in % */
+
+#define BUZZER_NOTES_PER_OCTAVE 12 /*!< Notes of an octave, from C to B */
+#define BUZZER_NUM_OCTAVES 4       /*!< Octaves of the table of notes, from octave 4 */
+#define BUZZER_NUM_NOTES (BUZZER_NOTES_PER_OCTAVE * BUZZER_NUM_OCTAVES) /*!< Number of notes of the table. Note 0 is C4 */
+#define BUZZER_NOTE_SILENCE 0xFF   /*!< Note index to silence the buzzer */
+
+#define BUZZER_DAC_0_GPIO GPIOA          /*!< DAC output GPIO port (DAC_OUT1), used when #BUZZER_DAC is 1 */
+#define BUZZER_DAC_0_PIN 4               /*!< DAC output GPIO pin */
+#define BUZZER_DAC_BLOCK_SAMPLES 64      /*!< Samples mixed each time the DMA plays half of its buffer (2 ms at 32 kHz) */
+
+/* Musical notes frequencies of octave 4 in hundredths of Hz. The timer values of the table of notes are computed from them at compile time */
+#define NOTA_DO 26163
+#define NOTA_DO2 27718
+#define NOTA_RE 29366
+#define NOTA_RE2 31113
+#define NOTA_MI 32963
+#define NOTA_FA 34923
+#define NOTA_FA2 36999
+#define NOTA_SOL 39200
+#define NOTA_SOL2 41530
+#define NOTA_LA 44000
+#define NOTA_LA2 46616
+#define NOTA_SI 49388
+#define NOTA_SIB NOTA_LA2
+#define NOTA_MIB NOTA_RE2
 
 /* Function prototypes and explanation -------------------------------------------------*/
 
@@ -47,9 +60,9 @@
 /// @param status To indicate if PWM starts, or not, from the beginning.
 void port_buzzer_init(uint8_t buzzer_id);
 
-/// @brief Set the PWM ON or OFF, with the note frequency given
+/// @brief Start playing a note of the table of notes, or silence the buzzer. It returns immediately; the note lasts until the next call.
 /// @param buzzer_id Buzzer ID. This index is used to select the element of the buzzers_arr[] array.
-/// @param freq Set the frequency of the sound produced
-void port_buzzer_pwm_timer_set(uint8_t buzzer_id, uint32_t freq);
+/// @param note Index of the note: semitones from C4, up to #BUZZER_NUM_NOTES - 1. #BUZZER_NOTE_SILENCE to silence the buzzer.
+void port_buzzer_set_note(uint8_t buzzer_id, uint8_t note);
 
 #endif
\ No newline at end of file
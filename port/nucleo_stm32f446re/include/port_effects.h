@@ -0,0 +1,46 @@
+/**
+ * @file port_effects.h
+ * @brief Header for port_effects.c file.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef PORT_EFFECTS_H_
+#define PORT_EFFECTS_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Standard C includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Defines */
+#define EFFECTS_TMR_CLOCK_HZ 1000000 /*!< Counter clock of the tick timer: 1 us per count, so the counter read in the interrupt is its latency in us */
+
+/* Function prototypes and explanation -------------------------------------------------*/
+
+/// @brief Configure the tick timer of the light effects. It is stopped until `port_effects_start()`.
+/// @param tick_ms Period of the tick in ms, up to 65 ms.
+void port_effects_init(uint32_t tick_ms);
+
+/// @brief Start the tick timer. Its interrupt calls `effects_tick()` every period.
+void port_effects_start(void);
+
+/// @brief Stop the tick timer. No `effects_tick()` runs after this function returns.
+void port_effects_stop(void);
+
+/// @brief Mask the interrupt of the tick timer, so that the main loop can write the RGB LED without racing with `effects_tick()`. The timer keeps running: a tick that comes meanwhile is taken on `port_effects_unlock()`.
+void port_effects_lock(void);
+
+/// @brief Unmask the interrupt of the tick timer masked by `port_effects_lock()`.
+void port_effects_unlock(void);
+
+/// @brief Return the maximum latency of the interrupt of the tick timer since `port_effects_reset_latency()`: the time from the tick to the start of the frame. As the ticks come from the timer, this is the jitter of the frames.
+/// @return uint32_t Latency in us.
+uint32_t port_effects_get_max_latency_us(void);
+
+/// @brief Reset the maximum latency of the interrupt of the tick timer.
+void port_effects_reset_latency(void);
+
+#endif
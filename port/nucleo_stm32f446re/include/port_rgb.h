@@ -12,28 +12,72 @@
 /* Includes ------------------------------------------------------------------*/
 /* Standard C includes */
 #include <stdint.h>
+#include <stdbool.h>
+#include "port_system.h"
 
 /* Defines and enums ----------------------------------------------------------*/
 /* Defines */
+#ifndef RGB_WS2812
+#define RGB_WS2812 0 /*!< Backend of the RGB LEDs: 0 for one LED on three PWM channels, 1 (`make RGB_WS2812=1`) for a chain of WS2812/SK6812 LEDs driven by the SPI and the DMA, where the RGB LED ID is the index of the LED in the chain */
+#endif
+
 #define RGB_0_ID 0         /*!< RBG ID */
-#define RGB_R_0_GPIO GPIOB /*!< R GPIO */
+#define RGB_R_0_GPIO GPIOB /*!< R GPIO. TIM3_CH1, see the timer map of port_system.h */
 #define RGB_R_0_PIN 4      /*!< R GPIO pin*/
-#define RGB_G_0_GPIO GPIOC /*!< G GPIO */
+#define RGB_G_0_GPIO GPIOC /*!< G GPIO. TIM8_CH2 */
 #define RGB_G_0_PIN 7      /*!< G GPIO pin */
-#define RGB_B_0_GPIO GPIOB /*!< B GPIO */
+#define RGB_B_0_GPIO GPIOB /*!< B GPIO. TIM3_CH2 */
 #define RGB_B_0_PIN 5      /*!< B GPIO pin */
 
+#define RGB_LEVEL_MAX 255      /*!< Maximum 8-bit level of a channel and maximum brightness */
+#define RGB_PWM_PERIOD 1024    /*!< Counts of the PWM period: 15.6 kHz with the counter at 16 MHz, no visible flicker */
+#define RGB_LED_CURRENT_UA 20000 /*!< Estimated current of one LED with the PWM always on, in uA. Used by `port_rgb_get_current_ua()` */
+
+#define RGB_WS2812_0_GPIO GPIOB        /*!< Data input of the chain of LEDs: SPI2_MOSI (AF5), used when #RGB_WS2812 is 1 */
+#define RGB_WS2812_0_PIN 15            /*!< Data input GPIO pin */
+#define RGB_WS2812_NUM_LEDS 8          /*!< LEDs of the chain. A refresh of the whole chain takes 540 us of DMA */
+#define RGB_WS2812_CURRENT_UA 12000    /*!< Estimated current of one color of a LED of the chain at the maximum level, in uA */
+
 /* Function prototypes and explanation -------------------------------------------------*/
 
 /// @brief Configure the HW specifications of a given RGB LED.
 /// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
 void port_rgb_init(uint8_t rgb_id);
 
-/// @brief Set a color on the RGB LED.
+/// @brief Set a color on the RGB LED with each channel on or off. The channels on are lit at the brightness of `port_rgb_set_brightness()` (maximum by default).
 /// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
-/// @param r Intensity level of the RED LED
-/// @param g Intensity level of the GREEN LED
-/// @param b Intensity level of the BLUE LED
+/// @param r Intensity level of the RED LED: on (not 0, e.g. `HIGH`) or off (0, `LOW`)
+/// @param g Intensity level of the GREEN LED: on (not 0, e.g. `HIGH`) or off (0, `LOW`)
+/// @param b Intensity level of the BLUE LED: on (not 0, e.g. `HIGH`) or off (0, `LOW`)
 void port_rgb_set_color(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b);
 
+/// @brief Set a 24-bit color on the RGB LED. The levels are perceptual: they are gamma corrected, so half level looks half as bright. They are scaled by the brightness of `port_rgb_set_brightness()`.
+/// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
+/// @param r Level of the RED LED, from 0 to #RGB_LEVEL_MAX
+/// @param g Level of the GREEN LED, from 0 to #RGB_LEVEL_MAX
+/// @param b Level of the BLUE LED, from 0 to #RGB_LEVEL_MAX
+void port_rgb_set_level(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b);
+
+/// @brief Set the brightness of the RGB LED, which scales all the channels. The color being shown is updated.
+/// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
+/// @param brightness Brightness, from 0 to #RGB_LEVEL_MAX
+void port_rgb_set_brightness(uint8_t rgb_id, uint8_t brightness);
+
+/// @brief Check if a channel of the RGB LED is dimmed, so it needs the PWM timers running. Channels fully on or off keep their level in stop mode, as the GPIOs did.
+/// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
+/// @return true
+/// @return false
+bool port_rgb_check_pwm_activity(uint8_t rgb_id);
+
+/// @brief Check if the RGB LEDs can run with a clock of the system. The PWM timers run with all of them. The SPI of the WS2812 LEDs needs a clock of APB1 that it divides down to exactly #WS2812_SPI_CLOCK_HZ: the HSI and the 64 MHz of the PLL, not the 84 and 180 MHz.
+/// @param clock Clock of #port_system_clock_t.
+/// @return true
+/// @return false if the LEDs cannot show any color with that clock
+bool port_rgb_check_clock(port_system_clock_t clock);
+
+/// @brief Estimate the current drawn by the RGB LED with the color being shown: #RGB_LED_CURRENT_UA times the duty cycle of each channel.
+/// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
+/// @return uint32_t Current in uA
+uint32_t port_rgb_get_current_ua(uint8_t rgb_id);
+
 #endif
\ No newline at end of file
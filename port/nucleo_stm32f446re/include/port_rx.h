@@ -53,4 +53,18 @@ uint32_t port_rx_get_num_edges(uint8_t rx_id);
 /// @param rx_id Receiver ID. This index is used to select the element of the receivers_arr[] array
 void port_rx_clean_buffer(uint8_t rx_id);
 
+/// @brief Return the time of the last edge stored by the infrared receiver, taken in its interrupt.
+/// @param rx_id Receiver ID. This index is used to select the element of the receivers_arr[] array
+/// @return uint64_t Time of the edge, as `port_system_get_micros64()`
+uint64_t port_rx_get_last_edge_us(uint8_t rx_id);
+
+/// @brief Enable/disable the loopback mode. In loopback mode the edges of the GPIO are ignored and the receiver only stores the edges injected with `port_rx_inject_edge()`.
+/// @param rx_id Receiver ID. This index is used to select the element of the receivers_arr[] array
+/// @param enable true to enable the loopback mode
+void port_rx_set_loopback(uint8_t rx_id, bool enable);
+
+/// @brief Store an edge as if it had been detected by the infrared receiver. It is called by the infrared transmitter in loopback mode at each switch of its PWM, and it is ignored if the receiver is not in loopback mode.
+/// @param rx_id Receiver ID. This index is used to select the element of the receivers_arr[] array
+void port_rx_inject_edge(uint8_t rx_id);
+
 #endif
@@ -19,20 +19,62 @@
 
 /* Defines and enums ----------------------------------------------------------*/
 /* Defines */
-#define SENSOR_0_ID 0       /*!< SENSOR identifier */
-#define SENSOR_0_GPIO GPIOA /*!< SENSOR GPIO port */
-#define SENSOR_0_PIN 10     /*!< SENSOR GPIO pin */
+#define SENSOR_0_ID 0          /*!< SENSOR identifier */
+#define SENSOR_0_GPIO GPIOA    /*!< SENSOR GPIO port */
+#define SENSOR_0_PIN 0         /*!< SENSOR GPIO pin. ADC1_IN0 */
+#define SENSOR_0_ADC_CHANNEL 0 /*!< ADC channel of the sensor */
 
-#define SENSOR_LIMIT 0.5 /*!< SENSOR limit between light and no light */
+#define SENSOR_VALUE_MAX 4095         /*!< Maximum value of the sensor: 12-bit ADC. The value grows with the darkness, as the voltage of the photoresistor divider */
+#define SENSOR_NO_LIGHT_ENTER 2600    /*!< Default value from which there is no light. It must stay above the input high level of the pin (about 2200 at 3.3 V) so that the EXTI wakes the system up from stop mode before the threshold is reached */
+#define SENSOR_NO_LIGHT_EXIT 2200     /*!< Default value below which there is light again. The gap with #SENSOR_NO_LIGHT_ENTER is the hysteresis */
+#define SENSOR_SAMPLE_RATE_HZ 200     /*!< Default sample rate of the ADC */
+#define SENSOR_SAMPLE_RATE_MIN_HZ 2   /*!< Minimum sample rate of the ADC */
+#define SENSOR_SAMPLE_RATE_MAX_HZ 10000 /*!< Maximum sample rate of the ADC */
+#define SENSOR_BUFFER_SAMPLES 16      /*!< Circular buffer of the DMA. The filter is updated with the mean of each half */
+#define SENSOR_FILTER_SHIFT 2         /*!< Exponential filter of the means: each one weighs 1/2^SENSOR_FILTER_SHIFT. Time constant of 4 half buffers, 160 ms at 200 Hz */
+#define SENSOR_DEBOUNCE_MS 200        /*!< Time that the light must stay beyond a threshold to change the state */
 
 /* Function prototypes and explanation -------------------------------------------------*/
-/// @brief Configure the HW specifications of a given sensor.
+/// @brief Configure the HW specifications of a given sensor and start sampling at #SENSOR_SAMPLE_RATE_HZ.
 /// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
 void port_sensor_init(uint32_t sensor_id);
 
-/// @brief Return the value of the sensor
+/// @brief Return the latest filtered value of the sensor. It never waits for a conversion.
 /// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
-/// @return uint32_t Light sensor value
+/// @return uint32_t Light sensor value, from 0 (full light) to #SENSOR_VALUE_MAX
 uint32_t port_sensor_get_value(uint32_t sensor_id);
 
+/// @brief Set the sample rate of the ADC of the sensor.
+/// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
+/// @param rate_hz Sample rate, from #SENSOR_SAMPLE_RATE_MIN_HZ to #SENSOR_SAMPLE_RATE_MAX_HZ.
+/// @return true
+/// @return false if the sample rate is out of range
+bool port_sensor_set_sample_rate(uint32_t sensor_id, uint32_t rate_hz);
+
+/// @brief Return the time covered by the samples filtered since the initialization. It advances with each update of the filter, also while the CPU sleeps and the SysTick is stopped, so it is the time base of the users of the filtered value. It wraps around every 71 minutes.
+/// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
+/// @return uint32_t Time in us
+uint32_t port_sensor_get_sampled_us(uint32_t sensor_id);
+
+/// @brief Return the debounced state of the light. It is updated by the interrupts of the sensor, so it is only a read.
+/// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
+/// @return true if there is no light
+/// @return false if there is light
+bool port_sensor_get_no_light(uint32_t sensor_id);
+
+/// @brief Set the thresholds of the light, with hysteresis: there is no light from a value of the sensor, and there is light again below a lower one.
+/// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
+/// @param no_light_enter Value from which there is no light, up to #SENSOR_VALUE_MAX.
+/// @param no_light_exit Value below which there is light again. Lower than `no_light_enter`.
+/// @return true
+/// @return false if the thresholds are not valid
+bool port_sensor_set_thresholds(uint32_t sensor_id, uint32_t no_light_enter, uint32_t no_light_exit);
+
+/// @brief Prepare the sensor for stop mode, where the ADC is off, or restart sampling after it. In stop mode the pin is a digital input whose EXTI wakes the system up on both edges.
+/// @param sensor_id Sensor ID. This index is used to select the element of the sensors_arr[] array.
+/// @param enable true before entering stop mode, false after waking up.
+/// @return true
+/// @return false if the pin is already past its input threshold, so no edge would wake the system up: the sensor keeps sampling and the system must only sleep the CPU
+bool port_sensor_set_low_power(uint32_t sensor_id, bool enable);
+
 #endif
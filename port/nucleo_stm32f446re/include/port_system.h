@@ -32,6 +32,41 @@
 #define GET_PIN_IRQN(pin) (pin >= 10 ? EXTI15_10_IRQn : (pin >= 5 ? EXTI9_5_IRQn : (EXTI0_IRQn + pin))) /*!< Compute the IRQ number associated to a GPIO pin */
 
 /* Microcontroller STM32F446RE */
+/* Clock configuration */
+#define HSI_VALUE ((uint32_t)16000000)  /*!< Value of the Internal oscillator in Hz */
+#define SYSTEM_CORE_CLOCK_HZ HSI_VALUE  /*!< Frequency of the System clock (and of the timers) in Hz after the initialization, before any change with `port_system_set_clock()` */
+
+/* Clocks of the system: the HSI for the lowest current, and the PLL (fed by the HSI) for bursts of work. The APB1 bus runs at 45 MHz at most and the APB2 bus at 90 MHz, so at 180 MHz the timers of each bus have a different clock.
+ * Each line is: name, core clock, clock of the timers of APB1 (TIM2 to TIM7, TIM12 to TIM14), clock of the timers of APB2 (TIM1, TIM8 to TIM11), all in Hz, and the typical current in run and sleep modes in uA, which estimates the energy (approximate figures of the datasheet at 3.3 V with the peripherals of the system on; measure the board for exact ones) */
+#define PORT_SYSTEM_CLOCKS_MAP(X)                                      \
+  X(HSI_16MHZ, 16000000U, 16000000U, 16000000U, 5500U, 2200U)          \
+  X(PLL_64MHZ, 64000000U, 64000000U, 64000000U, 16000U, 5500U)         \
+  X(PLL_84MHZ, 84000000U, 84000000U, 84000000U, 20000U, 7000U)         \
+  X(PLL_180MHZ, 180000000U, 90000000U, 180000000U, 48000U, 16000U) /*!< X-macro with all the clocks of the system */
+#define PORT_SYSTEM_STOP_UA 350U                                     /*!< Typical current in stop mode, with the regulator in low power mode, in uA */
+#define PORT_SYSTEM_VDD_MV 3300U                                     /*!< Supply voltage of the MCU, to turn the currents into energy */
+#define PORT_SYSTEM_MAX_CLOCK_CALLBACKS 8                            /*!< Functions that can be called at each change of the clock, one per owner of a timer or of a clocked peripheral */
+#define PORT_TIMER_ON_APB2(n) (((n) == 1) || (((n) >= 8) && ((n) <= 11))) /*!< Whether a timer of the timer map is clocked by the APB2 bus */
+#define PORT_TIMER_CLOCK_HZ(n, apb1_timer_hz, apb2_timer_hz) (PORT_TIMER_ON_APB2(n) ? (apb2_timer_hz) : (apb1_timer_hz)) /*!< Clock of a timer of the timer map with a line of #PORT_SYSTEM_CLOCKS_MAP. Used to check the timer constants at compile time for all the clocks */
+
+/* Timer resources. Each function that programs a timer owns it entirely (prescaler, auto-reload and update events are shared by all its channels), so two functions must never use the same timer. The map is checked at compile time in port_system.c and, together with the pins of the port headers, by tools/check_pinmap.py */
+#define PORT_TIMER_TX_SYMBOL 1     /*!< TIM1: symbol timer of the infrared transmitters (update interrupt) */
+#define PORT_TIMER_TX_CARRIER 2    /*!< TIM2: carrier of the infrared transmitter, CH3 on PB10 (AF1) */
+#define PORT_TIMER_TX_CARRIER_CH 3 /*!< Channel of the carrier timer */
+#define PORT_TIMER_RX_TICK 12      /*!< TIM12: time base of the edges of the infrared receiver */
+#define PORT_TIMER_BUZZER 4        /*!< TIM4: PWM of the buzzer, CH2 on PB7 (AF2) */
+#define PORT_TIMER_BUZZER_CH 2     /*!< Channel of the buzzer timer */
+#define PORT_TIMER_RGB 3           /*!< TIM3: PWM of the red (CH1 on PB4) and blue (CH2 on PB5) LEDs, AF2 */
+#define PORT_TIMER_RGB_G 8         /*!< TIM8: PWM of the green LED, CH2 on PC7 (AF3). PC7 is also TIM3_CH2, already taken by the blue LED */
+#define PORT_TIMER_AUDIO_DAC 6     /*!< TIM6: sample clock of the DAC audio backend (TRGO triggers DAC channel 1, fed by DMA1 Stream5) */
+#define PORT_TIMER_EFFECTS 7       /*!< TIM7: tick of the light effects engine (update interrupt) */
+#define PORT_TIMER_SENSOR 5        /*!< TIM5: trigger of the ADC of the light sensor (CC1 event, no output pin) */
+#define PORT_TIMER_BUTTON_SCAN 9   /*!< TIM9: scan of the buttons (update interrupt, TIM1_BRK_TIM9 IRQ, free since TIM1 does not use its break) */
+
+#define PORT_TIMERS_MAP(X) X(TX_SYMBOL) X(TX_CARRIER) X(RX_TICK) X(BUZZER) X(RGB) X(RGB_G) X(AUDIO_DAC) X(EFFECTS) X(SENSOR) X(BUTTON_SCAN) /*!< X-macro with all the functions of the timer map. Add new owners here */
+#define PORT_TIM(n) _PORT_TIM(n)                                         /*!< CMSIS timer of a number of the timer map, e.g. `PORT_TIM(PORT_TIMER_BUZZER)` is `TIM4` */
+#define _PORT_TIM(n) TIM##n                                              /*!< Helper of `PORT_TIM()` to expand the number before pasting */
+
 /* Timer configuration */
 #define RCC_HSI_CALIBRATION_DEFAULT 0x10U            /*!< Default HSI calibration trimming value */
 #define TICK_FREQ_1KHZ 1U                            /*!< Freqency in kHz of the System tick */
@@ -41,8 +76,22 @@
                                                          0 bit  for subpriority */
 
 /* Power */
+#define POWER_REGULATOR_VOLTAGE_SCALE1 0x03 /*!< Scale 1 mode: the maximum value of fHCLK is 168 MHz, 180 MHz with the over-drive. */
 #define POWER_REGULATOR_VOLTAGE_SCALE3 0x01 /*!< Scale 3 mode: the maximum value of fHCLK is 120 MHz. */
 
+/* Real-time clock: time base of the sleeps, which goes on in stop mode */
+#ifndef RTC_LSE
+#define RTC_LSE 0 /*!< Set to 1 (`make RTC_LSE=1`) to clock the RTC with the 32.768 kHz crystal (LSE, X2 of the Nucleo board), which takes about 2 s to start. By default it is clocked with the LSI, which starts at once and is calibrated against the HSI, but drifts with the temperature */
+#endif
+#define RTC_LSE_HZ 32768U                                                  /*!< Frequency of the LSE crystal */
+#define RTC_PREDIV_A 1U                                                    /*!< Asynchronous prescaler of the RTC minus 1: the subsecond counter runs at RTCCLK / 2, 16384 Hz with the LSE */
+#define RTC_PREDIV_S 16383U                                                /*!< Synchronous prescaler of the RTC minus 1: ticks of the subsecond counter per second of the calendar */
+#define RTC_DAY_TICKS (86400U * (RTC_PREDIV_S + 1))                        /*!< Ticks of the subsecond counter in a day of the calendar, when its time wraps around */
+#define RTC_WAKEUP_TICKS (16U / (RTC_PREDIV_A + 1))                        /*!< Ticks of the subsecond counter per count of the wakeup timer, clocked at RTCCLK / 16 */
+#define RTC_WAKEUP_MAX_COUNTS 0x10000U                                     /*!< Longest period of the wakeup timer: 32 s with the LSE. A farther deadline wakes the system up earlier, and it sleeps again */
+#define RTC_WAKEUP_EXTI_LINE 22                                            /*!< EXTI line of the wakeup timer, which wakes the system up from stop mode */
+#define RTC_CALIBRATION_TICKS 512U                                         /*!< Ticks of the subsecond counter timed with the cycle counter to measure the frequency of the LSI: 32 ms */
+
 /* GPIOs */
 #define HIGH true /*!< Logic 1 */
 #define LOW false /*!< Logic 0 */
@@ -59,6 +108,37 @@
 #define GPIO_PUPDR_PUP 0x01    /*!< GPIO no pull up */
 #define GPIO_PUPDR_PDOWN 0x02  /*!< GPIO no pull down */
 
+/* Enums */
+#define _PORT_SYSTEM_CLOCK_ENUM(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) PORT_SYSTEM_CLOCK_##name, /*!< Helper of #port_system_clock_t */
+
+/// @brief Clocks of the system, from #PORT_SYSTEM_CLOCKS_MAP.
+typedef enum
+{
+  PORT_SYSTEM_CLOCKS_MAP(_PORT_SYSTEM_CLOCK_ENUM)
+  PORT_SYSTEM_NUM_CLOCKS /*!< Number of clocks */
+} port_system_clock_t;
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Function called at each change of the clock: with `changed` false right before it, to finish or pause what cannot go through it (e.g. a transfer of the SPI), and with `changed` true right after it, to retime its peripheral with `port_system_get_timer_clock_hz()`. Both calls run with the interrupts masked, so they must be short.
+typedef void (*port_system_clock_cb_t)(bool changed);
+
+/**
+ * @brief Structure to report the time spent in each power mode since `port_system_reset_sleep_stats()`, measured with the RTC, and the accuracy of the millisecond tick.
+ */
+typedef struct
+{
+  uint32_t run_ms;               /*!< Time awake, with the CPU running */
+  uint32_t sleep_ms;             /*!< Time in sleep mode: only the CPU clock stopped */
+  uint32_t stop_ms;              /*!< Time in stop mode: all the clocks but the RTC stopped */
+  uint32_t num_sleeps;           /*!< Sleeps in any of the modes */
+  uint32_t num_deadline_wakeups; /*!< Sleeps ended by the wakeup timer at their deadline, instead of by another interrupt */
+  int32_t millis_error_ms;       /*!< Time counted by `port_system_get_millis()` minus the time measured by the RTC. It comes from the error of the HSI while the SysTick runs and from the rounding of the sleeps */
+  uint32_t clock_run_ms[PORT_SYSTEM_NUM_CLOCKS];   /*!< Time awake with each clock */
+  uint32_t clock_sleep_ms[PORT_SYSTEM_NUM_CLOCKS]; /*!< Time in sleep mode with each clock, which keeps running for the peripherals */
+  uint32_t num_clock_changes;                      /*!< Changes of the clock with `port_system_set_clock()` */
+  uint32_t energy_uj;                              /*!< Energy estimated from the times above with the typical currents of #PORT_SYSTEM_CLOCKS_MAP and #PORT_SYSTEM_STOP_UA */
+} port_system_sleep_stats_t;
+
 /* Function prototypes and explanation -------------------------------------------------*/
 
 /**
@@ -108,6 +188,87 @@ void port_system_delay_ms(uint32_t ms);
  */
 void port_system_delay_until_ms(uint32_t *p_t, uint32_t ms);
 
+/**
+ * @brief Get the count of CPU cycles of the cycle counter (DWT). It wraps around every 2^32 cycles (268 s at 16 MHz), so only differences between two counts are meaningful.
+ * @return uint32_t
+ */
+uint32_t port_system_get_cycles(void);
+
+/**
+ * @brief Convert a number of CPU cycles into microseconds with the current system clock. The difference between two counts taken with different clocks has no meaning. Times that may span a change of the clock or a sleep are taken with `port_system_get_micros64()`.
+ *
+ * @param cycles Number of cycles, usually the difference between two counts of `port_system_get_cycles()`
+ * @return uint32_t Microseconds
+ */
+uint32_t port_system_cycles_to_us(uint32_t cycles);
+
+/**
+ * @brief Get the time since the initialization in microseconds. It is the cycle counter (DWT) extended to 64 bits, so it never wraps around: a new base is taken by the SysTick before the counter wraps, at each change of the clock and after each sleep, where the time slept is measured with the RTC. It is monotonic and can be read from any interrupt without locks: a read interrupted by a new base is done again.
+ *
+ * @return uint64_t Time in us
+ */
+uint64_t port_system_get_micros64(void);
+
+/**
+ * @brief Change the clock of the system. The voltage scaling (and the over-drive at 180 MHz), the wait states of the flash and the prescalers of the APB buses are set for the new clock, and the SysTick, the prescaler of the SWO and the functions of `port_system_add_clock_callback()` are retimed, all with the interrupts masked. The millisecond tick keeps the fraction of millisecond in progress. The PLL takes about 0.2 ms to lock.
+ * @note Stop mode stops the PLL: the sleeps start it again on wakeup, before the interrupts are unmasked.
+ *
+ * @param clock Clock of #port_system_clock_t.
+ * @return true
+ * @return false if the clock does not exist
+ */
+bool port_system_set_clock(port_system_clock_t clock);
+
+/**
+ * @brief Get the current clock of the system.
+ * @return port_system_clock_t
+ */
+port_system_clock_t port_system_get_clock(void);
+
+/**
+ * @brief Get the clock of a timer with the current clock of the system, which depends on the bus of the timer.
+ *
+ * @param timer Number of the timer, as in the timer map (e.g. #PORT_TIMER_BUZZER).
+ * @return uint32_t Clock of the timer in Hz
+ */
+uint32_t port_system_get_timer_clock_hz(uint32_t timer);
+
+/**
+ * @brief Get the clock of the peripherals of the APB1 bus (e.g. the SPI2) with the current clock of the system.
+ * @return uint32_t Clock of the APB1 bus in Hz
+ */
+uint32_t port_system_get_apb1_clock_hz(void);
+
+/**
+ * @brief Get the clock of the peripherals of the APB1 bus with a clock of the system, to check if a peripheral can run with it before it is set.
+ * @param clock Clock of #port_system_clock_t.
+ * @return uint32_t Clock of the APB1 bus in Hz, or 0 if the clock does not exist
+ */
+uint32_t port_system_get_clock_apb1_hz(port_system_clock_t clock);
+
+/**
+ * @brief Get the clock of the peripherals of the APB2 bus (e.g. the ADC) with the current clock of the system.
+ * @return uint32_t Clock of the APB2 bus in Hz
+ */
+uint32_t port_system_get_apb2_clock_hz(void);
+
+/**
+ * @brief Add a function to be called at each change of the clock. Each owner of a timer adds one at its initialization. Adding the same function again has no effect.
+ *
+ * @param p_callback Function of #port_system_clock_cb_t.
+ * @return true
+ * @return false if there are already #PORT_SYSTEM_MAX_CLOCK_CALLBACKS functions
+ */
+bool port_system_add_clock_callback(port_system_clock_cb_t p_callback);
+
+/**
+ * @brief Load a new prescaler in a running timer at once, keeping its count, so the period in progress is not stretched or shortened by a change of the clock. The update event that loads it does not interrupt, but it also loads the preloaded auto-reload and compare values.
+ *
+ * @param p_tim Timer (CMSIS struct like).
+ * @param psc New prescaler.
+ */
+void port_system_timer_set_prescaler(TIM_TypeDef *p_tim, uint32_t psc);
+
 /** @verbatim
       ==============================================================================
                               ##### How to use GPIOs #####
@@ -226,13 +387,34 @@ void port_system_gpio_write(GPIO_TypeDef *port, uint8_t pin, bool value);
 /// @brief Set the system in stop mode for low power consumption.
 void port_system_power_stop(void);
 
-/// @brief Suspend Tick increment.
+/// @brief Set the system in sleep mode: only the CPU clock is stopped, so the timers keep running.
+void port_system_power_sleep(void);
+
+/// @brief Suspend Tick increment. The counter of the SysTick stops too, so it keeps the fraction of the millisecond in progress.
 void port_system_systick_suspend(void);
 
 /// @brief Resume Tick increment.
 void port_system_systick_resume(void);
 
-/// @brief Enable low power consumption in sleep mode.
+/// @brief Enable low power consumption in stop mode until an interrupt wakes the system up. The SysTick is suspended, and the time slept, measured with the RTC, is added to the millisecond tick on wakeup, before the handler of the interrupt runs.
 void port_system_sleep(void);
 
+/// @brief Enable low power consumption in sleep mode, but keeping the clocks of the peripherals (e.g. the PWM of a dimmed LED). It saves less power than `port_system_sleep()`. The millisecond tick is kept as in `port_system_sleep()`.
+void port_system_sleep_light(void);
+
+/// @brief Enable low power consumption in stop mode until an interrupt or a deadline, whatever comes first. The wakeup timer of the RTC is programmed for the deadline. It returns at once if the deadline has passed.
+/// @param deadline_ms System tick, as `port_system_get_millis()`, at which the system must be awake.
+void port_system_sleep_until(uint32_t deadline_ms);
+
+/// @brief Enable low power consumption in sleep mode until an interrupt or a deadline, whatever comes first, as `port_system_sleep_until()`.
+/// @param deadline_ms System tick, as `port_system_get_millis()`, at which the system must be awake.
+void port_system_sleep_light_until(uint32_t deadline_ms);
+
+/// @brief Return the time spent in each power mode and with each clock, the estimated energy and the accuracy of the millisecond tick since the last reset of the statistics. It must be called from the main loop, as the sleeps.
+/// @param p_stats Pointer to the structure to fill.
+void port_system_get_sleep_stats(port_system_sleep_stats_t *p_stats);
+
+/// @brief Reset the statistics of the sleeps and take the current time as the reference of the accuracy of the millisecond tick.
+void port_system_reset_sleep_stats(void);
+
 #endif /* PORT_SYSTEM_H_ */
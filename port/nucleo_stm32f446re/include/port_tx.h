@@ -35,14 +35,32 @@ void port_tx_init(uint8_t tx_id, bool status);
 /// @param status To indicate if PWM starts, or not, from the beginning.
 void port_tx_pwm_timer_set(uint8_t tx_id, bool status);
 
-/// @brief Start the symbol timer and reset the count of ticks.
-void port_tx_symbol_tmr_start();
+/// @brief Set the frequency and duty cycle of the carrier (PWM). It must be called while the transmitter is idle.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+/// @param freq_hz Frequency of the carrier in Hz (36, 38 or 40 kHz for the usual protocols).
+/// @param duty_percent Duty cycle of the carrier, 0-100.
+void port_tx_set_carrier(uint8_t tx_id, uint32_t freq_hz, uint8_t duty_percent);
+
+/// @brief Start sending a burst schedule. The symbol timer interrupts switch the PWM at each duration, so this function returns immediately.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+/// @param p_durations Pointer to the array of durations in symbol ticks. Even positions are PWM bursts (ON) and odd positions are silences (OFF). It must remain valid until the transmission ends.
+/// @param num_durations Number of elements of the array of durations.
+void port_tx_send_bursts(uint8_t tx_id, const uint16_t *p_durations, uint32_t num_durations);
 
-/// @brief Stop the symbol timer.
-void port_tx_symbol_tmr_stop();
+/// @brief Check if a burst schedule is being sent.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+/// @return true If the transmitter is still sending
+/// @return false If the transmitter is idle
+bool port_tx_is_busy(uint8_t tx_id);
 
-/// @brief Get the count of the symbol ticks.
-/// @return uint32_t
-uint32_t port_tx_tmr_get_tick();
+/// @brief Enable/disable the loopback mode. The transmitter feeds the infrared receiver with an edge at each switch of its PWM (the first edge of a burst is a falling edge of the receiver), and the receiver ignores its GPIO. Used to measure the latency of the whole system without optics.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+/// @param enable true to enable the loopback mode
+void port_tx_set_loopback(uint8_t tx_id, bool enable);
+
+/// @brief Get the number of symbol timer interrupts of the burst schedule being sent, or of the last one if the transmitter is idle. A NEC frame (68 durations) costs 68 interrupts.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+/// @return uint32_t Number of interrupts
+uint32_t port_tx_get_isr_count(uint8_t tx_id);
 
 #endif
\ No newline at end of file
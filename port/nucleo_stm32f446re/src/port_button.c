@@ -3,6 +3,8 @@
  * @brief File containing functions related to the HW of the button FSM.
  *
  * This files defines an internal struct which coontains the HW information of the button.
+ * All the buttons share one EXTI path and one scan: an edge of any button starts a timer that samples all of them every #BUTTON_SCAN_PERIOD_MS and debounces them together with vertical counters, one bit per button. The timer stops when all the buttons are stable.
+ * The interrupt of the button takes the time in us of the first edge of a change, and the scan stores the change in the queue of events of the button when it accepts it, with that time. So the durations of the presses are measured at the edges, and not when the scan accepts them or the main loop reads them. The button FSM turns the events into the gestures of each button.
  *
  * @author Hernán García Quijano
  * @author Ángel Rodrigo Pérez Iglesias
@@ -11,7 +13,20 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "port_button.h"
-#include "port_sensor.h" /*!<Included in order to work with its interruption handler that lays within this file.*/
+#include "keyscan.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define BUTTON_SCAN_TIM PORT_TIM(PORT_TIMER_BUTTON_SCAN) /*!< Timer of the scan of the buttons */
+#define BUTTON_SCAN_TMR_CLOCK_HZ 10000                 /*!< Counter clock of the scan timer. Not lower: the 16-bit prescaler must divide the 180 MHz of APB2 down to it */
+#define BUTTON_SCAN_TMR_PSC(timer_hz) (((timer_hz) / BUTTON_SCAN_TMR_CLOCK_HZ) - 1) /*!< Prescaler of the scan timer */
+#define BUTTON_NUM (sizeof(buttons_arr) / sizeof(buttons_arr[0])) /*!< Number of buttons */
+
+_Static_assert(BUTTON_0_PIN >= 10, "The buttons must be on the EXTI lines 10 to 15: the handler of the lines 5 to 9 belongs to the infrared receiver");
+
+/// @brief Check of the scan timer for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _BUTTON_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) \
+    _Static_assert(BUTTON_SCAN_TMR_PSC(PORT_TIMER_CLOCK_HZ(PORT_TIMER_BUTTON_SCAN, apb1_timer_hz, apb2_timer_hz)) <= 0xFFFF, "The prescaler of the scan timer does not fit in 16 bits with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_BUTTON_CLOCK_CHECK)
 
 /* Typedefs --------------------------------------------------------------------*/
 
@@ -20,34 +35,163 @@ typedef struct
 {
     GPIO_TypeDef *p_port; /*!< GPIO where the button is connected */
     uint8_t pin;          /*!< Pin/line where the button is connected */
-    bool flag_pressed;    /*!< Flag to indicate that the button has been pressed. If it occurs in a rising or falling edge depends on how the function port_button_is_pressed implements it. */
+    uint64_t change_us;   /*!< Time of the first edge of the change not accepted by the scan yet */
+    port_button_event_t events_arr[BUTTON_EVENTS_QUEUE_SIZE]; /*!< Queue of the debounced events, written by the scan */
+    volatile uint8_t events_head; /*!< Index of the next event written by the scan */
+    volatile uint8_t events_tail; /*!< Index of the next event read by the FSM */
 } port_button_hw_t;
 
+_Static_assert((BUTTON_EVENTS_QUEUE_SIZE & (BUTTON_EVENTS_QUEUE_SIZE - 1)) == 0, "The size of the queue of events must be a power of 2");
+
 /* Global variables ------------------------------------------------------------*/
 
-/// @brief Array of elements that represents the HW characteristics of the buttons.
+/// @brief Array of elements that represents the HW characteristics of the buttons. The buttons are active low. Add new buttons here: the scan takes them all.
 static port_button_hw_t buttons_arr[] = {
-    [BUTTON_0_ID] = {.p_port = BUTTON_0_GPIO, .pin = BUTTON_0_PIN, .flag_pressed = false},
+    [BUTTON_0_ID] = {.p_port = BUTTON_0_GPIO, .pin = BUTTON_0_PIN},
 };
 
+_Static_assert(BUTTON_NUM <= KEYSCAN_MAX_KEYS, "The buttons are debounced with one bit of a word each");
+
+static keyscan_t keys;           /*!< Debounce of all the buttons, bit i is the button of ID i */
+static uint32_t initialized_msk; /*!< Buttons initialized, the only ones scanned */
+static uint32_t changing_msk;    /*!< Buttons with an edge not accepted by the scan yet, whose change_us is valid */
+
+/* Private functions */
+
+/// @brief Store a debounced event of a button in its queue. If the queue is full, the event is lost and the FSM resynchronizes with the next one.
+/// @param p_button Pointer to the button.
+/// @param pressed true for a press, false for a release.
+/// @param time_us Time of the first edge of the change.
+static void _push_event(port_button_hw_t *p_button, bool pressed, uint64_t time_us)
+{
+    uint8_t head = p_button->events_head;
+    uint8_t next = (head + 1) & (BUTTON_EVENTS_QUEUE_SIZE - 1);
+    if (next == p_button->events_tail)
+    {
+        return;
+    }
+    p_button->events_arr[head].time_us = time_us;
+    p_button->events_arr[head].pressed = pressed;
+    p_button->events_head = next;
+}
+
+/// @brief Read the raw state of all the buttons initialized.
+/// @return uint32_t Raw state: bit i is 1 if the button of ID i is pressed.
+static uint32_t _read_raw(void)
+{
+    uint32_t raw = 0;
+    for (uint32_t i = 0; i < BUTTON_NUM; i++)
+    {
+        if (!port_system_gpio_read(buttons_arr[i].p_port, buttons_arr[i].pin))
+        {
+            raw |= (1UL << i);
+        }
+    }
+    return raw & initialized_msk;
+}
+
+/// @brief Configure the scan timer: an update interrupt every #BUTTON_SCAN_PERIOD_MS. It is started by the edges of the buttons.
+static void _timer_scan_setup(void)
+{
+    RCC->APB2ENR |= RCC_APB2ENR_TIM9EN;
+    BUTTON_SCAN_TIM->CR1 = 0;
+    BUTTON_SCAN_TIM->PSC = BUTTON_SCAN_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_BUTTON_SCAN));
+    BUTTON_SCAN_TIM->ARR = ((BUTTON_SCAN_PERIOD_MS * BUTTON_SCAN_TMR_CLOCK_HZ) / 1000) - 1;
+    BUTTON_SCAN_TIM->EGR = TIM_EGR_UG;
+    BUTTON_SCAN_TIM->SR = ~TIM_SR_UIF;
+    BUTTON_SCAN_TIM->DIER |= TIM_DIER_UIE;
+
+    NVIC_SetPriority(TIM1_BRK_TIM9_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0)); /* Priority 3: the edges are already timestamped by the EXTI */
+    NVIC_EnableIRQ(TIM1_BRK_TIM9_IRQn);
+}
+
+/// @brief Start the scan timer, if it is not running.
+static void _scan_start(void)
+{
+    if (!(BUTTON_SCAN_TIM->CR1 & TIM_CR1_CEN))
+    {
+        BUTTON_SCAN_TIM->CNT = 0;
+        BUTTON_SCAN_TIM->CR1 |= TIM_CR1_CEN;
+    }
+}
+
+/// @brief Handle the EXTI lines of all the buttons: take the time of the edge of each button whose line is pending, if it is the first one of a change, and start the scan.
+static void _handle_exti(void)
+{
+    for (uint32_t i = 0; i < BUTTON_NUM; i++)
+    {
+        port_button_hw_t *p_button = &buttons_arr[i];
+        if (EXTI->PR & BIT_POS_TO_MASK(p_button->pin))
+        {
+            if (!(changing_msk & (1UL << i)))
+            {
+                p_button->change_us = port_system_get_micros64();
+                changing_msk |= (1UL << i);
+            }
+            EXTI->PR = BIT_POS_TO_MASK(p_button->pin); /* Clear the flag by writing a 1. A read-modify-write would clear the other lines too */
+            _scan_start();
+        }
+    }
+}
+
+/// @brief Retime the scan timer after a change of the clock, keeping the phase of the current scan period.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+    if (changed)
+    {
+        port_system_timer_set_prescaler(BUTTON_SCAN_TIM, BUTTON_SCAN_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_BUTTON_SCAN)));
+    }
+}
+
+/* Public functions */
+
 void port_button_init(uint32_t button_id)
 {
     GPIO_TypeDef *p_port1 = buttons_arr[button_id].p_port;
     uint8_t pin1 = buttons_arr[button_id].pin;
 
+    if (initialized_msk == 0)
+    {
+        _timer_scan_setup();
+        keyscan_init(&keys, 0);
+        port_system_add_clock_callback(_clock_retime);
+    }
     port_system_gpio_config(p_port1, pin1, GPIO_MODE_IN, GPIO_PUPDR_NOPULL); // input, no-pulls
+    NVIC_DisableIRQ(TIM1_BRK_TIM9_IRQn);
+    initialized_msk |= (1UL << button_id);
+    keys.state = (keys.state & ~(1UL << button_id)) | (_read_raw() & (1UL << button_id)); /* Start from the current state, so a button already pressed is not seen as a new press */
+    NVIC_EnableIRQ(TIM1_BRK_TIM9_IRQn);
     port_system_gpio_config_exti(buttons_arr[button_id].p_port, buttons_arr[button_id].pin, (TRIGGER_BOTH_EDGE | TRIGGER_ENABLE_INTERR_REQ));
     port_system_gpio_exti_enable(buttons_arr[button_id].pin, 1, 0);
 }
 
 bool port_button_is_pressed(uint32_t button_id)
 {
-    return buttons_arr[button_id].flag_pressed;
+    return (keys.state & (1UL << button_id)) != 0;
 }
 
-uint32_t port_button_get_tick()
+bool port_button_pop_event(uint32_t button_id, port_button_event_t *p_event)
 {
-    return port_system_get_millis();
+    port_button_hw_t *p_button = &buttons_arr[button_id];
+    uint8_t tail = p_button->events_tail;
+    if (tail == p_button->events_head)
+    {
+        return false;
+    }
+    *p_event = p_button->events_arr[tail];
+    p_button->events_tail = (tail + 1) & (BUTTON_EVENTS_QUEUE_SIZE - 1);
+    return true;
+}
+
+bool port_button_check_scanning(void)
+{
+    return (BUTTON_SCAN_TIM->CR1 & TIM_CR1_CEN) != 0;
+}
+
+uint64_t port_button_get_time_us(void)
+{
+    return port_system_get_micros64();
 }
 
 //------------------------------------------------------
@@ -62,23 +206,31 @@ uint32_t port_button_get_tick()
 void EXTI15_10_IRQHandler(void)
 {
     port_system_systick_resume();
-    /* ISR user button in PC13 */
-    if (EXTI->PR & BIT_POS_TO_MASK(buttons_arr[BUTTON_0_ID].pin))
+    _handle_exti();
+}
+
+/// @brief This function handles the interrupt of the scan timer: sample all the buttons, debounce them, store the changes accepted as events and stop the scan when they are all stable.
+void TIM1_BRK_TIM9_IRQHandler(void)
+{
+    if (BUTTON_SCAN_TIM->SR & TIM_SR_UIF)
     {
-        if (port_system_gpio_read(buttons_arr[BUTTON_0_ID].p_port, buttons_arr[BUTTON_0_ID].pin))
+        BUTTON_SCAN_TIM->SR = ~TIM_SR_UIF;
+        NVIC_DisableIRQ(EXTI15_10_IRQn); /* An edge between the sample and the update of changing_msk would lose its time */
+        uint32_t raw = _read_raw();
+        uint32_t changed = keyscan_update(&keys, raw);
+        for (uint32_t i = 0; i < BUTTON_NUM; i++)
         {
-            buttons_arr[BUTTON_0_ID].flag_pressed = false;
+            if (changed & (1UL << i))
+            {
+                uint64_t time_us = (changing_msk & (1UL << i)) ? buttons_arr[i].change_us : port_system_get_micros64();
+                _push_event(&buttons_arr[i], (keys.state & (1UL << i)) != 0, time_us);
+            }
         }
-        else
+        changing_msk &= (raw ^ keys.state); /* A button back at its state has only bounced or glitched: its next edge starts a new change */
+        NVIC_EnableIRQ(EXTI15_10_IRQn);
+        if (keyscan_check_settled(&keys, raw))
         {
-            buttons_arr[BUTTON_0_ID].flag_pressed = true;
+            BUTTON_SCAN_TIM->CR1 &= ~TIM_CR1_CEN;
         }
-        EXTI->PR |= BIT_POS_TO_MASK(buttons_arr[BUTTON_0_ID].pin); /* Limpiar flag , escribiendo un 1 */
-    }
-
-    if (EXTI->PR & BIT_POS_TO_MASK(SENSOR_0_PIN))
-    {
-        port_system_gpio_read(SENSOR_0_GPIO, SENSOR_0_PIN);
-        EXTI->PR |= BIT_POS_TO_MASK(SENSOR_0_PIN); /* Limpiar flag , escribiendo un 1 */
     }
 }
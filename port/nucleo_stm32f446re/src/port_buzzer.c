@@ -8,10 +8,29 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "port_buzzer.h"
-#include <math.h>
+
+#if !BUZZER_DAC /* The DAC backend is in port_buzzer_dac.c */
 
 /* Defines --------------------------------------------------------------------*/
-#define ALT_FUNC1_TIM_PWM 1 /*!< TIM2 Alternate Function mapping */
+#define ALT_FUNC2_TIM_PWM 2 /*!< TIM4 Alternate Function mapping */
+#define BUZZER_TIM PORT_TIM(PORT_TIMER_BUZZER) /*!< PWM timer of the buzzer, owned only by the buzzer */
+
+#define BUZZER_TMR_CLOCK_HZ 2000000 /*!< Counter clock of the PWM timer: a divisor of the timer clock with all the clocks of the system, so the table of notes holds for all of them. The period of the highest note is still 506 counts, within 0.1 % */
+#define BUZZER_TMR_PSC(timer_hz) (((timer_hz) / BUZZER_TMR_CLOCK_HZ) - 1) /*!< Prescaler of the PWM timer */
+#define BUZZER_TMR_ARR(centi_hz, octave) ((((uint64_t)BUZZER_TMR_CLOCK_HZ * 100U) + (((uint64_t)(centi_hz) << (octave)) / 2)) / ((uint64_t)(centi_hz) << (octave)) - 1) /*!< Auto-reload of the PWM timer for a note of octave 4 + `octave` */
+#define BUZZER_NOTE(centi_hz, octave) {.arr = (uint16_t)BUZZER_TMR_ARR(centi_hz, octave), .ccr = (uint16_t)(((BUZZER_TMR_ARR(centi_hz, octave) + 1) * BUZZER_PWM_DC_PERCENT) / 100)} /*!< Timer values of a note */
+/// @brief Timer values of the 12 notes of octave 4 + `octave`.
+#define BUZZER_OCTAVE(octave)                                                                                                 \
+  BUZZER_NOTE(NOTA_DO, octave), BUZZER_NOTE(NOTA_DO2, octave), BUZZER_NOTE(NOTA_RE, octave), BUZZER_NOTE(NOTA_RE2, octave),     \
+  BUZZER_NOTE(NOTA_MI, octave), BUZZER_NOTE(NOTA_FA, octave), BUZZER_NOTE(NOTA_FA2, octave), BUZZER_NOTE(NOTA_SOL, octave),     \
+  BUZZER_NOTE(NOTA_SOL2, octave), BUZZER_NOTE(NOTA_LA, octave), BUZZER_NOTE(NOTA_LA2, octave), BUZZER_NOTE(NOTA_SI, octave)
+
+_Static_assert(BUZZER_TMR_ARR(NOTA_DO, 0) <= 0xFFFF, "The lowest note does not fit a 16-bit auto-reload");
+
+/// @brief Check of the PWM timer for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _BUZZER_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) \
+  _Static_assert((PORT_TIMER_CLOCK_HZ(PORT_TIMER_BUZZER, apb1_timer_hz, apb2_timer_hz) % BUZZER_TMR_CLOCK_HZ) == 0, "The counter clock of the buzzer must be a divisor of the timer clock with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_BUZZER_CLOCK_CHECK)
 
 /* Typedefs --------------------------------------------------------------------*/
 
@@ -24,13 +43,24 @@ typedef struct
 
 } port_buzzer_hw_t;
 
+/// @brief Structure to define the values of the PWM timer for a note.
+typedef struct
+{
+  uint16_t arr; /*!< Auto-reload: period of the note in timer counts */
+  uint16_t ccr; /*!< Capture/compare: high time of the PWM, #BUZZER_PWM_DC_PERCENT of the period */
+
+} port_buzzer_note_t;
+
 /* Global variables ------------------------------------------------------------*/
 
 /// @brief Array of elements that represents the HW characteristics of the buzzers.
 static port_buzzer_hw_t buzzers_arr[] = {
-    [BUZZER_0_ID] = {.p_port = BUZZER_0_GPIO, .pin = BUZZER_0_PIN, .alt_func = ALT_FUNC1_TIM_PWM},
+    [BUZZER_0_ID] = {.p_port = BUZZER_0_GPIO, .pin = BUZZER_0_PIN, .alt_func = ALT_FUNC2_TIM_PWM},
 };
 
+/// @brief Array of the timer values of each note, computed at compile time for #BUZZER_TMR_CLOCK_HZ. Changing a note is a table load plus register writes.
+static const port_buzzer_note_t notes_arr[BUZZER_NUM_NOTES] = {BUZZER_OCTAVE(0), BUZZER_OCTAVE(1), BUZZER_OCTAVE(2), BUZZER_OCTAVE(3)};
+
 /* buzzer private functions */
 
 /// @brief Configure the PWM timer. This timer configures the PWM for the buzzer.
@@ -39,10 +69,22 @@ static void _timer_pwm_setup(uint32_t buzzer_id)
 {
   if (buzzer_id == BUZZER_0_ID)
   {
-    TIM2->CR1 |= 0x0001;
-    TIM2->CCER |= 0x0010;
-    TIM2->CCMR1 |= 0x6000;
-    TIM2->CCR2 = 0;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM4EN;
+    BUZZER_TIM->CR1 |= TIM_CR1_CEN;
+    BUZZER_TIM->CCER |= TIM_CCER_CC2E;
+    BUZZER_TIM->CCMR1 |= TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1; /* PWM mode 1 on channel 2 */
+    BUZZER_TIM->PSC = BUZZER_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_BUZZER));
+    BUZZER_TIM->CCR2 = 0;
+  }
+}
+
+/// @brief Retime the PWM timer after a change of the clock. The note being played keeps its pitch: only the prescaler changes.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+  if (changed)
+  {
+    port_system_timer_set_prescaler(BUZZER_TIM, BUZZER_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_BUZZER)));
   }
 }
 
@@ -53,19 +95,23 @@ void port_buzzer_init(uint8_t buzzer_id)
   port_system_gpio_config(buzzers_arr[buzzer_id].p_port, buzzers_arr[buzzer_id].pin, GPIO_MODE_ALTERNATE, GPIO_PUPDR_NOPULL);
   port_system_gpio_config_alternate(buzzers_arr[buzzer_id].p_port, buzzers_arr[buzzer_id].pin, buzzers_arr[buzzer_id].alt_func);
   _timer_pwm_setup(buzzer_id);
+  port_system_add_clock_callback(_clock_retime);
 }
 
-void port_buzzer_pwm_timer_set(uint8_t buzzer_id, uint32_t freq)
+void port_buzzer_set_note(uint8_t buzzer_id, uint8_t note)
 {
   if (buzzer_id == BUZZER_0_ID)
   {
-    uint32_t arr = ((SystemCoreClock / freq) - 1);
-    TIM2->ARR = arr;
-    TIM2->PSC = 0;
-    TIM2->EGR |= 0x0001;
-    uint32_t ccr2 = BUZZER_PWM_DC * (arr + 1);
-    TIM2->CCR2 = ccr2;
-    port_system_delay_ms(500);
-    TIM2->CCR2 = 0;
+    if (note >= BUZZER_NUM_NOTES)
+    {
+      BUZZER_TIM->CCR2 = 0; /* Silence */
+      return;
+    }
+    const port_buzzer_note_t *p_note = &notes_arr[note];
+    BUZZER_TIM->ARR = p_note->arr;
+    BUZZER_TIM->EGR = TIM_EGR_UG;
+    BUZZER_TIM->CCR2 = p_note->ccr;
   }
 }
+
+#endif
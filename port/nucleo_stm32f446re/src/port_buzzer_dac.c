@@ -0,0 +1,185 @@
+/**
+ * @file port_buzzer_dac.c
+ * @brief Audio backend of the buzzer on the DAC: the wavetable synthesizer is streamed to DAC channel 1 by the DMA, triggered by a timer.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "port_buzzer.h"
+
+#if BUZZER_DAC /* The PWM backend is in port_buzzer.c */
+
+#include "synth.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define DAC_TIM PORT_TIM(PORT_TIMER_AUDIO_DAC)                             /*!< Sample clock of the DAC, owned only by this backend */
+#define DAC_TMR_ARR(timer_hz) ((((timer_hz) + (SYNTH_SAMPLE_RATE_HZ / 2)) / SYNTH_SAMPLE_RATE_HZ) - 1) /*!< Auto-reload of the sample clock (prescaler 0), rounded: 499 at 16 MHz. At 90 MHz the sample rate is 0.02 % off, far below what can be heard */
+#define DAC_TSEL_TIM6_TRGO 0                                             /*!< DAC channel 1 trigger selection: TIM6 TRGO */
+#define DAC_DMA_STREAM DMA1_Stream5                                      /*!< DMA stream of DAC channel 1 */
+#define DAC_DMA_CHANNEL 7                                                /*!< DMA channel of DAC channel 1 in DMA1 Stream5 */
+#define DAC_BUFFER_SAMPLES (2 * BUZZER_DAC_BLOCK_SAMPLES)                /*!< Circular buffer of the DMA: two blocks, one is played while the other is mixed */
+#define DAC_VOICE 0                                                      /*!< Voice of the synthesizer that plays the notes of `port_buzzer_set_note()` */
+#define DAC_SILENT_BLOCKS 2                                              /*!< Blocks mixed in silence before the stream stops: then both halves of the buffer are silent */
+
+_Static_assert(SYNTH_NUM_NOTES == BUZZER_NUM_NOTES, "The synthesizer and the buzzer must share the table of notes");
+
+/* Global variables ------------------------------------------------------------*/
+static uint16_t dac_buffer_arr[DAC_BUFFER_SAMPLES]; /*!< Circular buffer of samples read by the DMA */
+static volatile bool streaming;                     /*!< Flag of the sample clock and the DMA running. They only run while the synthesizer sounds */
+static uint8_t silent_blocks;                       /*!< Blocks mixed in silence since the synthesizer went quiet */
+
+/* buzzer private functions */
+
+/// @brief Configure the sample clock. Its update event is the trigger (TRGO) of the DAC.
+static void _timer_sample_setup(void)
+{
+  RCC->APB1ENR |= RCC_APB1ENR_TIM6EN;
+  DAC_TIM->CR1 = 0;
+  DAC_TIM->PSC = 0;
+  DAC_TIM->ARR = DAC_TMR_ARR(port_system_get_timer_clock_hz(PORT_TIMER_AUDIO_DAC));
+  DAC_TIM->CR2 = (DAC_TIM->CR2 & ~TIM_CR2_MMS) | (0x2 << TIM_CR2_MMS_Pos); /* MMS = 010: update event as TRGO */
+  DAC_TIM->EGR = TIM_EGR_UG;
+}
+
+/// @brief Configure the DMA to copy the circular buffer into the DAC, one sample per trigger, with an interrupt at each half of the buffer.
+static void _dma_setup(void)
+{
+  RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+  DAC_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+  while (DAC_DMA_STREAM->CR & DMA_SxCR_EN)
+  {
+  }
+  DAC_DMA_STREAM->PAR = (uint32_t)&DAC->DHR12R1;
+  DAC_DMA_STREAM->M0AR = (uint32_t)dac_buffer_arr;
+  DAC_DMA_STREAM->NDTR = DAC_BUFFER_SAMPLES;
+  DAC_DMA_STREAM->CR = (DAC_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL_1 | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_DIR_0 | DMA_SxCR_HTIE | DMA_SxCR_TCIE; /* Memory to peripheral, 16-bit, circular */
+  DMA1->HIFCR = DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTCIF5;
+
+  NVIC_SetPriority(DMA1_Stream5_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0)); /* Priority 3: below the infrared timers, a late block is only a glitch */
+  NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+}
+
+/// @brief Configure DAC channel 1, triggered by the sample clock and fed by the DMA. The output is first set to the silence, which it keeps while the stream is stopped.
+static void _dac_setup(void)
+{
+  RCC->APB1ENR |= RCC_APB1ENR_DACEN;
+  DAC->CR = DAC_CR_EN1;
+  DAC->DHR12R1 = SYNTH_SAMPLE_MID; /* Without a trigger the sample is output after one clock cycle */
+  DAC->CR = (DAC_TSEL_TIM6_TRGO << DAC_CR_TSEL1_Pos) | DAC_CR_TEN1 | DAC_CR_DMAEN1 | DAC_CR_EN1;
+}
+
+/// @brief Start the stream of samples, if it is stopped. The whole buffer is mixed first, so the note sounds at once and the interrupt of the first half goes on from where the buffer ends.
+static void _stream_start(void)
+{
+  NVIC_DisableIRQ(DMA1_Stream5_IRQn);
+  silent_blocks = 0;
+  if (!streaming)
+  {
+    synth_render(dac_buffer_arr, DAC_BUFFER_SAMPLES);
+    DAC_DMA_STREAM->NDTR = DAC_BUFFER_SAMPLES;
+    DMA1->HIFCR = DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTCIF5;
+    DAC_DMA_STREAM->CR |= DMA_SxCR_EN;
+    DAC_TIM->CNT = 0;
+    DAC_TIM->CR1 |= TIM_CR1_CEN;
+    streaming = true;
+  }
+  NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+}
+
+/// @brief Stop the sample clock and the DMA. The DAC keeps the last sample, the silence, and the CPU is not woken up by the blocks any more.
+static void _stream_stop(void)
+{
+  DAC_TIM->CR1 &= ~TIM_CR1_CEN;
+  DAC_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+  while (DAC_DMA_STREAM->CR & DMA_SxCR_EN)
+  {
+  }
+  DMA1->HIFCR = DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTCIF5;
+  NVIC_ClearPendingIRQ(DMA1_Stream5_IRQn);
+  streaming = false;
+}
+
+/// @brief Mix a block of the buffer. Once the synthesizer is quiet, including the release of the last note, the stream stops after #DAC_SILENT_BLOCKS silent blocks.
+/// @param p_block Pointer to the block.
+static void _render_block(uint16_t *p_block)
+{
+  bool silent = !synth_check_activity();
+  synth_render(p_block, BUZZER_DAC_BLOCK_SAMPLES);
+  if (!silent)
+  {
+    silent_blocks = 0;
+  }
+  else if (++silent_blocks >= DAC_SILENT_BLOCKS)
+  {
+    _stream_stop();
+  }
+}
+
+/// @brief Retime the sample clock after a change of the clock.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+  if (!changed)
+  {
+    return;
+  }
+  DAC_TIM->ARR = DAC_TMR_ARR(port_system_get_timer_clock_hz(PORT_TIMER_AUDIO_DAC));
+  if (DAC_TIM->CNT > DAC_TIM->ARR)
+  {
+    DAC_TIM->EGR = TIM_EGR_UG; /* Restart the period if the counter is already past the new one: one sample comes early */
+  }
+}
+
+/* Public functions */
+
+void port_buzzer_init(uint8_t buzzer_id)
+{
+  if (buzzer_id != BUZZER_0_ID)
+  {
+    return;
+  }
+  port_system_gpio_config(BUZZER_DAC_0_GPIO, BUZZER_DAC_0_PIN, GPIO_MODE_ANALOG, GPIO_PUPDR_NOPULL);
+  synth_init();
+  streaming = false;
+  _timer_sample_setup();
+  _dma_setup();
+  _dac_setup(); /* The stream starts with the first note */
+  port_system_add_clock_callback(_clock_retime);
+}
+
+void port_buzzer_set_note(uint8_t buzzer_id, uint8_t note)
+{
+  if (buzzer_id == BUZZER_0_ID)
+  {
+    if (note >= BUZZER_NUM_NOTES)
+    {
+      synth_note_off(DAC_VOICE); /* Release: the note fades out instead of clicking */
+      return;
+    }
+    synth_note_on(DAC_VOICE, note, SYNTH_VOLUME_MAX);
+    _stream_start();
+  }
+}
+
+//------------------------------------------------------
+// INTERRUPT SERVICE ROUTINES
+//------------------------------------------------------
+
+/// @brief This function handles the interrupts of DMA1 Stream5. When half of the buffer has been played, the first block is mixed again while the DMA plays the second one, and vice versa. The CPU works once per block, never per sample, and only while a note sounds.
+void DMA1_Stream5_IRQHandler(void)
+{
+  if (DMA1->HISR & DMA_HISR_HTIF5)
+  {
+    DMA1->HIFCR = DMA_HIFCR_CHTIF5;
+    _render_block(&dac_buffer_arr[0]);
+  }
+  if (streaming && (DMA1->HISR & DMA_HISR_TCIF5))
+  {
+    DMA1->HIFCR = DMA_HIFCR_CTCIF5;
+    _render_block(&dac_buffer_arr[BUZZER_DAC_BLOCK_SAMPLES]);
+  }
+}
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file port_effects.c
+ * @brief Portable functions of the tick timer of the light effects.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "port_effects.h"
+#include "port_system.h"
+#include "effects.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define EFFECTS_TIM PORT_TIM(PORT_TIMER_EFFECTS)                          /*!< Tick timer of the effects, owned only by the effects */
+#define EFFECTS_TMR_PSC(timer_hz) (((timer_hz) / EFFECTS_TMR_CLOCK_HZ) - 1) /*!< Prescaler of the tick timer */
+
+/// @brief Check of the tick timer for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _EFFECTS_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) \
+  _Static_assert((PORT_TIMER_CLOCK_HZ(PORT_TIMER_EFFECTS, apb1_timer_hz, apb2_timer_hz) % EFFECTS_TMR_CLOCK_HZ) == 0, "The tick of the effects must be a whole number of timer clock cycles with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_EFFECTS_CLOCK_CHECK)
+
+/* Global variables ------------------------------------------------------------*/
+static volatile uint32_t max_latency_us; /*!< Maximum latency of the interrupt of the tick timer */
+
+/* Private functions */
+
+/// @brief Retime the tick timer after a change of the clock, keeping the phase of the current tick.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+  if (changed)
+  {
+    port_system_timer_set_prescaler(EFFECTS_TIM, EFFECTS_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_EFFECTS)));
+  }
+}
+
+/* Public functions */
+
+void port_effects_init(uint32_t tick_ms)
+{
+  RCC->APB1ENR |= RCC_APB1ENR_TIM7EN;
+  EFFECTS_TIM->CR1 = 0;
+  EFFECTS_TIM->PSC = EFFECTS_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_EFFECTS));
+  EFFECTS_TIM->ARR = (tick_ms * (EFFECTS_TMR_CLOCK_HZ / 1000)) - 1;
+  EFFECTS_TIM->EGR = TIM_EGR_UG;
+  EFFECTS_TIM->SR = ~TIM_SR_UIF;
+  EFFECTS_TIM->DIER |= TIM_DIER_UIE;
+  max_latency_us = 0;
+
+  NVIC_SetPriority(TIM7_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 2, 0)); /* Priority 2: below the infrared timers, above the DAC audio blocks */
+  NVIC_EnableIRQ(TIM7_IRQn);
+  port_system_add_clock_callback(_clock_retime);
+}
+
+void port_effects_start(void)
+{
+  EFFECTS_TIM->CNT = 0;
+  EFFECTS_TIM->SR = ~TIM_SR_UIF;
+  EFFECTS_TIM->CR1 |= TIM_CR1_CEN;
+}
+
+void port_effects_stop(void)
+{
+  EFFECTS_TIM->CR1 &= ~TIM_CR1_CEN;
+  EFFECTS_TIM->SR = ~TIM_SR_UIF;
+  NVIC_ClearPendingIRQ(TIM7_IRQn);
+}
+
+void port_effects_lock(void)
+{
+  NVIC_DisableIRQ(TIM7_IRQn);
+}
+
+void port_effects_unlock(void)
+{
+  NVIC_EnableIRQ(TIM7_IRQn);
+}
+
+uint32_t port_effects_get_max_latency_us(void)
+{
+  return max_latency_us;
+}
+
+void port_effects_reset_latency(void)
+{
+  max_latency_us = 0;
+}
+
+//------------------------------------------------------
+// INTERRUPT SERVICE ROUTINES
+//------------------------------------------------------
+
+/// @brief This function handles the interrupt of the tick timer of the effects. The counter restarts at each tick, so its value on entry is the latency of the interrupt.
+void TIM7_IRQHandler(void)
+{
+  uint32_t latency_us = EFFECTS_TIM->CNT;
+  EFFECTS_TIM->SR = ~TIM_SR_UIF;
+  if (latency_us > max_latency_us)
+  {
+    max_latency_us = latency_us;
+  }
+  effects_tick();
+}
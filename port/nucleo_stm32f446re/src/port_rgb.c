@@ -9,8 +9,28 @@
 /* Includes ------------------------------------------------------------------*/
 /* Standard C includes */
 #include "port_rgb.h"
+
+#if !RGB_WS2812 /* The backend of the chain of addressable LEDs is in port_rgb_ws2812.c */
+
 #include "port_system.h"
 
+/* Defines --------------------------------------------------------------------*/
+#define ALT_FUNC2_TIM3 2 /*!< TIM3 Alternate Function mapping */
+#define ALT_FUNC3_TIM8 3 /*!< TIM8 Alternate Function mapping */
+#define RGB_TIM PORT_TIM(PORT_TIMER_RGB)     /*!< PWM timer of the red and blue LEDs */
+#define RGB_G_TIM PORT_TIM(PORT_TIMER_RGB_G) /*!< PWM timer of the green LED */
+#define RGB_PWM_MODE_CH2 (TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2PE) /*!< PWM mode 1 with preload on channel 2 */
+#define RGB_PWM_MODE_CH1 (TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE) /*!< PWM mode 1 with preload on channel 1 */
+#define RGB_TMR_CLOCK_HZ 16000000U                                                /*!< Counter clock of the PWM timers, or the nearest one the prescaler of TIM3 can get: the PWM stays about 15.6 kHz with all the clocks of the system */
+#define RGB_TMR_DIV(rgb_timer_hz) (((rgb_timer_hz) + (RGB_TMR_CLOCK_HZ / 2)) / RGB_TMR_CLOCK_HZ) /*!< Division of the clock of TIM3 down to the counter clock, rounded */
+#define RGB_TMR_PSC(timer_hz, rgb_timer_hz) (((uint32_t)(((uint64_t)(timer_hz) * RGB_TMR_DIV(rgb_timer_hz)) / (rgb_timer_hz))) - 1) /*!< Prescaler of a PWM timer clocked at `timer_hz` for the counter clock of TIM3, clocked at `rgb_timer_hz`. Both timers count at the same rate, so their periods are equal */
+
+/// @brief Check of the PWM timers for a clock of #PORT_SYSTEM_CLOCKS_MAP: the counter clock of TIM3 must divide the clock of TIM8, or the periods would differ and the channels would drift out of phase.
+#define _RGB_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua)                                                                                                                                           \
+    _Static_assert((((uint64_t)PORT_TIMER_CLOCK_HZ(PORT_TIMER_RGB_G, apb1_timer_hz, apb2_timer_hz) * RGB_TMR_DIV(PORT_TIMER_CLOCK_HZ(PORT_TIMER_RGB, apb1_timer_hz, apb2_timer_hz))) % PORT_TIMER_CLOCK_HZ(PORT_TIMER_RGB, apb1_timer_hz, apb2_timer_hz)) == 0, \
+                   "The PWM timers of the RGB LED must have the same period with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_RGB_CLOCK_CHECK)
+
 /* Typedefs --------------------------------------------------------------------*/
 /**
  * @brief Structure to define the HW dependencies of an RGB LED.
@@ -23,6 +43,11 @@ typedef struct
     uint8_t pin_green;          // Pin/line where the GREEN LED is connected
     GPIO_TypeDef *p_port_blue;  // GPIO where the BLUE LED is connected
     uint8_t pin_blue;           // Pin/line where the BLUE LED is connected
+    volatile uint32_t *p_ccr_red;   // Compare register of the PWM channel of the RED LED
+    volatile uint32_t *p_ccr_green; // Compare register of the PWM channel of the GREEN LED
+    volatile uint32_t *p_ccr_blue;  // Compare register of the PWM channel of the BLUE LED
+    uint8_t levels[3];              // Levels of the color being shown (R, G, B), before the brightness
+    uint8_t brightness;             // Brightness that scales all the channels
 } port_rgb_hw_t;
 
 /* Global variables ------------------------------------------------------------*/
@@ -37,19 +62,162 @@ static port_rgb_hw_t rgb_arr[] = {
         .pin_green = RGB_G_0_PIN,
         .p_port_blue = RGB_B_0_GPIO,
         .pin_blue = RGB_B_0_PIN,
+        .p_ccr_red = &RGB_TIM->CCR1,
+        .p_ccr_green = &RGB_G_TIM->CCR2,
+        .p_ccr_blue = &RGB_TIM->CCR2,
+        .brightness = RGB_LEVEL_MAX,
     }};
 
+/**
+ * @brief Gamma correction (2.2) of the 8-bit levels into compare values of the PWM: round(RGB_PWM_PERIOD * (level / 255)^2.2). Computed offline, so the conversion is a table load. The maximum level is #RGB_PWM_PERIOD, above the auto-reload, so the output is always high, as 0 is always low.
+ */
+static const uint16_t gamma_arr[RGB_LEVEL_MAX + 1] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 2, 2,
+    2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 9, 10,
+    11, 11, 12, 13, 14, 15, 16, 16, 17, 18, 19, 20, 21, 23, 24, 25,
+    26, 27, 28, 30, 31, 32, 34, 35, 36, 38, 39, 41, 42, 44, 46, 47,
+    49, 51, 52, 54, 56, 58, 60, 61, 63, 65, 67, 69, 71, 73, 76, 78,
+    80, 82, 84, 87, 89, 91, 94, 96, 99, 101, 104, 106, 109, 111, 114, 117,
+    119, 122, 125, 128, 131, 133, 136, 139, 142, 145, 148, 152, 155, 158, 161, 164,
+    168, 171, 174, 178, 181, 184, 188, 191, 195, 199, 202, 206, 210, 213, 217, 221,
+    225, 229, 233, 237, 241, 245, 249, 253, 257, 261, 265, 269, 274, 278, 282, 287,
+    291, 296, 300, 305, 309, 314, 319, 323, 328, 333, 338, 342, 347, 352, 357, 362,
+    367, 372, 377, 383, 388, 393, 398, 404, 409, 414, 420, 425, 431, 436, 442, 447,
+    453, 459, 464, 470, 476, 482, 488, 494, 499, 505, 511, 518, 524, 530, 536, 542,
+    548, 555, 561, 568, 574, 580, 587, 593, 600, 607, 613, 620, 627, 634, 640, 647,
+    654, 661, 668, 675, 682, 689, 696, 704, 711, 718, 725, 733, 740, 747, 755, 762,
+    770, 778, 785, 793, 801, 808, 816, 824, 832, 840, 848, 856, 864, 872, 880, 888,
+    896, 904, 913, 921, 929, 938, 946, 955, 963, 972, 980, 989, 998, 1006, 1015, 1024,
+};
+
+_Static_assert(RGB_PWM_PERIOD == 1024, "The gamma table is computed for a PWM period of 1024 counts");
+
+/* Private functions */
+
+/// @brief Configure a PWM timer of the RGB LEDs: period of #RGB_PWM_PERIOD counts, both channels in PWM mode 1 and off.
+/// @param p_tim Pointer to the timer.
+/// @param timer Number of the timer in the timer map.
+static void _timer_pwm_setup(TIM_TypeDef *p_tim, uint32_t timer)
+{
+    p_tim->CR1 = TIM_CR1_ARPE;
+    p_tim->PSC = RGB_TMR_PSC(port_system_get_timer_clock_hz(timer), port_system_get_timer_clock_hz(PORT_TIMER_RGB));
+    p_tim->ARR = RGB_PWM_PERIOD - 1;
+    p_tim->CCR1 = 0;
+    p_tim->CCR2 = 0;
+    p_tim->CCMR1 = RGB_PWM_MODE_CH1 | RGB_PWM_MODE_CH2;
+    p_tim->EGR = TIM_EGR_UG;
+}
+
+/// @brief Write the compare registers with the levels and the brightness of the RGB LED. The three channels change together: the update events of both timers are disabled while the registers are written, so the preloaded values are only transferred at the next update, which both timers reach at the same time (they are started in phase). Otherwise, the green LED (TIM8) could change up to a PWM period before or after the red and blue ones, showing an intermediate color.
+/// @param rgb_id RGB LED ID. This index is used to select the element of the rgb_arr[] array
+static void _update_pwm(uint8_t rgb_id)
+{
+    port_rgb_hw_t *p_rgb = &rgb_arr[rgb_id];
+    volatile uint32_t *p_ccr_arr[3] = {p_rgb->p_ccr_red, p_rgb->p_ccr_green, p_rgb->p_ccr_blue};
+    uint16_t ccr_arr[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        uint32_t level = ((uint32_t)p_rgb->levels[i] * p_rgb->brightness + (RGB_LEVEL_MAX / 2)) / RGB_LEVEL_MAX;
+        ccr_arr[i] = gamma_arr[level];
+    }
+
+    RGB_TIM->CR1 |= TIM_CR1_UDIS;
+    RGB_G_TIM->CR1 |= TIM_CR1_UDIS;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        *p_ccr_arr[i] = ccr_arr[i];
+    }
+    RGB_TIM->CR1 &= ~TIM_CR1_UDIS;
+    RGB_G_TIM->CR1 &= ~TIM_CR1_UDIS;
+}
+
+/// @brief Retime the PWM timers after a change of the clock. At 180 MHz the timer of the green LED has twice the clock of the other one, so it gets twice its prescaler and both keep the same period. The timers count at different rates from the change of the clock until their prescalers are set, so the counter of the green LED is then put back in phase with the other one. TIM8 cannot be reset by TIM3 instead: TIM3 is not one of its internal triggers.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+    if (changed)
+    {
+        uint32_t rgb_timer_hz = port_system_get_timer_clock_hz(PORT_TIMER_RGB);
+        port_system_timer_set_prescaler(RGB_TIM, RGB_TMR_PSC(rgb_timer_hz, rgb_timer_hz));
+        port_system_timer_set_prescaler(RGB_G_TIM, RGB_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_RGB_G), rgb_timer_hz));
+        RGB_G_TIM->CNT = RGB_TIM->CNT; /* Same rate from now on: only the phase lost meanwhile is corrected, within a few cycles */
+    }
+}
+
+/* Public functions */
+
 void port_rgb_init(uint8_t rgb_id)
 {
-    port_system_gpio_config(RGB_R_0_GPIO, RGB_R_0_PIN, GPIO_MODE_OUT, GPIO_PUPDR_NOPULL);
-    port_system_gpio_config(RGB_G_0_GPIO, RGB_G_0_PIN, GPIO_MODE_OUT, GPIO_PUPDR_NOPULL);
-    port_system_gpio_config(RGB_B_0_GPIO, RGB_B_0_PIN, GPIO_MODE_OUT, GPIO_PUPDR_NOPULL);
+    port_rgb_hw_t *p_rgb = &rgb_arr[rgb_id];
+    port_system_gpio_config(p_rgb->p_port_red, p_rgb->pin_red, GPIO_MODE_ALTERNATE, GPIO_PUPDR_NOPULL);
+    port_system_gpio_config_alternate(p_rgb->p_port_red, p_rgb->pin_red, ALT_FUNC2_TIM3);
+    port_system_gpio_config(p_rgb->p_port_green, p_rgb->pin_green, GPIO_MODE_ALTERNATE, GPIO_PUPDR_NOPULL);
+    port_system_gpio_config_alternate(p_rgb->p_port_green, p_rgb->pin_green, ALT_FUNC3_TIM8);
+    port_system_gpio_config(p_rgb->p_port_blue, p_rgb->pin_blue, GPIO_MODE_ALTERNATE, GPIO_PUPDR_NOPULL);
+    port_system_gpio_config_alternate(p_rgb->p_port_blue, p_rgb->pin_blue, ALT_FUNC2_TIM3);
+
+    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+    RCC->APB2ENR |= RCC_APB2ENR_TIM8EN;
+    _timer_pwm_setup(RGB_TIM, PORT_TIMER_RGB);
+    _timer_pwm_setup(RGB_G_TIM, PORT_TIMER_RGB_G);
+    RGB_TIM->CCER |= TIM_CCER_CC1E | TIM_CCER_CC2E;
+    RGB_G_TIM->CCER |= TIM_CCER_CC2E;
+    RGB_G_TIM->BDTR |= TIM_BDTR_MOE; /* TIM8 is an advanced timer: its outputs are only enabled with the main output enable */
+
     port_rgb_set_color(rgb_id, 0, 0, 0);
+    RGB_TIM->CNT = 0;
+    RGB_G_TIM->CNT = 0;
+    RGB_TIM->CR1 |= TIM_CR1_CEN; /* Started back to back, so the counters of both timers are in phase within a few cycles */
+    RGB_G_TIM->CR1 |= TIM_CR1_CEN;
+    port_system_add_clock_callback(_clock_retime);
 }
 
 void port_rgb_set_color(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
 {
-    port_system_gpio_write(rgb_arr[rgb_id].p_port_red, rgb_arr[rgb_id].pin_red, (bool)r);
-    port_system_gpio_write(rgb_arr[rgb_id].p_port_green, rgb_arr[rgb_id].pin_green, (bool)g);
-    port_system_gpio_write(rgb_arr[rgb_id].p_port_blue, rgb_arr[rgb_id].pin_blue, (bool)b);
+    port_rgb_set_level(rgb_id, r ? RGB_LEVEL_MAX : 0, g ? RGB_LEVEL_MAX : 0, b ? RGB_LEVEL_MAX : 0);
+}
+
+void port_rgb_set_level(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
+{
+    rgb_arr[rgb_id].levels[0] = r;
+    rgb_arr[rgb_id].levels[1] = g;
+    rgb_arr[rgb_id].levels[2] = b;
+    _update_pwm(rgb_id);
 }
+
+void port_rgb_set_brightness(uint8_t rgb_id, uint8_t brightness)
+{
+    rgb_arr[rgb_id].brightness = brightness;
+    _update_pwm(rgb_id);
+}
+
+bool port_rgb_check_pwm_activity(uint8_t rgb_id)
+{
+    port_rgb_hw_t *p_rgb = &rgb_arr[rgb_id];
+    volatile uint32_t *p_ccr_arr[3] = {p_rgb->p_ccr_red, p_rgb->p_ccr_green, p_rgb->p_ccr_blue};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        if ((*p_ccr_arr[i] != 0) && (*p_ccr_arr[i] < RGB_PWM_PERIOD))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool port_rgb_check_clock(port_system_clock_t clock)
+{
+    return clock < PORT_SYSTEM_NUM_CLOCKS; /* The timers are checked for all the clocks at compile time */
+}
+
+uint32_t port_rgb_get_current_ua(uint8_t rgb_id)
+{
+    port_rgb_hw_t *p_rgb = &rgb_arr[rgb_id];
+    uint32_t current = 0;
+    current += (RGB_LED_CURRENT_UA * *p_rgb->p_ccr_red) / RGB_PWM_PERIOD;
+    current += (RGB_LED_CURRENT_UA * *p_rgb->p_ccr_green) / RGB_PWM_PERIOD;
+    current += (RGB_LED_CURRENT_UA * *p_rgb->p_ccr_blue) / RGB_PWM_PERIOD;
+    return current;
+}
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file port_rgb_ws2812.c
+ * @brief Backend of the RGB LEDs on a chain of WS2812/SK6812 addressable LEDs: the bitstream is sent from a frame buffer by the DMA through the SPI. The RGB LED ID is the index of the LED in the chain.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 18/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "port_rgb.h"
+
+#if RGB_WS2812 /* The PWM backend is in port_rgb.c */
+
+#include "port_system.h"
+#include "ws2812.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define ALT_FUNC5_SPI2 5                  /*!< SPI2 Alternate Function mapping */
+#define WS2812_SPI SPI2                   /*!< SPI of the bitstream. Only MOSI is used */
+#define WS2812_SPI_BR_MAX 7               /*!< Highest baud rate control of the SPI: fPCLK / 256 */
+#define WS2812_DMA_STREAM DMA1_Stream4    /*!< DMA stream of SPI2_TX */
+#define WS2812_DMA_CHANNEL 0              /*!< DMA channel of SPI2_TX in DMA1 Stream4 */
+#define WS2812_BUFFER_BYTES (WS2812_RESET_BYTES + (RGB_WS2812_NUM_LEDS * WS2812_BYTES_PER_LED)) /*!< Frame buffer: the reset, then the LEDs */
+
+/* Typedefs --------------------------------------------------------------------*/
+/**
+ * @brief Structure to define the color of a LED of the chain.
+ */
+typedef struct
+{
+    uint8_t levels[3]; // Levels of the color being shown (R, G, B), before the brightness
+    uint8_t brightness; // Brightness that scales all the channels
+} port_rgb_led_t;
+
+/* Global variables ------------------------------------------------------------*/
+static port_rgb_led_t leds_arr[RGB_WS2812_NUM_LEDS]; /*!< Colors of the LEDs of the chain */
+static uint8_t frame_arr[WS2812_BUFFER_BYTES];       /*!< Frame buffer read by the DMA. The bytes of the reset are never written, so they stay at 0 */
+static volatile bool busy;                           /*!< Flag of a transfer of the DMA in progress */
+static volatile bool dirty;                          /*!< Flag of a color changed during a transfer, which is sent when it ends */
+static bool initialized;                             /*!< Flag of the SPI and the DMA configured */
+static volatile bool spi_ok;                         /*!< Flag of the SPI at #WS2812_SPI_CLOCK_HZ with the current clock. While it is off the SPI is disabled and the changes of color wait */
+
+/**
+ * @brief Gamma correction (2.2) of the 8-bit levels: round(255 * (level / 255)^2.2). The LEDs dim with a linear PWM of their own, so the correction is applied before sending the color.
+ */
+static const uint8_t gamma_arr[RGB_LEVEL_MAX + 1] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6,
+    6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+    12, 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19,
+    20, 20, 21, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27, 28, 28, 29,
+    30, 30, 31, 32, 33, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41,
+    42, 43, 43, 44, 45, 46, 47, 48, 49, 49, 50, 51, 52, 53, 54, 55,
+    56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+    73, 74, 75, 76, 77, 78, 79, 81, 82, 83, 84, 85, 87, 88, 89, 90,
+    91, 93, 94, 95, 97, 98, 99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+/* Private functions */
+
+/// @brief Return the value sent to a LED for a level: scaled by the brightness and gamma corrected.
+/// @param p_led Pointer to the LED.
+/// @param channel Channel: 0 for RED, 1 for GREEN, 2 for BLUE.
+/// @return uint8_t Value sent to the LED.
+static uint8_t _get_value(const port_rgb_led_t *p_led, uint8_t channel)
+{
+    uint32_t level = ((uint32_t)p_led->levels[channel] * p_led->brightness + (RGB_LEVEL_MAX / 2)) / RGB_LEVEL_MAX;
+    return gamma_arr[level];
+}
+
+/// @brief Encode all the LEDs into the frame buffer and start the transfer of the DMA. The DMA must be stopped.
+static void _start_transfer(void)
+{
+    for (uint8_t i = 0; i < RGB_WS2812_NUM_LEDS; i++)
+    {
+        ws2812_encode_led(&frame_arr[WS2812_RESET_BYTES + (i * WS2812_BYTES_PER_LED)], _get_value(&leds_arr[i], 0), _get_value(&leds_arr[i], 1), _get_value(&leds_arr[i], 2));
+    }
+    dirty = false;
+    busy = true;
+    DMA1->HIFCR = DMA_HIFCR_CTCIF4;
+    WS2812_DMA_STREAM->NDTR = WS2812_BUFFER_BYTES;
+    WS2812_DMA_STREAM->CR |= DMA_SxCR_EN;
+}
+
+/// @brief Send the colors to the chain. If a transfer is in progress, the frame buffer is not touched and the colors are sent when it ends, so a LED never receives half of a color. If the SPI cannot run at the clock of the system, the colors are sent when it can again.
+static void _refresh(void)
+{
+    NVIC_DisableIRQ(DMA1_Stream4_IRQn);
+    if (busy || !spi_ok)
+    {
+        dirty = true;
+    }
+    else
+    {
+        _start_transfer();
+    }
+    NVIC_EnableIRQ(DMA1_Stream4_IRQn);
+}
+
+/// @brief Find the baud rate control of the SPI that divides a clock of APB1 down to exactly #WS2812_SPI_CLOCK_HZ. The bitstream has no margin for another rate: 4 MHz is reached from 16 MHz (HSI) and 32 MHz (PLL at 64 MHz), but not from the 42 or 45 MHz of APB1 with the PLL at 84 or 180 MHz.
+/// @param pclk_hz Clock of APB1.
+/// @param p_br Pointer to store the baud rate control.
+/// @return true
+/// @return false if no division of the clock gives the rate
+static bool _spi_get_baud_rate(uint32_t pclk_hz, uint32_t *p_br)
+{
+    uint32_t br = 0;
+    while ((br < WS2812_SPI_BR_MAX) && ((pclk_hz >> (br + 1)) > WS2812_SPI_CLOCK_HZ))
+    {
+        br++;
+    }
+    *p_br = br;
+    return ((pclk_hz >> (br + 1)) == WS2812_SPI_CLOCK_HZ) && ((pclk_hz & ((2UL << br) - 1)) == 0);
+}
+
+/// @brief Set the baud rate of the SPI for the clock of APB1 and enable it, if it can run with it. Otherwise the SPI is left disabled; `fsm_retina_set_clocks()` refuses those clocks with `port_rgb_check_clock()`, so it only happens if the clock is set by other means.
+static void _spi_set_baud_rate(void)
+{
+    uint32_t br;
+    WS2812_SPI->CR1 &= ~SPI_CR1_SPE; /* The baud rate is only changed with the SPI disabled */
+    spi_ok = _spi_get_baud_rate(port_system_get_apb1_clock_hz(), &br);
+    if (spi_ok)
+    {
+        MODIFY_REG(WS2812_SPI->CR1, SPI_CR1_BR, br << SPI_CR1_BR_Pos);
+        WS2812_SPI->CR1 |= SPI_CR1_SPE;
+    }
+}
+
+/// @brief Retime the SPI around a change of the clock. Before it, the transfer in progress is finished, as its bits would change their length; after it, the baud rate is set again and the colors changed meanwhile are sent.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+    if (!changed)
+    {
+        while (WS2812_DMA_STREAM->CR & DMA_SxCR_EN) /* The interrupts are masked, so the end of the transfer is handled after the change */
+        {
+        }
+        while (!(WS2812_SPI->SR & SPI_SR_TXE) || (WS2812_SPI->SR & SPI_SR_BSY))
+        {
+        }
+        return;
+    }
+    _spi_set_baud_rate();
+    if (spi_ok && dirty && !busy)
+    {
+        _start_transfer();
+    }
+}
+
+/// @brief Configure the SPI as a transmit-only master fed by the DMA, and the DMA to copy the frame buffer into it.
+static void _spi_dma_setup(void)
+{
+    RCC->APB1ENR |= RCC_APB1ENR_SPI2EN;
+    WS2812_SPI->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI; /* 8-bit frames, MSB first, CPOL = CPHA = 0 */
+    WS2812_SPI->CR2 = SPI_CR2_TXDMAEN;
+    _spi_set_baud_rate();
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+    WS2812_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while (WS2812_DMA_STREAM->CR & DMA_SxCR_EN)
+    {
+    }
+    WS2812_DMA_STREAM->PAR = (uint32_t)&WS2812_SPI->DR;
+    WS2812_DMA_STREAM->M0AR = (uint32_t)frame_arr;
+    WS2812_DMA_STREAM->CR = (WS2812_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE; /* Memory to peripheral, 8-bit, normal mode */
+    DMA1->HIFCR = DMA_HIFCR_CTCIF4;
+
+    NVIC_SetPriority(DMA1_Stream4_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0)); /* Priority 3: a late refresh is not visible */
+    NVIC_EnableIRQ(DMA1_Stream4_IRQn);
+}
+
+/* Public functions */
+
+void port_rgb_init(uint8_t rgb_id)
+{
+    if (!initialized)
+    {
+        port_system_gpio_config(RGB_WS2812_0_GPIO, RGB_WS2812_0_PIN, GPIO_MODE_ALTERNATE, GPIO_PUPDR_PDOWN); /* Low while the SPI is off, as the reset */
+        port_system_gpio_config_alternate(RGB_WS2812_0_GPIO, RGB_WS2812_0_PIN, ALT_FUNC5_SPI2);
+        for (uint8_t i = 0; i < RGB_WS2812_NUM_LEDS; i++)
+        {
+            leds_arr[i].brightness = RGB_LEVEL_MAX;
+        }
+        busy = false;
+        dirty = false;
+        _spi_dma_setup();
+        port_system_add_clock_callback(_clock_retime);
+        initialized = true;
+    }
+    port_rgb_set_color(rgb_id, 0, 0, 0);
+}
+
+void port_rgb_set_color(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
+{
+    port_rgb_set_level(rgb_id, r ? RGB_LEVEL_MAX : 0, g ? RGB_LEVEL_MAX : 0, b ? RGB_LEVEL_MAX : 0);
+}
+
+void port_rgb_set_level(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
+{
+    if (rgb_id >= RGB_WS2812_NUM_LEDS)
+    {
+        return;
+    }
+    leds_arr[rgb_id].levels[0] = r;
+    leds_arr[rgb_id].levels[1] = g;
+    leds_arr[rgb_id].levels[2] = b;
+    _refresh();
+}
+
+void port_rgb_set_brightness(uint8_t rgb_id, uint8_t brightness)
+{
+    if (rgb_id >= RGB_WS2812_NUM_LEDS)
+    {
+        return;
+    }
+    leds_arr[rgb_id].brightness = brightness;
+    _refresh();
+}
+
+bool port_rgb_check_pwm_activity(uint8_t rgb_id)
+{
+    (void)rgb_id;
+    return busy; /* The LEDs keep their colors by themselves; only a transfer needs the clocks */
+}
+
+bool port_rgb_check_clock(port_system_clock_t clock)
+{
+    uint32_t br;
+    return (clock < PORT_SYSTEM_NUM_CLOCKS) && _spi_get_baud_rate(port_system_get_clock_apb1_hz(clock), &br);
+}
+
+uint32_t port_rgb_get_current_ua(uint8_t rgb_id)
+{
+    if (rgb_id >= RGB_WS2812_NUM_LEDS)
+    {
+        return 0;
+    }
+    uint32_t current = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        current += (RGB_WS2812_CURRENT_UA * _get_value(&leds_arr[rgb_id], i)) / RGB_LEVEL_MAX;
+    }
+    return current;
+}
+
+//------------------------------------------------------
+// INTERRUPT SERVICE ROUTINES
+//------------------------------------------------------
+
+/// @brief This function handles the interrupt of DMA1 Stream4: the frame buffer has been sent. If a color changed meanwhile, the next frame is sent at once; it starts with the reset, which latches the previous one.
+void DMA1_Stream4_IRQHandler(void)
+{
+    if (DMA1->HISR & DMA_HISR_TCIF4)
+    {
+        DMA1->HIFCR = DMA_HIFCR_CTCIF4;
+        busy = false;
+        if (dirty && spi_ok)
+        {
+            _start_transfer();
+        }
+    }
+}
+
+#endif
@@ -14,6 +14,16 @@
 #include "port_rx.h"
 #include "port_system.h"
 #include "fsm_rx_nec.h"
+#include "latency.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define RX_TIM PORT_TIM(PORT_TIMER_RX_TICK) /*!< Time base of the edges, owned only by the receivers */
+#define RX_TMR_PSC(timer_hz) (((timer_hz) / 1000000 * NEC_RX_TIMER_TICK_BASE_US) - 1) /*!< Prescaler of the time base: one count is one tick of #NEC_RX_TIMER_TICK_BASE_US */
+
+/// @brief Check of the time base for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _RX_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) \
+  _Static_assert(RX_TMR_PSC(PORT_TIMER_CLOCK_HZ(PORT_TIMER_RX_TICK, apb1_timer_hz, apb2_timer_hz)) <= 0xFFFF, "The prescaler of the time base does not fit in 16 bits with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_RX_CLOCK_CHECK)
 
 /* Typedefs --------------------------------------------------------------------*/
 /**
@@ -25,6 +35,8 @@ typedef struct
   uint8_t pin;                          // Pin/line where the infrared transmitter is connected
   uint16_t edge_ticks[NEC_FRAME_EDGES]; // Array to store the time ticks of the edges detected by the infrared receiver. It size must be larger or equal than the number of expected edges of the NEC protocol.
   uint16_t edge_idx;                    // Index to go though the edge_ticks array.
+  volatile uint64_t last_edge_us;       // Time of the last edge stored, as port_system_get_micros64().
+  bool loopback;                        // Ignore the GPIO and take the edges injected by the infrared transmitter.
 } port_rx_hw_t;
 
 /* Global variables ------------------------------------------------------------*/
@@ -32,7 +44,7 @@ typedef struct
  * @brief Array of elements that represents the HW characteristics of the infrared receivers.
  */
 static port_rx_hw_t receivers_arr[] = {
-    [IR_RX_0_ID] = {.p_port = IR_RX_0_GPIO, .pin = IR_RX_0_PIN}};
+    [IR_RX_0_ID] = {.p_port = IR_RX_0_GPIO, .pin = IR_RX_0_PIN, .loopback = false}};
 
 /* Infrared receiver private functions */
 /**
@@ -57,8 +69,10 @@ static void _store_edge_tick(uint8_t rx_id)
     return;
   if (edges_idx < NEC_FRAME_EDGES)
   {
-    receivers_arr[rx_id].edge_ticks[edges_idx] = TIM3->CNT;
+    receivers_arr[rx_id].edge_ticks[edges_idx] = RX_TIM->CNT;
+    receivers_arr[rx_id].last_edge_us = port_system_get_micros64();
     receivers_arr[rx_id].edge_idx++;
+    LATENCY_MARK(LATENCY_LAST_EDGE);
   }
   else
   {
@@ -69,16 +83,27 @@ static void _store_edge_tick(uint8_t rx_id)
 /// @brief Configure the timer tick. This timer sets the basis for tick counting for checking received NEC symbols.
 void _timer_rx_setup()
 {
-  RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
-  TIM3->CNT = 0;
-  TIM3->ARR = 65535;
-  TIM3->PSC = (SystemCoreClock * NEC_RX_TIMER_TICK_BASE_US / 1000000) - 1;
-  TIM3->EGR = TIM_EGR_UG;
+  RCC->APB1ENR |= RCC_APB1ENR_TIM12EN;
+  RX_TIM->CNT = 0;
+  RX_TIM->ARR = 65535;
+  RX_TIM->PSC = RX_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_RX_TICK));
+  RX_TIM->EGR = TIM_EGR_UG;
+}
+
+/// @brief Retime the time base after a change of the clock. The new prescaler is loaded at once and the count is kept, so a frame being received keeps its ticks.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+  if (changed)
+  {
+    port_system_timer_set_prescaler(RX_TIM, RX_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_RX_TICK)));
+  }
 }
 
 void port_rx_init(uint8_t rx_id)
 {
   _timer_rx_setup();
+  port_system_add_clock_callback(_clock_retime);
   port_system_gpio_config(receivers_arr[rx_id].p_port, receivers_arr[rx_id].pin, GPIO_MODE_IN, GPIO_PUPDR_NOPULL);
   port_system_gpio_config_exti(receivers_arr[rx_id].p_port, receivers_arr[rx_id].pin, (TRIGGER_BOTH_EDGE | TRIGGER_ENABLE_INTERR_REQ));
   port_system_gpio_exti_enable(receivers_arr[rx_id].pin, 2, 0);
@@ -100,13 +125,13 @@ void port_rx_en(uint8_t rx_id, bool interr_en)
 
 void port_rx_tmr_start()
 {
-  TIM3->CNT = 0;
-  TIM3->CR1 |= TIM_CR1_CEN;
+  RX_TIM->CNT = 0;
+  RX_TIM->CR1 |= TIM_CR1_CEN;
 }
 
 void port_rx_tmr_stop()
 {
-  TIM3->CR1 &= ~TIM_CR1_CEN;
+  RX_TIM->CR1 &= ~TIM_CR1_CEN;
 }
 
 uint32_t port_rx_get_num_edges(uint8_t rx_id)
@@ -124,6 +149,33 @@ void port_rx_clean_buffer(uint8_t rx_id)
   _reset_edge_ticks_idx(rx_id);
 }
 
+uint64_t port_rx_get_last_edge_us(uint8_t rx_id)
+{
+  uint64_t last_edge_us;
+  do
+  {
+    last_edge_us = receivers_arr[rx_id].last_edge_us;
+  } while (last_edge_us != receivers_arr[rx_id].last_edge_us); /* The interrupt of an edge may write it between the two halves of a read */
+  return last_edge_us;
+}
+
+void port_rx_set_loopback(uint8_t rx_id, bool enable)
+{
+  receivers_arr[rx_id].loopback = enable;
+}
+
+void port_rx_inject_edge(uint8_t rx_id)
+{
+  uint16_t edges_idx = receivers_arr[rx_id].edge_idx;
+  if (receivers_arr[rx_id].loopback && (edges_idx < NEC_FRAME_EDGES))
+  {
+    receivers_arr[rx_id].edge_ticks[edges_idx] = RX_TIM->CNT;
+    receivers_arr[rx_id].last_edge_us = port_system_get_micros64();
+    receivers_arr[rx_id].edge_idx++;
+    LATENCY_MARK(LATENCY_LAST_EDGE);
+  }
+}
+
 /// @brief This function handles Px5-Px9 global interrupts.
 void EXTI9_5_IRQHandler(void)
 {
@@ -131,6 +183,9 @@ void EXTI9_5_IRQHandler(void)
   if (EXTI->PR & BIT_POS_TO_MASK(receivers_arr[IR_RX_0_ID].pin))
   {
     EXTI->PR |= BIT_POS_TO_MASK(receivers_arr[IR_RX_0_ID].pin); /* Limpiar flag , escribiendo un 1 */
-    _store_edge_tick(IR_RX_0_ID);
+    if (!receivers_arr[IR_RX_0_ID].loopback)
+    {
+      _store_edge_tick(IR_RX_0_ID);
+    }
   }
 }
@@ -2,7 +2,8 @@
  * @file port_sensor.c
  * @brief File containing portable functions related to the HW of the light sensor .
  *
- * This files defines an internal struct which coontains the HW information of the
+ * The photoresistor is sampled by the ADC, triggered by a timer, and the DMA copies the samples into a circular buffer. Each half of the buffer is averaged and filtered in the interrupt of the DMA, so reading the sensor is only reading the filtered value.
+ * The changes of light are detected by the analog watchdog of the ADC, which interrupts when a conversion crosses the threshold of the state, and confirmed after a debounce time counted in half buffers, so the pace is the one of the trigger timer. In stop mode the ADC is off: the pin is switched to a digital input whose EXTI wakes the system up.
  *
  * @author Hernán García Quijano
  * @author Ángel Rodrigo Pérez Iglesias
@@ -12,31 +13,337 @@
 /* Includes ------------------------------------------------------------------*/
 #include "port_sensor.h"
 
+/* Defines --------------------------------------------------------------------*/
+#define SENSOR_TIM PORT_TIM(PORT_TIMER_SENSOR)                       /*!< Trigger timer of the ADC, owned only by the sensor */
+#define SENSOR_TMR_CLOCK_HZ 100000                                  /*!< Counter clock of the trigger timer */
+#define SENSOR_TMR_PSC(timer_hz) (((timer_hz) / SENSOR_TMR_CLOCK_HZ) - 1) /*!< Prescaler of the trigger timer */
+#define SENSOR_ADC_CLOCK_MAX_HZ 36000000                            /*!< Maximum clock of the ADC at 3.3 V */
+#define SENSOR_ADCPRE_DIV4 0x1                                      /*!< ADC prescaler PCLK2 / 4: within the maximum clock of the ADC with all the clocks of the system */
+#define SENSOR_ADC_EXTSEL_TIM5_CC1 0xA                              /*!< ADC external trigger selection: TIM5 CC1 event */
+#define SENSOR_ADC_SMP_480 0x7                                      /*!< Sample time of 480 ADC cycles: the photoresistor divider has a high impedance */
+#define SENSOR_DMA_STREAM DMA2_Stream0                              /*!< DMA stream of ADC1 */
+#define SENSOR_DMA_CHANNEL 0                                        /*!< DMA channel of ADC1 in DMA2 Stream0 */
+#define SENSOR_HALF_SAMPLES (SENSOR_BUFFER_SAMPLES / 2)             /*!< Samples averaged at each interrupt of the DMA */
+#define SENSOR_FILTER_FRAC 4                                        /*!< Fractional bits of the filtered value (Q4) */
+#define SENSOR_DEBOUNCE_BLOCKS(rate_hz) ((((SENSOR_DEBOUNCE_MS * (rate_hz)) / (1000 * SENSOR_HALF_SAMPLES)) > 0) ? ((SENSOR_DEBOUNCE_MS * (rate_hz)) / (1000 * SENSOR_HALF_SAMPLES)) : 1) /*!< Half buffers of the debounce time at a sample rate, at least 1 */
+
+_Static_assert((SENSOR_HALF_SAMPLES & (SENSOR_HALF_SAMPLES - 1)) == 0, "The mean of half buffer is a shift: the number of samples must be a power of 2");
+
+/// @brief Check of the trigger timer for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _SENSOR_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua)                                                                                 \
+    _Static_assert((PORT_TIMER_CLOCK_HZ(PORT_TIMER_SENSOR, apb1_timer_hz, apb2_timer_hz) % SENSOR_TMR_CLOCK_HZ) == 0, "The trigger period must be a whole number of timer clock cycles with the clock " #name); \
+    _Static_assert(SENSOR_TMR_PSC(PORT_TIMER_CLOCK_HZ(PORT_TIMER_SENSOR, apb1_timer_hz, apb2_timer_hz)) <= 0xFFFF, "The prescaler of the trigger timer does not fit in 16 bits with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_SENSOR_CLOCK_CHECK)
+
 /* Typedefs --------------------------------------------------------------------*/
 
 /// @brief Structure to define the HW dependencies of a light sensor.
 typedef struct
 {
-    GPIO_TypeDef *p_port; /*!< GPIO where the sensor is connected */
-    uint8_t pin;          /*!< Pin/line where the sensor is connected */
+    GPIO_TypeDef *p_port;  /*!< GPIO where the sensor is connected */
+    uint8_t pin;           /*!< Pin/line where the sensor is connected */
+    uint8_t adc_channel;   /*!< ADC channel of the pin */
+    volatile uint32_t filtered; /*!< Filtered value in Q4, updated by the interrupt of the DMA */
+    volatile bool filter_ready; /*!< Flag of the filter initialized with a first mean */
+    volatile bool no_light;     /*!< Debounced state of the light: true if there is no light */
+    uint32_t no_light_enter;    /*!< Value from which there is no light */
+    uint32_t no_light_exit;     /*!< Value below which there is light again */
+    volatile uint32_t debounce_left; /*!< Half buffers left to confirm a crossing of the threshold, 0 if none is being debounced */
+    uint32_t debounce_blocks;   /*!< Half buffers of the debounce time at the current sample rate */
+    volatile uint32_t sampled_us; /*!< Time covered by the samples filtered, in us. It only advances while sampling */
+    uint32_t block_us;          /*!< Time covered by half of the buffer at the current sample rate, in us */
 } port_sensor_hw_t;
 
 /* Global variables ------------------------------------------------------------*/
 
 /// @brief Array of elements that represents the HW characteristics of the sensors.
 static port_sensor_hw_t sensors_arr[] = {
-    [SENSOR_0_ID] = {.p_port = SENSOR_0_GPIO, .pin = SENSOR_0_PIN},
+    [SENSOR_0_ID] = {.p_port = SENSOR_0_GPIO, .pin = SENSOR_0_PIN, .adc_channel = SENSOR_0_ADC_CHANNEL, .no_light_enter = SENSOR_NO_LIGHT_ENTER, .no_light_exit = SENSOR_NO_LIGHT_EXIT},
 };
 
+static uint16_t samples_arr[SENSOR_BUFFER_SAMPLES]; /*!< Circular buffer of samples written by the DMA */
+
+/* Private functions */
+
+/// @brief Configure the trigger timer of the ADC: a compare event of channel 1 each sample period. The channel has no output pin.
+/// @param rate_hz Sample rate.
+static void _timer_trigger_setup(uint32_t rate_hz)
+{
+    RCC->APB1ENR |= RCC_APB1ENR_TIM5EN;
+    SENSOR_TIM->CR1 = 0;
+    SENSOR_TIM->PSC = SENSOR_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_SENSOR));
+    SENSOR_TIM->ARR = (SENSOR_TMR_CLOCK_HZ / rate_hz) - 1;
+    SENSOR_TIM->CCR1 = (SENSOR_TMR_CLOCK_HZ / rate_hz) / 2;
+    SENSOR_TIM->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1; /* PWM mode 1: a rising edge of OC1REF each period */
+    SENSOR_TIM->CCER |= TIM_CCER_CC1E;
+    SENSOR_TIM->EGR = TIM_EGR_UG;
+}
+
+/// @brief Configure the DMA to copy the conversions into the circular buffer, with an interrupt at each half of the buffer.
+static void _dma_setup(void)
+{
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+    SENSOR_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while (SENSOR_DMA_STREAM->CR & DMA_SxCR_EN)
+    {
+    }
+    SENSOR_DMA_STREAM->PAR = (uint32_t)&ADC1->DR;
+    SENSOR_DMA_STREAM->M0AR = (uint32_t)samples_arr;
+    SENSOR_DMA_STREAM->NDTR = SENSOR_BUFFER_SAMPLES;
+    SENSOR_DMA_STREAM->CR = (SENSOR_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE; /* Peripheral to memory, 16-bit, circular */
+    DMA2->LIFCR = DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTCIF0;
+
+    NVIC_SetPriority(DMA2_Stream0_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0)); /* Priority 3: the light changes slowly */
+    NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+/// @brief Set the prescaler of the ADC clock: the lowest division of PCLK2 within #SENSOR_ADC_CLOCK_MAX_HZ, so the conversions of 480 cycles stay short enough for #SENSOR_SAMPLE_RATE_MAX_HZ at 16 MHz.
+static void _adc_set_prescaler(void)
+{
+    uint32_t adcpre = 0; /* PCLK2 / 2, 4, 6 or 8 */
+    while (((port_system_get_apb2_clock_hz() / (2 * (adcpre + 1))) > SENSOR_ADC_CLOCK_MAX_HZ) && (adcpre < 3))
+    {
+        adcpre++;
+    }
+    MODIFY_REG(ADC123_COMMON->CCR, ADC_CCR_ADCPRE, adcpre << ADC_CCR_ADCPRE_Pos);
+}
+
+/// @brief Configure the ADC to convert the channel of the sensor at each trigger and request the DMA.
+/// @param adc_channel ADC channel.
+static void _adc_setup(uint8_t adc_channel)
+{
+    RCC->APB2ENR |= RCC_APB2ENR_ADC1EN;
+    _adc_set_prescaler();
+    ADC1->CR1 = ADC_CR1_AWDEN | ADC_CR1_AWDSGL | (adc_channel & ADC_CR1_AWDCH); /* 12-bit resolution, analog watchdog on the channel of the sensor */
+    ADC1->SMPR2 = (ADC1->SMPR2 & ~(0x7UL << (3 * adc_channel))) | (SENSOR_ADC_SMP_480 << (3 * adc_channel));
+    ADC1->SQR1 = 0; /* One conversion */
+    ADC1->SQR3 = adc_channel;
+    ADC1->CR2 = ADC_CR2_EXTEN_0 | (SENSOR_ADC_EXTSEL_TIM5_CC1 << ADC_CR2_EXTSEL_Pos) | ADC_CR2_DMA | ADC_CR2_DDS | ADC_CR2_ADON; /* Rising edge of the trigger, DMA requests in circular mode */
+
+    NVIC_SetPriority(ADC_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0));
+    NVIC_EnableIRQ(ADC_IRQn);
+}
+
+/// @brief Arm the analog watchdog with the threshold that leaves the current state: the one to enter the no light state while there is light, and the one to exit it while there is no light.
+/// @param p_sensor Pointer to the sensor.
+static void _watchdog_arm(port_sensor_hw_t *p_sensor)
+{
+    if (p_sensor->no_light)
+    {
+        ADC1->LTR = p_sensor->no_light_exit;
+        ADC1->HTR = SENSOR_VALUE_MAX;
+    }
+    else
+    {
+        ADC1->LTR = 0;
+        ADC1->HTR = p_sensor->no_light_enter;
+    }
+    ADC1->SR = ~ADC_SR_AWD;
+    ADC1->CR1 |= ADC_CR1_AWDIE;
+}
+
+/// @brief Finish the debounce of a crossing of the threshold: the state changes only if the filtered value is still beyond the threshold. Then the watchdog is armed again.
+/// @param p_sensor Pointer to the sensor.
+static void _debounce_end(port_sensor_hw_t *p_sensor)
+{
+    uint32_t value = p_sensor->filtered >> SENSOR_FILTER_FRAC;
+    if (!p_sensor->no_light && (value >= p_sensor->no_light_enter))
+    {
+        p_sensor->no_light = true;
+    }
+    else if (p_sensor->no_light && (value <= p_sensor->no_light_exit))
+    {
+        p_sensor->no_light = false;
+    }
+    _watchdog_arm(p_sensor);
+}
+
+/// @brief Start sampling: the pin in analog mode, the ADC, the DMA and the trigger timer.
+/// @param p_sensor Pointer to the sensor.
+static void _sampling_start(port_sensor_hw_t *p_sensor)
+{
+    port_system_gpio_config(p_sensor->p_port, p_sensor->pin, GPIO_MODE_ANALOG, GPIO_PUPDR_NOPULL);
+    p_sensor->filter_ready = false;
+    p_sensor->debounce_left = 0;
+    _dma_setup();
+    _adc_setup(p_sensor->adc_channel);
+    _watchdog_arm(p_sensor);
+    SENSOR_DMA_STREAM->CR |= DMA_SxCR_EN;
+    SENSOR_TIM->CNT = 0;
+    SENSOR_TIM->CR1 |= TIM_CR1_CEN;
+}
+
+/// @brief Update the filter of a sensor with the mean of half of the circular buffer.
+/// @param p_sensor Pointer to the sensor.
+/// @param p_samples Pointer to the half of the buffer.
+static void _filter_update(port_sensor_hw_t *p_sensor, const uint16_t *p_samples)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < SENSOR_HALF_SAMPLES; i++)
+    {
+        sum += p_samples[i];
+    }
+    uint32_t mean = (sum << SENSOR_FILTER_FRAC) / SENSOR_HALF_SAMPLES; /* Q4 */
+    p_sensor->sampled_us += p_sensor->block_us;
+    if (!p_sensor->filter_ready)
+    {
+        p_sensor->filtered = mean;
+        p_sensor->filter_ready = true;
+        return;
+    }
+    p_sensor->filtered = (uint32_t)((int32_t)p_sensor->filtered + (((int32_t)mean - (int32_t)p_sensor->filtered) >> SENSOR_FILTER_SHIFT));
+}
+
+/// @brief Retime the sensor around a change of the clock. Before it, the ADC clock goes to PCLK2 / 4, valid with the old and the new clocks; after it, the trigger timer gets its prescaler and the ADC its lowest division again. A conversion in progress may get a few ADC cycles of the other prescaler, which only changes its sample time.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+    if (!changed)
+    {
+        MODIFY_REG(ADC123_COMMON->CCR, ADC_CCR_ADCPRE, SENSOR_ADCPRE_DIV4 << ADC_CCR_ADCPRE_Pos);
+        return;
+    }
+    port_system_timer_set_prescaler(SENSOR_TIM, SENSOR_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_SENSOR)));
+    _adc_set_prescaler();
+}
+
+/* Public functions */
+
 void port_sensor_init(uint32_t sensor_id)
 {
-    port_system_gpio_config(sensors_arr[sensor_id].p_port, sensors_arr[sensor_id].pin, GPIO_MODE_IN, GPIO_PUPDR_NOPULL);                        // input, no-pulls
-    port_system_gpio_config_exti(sensors_arr[sensor_id].p_port, sensors_arr[sensor_id].pin, (TRIGGER_RISING_EDGE | TRIGGER_ENABLE_INTERR_REQ)); // ???????????
-    port_system_gpio_exti_enable(sensors_arr[sensor_id].pin, 1, 0);
+    port_sensor_hw_t *p_sensor = &sensors_arr[sensor_id];
+    p_sensor->filtered = 0;
+    p_sensor->no_light = false;
+    p_sensor->debounce_blocks = SENSOR_DEBOUNCE_BLOCKS(SENSOR_SAMPLE_RATE_HZ);
+    p_sensor->sampled_us = 0;
+    p_sensor->block_us = (SENSOR_HALF_SAMPLES * 1000000UL) / SENSOR_SAMPLE_RATE_HZ;
+    _timer_trigger_setup(SENSOR_SAMPLE_RATE_HZ);
+    _sampling_start(p_sensor);
+    port_system_add_clock_callback(_clock_retime);
 }
 
 uint32_t port_sensor_get_value(uint32_t sensor_id)
 {
-    uint32_t value = port_system_gpio_read(sensors_arr[SENSOR_0_ID].p_port, sensors_arr[SENSOR_0_ID].pin);
-    return value;
+    return sensors_arr[sensor_id].filtered >> SENSOR_FILTER_FRAC;
+}
+
+bool port_sensor_set_sample_rate(uint32_t sensor_id, uint32_t rate_hz)
+{
+    if ((sensor_id != SENSOR_0_ID) || (rate_hz < SENSOR_SAMPLE_RATE_MIN_HZ) || (rate_hz > SENSOR_SAMPLE_RATE_MAX_HZ))
+    {
+        return false;
+    }
+    sensors_arr[sensor_id].debounce_blocks = SENSOR_DEBOUNCE_BLOCKS(rate_hz);
+    sensors_arr[sensor_id].block_us = (SENSOR_HALF_SAMPLES * 1000000UL) / rate_hz;
+    SENSOR_TIM->ARR = (SENSOR_TMR_CLOCK_HZ / rate_hz) - 1;
+    SENSOR_TIM->CCR1 = (SENSOR_TMR_CLOCK_HZ / rate_hz) / 2;
+    if (SENSOR_TIM->CNT > SENSOR_TIM->ARR)
+    {
+        SENSOR_TIM->EGR = TIM_EGR_UG; /* Restart the period if the counter is already past the new one */
+    }
+    return true;
+}
+
+uint32_t port_sensor_get_sampled_us(uint32_t sensor_id)
+{
+    return sensors_arr[sensor_id].sampled_us;
+}
+
+bool port_sensor_get_no_light(uint32_t sensor_id)
+{
+    return sensors_arr[sensor_id].no_light;
+}
+
+bool port_sensor_set_thresholds(uint32_t sensor_id, uint32_t no_light_enter, uint32_t no_light_exit)
+{
+    if ((sensor_id != SENSOR_0_ID) || (no_light_exit >= no_light_enter) || (no_light_enter > SENSOR_VALUE_MAX))
+    {
+        return false;
+    }
+    port_sensor_hw_t *p_sensor = &sensors_arr[sensor_id];
+    NVIC_DisableIRQ(ADC_IRQn);
+    p_sensor->no_light_enter = no_light_enter;
+    p_sensor->no_light_exit = no_light_exit;
+    if (p_sensor->debounce_left == 0)
+    {
+        _watchdog_arm(p_sensor);
+    }
+    NVIC_EnableIRQ(ADC_IRQn);
+    return true;
+}
+
+bool port_sensor_set_low_power(uint32_t sensor_id, bool enable)
+{
+    port_sensor_hw_t *p_sensor = &sensors_arr[sensor_id];
+    if (!enable)
+    {
+        port_system_gpio_exti_disable(p_sensor->pin);
+        EXTI->IMR &= ~BIT_POS_TO_MASK(p_sensor->pin);
+        EXTI->PR = BIT_POS_TO_MASK(p_sensor->pin);
+        _sampling_start(p_sensor);
+        return true;
+    }
+
+    SENSOR_TIM->CR1 &= ~TIM_CR1_CEN;
+    ADC1->CR2 &= ~ADC_CR2_ADON;
+    SENSOR_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    port_system_gpio_config(p_sensor->p_port, p_sensor->pin, GPIO_MODE_IN, GPIO_PUPDR_NOPULL);
+    if (port_system_gpio_read(p_sensor->p_port, p_sensor->pin) != p_sensor->no_light)
+    {
+        _sampling_start(p_sensor); /* The pin is already past its input threshold, so the edge that should wake the system up may never come */
+        return false;
+    }
+    port_system_gpio_config_exti(p_sensor->p_port, p_sensor->pin, TRIGGER_BOTH_EDGE | TRIGGER_ENABLE_INTERR_REQ);
+    EXTI->PR = BIT_POS_TO_MASK(p_sensor->pin);
+    port_system_gpio_exti_enable(p_sensor->pin, 3, 0);
+    return true;
+}
+
+//------------------------------------------------------
+// INTERRUPT SERVICE ROUTINES
+//------------------------------------------------------
+
+/// @brief This function handles the interrupts of DMA2 Stream0. When half of the buffer has been written, its mean updates the filter while the DMA writes the other half.
+void DMA2_Stream0_IRQHandler(void)
+{
+    if (DMA2->LISR & DMA_LISR_HTIF0)
+    {
+        DMA2->LIFCR = DMA_LIFCR_CHTIF0;
+        _filter_update(&sensors_arr[SENSOR_0_ID], &samples_arr[0]);
+    }
+    if (DMA2->LISR & DMA_LISR_TCIF0)
+    {
+        DMA2->LIFCR = DMA_LIFCR_CTCIF0;
+        _filter_update(&sensors_arr[SENSOR_0_ID], &samples_arr[SENSOR_HALF_SAMPLES]);
+    }
+    port_sensor_hw_t *p_sensor = &sensors_arr[SENSOR_0_ID];
+    if (p_sensor->debounce_left > 0)
+    {
+        p_sensor->debounce_left--;
+        if (p_sensor->debounce_left == 0)
+        {
+            _debounce_end(p_sensor);
+        }
+    }
+}
+
+/// @brief This function handles the interrupt of the ADC: the analog watchdog has seen a conversion beyond the threshold of the state. The watchdog is disarmed and the crossing is debounced by the interrupt of the DMA.
+void ADC_IRQHandler(void)
+{
+    if (ADC1->SR & ADC_SR_AWD)
+    {
+        ADC1->CR1 &= ~ADC_CR1_AWDIE;
+        ADC1->SR = ~ADC_SR_AWD;
+        sensors_arr[SENSOR_0_ID].debounce_left = sensors_arr[SENSOR_0_ID].debounce_blocks;
+    }
+}
+
+/// @brief This function handles the interrupt of the EXTI line of the sensor, only enabled in stop mode: the light has changed and the system wakes up to sample it again.
+void EXTI0_IRQHandler(void)
+{
+    port_system_systick_resume();
+    if (EXTI->PR & BIT_POS_TO_MASK(SENSOR_0_PIN))
+    {
+        EXTI->PR = BIT_POS_TO_MASK(SENSOR_0_PIN); /* Clear the flag by writing a 1 */
+    }
 }
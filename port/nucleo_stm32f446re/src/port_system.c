@@ -8,11 +8,84 @@
 /* Includes ------------------------------------------------------------------*/
 #include "port_system.h"
 
-/* Defines -------------------------------------------------------------------*/
-#define HSI_VALUE ((uint32_t)16000000) /*!< Value of the Internal oscillator in Hz */
+/* Timer map check: the sum of the masks of the timers only equals their OR if no timer has two owners */
+#define _TIMER_MSK(func) (1UL << PORT_TIMER_##func) /*!< Mask of the timer of a function of the map */
+#define _TIMER_SUM(func) +_TIMER_MSK(func)          /*!< Term of the sum of masks */
+#define _TIMER_OR(func) | _TIMER_MSK(func)          /*!< Term of the OR of masks */
+_Static_assert((0 PORT_TIMERS_MAP(_TIMER_SUM)) == (0 PORT_TIMERS_MAP(_TIMER_OR)), "Two functions use the same timer: fix the timer map of port_system.h");
+
+/* Clocks */
+#define PLL_M 8U /*!< Division of the HSI at the input of the PLL: 2 MHz, the recommended one to limit the jitter */
+
+/* Microsecond clock */
+#define MICROS_REBASE_MS 1024U /*!< Period of the new bases of the microsecond clock taken by the SysTick, well below the wrap around of the cycle counter: 23 s at 180 MHz */
+
+/// @brief Structure to define the configuration of the RCC, the power controller and the flash for a clock of the system.
+typedef struct
+{
+  uint32_t pll_n;         /*!< Multiplication of the PLL (VCO at 2 MHz * pll_n), 0 to run on the HSI without the PLL */
+  uint32_t pll_p;         /*!< Division of the VCO for the system clock: 2, 4, 6 or 8 */
+  uint32_t vos;           /*!< Voltage scaling of the regulator */
+  bool over_drive;        /*!< Flag of the over-drive of the regulator, needed above 168 MHz */
+  uint32_t flash_latency; /*!< Wait states of the flash at 3.3 V: one more each 30 MHz */
+  uint32_t ppre;          /*!< Prescalers of the APB1 and APB2 buses, as the bits of the CFGR register */
+} port_system_clock_cfg_t;
+
+/// @brief Clocks of the system, in the order of #port_system_clock_t. Their frequencies are in #PORT_SYSTEM_CLOCKS_MAP.
+static const port_system_clock_cfg_t clocks_arr[PORT_SYSTEM_NUM_CLOCKS] = {
+    [PORT_SYSTEM_CLOCK_HSI_16MHZ] = {.pll_n = 0, .pll_p = 0, .vos = POWER_REGULATOR_VOLTAGE_SCALE3, .over_drive = false, .flash_latency = 0, .ppre = RCC_CFGR_PPRE1_DIV1 | RCC_CFGR_PPRE2_DIV1},
+    [PORT_SYSTEM_CLOCK_PLL_64MHZ] = {.pll_n = 128, .pll_p = 4, .vos = POWER_REGULATOR_VOLTAGE_SCALE3, .over_drive = false, .flash_latency = 2, .ppre = RCC_CFGR_PPRE1_DIV2 | RCC_CFGR_PPRE2_DIV1},  /* 256 MHz / 4, APB1 at 32 MHz, which the SPI divides down to 4 MHz */
+    [PORT_SYSTEM_CLOCK_PLL_84MHZ] = {.pll_n = 168, .pll_p = 4, .vos = POWER_REGULATOR_VOLTAGE_SCALE3, .over_drive = false, .flash_latency = 2, .ppre = RCC_CFGR_PPRE1_DIV2 | RCC_CFGR_PPRE2_DIV1},  /* 336 MHz / 4, APB1 at 42 MHz */
+    [PORT_SYSTEM_CLOCK_PLL_180MHZ] = {.pll_n = 180, .pll_p = 2, .vos = POWER_REGULATOR_VOLTAGE_SCALE1, .over_drive = true, .flash_latency = 5, .ppre = RCC_CFGR_PPRE1_DIV4 | RCC_CFGR_PPRE2_DIV2}, /* 360 MHz / 2, APB1 at 45 MHz, APB2 at 90 MHz */
+};
+
+#define _CLOCK_HZ(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua) [PORT_SYSTEM_CLOCK_##name] = {core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua}, /*!< Line of the table of frequencies and currents of the clocks */
+
+/// @brief Frequencies and currents of the clocks of the system, from #PORT_SYSTEM_CLOCKS_MAP.
+static const struct
+{
+  uint32_t core_hz;       /*!< Core clock */
+  uint32_t apb1_timer_hz; /*!< Clock of the timers of APB1 */
+  uint32_t apb2_timer_hz; /*!< Clock of the timers of APB2 */
+  uint32_t run_ua;        /*!< Typical current in run mode */
+  uint32_t sleep_ua;      /*!< Typical current in sleep mode */
+} clock_hz_arr[PORT_SYSTEM_NUM_CLOCKS] = {PORT_SYSTEM_CLOCKS_MAP(_CLOCK_HZ)};
+
+/// @brief Structure to define a base of the microsecond clock: a time and the count of the cycle counter at that time. The time later is the base plus the cycles counted since, at the rate of the base.
+typedef struct
+{
+  uint64_t us;            /*!< Time of the base, in us */
+  uint32_t cycles;        /*!< Count of the cycle counter at the time of the base */
+  uint32_t cycles_per_us; /*!< Cycles of the system clock per us from the base on */
+} port_system_micros_base_t;
 
 /* GLOBAL VARIABLES */
-static uint32_t msTicks = 0; /*!< Variable to store millisecond ticks. @warning **It must be declared volatile!** Just because it is modified in an ISR. **Add it to the definition** after *static*. */
+static volatile uint32_t msTicks = 0; /*!< Variable to store millisecond ticks. It is volatile because it is modified in an ISR */
+
+static volatile port_system_micros_base_t micros_bases_arr[2] = {[0] = {.us = 0, .cycles = 0, .cycles_per_us = SYSTEM_CORE_CLOCK_HZ / 1000000U}}; /*!< Bases of the microsecond clock: the current one is read while the other is written */
+static volatile uint32_t micros_gen = 0;                                                                                                      /*!< Generation of the bases, one more at each new base. Its lowest bit is the index of the current one */
+static uint32_t micros_remainder = 0;                                                                                                         /*!< Fraction of us since the last synchronization with the RTC not yet added to the microsecond clock, in 1/`rtc_tick_hz` us */
+static uint32_t systick_carry_ns = 0; /*!< Fraction of millisecond counted by the SysTick before the changes of the clock, which restart it */
+
+static port_system_clock_t clock_current = PORT_SYSTEM_CLOCK_HSI_16MHZ;    /*!< Current clock of the system */
+static port_system_clock_cb_t clock_cb_arr[PORT_SYSTEM_MAX_CLOCK_CALLBACKS]; /*!< Functions called at each change of the clock */
+static uint32_t num_clock_cbs = 0;                                         /*!< Functions in `clock_cb_arr` */
+
+static uint32_t rtc_tick_hz = RTC_LSE_HZ / (RTC_PREDIV_A + 1); /*!< Frequency of the subsecond counter of the RTC: nominal with the LSE, measured with the LSI */
+static uint32_t rtc_last_ticks = 0;                           /*!< Last read of the RTC, in ticks since midnight of the calendar */
+static uint64_t rtc_total_ticks = 0;                          /*!< Ticks of the RTC counted since the initialization */
+static uint64_t rtc_sync_ticks = 0;                           /*!< Ticks of the RTC at the last synchronization of the microsecond clock, taken at the edge of a tick */
+static uint64_t rtc_sync_us = 0;                              /*!< Time of the RTC in us at `rtc_sync_ticks` */
+static uint32_t tick_remainder_ns = 0;                        /*!< Fraction of millisecond of the sleeps not yet added to `msTicks`, in ns */
+static uint64_t stats_rtc_ref = 0;                            /*!< Ticks of the RTC at the reset of the statistics */
+static uint32_t stats_ms_ref = 0;                             /*!< System tick at the reset of the statistics */
+static uint64_t stats_mark = 0;                               /*!< Ticks of the RTC at the end of the last period added to the statistics */
+static uint64_t stats_run_ticks[PORT_SYSTEM_NUM_CLOCKS];      /*!< Ticks of the RTC spent awake with each clock */
+static uint64_t stats_sleep_ticks[PORT_SYSTEM_NUM_CLOCKS];    /*!< Ticks of the RTC spent in sleep mode with each clock */
+static uint64_t stats_stop_ticks = 0;                         /*!< Ticks of the RTC spent in stop mode */
+static uint32_t stats_num_clock_changes = 0;                  /*!< Changes of the clock since the reset of the statistics */
+static uint32_t stats_num_sleeps = 0;                         /*!< Sleeps since the reset of the statistics */
+static uint32_t stats_num_deadline_wakeups = 0;               /*!< Sleeps ended by the wakeup timer */
 
 /* These variables are declared extern in CMSIS (system_stm32f4xx.h) */
 uint32_t SystemCoreClock = HSI_VALUE;                                               /*!< Frequency of the System clock */
@@ -72,8 +145,8 @@ static void system_clock_config(void)
       must be correctly programmed according to the frequency of the CPU clock
       (HCLK) and the supply voltage of the device. */
 
-  /* Increasing the number of wait states because of higher CPU frequency */
-  FLASH->ACR = FLASH_ACR_LATENCY_2WS; /* Program the new number of wait states to the LATENCY bits in the FLASH_ACR register */
+  /* No wait states up to 30 MHz at 3.3 V. The clocks of the PLL raise them with `port_system_set_clock()` */
+  MODIFY_REG(FLASH->ACR, FLASH_ACR_LATENCY, clocks_arr[PORT_SYSTEM_CLOCK_HSI_16MHZ].flash_latency); /* Program the new number of wait states to the LATENCY bits in the FLASH_ACR register */
 
   /* Change in clock source is performed in 16 clock cycles after writing to CFGR */
   RCC->CFGR &= ~RCC_CFGR_SW; // Clean and set value
@@ -86,6 +159,403 @@ static void system_clock_config(void)
   SysTick_Config(SystemCoreClock / (1000U / TICK_FREQ_1KHZ)); /* Set Systick to 1 ms */
 }
 
+/// @brief Program the wait states of the flash and wait until they are active.
+/// @param latency Wait states.
+static void _flash_set_latency(uint32_t latency)
+{
+  MODIFY_REG(FLASH->ACR, FLASH_ACR_LATENCY, latency);
+  while ((FLASH->ACR & FLASH_ACR_LATENCY) != latency)
+  {
+  }
+}
+
+/// @brief Run the system on the HSI: switch the system clock to it, then lower the prescalers of the buses and the wait states of the flash, and stop the over-drive and the PLL. The order keeps the flash and the buses within their limits at every step.
+static void _clock_hsi(void)
+{
+  RCC->CFGR &= ~RCC_CFGR_SW; /* SW = 00: HSI */
+  while ((RCC->CFGR & RCC_CFGR_SWS) != 0)
+  {
+  }
+  MODIFY_REG(RCC->CFGR, (RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2), clocks_arr[PORT_SYSTEM_CLOCK_HSI_16MHZ].ppre);
+  _flash_set_latency(clocks_arr[PORT_SYSTEM_CLOCK_HSI_16MHZ].flash_latency);
+  if (PWR->CR & PWR_CR_ODEN)
+  {
+    PWR->CR &= ~PWR_CR_ODSWEN;
+    while (PWR->CSR & PWR_CSR_ODSWRDY)
+    {
+    }
+    PWR->CR &= ~PWR_CR_ODEN;
+  }
+  RCC->CR &= ~RCC_CR_PLLON;
+  while (RCC->CR & RCC_CR_PLLRDY)
+  {
+  }
+  MODIFY_REG(PWR->CR, PWR_CR_VOS, (clocks_arr[PORT_SYSTEM_CLOCK_HSI_16MHZ].vos << PWR_CR_VOS_Pos));
+}
+
+/// @brief Configure the RCC, the regulator and the flash for a clock. From the HSI, the PLL is started with the voltage scaling of the clock (it can only be changed with the PLL off) and the over-drive if needed, and the wait states and the prescalers are raised before the system clock switches to it. The timers and the SysTick are not retimed.
+/// @param clock Clock of #port_system_clock_t.
+static void _clock_apply(port_system_clock_t clock)
+{
+  const port_system_clock_cfg_t *p_cfg = &clocks_arr[clock];
+  _clock_hsi();
+  if (p_cfg->pll_n != 0)
+  {
+    MODIFY_REG(PWR->CR, PWR_CR_VOS, (p_cfg->vos << PWR_CR_VOS_Pos));
+    MODIFY_REG(RCC->PLLCFGR, (RCC_PLLCFGR_PLLM | RCC_PLLCFGR_PLLN | RCC_PLLCFGR_PLLP | RCC_PLLCFGR_PLLSRC),
+               (PLL_M << RCC_PLLCFGR_PLLM_Pos) | (p_cfg->pll_n << RCC_PLLCFGR_PLLN_Pos) | (((p_cfg->pll_p / 2) - 1) << RCC_PLLCFGR_PLLP_Pos)); /* PLLSRC = 0: HSI */
+    RCC->CR |= RCC_CR_PLLON;
+    if (p_cfg->over_drive)
+    {
+      PWR->CR |= PWR_CR_ODEN;
+      while (!(PWR->CSR & PWR_CSR_ODRDY))
+      {
+      }
+      PWR->CR |= PWR_CR_ODSWEN;
+      while (!(PWR->CSR & PWR_CSR_ODSWRDY))
+      {
+      }
+    }
+    while (!(RCC->CR & RCC_CR_PLLRDY))
+    {
+    }
+    while (!(PWR->CSR & PWR_CSR_VOSRDY))
+    {
+    }
+    _flash_set_latency(p_cfg->flash_latency);
+    MODIFY_REG(RCC->CFGR, (RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2), p_cfg->ppre);
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, (RCC_CFGR_SW_PLL << RCC_CFGR_SW_Pos));
+    while (((RCC->CFGR & RCC_CFGR_SWS) >> RCC_CFGR_SWS_Pos) != RCC_CFGR_SW_PLL)
+    {
+    }
+  }
+  SystemCoreClock = clock_hz_arr[clock].core_hz;
+}
+
+/// @brief Write the next base of the microsecond clock and make it the current one. It is only called where no reader can interrupt it: in the SysTick handler, which has the highest priority, or with the interrupts masked. A reader interrupted by it sees the generation change and reads again.
+/// @param us Time of the base, in us.
+/// @param cycles Count of the cycle counter at that time.
+/// @param cycles_per_us Cycles of the system clock per us from then on.
+static void _micros_set(uint64_t us, uint32_t cycles, uint32_t cycles_per_us)
+{
+  volatile port_system_micros_base_t *p_next = &micros_bases_arr[(micros_gen + 1) & 1];
+  p_next->us = us;
+  p_next->cycles = cycles;
+  p_next->cycles_per_us = cycles_per_us;
+  micros_gen++;
+}
+
+/// @brief Move the base of the microsecond clock to now, before the cycle counter wraps around or the rate of its cycles changes. With the same rate, the fraction of us since the last whole one is kept in the base; with another one it is dropped, an error below 1 us that keeps the clock monotonic.
+/// @param cycles_per_us Cycles of the system clock per us from now on.
+static void _micros_rebase(uint32_t cycles_per_us)
+{
+  volatile port_system_micros_base_t *p_base = &micros_bases_arr[micros_gen & 1];
+  uint32_t now = DWT->CYCCNT;
+  uint32_t us = (now - p_base->cycles) / p_base->cycles_per_us;
+  uint32_t cycles = (cycles_per_us == p_base->cycles_per_us) ? (p_base->cycles + (us * cycles_per_us)) : now;
+  _micros_set(p_base->us + us, cycles, cycles_per_us);
+}
+
+/// @brief Return the time of the microsecond clock in ns, with the fraction of us that `port_system_get_micros64()` drops. Without it, each sleep would add that fraction to the millisecond tick. It is called with the interrupts masked, so no new base comes meanwhile.
+/// @return uint64_t Time in ns.
+static uint64_t _micros_get_ns(void)
+{
+  volatile port_system_micros_base_t *p_base = &micros_bases_arr[micros_gen & 1];
+  uint32_t cycles = DWT->CYCCNT - p_base->cycles;
+  return (p_base->us * 1000U) + (((uint64_t)cycles * 1000U) / p_base->cycles_per_us);
+}
+
+/// @brief Return the time of the microsecond clock at the last tick of the SysTick, before the system clock changes.
+/// @return uint64_t Time in ns.
+static uint64_t _systick_get_tick_ns(void)
+{
+  uint32_t elapsed = SysTick->LOAD - SysTick->VAL; /* Cycles of the current clock since the last tick */
+  return _micros_get_ns() - (((uint64_t)elapsed * 1000000000U) / SystemCoreClock);
+}
+
+/// @brief Reload the SysTick for the current system clock. Any write of its counter restarts the millisecond in progress, so the time since its last tick is kept in `systick_carry_ns` and added to the millisecond tick when it adds up to one. The time is taken from the microsecond clock, since the SysTick counts the HSI with the reload of the old clock while the PLL locks; a tick it reaches meanwhile is in that time, so it is dropped.
+/// @param tick_ns Time of the microsecond clock at the last tick before the change, from `_systick_get_tick_ns()`.
+/// @param tick_pending true if that tick had not been handled yet.
+static void _systick_retime(uint64_t tick_ns, bool tick_pending)
+{
+  systick_carry_ns += (uint32_t)(_micros_get_ns() - tick_ns);
+  while (systick_carry_ns >= 1000000U)
+  {
+    msTicks++;
+    systick_carry_ns -= 1000000U;
+  }
+  SysTick->LOAD = (SystemCoreClock / (1000U / TICK_FREQ_1KHZ)) - 1;
+  SysTick->VAL = 0;
+  SCB->ICSR = tick_pending ? SCB_ICSR_PENDSTSET_Msk : SCB_ICSR_PENDSTCLR_Msk;
+}
+
+/// @brief Scale the prescaler of the SWO, programmed by the debugger for the clock it found, so `printf()` keeps its baud rate. It is exact when the new clock is a multiple of the baud rate, as with the usual 2 MHz.
+/// @param old_hz System clock before the change.
+static void _swo_retime(uint32_t old_hz)
+{
+  uint64_t divider = TPI->ACPR + 1;
+  TPI->ACPR = (uint32_t)((((divider * SystemCoreClock) + (old_hz / 2)) / old_hz) - 1);
+}
+
+//------------------------------------------------------
+// REAL-TIME CLOCK
+//------------------------------------------------------
+
+/// @brief Unlock the write protection of the registers of the RTC.
+static void _rtc_unlock(void)
+{
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+}
+
+/// @brief Lock the write protection of the registers of the RTC.
+static void _rtc_lock(void)
+{
+  RTC->WPR = 0xFF;
+}
+
+/// @brief Read the time of the RTC as ticks of the subsecond counter since midnight. The shadow registers are bypassed, so the read is valid right after a wakeup from stop mode, and it is repeated until two reads match.
+/// @return uint32_t Ticks since midnight, up to #RTC_DAY_TICKS.
+static uint32_t _rtc_read_ticks(void)
+{
+  uint32_t ssr;
+  uint32_t tr;
+  do
+  {
+    ssr = RTC->SSR;
+    tr = RTC->TR;
+  } while ((ssr != RTC->SSR) || (tr != RTC->TR));
+
+  uint32_t hours = (10 * ((tr & RTC_TR_HT) >> RTC_TR_HT_Pos)) + ((tr & RTC_TR_HU) >> RTC_TR_HU_Pos);
+  uint32_t minutes = (10 * ((tr & RTC_TR_MNT) >> RTC_TR_MNT_Pos)) + ((tr & RTC_TR_MNU) >> RTC_TR_MNU_Pos);
+  uint32_t seconds = (10 * ((tr & RTC_TR_ST) >> RTC_TR_ST_Pos)) + ((tr & RTC_TR_SU) >> RTC_TR_SU_Pos);
+  return ((((hours * 60) + minutes) * 60 + seconds) * (RTC_PREDIV_S + 1)) + (RTC_PREDIV_S - ssr); /* The subsecond counter counts down */
+}
+
+/// @brief Add the ticks of the RTC since its last read to the total count. The time of the calendar wraps around every day, so it must be called at least once a day; the sleeps are much shorter.
+/// @return uint64_t Ticks of the RTC since the initialization.
+static uint64_t _rtc_update(void)
+{
+  uint32_t now = _rtc_read_ticks();
+  rtc_total_ticks += (now + RTC_DAY_TICKS - rtc_last_ticks) % RTC_DAY_TICKS;
+  rtc_last_ticks = now;
+  return rtc_total_ticks;
+}
+
+/// @brief Wait for the next tick of the subsecond counter of the RTC, 61 us at most with the LSE, to synchronize the microsecond clock with it.
+static void _rtc_wait_tick(void)
+{
+  uint32_t ssr = RTC->SSR;
+  while (RTC->SSR == ssr)
+  {
+  }
+}
+
+/// @brief Convert ticks of the RTC into milliseconds.
+/// @param ticks Ticks of the subsecond counter.
+/// @return uint32_t Milliseconds
+static uint32_t _rtc_ticks_to_ms(uint64_t ticks)
+{
+  return (uint32_t)((ticks * 1000U) / rtc_tick_hz);
+}
+
+#if !RTC_LSE
+/// @brief Measure the frequency of the subsecond counter, clocked by the LSI, by timing #RTC_CALIBRATION_TICKS ticks with the cycle counter. The result has the accuracy of the HSI (1 %), much better than the one of the LSI.
+/// @return uint32_t Frequency of the subsecond counter in Hz.
+static uint32_t _rtc_measure_tick_hz(void)
+{
+  uint32_t ssr = RTC->SSR;
+  while (RTC->SSR == ssr) /* Start at the edge of a tick */
+  {
+  }
+  uint32_t start = DWT->CYCCNT;
+  for (uint32_t i = 0; i < RTC_CALIBRATION_TICKS; i++)
+  {
+    ssr = RTC->SSR;
+    while (RTC->SSR == ssr)
+    {
+    }
+  }
+  uint32_t cycles = DWT->CYCCNT - start;
+  return (uint32_t)((((uint64_t)SystemCoreClock * RTC_CALIBRATION_TICKS) + (cycles / 2)) / cycles);
+}
+#endif
+
+/**
+ * @brief Start the RTC as the time base of the sleeps: the calendar counts from midnight with a subsecond counter of 16 kHz, and the wakeup timer interrupts through its EXTI line, so it also wakes the system up from stop mode.
+ *
+ * @attention This function should NOT be accesible from the outside. It is called by `port_system_init()` once the cycle counter runs.
+ */
+static void rtc_setup(void)
+{
+  uint32_t rtcsel = RTC_LSE ? 1 : 2; /* Clock of the RTC: 01 for the LSE, 10 for the LSI */
+  PWR->CR |= PWR_CR_DBP;             /* Write access to the backup domain, which keeps the RTC through a reset */
+  if ((RCC->BDCR & RCC_BDCR_RTCSEL) != (rtcsel << RCC_BDCR_RTCSEL_Pos))
+  {
+    RCC->BDCR |= RCC_BDCR_BDRST; /* The clock of the RTC can only be changed with a reset of the backup domain */
+    RCC->BDCR &= ~RCC_BDCR_BDRST;
+  }
+#if RTC_LSE
+  RCC->BDCR |= RCC_BDCR_LSEON;
+  while (!(RCC->BDCR & RCC_BDCR_LSERDY))
+  {
+  }
+#else
+  RCC->CSR |= RCC_CSR_LSION;
+  while (!(RCC->CSR & RCC_CSR_LSIRDY))
+  {
+  }
+#endif
+  RCC->BDCR |= (rtcsel << RCC_BDCR_RTCSEL_Pos) | RCC_BDCR_RTCEN;
+
+  _rtc_unlock();
+  RTC->ISR |= RTC_ISR_INIT;
+  while (!(RTC->ISR & RTC_ISR_INITF))
+  {
+  }
+  RTC->PRER = RTC_PREDIV_S; /* Two separate writes, as required by the RM */
+  RTC->PRER |= (RTC_PREDIV_A << RTC_PRER_PREDIV_A_Pos);
+  RTC->TR = 0;
+  RTC->CR = RTC_CR_BYPSHAD; /* 24 h format, wakeup timer off and clocked at RTCCLK / 16 */
+  RTC->ISR &= ~RTC_ISR_INIT;
+  _rtc_lock();
+
+  EXTI->IMR |= BIT_POS_TO_MASK(RTC_WAKEUP_EXTI_LINE);
+  EXTI->RTSR |= BIT_POS_TO_MASK(RTC_WAKEUP_EXTI_LINE);
+  NVIC_SetPriority(RTC_WKUP_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 3, 0)); /* Priority 3: the wakeup itself is the event, the handler only clears it */
+  NVIC_EnableIRQ(RTC_WKUP_IRQn);
+
+#if !RTC_LSE
+  rtc_tick_hz = _rtc_measure_tick_hz();
+#endif
+  _rtc_wait_tick();
+  rtc_last_ticks = _rtc_read_ticks();
+  rtc_total_ticks = 0;
+  rtc_sync_ticks = 0;
+  rtc_sync_us = port_system_get_micros64();
+  port_system_reset_sleep_stats();
+}
+
+/// @brief Program the wakeup timer of the RTC to interrupt after some milliseconds, rounded up to its resolution (0.5 ms with the LSE) and limited to its longest period. Two more counts are added, so the system does not wake up before the millisecond tick reaches the deadline: the prescaler of the timer is not reset when it starts, so its first count can be short by up to a whole one, and the millisecond tick can be ahead of the RTC by the error of the HSI since the last wakeup, below another one.
+/// @param ms Milliseconds to the deadline.
+static void _rtc_wakeup_start(uint32_t ms)
+{
+  uint64_t counts = ((((uint64_t)ms * rtc_tick_hz) + (1000U * RTC_WAKEUP_TICKS) - 1) / (1000U * RTC_WAKEUP_TICKS)) + 2;
+  if (counts > RTC_WAKEUP_MAX_COUNTS)
+  {
+    counts = RTC_WAKEUP_MAX_COUNTS;
+  }
+  _rtc_unlock();
+  RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+  while (!(RTC->ISR & RTC_ISR_WUTWF))
+  {
+  }
+  RTC->WUTR = (uint32_t)counts - 1; /* The timer interrupts after WUTR + 1 counts */
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  RTC->CR |= (RTC_CR_WUTE | RTC_CR_WUTIE);
+  _rtc_lock();
+}
+
+/// @brief Stop the wakeup timer of the RTC and clear its interrupt, also if the system was woken up by another one.
+/// @return true if the timer had reached the deadline
+/// @return false if it had not
+static bool _rtc_wakeup_stop(void)
+{
+  bool expired = (RTC->ISR & RTC_ISR_WUTF) != 0;
+  _rtc_unlock();
+  RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  _rtc_lock();
+  EXTI->PR = BIT_POS_TO_MASK(RTC_WAKEUP_EXTI_LINE);
+  NVIC_ClearPendingIRQ(RTC_WKUP_IRQn);
+  return expired;
+}
+
+/// @brief Synchronize the microsecond clock with the RTC after a sleep, in which the cycle counter stops (stop mode) or does not count the time of the CPU. The time is the one of the last synchronization plus the ticks of the RTC since then, both taken at the edge of a tick, so the sleep can start at any time within a tick: the time awake was counted by the cycle counter, and the time slept is the rest. The fraction of us left is kept for the next synchronization. If the cycle counter ran faster than the RTC since then, the clock keeps its time at the start of the sleep, so it never goes back.
+/// @param start_ns Time of the microsecond clock at the start of the sleep, in ns.
+/// @param ticks Ticks of the RTC since the initialization, at the edge of a tick.
+/// @param cycles Count of the cycle counter at that edge.
+/// @return uint64_t Time of the microsecond clock at the wakeup, in ns.
+static uint64_t _micros_sync(uint64_t start_ns, uint64_t ticks, uint32_t cycles)
+{
+  uint64_t total = ((ticks - rtc_sync_ticks) * 1000000U) + micros_remainder;
+  micros_remainder = (uint32_t)(total % rtc_tick_hz);
+  rtc_sync_ticks = ticks;
+  rtc_sync_us += total / rtc_tick_hz;
+  uint64_t wake_ns = ((rtc_sync_us * 1000U) > start_ns) ? (rtc_sync_us * 1000U) : start_ns;
+  _micros_set(wake_ns / 1000U, cycles, SystemCoreClock / 1000000U);
+  return wake_ns;
+}
+
+/// @brief Add the time slept to the millisecond tick. The fraction of millisecond left is kept for the next sleep, so the rounding does not accumulate.
+/// @param slept_ns Time slept, in ns.
+static void _tick_catch_up(uint64_t slept_ns)
+{
+  uint64_t total = slept_ns + tick_remainder_ns;
+  msTicks += (uint32_t)(total / 1000000U);
+  tick_remainder_ns = (uint32_t)(total % 1000000U);
+}
+
+/// @brief Sleep, with the SysTick suspended, until an interrupt or a deadline. The sleep starts at once; on wakeup the system waits for the next tick of the subsecond counter of the RTC, the only wait, and synchronizes the microsecond clock with it. The time slept, from the start of the sleep to that tick, is added to the millisecond tick, and the SysTick restarts with the phase it had when suspended. The interrupts are masked from before the suspension of the SysTick to after the catch up: an interrupt still wakes the CPU up, but its handler runs once the tick is right again, so its timestamps are too.
+/// @param stop true for stop mode, false for sleep mode.
+/// @param has_deadline true to program the wakeup timer for the deadline.
+/// @param deadline_ms System tick at which the system must be awake.
+static void _sleep(bool stop, bool has_deadline, uint32_t deadline_ms)
+{
+  if (has_deadline)
+  {
+    int32_t left_ms = (int32_t)(deadline_ms - msTicks);
+    if (left_ms <= 0)
+    {
+      return;
+    }
+    _rtc_wakeup_start((uint32_t)left_ms);
+  }
+
+  __disable_irq();
+  uint64_t start_ns = _micros_get_ns();
+  port_system_systick_suspend();
+  uint64_t start = _rtc_update();
+  stats_run_ticks[clock_current] += start - stats_mark;
+  if (stop)
+  {
+    if (clocks_arr[clock_current].pll_n != 0)
+    {
+      _clock_hsi(); /* The over-drive must be off in stop mode, and the PLL stops anyway */
+    }
+    port_system_power_stop();
+    if (clocks_arr[clock_current].pll_n != 0)
+    {
+      _clock_apply(clock_current); /* The timers are still retimed for it */
+    }
+  }
+  else
+  {
+    port_system_power_sleep();
+  }
+  _rtc_wait_tick();
+  uint32_t wake_cycles = DWT->CYCCNT;
+  port_system_systick_resume();
+  stats_mark = _rtc_update();
+  uint32_t slept = (uint32_t)(stats_mark - start);
+  uint64_t wake_ns = _micros_sync(start_ns, stats_mark, wake_cycles);
+  if (has_deadline && _rtc_wakeup_stop())
+  {
+    stats_num_deadline_wakeups++;
+  }
+  _tick_catch_up(wake_ns - start_ns);
+  if (stop)
+  {
+    stats_stop_ticks += slept;
+  }
+  else
+  {
+    stats_sleep_ticks[clock_current] += slept;
+  }
+  stats_num_sleeps++;
+  __enable_irq();
+}
+
 size_t port_system_init()
 {
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
@@ -116,6 +586,14 @@ size_t port_system_init()
   /* Configure the system clock */
   system_clock_config();
 
+  /* Enable the cycle counter of the Data Watchpoint and Trace unit (DWT) to take timestamps */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /* Start the RTC, which measures the sleeps. The LSI is calibrated with the cycle counter */
+  rtc_setup();
+
   return 0;
 }
 
@@ -127,10 +605,70 @@ void port_system_power_stop()
   SCB->SCR &= ~((uint32_t)SCB_SCR_SLEEPDEEP_Msk);                // Reset SLEEPDEEP bit of Cortex System Control Register
 }
 
+void port_system_power_sleep()
+{
+  SCB->SCR &= ~((uint32_t)SCB_SCR_SLEEPDEEP_Msk); // Sleep mode, not Stop mode
+  __WFI();                                        // Request Wait For Interrupt
+}
+
 void port_system_sleep(void)
 {
-  port_system_systick_suspend();
-  port_system_power_stop();
+  _sleep(true, false, 0);
+}
+
+void port_system_sleep_light(void)
+{
+  _sleep(false, false, 0);
+}
+
+void port_system_sleep_until(uint32_t deadline_ms)
+{
+  _sleep(true, true, deadline_ms);
+}
+
+void port_system_sleep_light_until(uint32_t deadline_ms)
+{
+  _sleep(false, true, deadline_ms);
+}
+
+void port_system_get_sleep_stats(port_system_sleep_stats_t *p_stats)
+{
+  uint64_t now = _rtc_update();
+  uint64_t total = now - stats_rtc_ref;
+  uint64_t sleep_ticks = 0;
+  uint64_t energy = (uint64_t)PORT_SYSTEM_STOP_UA * _rtc_ticks_to_ms(stats_stop_ticks); /* uA * ms */
+  for (uint32_t i = 0; i < PORT_SYSTEM_NUM_CLOCKS; i++)
+  {
+    uint64_t run_ticks = stats_run_ticks[i] + ((i == clock_current) ? (now - stats_mark) : 0);
+    p_stats->clock_run_ms[i] = _rtc_ticks_to_ms(run_ticks);
+    p_stats->clock_sleep_ms[i] = _rtc_ticks_to_ms(stats_sleep_ticks[i]);
+    energy += ((uint64_t)clock_hz_arr[i].run_ua * p_stats->clock_run_ms[i]) + ((uint64_t)clock_hz_arr[i].sleep_ua * p_stats->clock_sleep_ms[i]);
+    sleep_ticks += stats_sleep_ticks[i];
+  }
+  p_stats->sleep_ms = _rtc_ticks_to_ms(sleep_ticks);
+  p_stats->stop_ms = _rtc_ticks_to_ms(stats_stop_ticks);
+  p_stats->run_ms = _rtc_ticks_to_ms(total - sleep_ticks - stats_stop_ticks);
+  p_stats->num_sleeps = stats_num_sleeps;
+  p_stats->num_deadline_wakeups = stats_num_deadline_wakeups;
+  p_stats->millis_error_ms = (int32_t)((msTicks - stats_ms_ref) - _rtc_ticks_to_ms(total));
+  p_stats->num_clock_changes = stats_num_clock_changes;
+  p_stats->energy_uj = (uint32_t)((energy * PORT_SYSTEM_VDD_MV) / 1000000U); /* uA * ms * mV = 1e-12 J */
+}
+
+void port_system_reset_sleep_stats(void)
+{
+  stats_rtc_ref = _rtc_update();
+  stats_mark = stats_rtc_ref;
+  stats_ms_ref = msTicks;
+  for (uint32_t i = 0; i < PORT_SYSTEM_NUM_CLOCKS; i++)
+  {
+    stats_run_ticks[i] = 0;
+    stats_sleep_ticks[i] = 0;
+  }
+  stats_stop_ticks = 0;
+  stats_num_sleeps = 0;
+  stats_num_deadline_wakeups = 0;
+  stats_num_clock_changes = 0;
 }
 
 //------------------------------------------------------
@@ -162,14 +700,130 @@ void port_system_delay_until_ms(uint32_t *p_t, uint32_t ms)
   *p_t = port_system_get_millis();
 }
 
+uint32_t port_system_get_cycles()
+{
+  return DWT->CYCCNT;
+}
+
+uint32_t port_system_cycles_to_us(uint32_t cycles)
+{
+  return cycles / (SystemCoreClock / 1000000U);
+}
+
+uint64_t port_system_get_micros64(void)
+{
+  uint32_t gen;
+  uint64_t us;
+  do
+  {
+    gen = micros_gen;
+    volatile port_system_micros_base_t *p_base = &micros_bases_arr[gen & 1];
+    us = p_base->us + ((DWT->CYCCNT - p_base->cycles) / p_base->cycles_per_us);
+  } while (gen != micros_gen); /* A new base was written meanwhile: read again */
+  return us;
+}
+
+bool port_system_set_clock(port_system_clock_t clock)
+{
+  if (clock >= PORT_SYSTEM_NUM_CLOCKS)
+  {
+    return false;
+  }
+  if (clock == clock_current)
+  {
+    return true;
+  }
+  __disable_irq();
+  for (uint32_t i = 0; i < num_clock_cbs; i++)
+  {
+    clock_cb_arr[i](false);
+  }
+  uint64_t now = _rtc_update();
+  stats_run_ticks[clock_current] += now - stats_mark;
+  stats_mark = now;
+  uint32_t old_hz = SystemCoreClock;
+  bool tick_pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+  uint64_t tick_ns = _systick_get_tick_ns();
+  _micros_rebase(clock_hz_arr[PORT_SYSTEM_CLOCK_HSI_16MHZ].core_hz / 1000000U); /* The change runs on the HSI, also while the PLL locks */
+  _clock_apply(clock);
+  _micros_rebase(SystemCoreClock / 1000000U);
+  clock_current = clock;
+  _systick_retime(tick_ns, tick_pending);
+  _swo_retime(old_hz);
+  for (uint32_t i = 0; i < num_clock_cbs; i++)
+  {
+    clock_cb_arr[i](true);
+  }
+  stats_num_clock_changes++;
+  __enable_irq();
+  return true;
+}
+
+port_system_clock_t port_system_get_clock(void)
+{
+  return clock_current;
+}
+
+uint32_t port_system_get_timer_clock_hz(uint32_t timer)
+{
+  return PORT_TIMER_CLOCK_HZ(timer, clock_hz_arr[clock_current].apb1_timer_hz, clock_hz_arr[clock_current].apb2_timer_hz);
+}
+
+uint32_t port_system_get_apb1_clock_hz(void)
+{
+  return SystemCoreClock >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+}
+
+uint32_t port_system_get_clock_apb1_hz(port_system_clock_t clock)
+{
+  if (clock >= PORT_SYSTEM_NUM_CLOCKS)
+  {
+    return 0;
+  }
+  return clock_hz_arr[clock].core_hz >> APBPrescTable[(clocks_arr[clock].ppre & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+}
+
+uint32_t port_system_get_apb2_clock_hz(void)
+{
+  return SystemCoreClock >> APBPrescTable[(RCC->CFGR & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos];
+}
+
+bool port_system_add_clock_callback(port_system_clock_cb_t p_callback)
+{
+  for (uint32_t i = 0; i < num_clock_cbs; i++)
+  {
+    if (clock_cb_arr[i] == p_callback)
+    {
+      return true;
+    }
+  }
+  if (num_clock_cbs == PORT_SYSTEM_MAX_CLOCK_CALLBACKS)
+  {
+    return false;
+  }
+  clock_cb_arr[num_clock_cbs++] = p_callback;
+  return true;
+}
+
+void port_system_timer_set_prescaler(TIM_TypeDef *p_tim, uint32_t psc)
+{
+  uint32_t cnt = p_tim->CNT;
+  uint32_t urs = p_tim->CR1 & TIM_CR1_URS;
+  p_tim->CR1 |= TIM_CR1_URS; /* The update event of UG does not set the interrupt flag */
+  p_tim->PSC = psc;
+  p_tim->EGR = TIM_EGR_UG; /* Load the prescaler now: it is only loaded at the update events */
+  p_tim->CNT = cnt;
+  p_tim->CR1 = (p_tim->CR1 & ~TIM_CR1_URS) | urs;
+}
+
 void port_system_systick_suspend()
 {
-  SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;
+  SysTick->CTRL &= ~(SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk);
 }
 
 void port_system_systick_resume()
 {
-  SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
+  SysTick->CTRL |= (SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk);
 }
 
 //------------------------------------------------------
@@ -259,7 +913,7 @@ void port_system_gpio_config_exti(GPIO_TypeDef *p_port, uint8_t pin, uint32_t mo
     masc = 7;
   }
 
-  if (pin > 0 && pin <= 3)
+  if (pin <= 3)
   {
     SYSCFG->EXTICR[0] &= ~(0x0FUL << 4 * (pin % 4)); 
     SYSCFG->EXTICR[0] |= (masc << 4 * (pin % 4));    
@@ -373,4 +1027,17 @@ void port_system_gpio_config_alternate(GPIO_TypeDef *p_port, uint8_t pin, uint8_
 void SysTick_Handler(void)
 {
   msTicks++;
+  if ((msTicks % MICROS_REBASE_MS) == 0)
+  {
+    _micros_rebase(micros_bases_arr[micros_gen & 1].cycles_per_us);
+  }
+}
+
+/// @brief This function handles the wakeup timer of the RTC. The wakeup is the event: the sleep that programmed the timer stops it and counts it, so the handler only clears the flags.
+void RTC_WKUP_IRQHandler(void)
+{
+  _rtc_unlock();
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  _rtc_lock();
+  EXTI->PR = BIT_POS_TO_MASK(RTC_WAKEUP_EXTI_LINE);
 }
@@ -9,13 +9,25 @@
 /* Includes ------------------------------------------------------------------*/
 #include "port_tx.h"
 #include "fsm_tx.h"
-#include <math.h>
+#include "port_rx.h"
+#include "latency.h"
 
 /* Defines --------------------------------------------------------------------*/
 #define ALT_FUNC1_TIM2    1 /*!< TIM2 Alternate Function mapping */
 
+#define TX_SYMBOL_TMR_PSC(timer_hz) ((uint32_t)(((uint64_t)(timer_hz) * NEC_TX_TIMER_TICK_BASE_NS) / 1000000000U) - 1) /*!< Prescaler of the symbol timer: one count of TIM1 is one symbol tick (899 at 16 MHz) */
+#define TX_PWM_TMR_ARR ((SYSTEM_CORE_CLOCK_HZ / NEC_PWM_FREQ_HZ) - 1)                                                  /*!< Auto-reload of the PWM timer to get the carrier frequency with prescaler 0 (420 at 16 MHz) */
+#define TX_PWM_TMR_CCR (((TX_PWM_TMR_ARR + 1) * NEC_PWM_DC_PERCENT) / 100)                                           /*!< Compare value of the PWM timer to get the duty cycle of the carrier */
+
+/// @brief Check of the symbol timer for a clock of #PORT_SYSTEM_CLOCKS_MAP.
+#define _TX_CLOCK_CHECK(name, core_hz, apb1_timer_hz, apb2_timer_hz, run_ua, sleep_ua)                                                                                                      \
+  _Static_assert((((uint64_t)PORT_TIMER_CLOCK_HZ(PORT_TIMER_TX_SYMBOL, apb1_timer_hz, apb2_timer_hz) * NEC_TX_TIMER_TICK_BASE_NS) % 1000000000U) == 0, "The symbol tick must be a whole number of timer clock cycles with the clock " #name); \
+  _Static_assert(TX_SYMBOL_TMR_PSC(PORT_TIMER_CLOCK_HZ(PORT_TIMER_TX_SYMBOL, apb1_timer_hz, apb2_timer_hz)) <= 0xFFFF, "The prescaler of the symbol timer does not fit in 16 bits with the clock " #name);
+PORT_SYSTEM_CLOCKS_MAP(_TX_CLOCK_CHECK)
+
 /* IMPORTANT
-The timer symbol is the same for all the TX, so it is not in the structure of TX. It has been decided to be the TIM1. It is like a systick but faster.
+The timer symbol is the same for all the TX, so it is not in the structure of TX. It has been decided to be the TIM1.
+Each count of TIM1 is one symbol tick, and each duration of the burst schedule is loaded in the auto-reload register, so the timer only interrupts when the PWM has to be switched (one interrupt per ON or OFF duration) instead of on every tick.
 */
 
 /* Typedefs --------------------------------------------------------------------*/
@@ -26,24 +38,28 @@ typedef struct
     GPIO_TypeDef *p_port; /*!< GPIO where the infrared transmitter is connected */
     uint8_t pin; /*!< Pin/line where the infrared transmitter is connected */
     uint8_t alt_func; /*!< Alternate function value according to the Alternate function table of the datasheet */
+    const uint16_t *p_durations; /*!< Burst schedule being sent: ON and OFF durations in symbol ticks */
+    uint32_t num_durations; /*!< Number of durations of the burst schedule */
+    uint32_t duration_idx; /*!< Index of the duration that the symbol timer is counting */
+    volatile uint32_t isr_count; /*!< Number of symbol timer interrupts of the current (or last) burst schedule */
+    bool loopback; /*!< Flag to feed each switch of the PWM into the infrared receiver as an edge */
+    volatile bool busy; /*!< Flag to indicate that a burst schedule is being sent. It is volatile because the ISR of the symbol timer clears it */
+    uint32_t carrier_hz; /*!< Frequency of the carrier, reprogrammed at each change of the clock */
+    uint8_t duty_percent; /*!< Duty cycle of the carrier */
 
 } port_tx_hw_t;
 
 
 /* Global variables ------------------------------------------------------------*/
 
-/// @brief Variable to store the count of ticks of the symbol timer
-volatile uint32_t symbol_tick;
-
-
 /// @brief Array of elements that represents the HW characteristics of the infrared transmitters.
 static port_tx_hw_t transmitters_arr[] = {
-  [IR_TX_0_ID] = {.p_port = IR_TX_0_GPIO, .pin = IR_TX_0_PIN, .alt_func = ALT_FUNC1_TIM2},
+  [IR_TX_0_ID] = {.p_port = IR_TX_0_GPIO, .pin = IR_TX_0_PIN, .alt_func = ALT_FUNC1_TIM2, .p_durations = NULL, .num_durations = 0, .duration_idx = 0, .isr_count = 0, .loopback = false, .busy = false, .carrier_hz = NEC_PWM_FREQ_HZ, .duty_percent = NEC_PWM_DC_PERCENT},
 };
 
 /* Infrared transmitter private functions */
 
-/// @brief Configure the symbol timer. This timer sets the tick base as a reference for the symbols of the protocol.
+/// @brief Configure the symbol timer. This timer counts symbol ticks and the durations of the burst schedule are loaded in its auto-reload register.
 static void _timer_symbol_setup()
 {
   /* Primero , habilitamos siempre el reloj del timer */
@@ -56,29 +72,24 @@ static void _timer_symbol_setup()
   /* 2) Deshabilita el contador (no es indispensable). */
   TIM1 -> CR1 &= ~ TIM_CR1_CEN ;
 
-  /* Habilita el preload (no es indispensable). */
+  /* Habilita el preload: la siguiente duracion se carga en el ARR mientras se cuenta la actual y pasa a ser activa en el evento de actualizacion. */
   TIM1->CR1 |= TIM_CR1_ARPE;
 
+  /* Solo el desbordamiento genera interrupcion, no el UG por software. */
+  TIM1->CR1 |= TIM_CR1_URS;
+
   /* 3) Aseguramos inicio del contador a 0 */
   TIM1->CNT = 0;
 
-  //CALCULOS
-  uint32_t psmin =  (((SystemCoreClock * NEC_TX_TIMER_TICK_BASE_US /1000000))/(65536)) - 1 ;
-  psmin = 0;
-  uint32_t arrmin = (((SystemCoreClock * NEC_TX_TIMER_TICK_BASE_US / 1000000))/(psmin + 1)) - 1;
-  
-  /* 4) Cargamos el autorreload */
-  TIM1->ARR = arrmin;
+  /* 4) Cargamos el autorreload (se reprograma con cada rafaga) */
+  TIM1->ARR = 0xFFFF;
 
-  /* 5) Cargamos el prescaler */
-  TIM1->PSC = psmin;
+  /* 5) Cargamos el prescaler: cada cuenta es un tick de simbolo */
+  TIM1->PSC = TX_SYMBOL_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_TX_SYMBOL));
+  TIM1->RCR = 0;
 
   /* 6) ( IMPORTANTE ) Re - inicializa el contador y actualiza los registros .
   IMPORTANTE realizarlo despues de cargar ARR y PSC */
-  /* Los valores de PSC y ARR estan en los registro de precarga . Para cargarlos
-  en los registros activos , necesitamos que se actualice un evento . Esto
-  podemos hacerlo manualmente actualizando el registro TIMx - >EGR , o esperar a
-  que pase el timer . */
   TIM1->EGR = TIM_EGR_UG; /* Genera evento de actualizacion */
 
   /* Interrupciones */
@@ -114,17 +125,11 @@ static void _timer_pwm_setup(uint32_t tx_id) /////AQUi
   /* 3) Aseguramos inicio del contador a 0 */
   TIM2->CNT = 0;
 
- //CALCULOS
-  uint32_t psmin =   (((SystemCoreClock / NEC_PWM_FREQ_HZ))/(65536)) - 1 ;
-  psmin =0 ;
-  uint32_t arrmin =  (((SystemCoreClock / NEC_PWM_FREQ_HZ)/(psmin + 1)) - 1);
-  uint32_t ccrxmin =  (NEC_PWM_DC*(arrmin+ 1));
-
   /* 4) Cargamos el autorreload */
-  TIM2->ARR = arrmin;
+  TIM2->ARR = TX_PWM_TMR_ARR;
 
   /* 5) Cargamos el prescaler */
-  TIM2->PSC = psmin;
+  TIM2->PSC = 0;
 
   TIM2->EGR = TIM_EGR_UG; /* Genera evento de actualizacion */
 
@@ -138,10 +143,22 @@ static void _timer_pwm_setup(uint32_t tx_id) /////AQUi
   TIM2 -> CCMR2 |= TIM_CCMR2_OC3PE ; /* Habilita el preload */
 
   /* 9) Ancho del pulso de PWM */
-  TIM2 -> CCR3 = ccrxmin;
+  TIM2 -> CCR3 = TX_PWM_TMR_CCR;
   }
 }
 
+/// @brief Retime the symbol timer and the carriers after a change of the clock. The new prescaler of the symbol timer is loaded by the update event of the next burst schedule; the clock must not change while one is being sent.
+/// @param changed true after the change of the clock, false before it.
+static void _clock_retime(bool changed)
+{
+  if (!changed)
+  {
+    return;
+  }
+  TIM1->PSC = TX_SYMBOL_TMR_PSC(port_system_get_timer_clock_hz(PORT_TIMER_TX_SYMBOL));
+  port_tx_set_carrier(IR_TX_0_ID, transmitters_arr[IR_TX_0_ID].carrier_hz, transmitters_arr[IR_TX_0_ID].duty_percent);
+}
+
 /* Public functions */
 
 void port_tx_init(uint8_t tx_id, bool status){
@@ -149,7 +166,9 @@ void port_tx_init(uint8_t tx_id, bool status){
   port_system_gpio_config_alternate(transmitters_arr[tx_id].p_port, transmitters_arr[tx_id].pin, transmitters_arr[tx_id].alt_func);
   _timer_symbol_setup();
   _timer_pwm_setup(tx_id);
+  port_tx_set_carrier(tx_id, transmitters_arr[tx_id].carrier_hz, transmitters_arr[tx_id].duty_percent);
   port_tx_pwm_timer_set(tx_id, status);
+  port_system_add_clock_callback(_clock_retime);
 }
 
 /* In order to make the academic effort of configuring the PWM, the values: timer, channel and masks are hardcoded and this function is not generic for any timer/channel. It is not the best way, but it is as it. */
@@ -167,30 +186,124 @@ if(tx_id == IR_TX_0_ID){
   }
 }
 
-void port_tx_symbol_tmr_start()
+void port_tx_set_carrier(uint8_t tx_id, uint32_t freq_hz, uint8_t duty_percent)
 {
-  TIM1->CNT = 0;
+  if ((tx_id == IR_TX_0_ID) && (freq_hz > 0))
+  {
+    transmitters_arr[tx_id].carrier_hz = freq_hz;
+    transmitters_arr[tx_id].duty_percent = duty_percent;
+    uint32_t arr = (port_system_get_timer_clock_hz(PORT_TIMER_TX_CARRIER) / freq_hz) - 1; /* Prescaler 0, integer division */
+    TIM2->ARR = arr;
+    TIM2->CCR3 = ((arr + 1) * duty_percent) / 100;
+    TIM2->EGR = TIM_EGR_UG; /* Load the preload registers now, so the first burst already has the new carrier */
+  }
+}
+
+/// @brief Load the first durations of the burst schedule and start the symbol timer.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+static void _symbol_tmr_start(uint8_t tx_id)
+{
+  port_tx_hw_t *p_tx = &transmitters_arr[tx_id];
+  TIM1->CR1 &= ~TIM_CR1_OPM;
+  TIM1->ARR = p_tx->p_durations[0] - 1;
+  TIM1->EGR = TIM_EGR_UG; /* Load the first duration in the active register and reset the counter (URS avoids the interrupt) */
+  if (p_tx->num_durations > 1)
+  {
+    TIM1->ARR = p_tx->p_durations[1] - 1; /* Preload the second duration */
+  }
+  else
+  {
+    TIM1->CR1 |= TIM_CR1_OPM; /* Only one duration: stop at the next update */
+  }
+  TIM1->SR = ~TIM_SR_UIF;
   TIM1 -> CR1 |= TIM_CR1_CEN ;
-  symbol_tick = 0;
 }
 
-void port_tx_symbol_tmr_stop()
+/// @brief Stop the symbol timer.
+static void _symbol_tmr_stop()
 {
-  TIM1 -> CR1 &= ~ TIM_CR1_CEN ;
+  TIM1 -> CR1 &= ~ (TIM_CR1_CEN | TIM_CR1_OPM);
 }
 
-uint32_t port_tx_tmr_get_tick()
+/// @brief Move to the next duration of the burst schedule, or finish the transmission if there are no more durations. This function is called by the ISR of the symbol timer, when the duration being counted has elapsed.
+/// @note The timer has already loaded the next duration from the preload register, so this function only switches the PWM and preloads the one after it. When the last duration starts, the one-pulse mode stops the timer at its end.
+/// @param tx_id Transmitter ID. This index is used to select the element of the transmitters_arr[] array.
+static void _next_duration(uint8_t tx_id)
 {
-  return symbol_tick;
+  port_tx_hw_t *p_tx = &transmitters_arr[tx_id];
+  p_tx->duration_idx++;
+  if (p_tx->duration_idx >= p_tx->num_durations)
+  {
+    port_tx_pwm_timer_set(tx_id, false);
+    _symbol_tmr_stop();
+    p_tx->busy = false;
+    return;
+  }
+  port_tx_pwm_timer_set(tx_id, (p_tx->duration_idx & 1) == 0); /* Even positions are bursts, odd positions are silences */
+  if (p_tx->loopback)
+  {
+    port_rx_inject_edge(IR_RX_0_ID);
+  }
+  if ((p_tx->duration_idx + 1) < p_tx->num_durations)
+  {
+    TIM1->ARR = p_tx->p_durations[p_tx->duration_idx + 1] - 1;
+  }
+  else
+  {
+    TIM1->CR1 |= TIM_CR1_OPM;
+  }
+}
+
+void port_tx_send_bursts(uint8_t tx_id, const uint16_t *p_durations, uint32_t num_durations)
+{
+  port_tx_hw_t *p_tx = &transmitters_arr[tx_id];
+  _symbol_tmr_stop();
+  if (num_durations == 0)
+  {
+    p_tx->busy = false;
+    return;
+  }
+  p_tx->p_durations = p_durations;
+  p_tx->num_durations = num_durations;
+  p_tx->duration_idx = 0;
+  p_tx->isr_count = 0;
+  p_tx->busy = true;
+  port_tx_pwm_timer_set(tx_id, true); /* The schedule always starts with a burst */
+  _symbol_tmr_start(tx_id);
+  LATENCY_MARK(LATENCY_FIRST_BURST);
+  if (p_tx->loopback)
+  {
+    port_rx_inject_edge(IR_RX_0_ID);
+  }
+}
+
+bool port_tx_is_busy(uint8_t tx_id)
+{
+  return transmitters_arr[tx_id].busy;
+}
+
+void port_tx_set_loopback(uint8_t tx_id, bool enable)
+{
+  transmitters_arr[tx_id].loopback = enable;
+  port_rx_set_loopback(IR_RX_0_ID, enable);
+}
+
+uint32_t port_tx_get_isr_count(uint8_t tx_id)
+{
+  return transmitters_arr[tx_id].isr_count;
 }
 
 //------------------------------------------------------
 // INTERRUPT SERVICE ROUTINES
 //------------------------------------------------------
 
-/// @brief This function handles TIM1-TIM10 global interrupts.
+/// @brief This function handles TIM1-TIM10 global interrupts. It is raised once per duration of the burst schedule, when the duration has elapsed, and switches the PWM.
 void TIM1_UP_TIM10_IRQHandler(void)
 {
   TIM1->SR &= ~TIM_SR_UIF;
-  symbol_tick++;
-}
\ No newline at end of file
+  if (transmitters_arr[IR_TX_0_ID].busy)
+  {
+    transmitters_arr[IR_TX_0_ID].isr_count++;
+    _next_duration(IR_TX_0_ID);
+  }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file brightness_sim.c
+ * @brief Host simulation of the automatic brightness of the RGB LED: a day of ambient light is fed to the brightness controller at the rate of the filter of the light sensor, and the current of the LED and the life of the battery are compared with the fixed maximum brightness. It also checks that the brightness never changes faster than the rate.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Itools/host -Icommon/include -Iport/nucleo_stm32f446re/include tools/brightness_sim.c common/src/brightness.c -lm -o brightness_sim
+ *   ./brightness_sim [battery capacity in mAh] [current of the rest of the system in mA]
+ *
+ * The LED shows white all day, the worst case. It returns 0 if the rate limit is respected.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "brightness.h"
+#include "port_rgb.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define LIGHT_MAX 4095                 /*!< Maximum value of the light sensor (darkness), as #SENSOR_VALUE_MAX */
+#define UPDATE_US 40000                /*!< Period of the filter of the light sensor: half buffer of 8 samples at 200 Hz */
+#define DAY_S (24 * 3600)              /*!< Seconds simulated */
+#define SHADOW_PERIOD_S 600            /*!< A shadow (or a flash of light at night) passes over the sensor every 10 minutes... */
+#define SHADOW_LENGTH_S 3              /*!< ...for 3 seconds */
+#define DEFAULT_BATTERY_MAH 5000       /*!< Capacity of the portable battery by default */
+#define DEFAULT_SYSTEM_MA 25           /*!< Current of the rest of the system by default: the board awake, the receiver and the sensor */
+#define NUM_CHANNELS 3                 /*!< Channels of the RGB LED, all on for white */
+
+/* Private functions */
+
+/// @brief Return the ambient light of the simulated day: night, dawn, sunlight, dusk and night again, with the passing shadows.
+/// @param t_s Time of the day in s.
+/// @return uint32_t Value of the light sensor.
+static uint32_t _get_light(double t_s)
+{
+    static const double hours_arr[] = {0, 6, 8, 12, 18, 20, 24};  /* Hours of the points of the profile */
+    static const double light_arr[] = {3900, 3900, 600, 150, 600, 3900, 3900}; /* Light at each point */
+    double h = t_s / 3600.0;
+    double light = light_arr[0];
+    for (size_t i = 1; i < sizeof(hours_arr) / sizeof(hours_arr[0]); i++)
+    {
+        if (h <= hours_arr[i])
+        {
+            light = light_arr[i - 1] + ((light_arr[i] - light_arr[i - 1]) * (h - hours_arr[i - 1])) / (hours_arr[i] - hours_arr[i - 1]);
+            break;
+        }
+    }
+    if (((uint32_t)t_s % SHADOW_PERIOD_S) < SHADOW_LENGTH_S)
+    {
+        light = (light < (LIGHT_MAX / 2)) ? LIGHT_MAX - 200 : 200; /* Shadow by day, a flash of light by night */
+    }
+    return (uint32_t)light;
+}
+
+/// @brief Return the current of the RGB LED showing white at a brightness, as `port_rgb_get_current_ua()`: #RGB_LED_CURRENT_UA times the gamma corrected duty cycle of each channel.
+/// @param brightness Brightness.
+/// @return double Current in uA.
+static double _get_current_ua(uint8_t brightness)
+{
+    double duty = round(RGB_PWM_PERIOD * pow(brightness / (double)RGB_LEVEL_MAX, 2.2)) / RGB_PWM_PERIOD;
+    return NUM_CHANNELS * RGB_LED_CURRENT_UA * duty;
+}
+
+int main(int argc, char *argv[])
+{
+    double battery_mah = (argc > 1) ? atof(argv[1]) : DEFAULT_BATTERY_MAH;
+    double system_ma = (argc > 2) ? atof(argv[2]) : DEFAULT_SYSTEM_MA;
+
+    brightness_init();
+    uint32_t num_updates = (uint32_t)((DAY_S * 1000000ULL) / UPDATE_US);
+    uint32_t updates_per_s = 1000000 / UPDATE_US;
+    double adaptive_sum_ua = 0;
+    uint32_t min_brightness = BRIGHTNESS_MAX;
+    uint32_t max_change_per_s = 0;
+    uint8_t second_start = brightness_get();
+    int errors = 0;
+    for (uint32_t n = 0; n < num_updates; n++)
+    {
+        brightness_update(_get_light(((double)n * UPDATE_US) / 1e6), UPDATE_US);
+        uint8_t b = brightness_get();
+        adaptive_sum_ua += _get_current_ua(b);
+        if (b < min_brightness)
+        {
+            min_brightness = b;
+        }
+        if (((n + 1) % updates_per_s) == 0)
+        {
+            uint32_t change = (uint32_t)abs((int)b - (int)second_start);
+            if (change > max_change_per_s)
+            {
+                max_change_per_s = change;
+            }
+            second_start = b;
+        }
+    }
+    if (max_change_per_s > BRIGHTNESS_RATE_DEFAULT)
+    {
+        errors++;
+    }
+
+    double fixed_ma = _get_current_ua(BRIGHTNESS_MAX) / 1000.0;
+    double adaptive_ma = adaptive_sum_ua / num_updates / 1000.0;
+    double fixed_h = battery_mah / (fixed_ma + system_ma);
+    double adaptive_h = battery_mah / (adaptive_ma + system_ma);
+    printf("Battery of %.0f mAh, rest of the system %.1f mA, LED white all day\n", battery_mah, system_ma);
+    printf("  fixed brightness:    LED %6.2f mA average, battery life %6.1f h\n", fixed_ma, fixed_h);
+    printf("  adaptive brightness: LED %6.2f mA average, battery life %6.1f h (%+.0f %%)\n", adaptive_ma, adaptive_h, 100.0 * (adaptive_h - fixed_h) / fixed_h);
+    printf("Minimum brightness %u, maximum change %u levels/s (limit %u)\n", (unsigned)min_brightness, (unsigned)max_change_per_s, (unsigned)BRIGHTNESS_RATE_DEFAULT);
+    printf("%s\n", errors ? "FAIL: the brightness changes faster than the rate" : "PASS");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file button_edges_test.c
+ * @brief Host test of the timestamped edges of the button: the button FSM runs against a stub of the port that takes the time of the first raw edge of a change, as the EXTI interrupt does, and debounces the buttons with keyscan every #BUTTON_SCAN_PERIOD_MS from the first edge, storing each change accepted as an event with that time, as the scan timer does. Presses with bounces are measured with the main loop running every 1, 7 and 49 ms, and the duration and the gesture must not depend on it.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Itools/host -Icommon/include -Iport/nucleo_stm32f446re/include tools/button_edges_test.c common/src/fsm_button.c common/src/keyscan.c common/src/fsm.c -o button_edges_test
+ *   ./button_edges_test
+ *
+ * It returns 0 if every check passes.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "fsm_button.h"
+#include "port_button.h"
+#include "keyscan.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define STEP_US 100          /*!< Step of the simulation */
+#define END_US 2500000       /*!< Time simulated for each press, enough for the click window to close */
+#define MAX_RAW_EDGES 16     /*!< Raw edges of a press, with its bounces */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to define a press of the button with bounces: the raw edges and what the FSM must measure.
+typedef struct
+{
+    const char *p_name;                      /*!< Name printed in the report */
+    port_button_event_t edges_arr[MAX_RAW_EDGES]; /*!< Raw edges, in order of time */
+    uint32_t num_edges;                      /*!< Number of raw edges */
+    uint32_t duration_ms;                    /*!< Duration expected: from the first press edge to the first release edge */
+    fsm_button_event_t event;                /*!< Gesture expected */
+} press_t;
+
+/* Global variables ------------------------------------------------------------*/
+static uint64_t now_us = 0;                                   /*!< Time of the simulation */
+static bool raw_pressed = false;                              /*!< Raw level of the button */
+static uint64_t change_us = 0;                                 /*!< Time of the first edge of the change not accepted yet */
+static bool changing = false;                                  /*!< Flag of change_us valid */
+static port_button_event_t queue_arr[BUTTON_EVENTS_QUEUE_SIZE]; /*!< Events stored by the scan */
+static uint32_t queue_head = 0;                                /*!< Next event written */
+static uint32_t queue_tail = 0;                                /*!< Next event read */
+static keyscan_t keys;                                        /*!< Debounce of the scan */
+static bool scanning = false;                                 /*!< Flag of the scan timer running */
+static uint64_t next_scan_us = 0;                             /*!< Time of the next sample of the scan */
+static int errors = 0;                                        /*!< Number of failed checks */
+
+/// @brief Presses tested: 0.3 to 2 ms of bounces at each edge, as a tactile switch.
+static const press_t presses_arr[] = {
+    {"click 120 ms", {{0, true}, {300, false}, {800, true}, {2000, false}, {2500, true}, {120000, false}, {120400, true}, {121000, false}}, 8, 120, BUTTON_EVENT_SINGLE_CLICK},
+    {"double click", {{0, true}, {300, false}, {800, true}, {90000, false}, {90500, true}, {91000, false}, {250000, true}, {250400, false}, {251000, true}, {340000, false}}, 10, 90, BUTTON_EVENT_DOUBLE_CLICK},
+    {"long 705 ms", {{0, true}, {300, false}, {800, true}, {2000, false}, {2500, true}, {705000, false}, {705400, true}, {706000, false}}, 8, 705, BUTTON_EVENT_LONG_PRESS},
+    {"hold 1800 ms", {{0, true}, {500, false}, {1000, true}, {1800000, false}, {1801500, true}, {1802000, false}}, 6, 1800, BUTTON_EVENT_HOLD},
+};
+
+/* Stub of the port */
+
+void port_button_init(uint32_t button_id)
+{
+    (void)button_id;
+    keyscan_init(&keys, 0);
+}
+
+bool port_button_is_pressed(uint32_t button_id)
+{
+    return (keys.state & (1UL << button_id)) != 0;
+}
+
+bool port_button_pop_event(uint32_t button_id, port_button_event_t *p_event)
+{
+    (void)button_id;
+    if (queue_tail == queue_head)
+    {
+        return false;
+    }
+    *p_event = queue_arr[queue_tail % BUTTON_EVENTS_QUEUE_SIZE];
+    queue_tail++;
+    return true;
+}
+
+uint64_t port_button_get_time_us(void)
+{
+    return now_us;
+}
+
+/* Private functions */
+
+/// @brief Take a raw edge as the EXTI interrupt does: take its time if it is the first one of a change, and start the scan.
+/// @param pressed true for a press, false for a release.
+static void _edge_interrupt(bool pressed)
+{
+    raw_pressed = pressed;
+    if (!changing)
+    {
+        change_us = now_us;
+        changing = true;
+    }
+    if (!scanning)
+    {
+        scanning = true;
+        next_scan_us = now_us + (BUTTON_SCAN_PERIOD_MS * 1000U);
+    }
+}
+
+/// @brief Take a sample of the scan as its timer interrupt does: store the change accepted as an event with the time of its first edge, and stop the scan when the button is stable.
+static void _scan_interrupt(void)
+{
+    uint32_t raw = raw_pressed ? 1U : 0U;
+    if (keyscan_update(&keys, raw) && ((queue_head - queue_tail) < (BUTTON_EVENTS_QUEUE_SIZE - 1)))
+    {
+        queue_arr[queue_head % BUTTON_EVENTS_QUEUE_SIZE] = (port_button_event_t){.time_us = change_us, .pressed = (keys.state != 0)};
+        queue_head++;
+    }
+    changing = ((raw ^ keys.state) != 0);
+    if (keyscan_check_settled(&keys, raw))
+    {
+        scanning = false;
+    }
+    next_scan_us += BUTTON_SCAN_PERIOD_MS * 1000U;
+}
+
+/// @brief Play a press against a new button FSM with a period of the main loop, and check the duration and the gesture.
+/// @param p_press Pointer to the press.
+/// @param loop_ms Period of the main loop.
+static void _test_press(const press_t *p_press, uint32_t loop_ms)
+{
+    now_us = 1000000; /* Start after the debounce of the reset */
+    raw_pressed = false;
+    queue_head = 0;
+    queue_tail = 0;
+    changing = false;
+    scanning = false;
+    fsm_t *p_fsm = fsm_button_new(BUTTON_0_ID);
+    uint64_t start_us = now_us;
+    uint64_t next_loop_us = now_us;
+    uint32_t edge_idx = 0;
+    fsm_button_event_t event = BUTTON_EVENT_NONE;
+    uint32_t duration_ms = 0;
+    for (; now_us < (start_us + END_US); now_us += STEP_US)
+    {
+        while ((edge_idx < p_press->num_edges) && ((start_us + p_press->edges_arr[edge_idx].time_us) <= now_us))
+        {
+            _edge_interrupt(p_press->edges_arr[edge_idx++].pressed);
+        }
+        if (scanning && (next_scan_us <= now_us))
+        {
+            _scan_interrupt();
+        }
+        if (next_loop_us <= now_us)
+        {
+            fsm_fire(p_fsm);
+            if (fsm_button_get_duration(p_fsm) != 0)
+            {
+                duration_ms = fsm_button_get_duration(p_fsm);
+            }
+            if (fsm_button_get_event(p_fsm) != BUTTON_EVENT_NONE)
+            {
+                event = fsm_button_get_event(p_fsm);
+            }
+            next_loop_us += loop_ms * 1000U;
+        }
+    }
+    bool ok = (duration_ms == p_press->duration_ms) && (event == p_press->event);
+    printf("  %-13s loop %2lu ms: %4lu ms, event %d %s\n", p_press->p_name, (unsigned long)loop_ms, (unsigned long)duration_ms, (int)event, ok ? "" : "<- FAIL");
+    errors += !ok;
+    fsm_destroy(p_fsm);
+}
+
+int main(void)
+{
+    static const uint32_t loops_ms_arr[] = {1, 7, 49};
+    for (uint32_t i = 0; i < (sizeof(presses_arr) / sizeof(presses_arr[0])); i++)
+    {
+        for (uint32_t j = 0; j < (sizeof(loops_ms_arr) / sizeof(loops_ms_arr[0])); j++)
+        {
+            _test_press(&presses_arr[i], loops_ms_arr[j]);
+        }
+    }
+    printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}
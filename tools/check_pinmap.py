@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Check the pin and timer map of the port.
+
+Usage: python3 tools/check_pinmap.py [port directory]
+
+It reads the <NAME>_GPIO/<NAME>_PIN pairs of the port headers and the timer
+map (PORT_TIMER_* and PORT_TIMERS_MAP) of port_system.h, prints them, and
+fails if two functions use the same pin or the same timer, if an owner of
+the timer map is missing from PORT_TIMERS_MAP, or if two source files of the
+port write the registers of the same timer.
+"""
+
+import glob
+import os
+import re
+import sys
+from collections import defaultdict
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+DEFAULT_PORT = os.path.join(ROOT, "port", "nucleo_stm32f446re")
+
+GPIO_RE = re.compile(r"^#define\s+(\w+)_GPIO\s+GPIO([A-H])\b", re.M)
+PIN_RE = re.compile(r"^#define\s+(\w+)_PIN\s+(\d+)\b", re.M)
+TIMER_RE = re.compile(r"^#define\s+PORT_TIMER_(\w+?)\s+(\d+)\b", re.M)
+MAP_RE = re.compile(r"^#define\s+PORT_TIMERS_MAP\(X\)\s+(.*?)\s*(/\*.*)?$", re.M)
+TIM_USE_RE = re.compile(r"\bTIM(\d+)\s*->")
+PORT_TIM_RE = re.compile(r"\bPORT_TIM\(PORT_TIMER_(\w+)\)")
+
+
+def main():
+    port = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_PORT
+    errors = []
+
+    pins = defaultdict(list)
+    for header in sorted(glob.glob(os.path.join(port, "include", "*.h"))):
+        text = open(header, encoding="utf-8").read()
+        gpios = dict(GPIO_RE.findall(text))
+        for name, pin in PIN_RE.findall(text):
+            if name in gpios:
+                pins[f"P{gpios[name]}{int(pin)}"].append(name)
+
+    system = open(os.path.join(port, "include", "port_system.h"), encoding="utf-8").read()
+    timers = defaultdict(list)
+    owners = set()
+    for name, number in TIMER_RE.findall(system):
+        if not name.endswith("_CH"):
+            timers[int(number)].append(name)
+            owners.add(name)
+    map_match = MAP_RE.search(system)
+    listed = set(re.findall(r"X\((\w+)\)", map_match.group(1))) if map_match else set()
+    for name in sorted(owners - listed):
+        errors.append(f"PORT_TIMER_{name} is not in PORT_TIMERS_MAP, so it is not checked at compile time")
+
+    numbers = {name: number for number, names in timers.items() for name in names}
+    writers = defaultdict(set)
+    for source in sorted(glob.glob(os.path.join(port, "src", "*.c"))):
+        text = open(source, encoding="utf-8").read()
+        used = [int(number) for number in TIM_USE_RE.findall(text)]
+        used += [numbers[name] for name in PORT_TIM_RE.findall(text) if name in numbers]
+        for number in used:
+            writers[number].add(os.path.basename(source))
+
+    print("Pins:")
+    for pin in sorted(pins, key=lambda p: (p[1], int(p[2:]))):
+        print(f"  {pin:5s} {', '.join(pins[pin])}")
+        if len(pins[pin]) > 1:
+            errors.append(f"{pin} is used by {', '.join(pins[pin])}")
+
+    print("Timers:")
+    for number in sorted(set(timers) | set(writers)):
+        files = ", ".join(sorted(writers[number])) or "-"
+        print(f"  TIM{number:<3d} {', '.join(timers[number]) or '(not in map)':24s} {files}")
+        if len(timers[number]) > 1:
+            errors.append(f"TIM{number} is owned by {', '.join(timers[number])}")
+        if len(writers[number]) > 1:
+            errors.append(f"TIM{number} is programmed by {files}")
+        if writers[number] and not timers[number]:
+            errors.append(f"TIM{number} is programmed by {files} but it is not in the timer map")
+
+    for error in errors:
+        print(f"error: {error}", file=sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,17 @@
+/**
+ * @file stm32f4xx.h
+ * @brief Host stand-in for the CMSIS device header, so that the host tools can include the headers of the port. It only declares the peripheral types taken by the prototypes of the port; the registers do not exist on the host, so the tools stub the port functions they use.
+ *
+ * Host tools that link FSMs using the port add `-Itools/host` before the include directory of the port.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+#ifndef STM32F4XX_HOST_H_
+#define STM32F4XX_HOST_H_
+
+typedef struct GPIO_TypeDef GPIO_TypeDef; /*!< GPIO port, only used through pointers */
+typedef struct TIM_TypeDef TIM_TypeDef;   /*!< Timer, only used through pointers */
+
+#endif
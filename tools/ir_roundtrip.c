@@ -0,0 +1,414 @@
+/**
+ * @file ir_roundtrip.c
+ * @brief Host round trip of the infrared encoders: each protocol of the registry encodes random codes, the burst schedules are turned into the edges that the infrared receiver stores (ticks of #NEC_RX_TIMER_TICK_BASE_US, with the bursts stretched as a demodulator does) and they are decoded back. It also checks the silence after each frame: the frame period of each protocol, also when a schedule is reused with another gap as the cache of the transmitter does, the NEC repetition frame and the minimum gaps.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Icommon/include tools/ir_roundtrip.c common/src/ir_encoder.c common/src/fsm_rx_nec.c common/src/fsm.c -o ir_roundtrip
+ *   ./ir_roundtrip [codes per protocol]
+ *
+ * NEC, extended NEC and the repetition frame are decoded by the NEC FSM of the receiver (`fsm_rx_NEC_parse_code()`). The receiver has no decoder for the other protocols, so Samsung, SIRC, RC5 and RC6 are decoded by reference decoders of this tool, written from the timings of each protocol and not from the registry. It returns 0 if every code is decoded back and every frame keeps its period.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "ir_encoder.h"
+#include "fsm_tx.h"
+#include "fsm_rx_nec.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define DEFAULT_CODES 1000      /*!< Random codes encoded per protocol by default */
+#define TOLERANCE_PERCENT 35    /*!< Tolerance of the reference decoders on each burst and silence */
+#define MAX_EDGES NEC_FRAME_EDGES /*!< Edges stored for a frame, as the buffer of the receiver */
+#define MAX_UNITS 128           /*!< Half-bits of a biphase frame */
+#define SAMSUNG_HEADER_US 4500  /*!< Samsung header burst and silence */
+#define SAMSUNG_BURST_US 560    /*!< Samsung burst of the bits and trailer */
+#define SAMSUNG_ONE_US 1690     /*!< Samsung silence of a bit 1 (560 us for a bit 0) */
+#define SIRC_HEADER_US 2400     /*!< SIRC header burst */
+#define SIRC_UNIT_US 600        /*!< SIRC silences and burst of a bit 0 (1200 us for a bit 1) */
+#define RC5_UNIT_US 889         /*!< RC5 half-bit */
+#define RC6_UNIT_US 444         /*!< RC6 half-bit */
+
+/* Global variables ------------------------------------------------------------*/
+/// @brief Names of the protocols of the registry, printed in the report.
+static const char *protocol_names[IR_PROTOCOL_NUM] = {"NEC", "NEC ext", "Samsung", "SIRC", "RC5", "RC6"};
+
+/// @brief Bits of the code given to the encoder for each protocol.
+static const uint8_t code_bits_arr[IR_PROTOCOL_NUM] = {32, 24, 32, 12, 13, 20};
+
+static uint16_t edges_arr[MAX_EDGES]; /*!< Edges of a frame, in ticks of the receiver */
+static uint32_t segments_us[MAX_EDGES]; /*!< Bursts and silences between the edges of a frame, in us */
+
+/* Private functions */
+
+/// @brief Turn a burst schedule into the edges stored by the receiver: one edge at the start of each burst and of each silence. Each burst is stretched and the following silence shortened, as the output of a demodulator. The ticks start at a random phase and wrap around, as the time base of the receiver.
+/// @param p_durations Pointer to the burst schedule.
+/// @param num_durations Number of durations of the burst schedule.
+/// @param stretch_us Time that each burst is stretched.
+/// @return uint32_t Number of edges.
+static uint32_t _schedule_to_edges(const uint16_t *p_durations, uint32_t num_durations, uint32_t stretch_us)
+{
+    uint64_t t_ns = ((uint64_t)rand() % 65536) * NEC_RX_TIMER_TICK_BASE_US * 1000U;
+    uint32_t num_edges = 0;
+    for (uint32_t i = 0; (i < num_durations) && (num_edges < MAX_EDGES); i++)
+    {
+        uint64_t edge_ns = t_ns + (((i & 1) == 1) ? (stretch_us * 1000ULL) : 0); /* The end of a burst is late */
+        edges_arr[num_edges++] = (uint16_t)(edge_ns / (NEC_RX_TIMER_TICK_BASE_US * 1000U));
+        t_ns += (uint64_t)p_durations[i] * NEC_TX_TIMER_TICK_BASE_NS;
+    }
+    return num_edges;
+}
+
+/// @brief Measure the bursts and silences between the edges. Even positions are bursts.
+/// @param num_edges Number of edges.
+/// @return uint32_t Number of bursts and silences.
+static uint32_t _edges_to_segments(uint32_t num_edges)
+{
+    for (uint32_t i = 0; (i + 1) < num_edges; i++)
+    {
+        segments_us[i] = (uint16_t)(edges_arr[i + 1] - edges_arr[i]) * NEC_RX_TIMER_TICK_BASE_US;
+    }
+    return (num_edges > 0) ? (num_edges - 1) : 0;
+}
+
+/// @brief Check if a burst or a silence matches its nominal length within the tolerance.
+/// @param us Length measured.
+/// @param nominal_us Nominal length.
+/// @return true
+/// @return false
+static bool _match(uint32_t us, uint32_t nominal_us)
+{
+    return ((us * 100U) >= (nominal_us * (100U - TOLERANCE_PERCENT))) && ((us * 100U) <= (nominal_us * (100U + TOLERANCE_PERCENT)));
+}
+
+/// @brief Decode a Samsung frame: header, 32 bits MSB first with pulse distance encoding and trailer.
+/// @param num_segments Number of bursts and silences.
+/// @param p_code Pointer to store the code.
+/// @return true if the frame is valid
+static bool _decode_samsung(uint32_t num_segments, uint32_t *p_code)
+{
+    if ((num_segments != 67) || !_match(segments_us[0], SAMSUNG_HEADER_US) || !_match(segments_us[1], SAMSUNG_HEADER_US))
+    {
+        return false;
+    }
+    uint32_t code = 0;
+    for (uint32_t i = 0; i < 32; i++)
+    {
+        uint32_t burst_us = segments_us[2 + (2 * i)];
+        uint32_t silence_us = segments_us[3 + (2 * i)];
+        if (!_match(burst_us, SAMSUNG_BURST_US))
+        {
+            return false;
+        }
+        if (_match(silence_us, SAMSUNG_ONE_US))
+        {
+            code = (code << 1) | 1;
+        }
+        else if (_match(silence_us, SAMSUNG_BURST_US))
+        {
+            code = code << 1;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    *p_code = code;
+    return _match(segments_us[66], SAMSUNG_BURST_US);
+}
+
+/// @brief Decode a SIRC frame: header and 12 bits LSB first with pulse width encoding. The silence of the last bit is the gap, so it has no edge.
+/// @param num_segments Number of bursts and silences.
+/// @param p_code Pointer to store the code.
+/// @return true if the frame is valid
+static bool _decode_sirc(uint32_t num_segments, uint32_t *p_code)
+{
+    if ((num_segments != 25) || !_match(segments_us[0], SIRC_HEADER_US) || !_match(segments_us[1], SIRC_UNIT_US))
+    {
+        return false;
+    }
+    uint32_t code = 0;
+    for (uint32_t i = 0; i < 12; i++)
+    {
+        uint32_t burst_us = segments_us[2 + (2 * i)];
+        if ((i < 11) && !_match(segments_us[3 + (2 * i)], SIRC_UNIT_US))
+        {
+            return false;
+        }
+        if (_match(burst_us, 2 * SIRC_UNIT_US))
+        {
+            code |= 1UL << i;
+        }
+        else if (!_match(burst_us, SIRC_UNIT_US))
+        {
+            return false;
+        }
+    }
+    *p_code = code;
+    return true;
+}
+
+/// @brief Turn the bursts and silences of a biphase frame into half-bits: 1 for a burst, 0 for a silence. The half-bits after the last burst are silences.
+/// @param num_segments Number of bursts and silences.
+/// @param unit_us Length of a half-bit.
+/// @param p_units Pointer to store the half-bits, after the ones already stored.
+/// @param num_units Number of half-bits already stored.
+/// @return uint32_t Number of half-bits stored, 0 if a burst or a silence is not a whole number of half-bits.
+static uint32_t _segments_to_units(uint32_t num_segments, uint32_t unit_us, uint8_t *p_units, uint32_t num_units)
+{
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        uint32_t count = (segments_us[i] + (unit_us / 2)) / unit_us;
+        if ((count == 0) || !_match(segments_us[i], count * unit_us))
+        {
+            return 0;
+        }
+        for (uint32_t j = 0; (j < count) && (num_units < MAX_UNITS); j++)
+        {
+            p_units[num_units++] = ((i & 1) == 0);
+        }
+    }
+    while (num_units < MAX_UNITS)
+    {
+        p_units[num_units++] = 0;
+    }
+    return num_units;
+}
+
+/// @brief Decode a RC5 frame: 14 bits MSB first, a bit 1 is a silence followed by a burst. The first half of the start bit is a silence, so it has no edge.
+/// @param num_segments Number of bursts and silences.
+/// @param p_code Pointer to store the 13-bit code, without the start bit.
+/// @return true if the frame is valid
+static bool _decode_rc5(uint32_t num_segments, uint32_t *p_code)
+{
+    uint8_t units_arr[MAX_UNITS] = {0};
+    if (_segments_to_units(num_segments, RC5_UNIT_US, units_arr, 1) == 0)
+    {
+        return false;
+    }
+    uint32_t code = 0;
+    for (uint32_t i = 0; i < 14; i++)
+    {
+        uint8_t first = units_arr[2 * i];
+        uint8_t second = units_arr[(2 * i) + 1];
+        if (first == second)
+        {
+            return false;
+        }
+        code = (code << 1) | second;
+    }
+    *p_code = code & 0x1FFF;
+    return (code >> 13) == 1;
+}
+
+/// @brief Decode a RC6 mode 0 frame: header of 6 half-bits of burst and 2 of silence, then 21 bits MSB first, a bit 1 is a burst followed by a silence. The fifth bit (toggle) lasts twice.
+/// @param num_segments Number of bursts and silences.
+/// @param p_code Pointer to store the 20-bit code, without the start bit.
+/// @return true if the frame is valid
+static bool _decode_rc6(uint32_t num_segments, uint32_t *p_code)
+{
+    uint8_t units_arr[MAX_UNITS] = {0};
+    if (_segments_to_units(num_segments, RC6_UNIT_US, units_arr, 0) == 0)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        if (units_arr[i] != (i < 6))
+        {
+            return false;
+        }
+    }
+    uint32_t code = 0;
+    uint32_t idx = 8;
+    for (uint32_t i = 0; i < 21; i++)
+    {
+        uint32_t width = (i == 4) ? 2 : 1;
+        uint8_t first = units_arr[idx];
+        uint8_t second = units_arr[idx + width];
+        if ((first == second) || (units_arr[idx + width - 1] != first) || (units_arr[idx + (2 * width) - 1] != second))
+        {
+            return false;
+        }
+        code = (code << 1) | first;
+        idx += 2 * width;
+    }
+    *p_code = code & 0xFFFFF;
+    return (code >> 20) == 1;
+}
+
+/// @brief Return the code expected from the decoder of a protocol: the code sent, after the packing of the encoder for the NEC decoder, or without the fixed bits for the reference decoders.
+/// @param protocol Protocol of the registry.
+/// @param code Code given to the encoder.
+/// @return uint32_t Code expected.
+static uint32_t _expected_code(ir_protocol_t protocol, uint32_t code)
+{
+    if (protocol == IR_PROTOCOL_NEC_EXT)
+    {
+        return ((code & 0xFFFFFF) << 8) | ((~code) & 0xFF);
+    }
+    return code;
+}
+
+/// @brief Encode a code, pad it to the frame period, feed its edges to the decoder of its protocol and compare the code decoded.
+/// @param p_fsm_nec Pointer to the NEC FSM of the receiver.
+/// @param protocol Protocol of the registry.
+/// @param code Code to be encoded.
+/// @param stretch_us Time that each burst is stretched.
+/// @return int 0 if the code is decoded back, 1 otherwise.
+static int _roundtrip(fsm_t *p_fsm_nec, ir_protocol_t protocol, uint32_t code, uint32_t stretch_us)
+{
+    uint16_t durations[IR_ENCODER_MAX_DURATIONS];
+    uint32_t num_durations = ir_encoder_build_schedule(protocol, code, durations);
+    ir_encoder_set_gap(ir_encoder_get_protocol(protocol), durations, num_durations, NEC_TX_GAP_MIN);
+    uint32_t num_edges = _schedule_to_edges(durations, num_durations, stretch_us);
+    uint32_t num_segments = _edges_to_segments(num_edges);
+    uint32_t decoded = 0;
+    bool valid = false;
+    switch (protocol)
+    {
+    case IR_PROTOCOL_NEC:
+    case IR_PROTOCOL_NEC_EXT:
+        valid = !fsm_rx_NEC_parse_code(p_fsm_nec, edges_arr, num_edges, &decoded);
+        break;
+    case IR_PROTOCOL_SAMSUNG:
+        valid = _decode_samsung(num_segments, &decoded);
+        break;
+    case IR_PROTOCOL_SIRC:
+        valid = _decode_sirc(num_segments, &decoded);
+        break;
+    case IR_PROTOCOL_RC5:
+        valid = _decode_rc5(num_segments, &decoded);
+        break;
+    default:
+        valid = _decode_rc6(num_segments, &decoded);
+        break;
+    }
+    if (!valid || (decoded != _expected_code(protocol, code)))
+    {
+        printf("%s: code 0x%08X (%u us of stretch) decoded as 0x%08X%s\n", protocol_names[protocol], (unsigned)code, (unsigned)stretch_us, (unsigned)decoded, valid ? "" : " (invalid frame)");
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Add up the durations of a burst schedule.
+/// @param p_durations Pointer to the burst schedule.
+/// @param num_durations Number of durations of the burst schedule.
+/// @return uint32_t Length of the frame and its gap, in ticks of the symbol timer.
+static uint32_t _schedule_ticks(const uint16_t *p_durations, uint32_t num_durations)
+{
+    uint32_t ticks = 0;
+    for (uint32_t i = 0; i < num_durations; i++)
+    {
+        ticks += p_durations[i];
+    }
+    return ticks;
+}
+
+/// @brief Check the gap of a protocol: a frame padded to the period lasts the period, also after the schedule has been sent with a longer gap, and an explicit gap is never shorter than the minimum of the protocol.
+/// @param protocol Protocol of the registry.
+/// @param code Code to be encoded.
+/// @return int Number of errors.
+static int _check_gaps(ir_protocol_t protocol, uint32_t code)
+{
+    const ir_protocol_desc_t *p_desc = ir_encoder_get_protocol(protocol);
+    uint16_t durations[IR_ENCODER_MAX_DURATIONS];
+    uint32_t num_durations = ir_encoder_build_schedule(protocol, code, durations);
+    uint32_t last = num_durations - 1;
+    int errors = 0;
+
+    ir_encoder_set_gap(p_desc, durations, num_durations, NEC_TX_GAP_MIN);
+    uint32_t fresh_ticks = _schedule_ticks(durations, num_durations);
+    ir_encoder_set_gap(p_desc, durations, num_durations, 2 * p_desc->frame_period); /* The cache keeps the schedule with the last gap set */
+    ir_encoder_set_gap(p_desc, durations, num_durations, NEC_TX_GAP_MIN);
+    uint32_t reused_ticks = _schedule_ticks(durations, num_durations);
+    if ((fresh_ticks != p_desc->frame_period) || (reused_ticks != p_desc->frame_period))
+    {
+        printf("%s: frame of %u ticks fresh and %u ticks reused, period %u ticks\n", protocol_names[protocol], (unsigned)fresh_ticks, (unsigned)reused_ticks, (unsigned)p_desc->frame_period);
+        errors++;
+    }
+    if (durations[last] < p_desc->gap_min)
+    {
+        printf("%s: padded gap of %u ticks, minimum %u ticks\n", protocol_names[protocol], durations[last], p_desc->gap_min);
+        errors++;
+    }
+    ir_encoder_set_gap(p_desc, durations, num_durations, 1);
+    if ((durations[last] < p_desc->gap_min) || (durations[last] < IR_ENCODER_MIN_TICKS))
+    {
+        printf("%s: gap of 1 tick set to %u ticks, minimum %u ticks\n", protocol_names[protocol], durations[last], p_desc->gap_min);
+        errors++;
+    }
+    return errors;
+}
+
+/// @brief Check the NEC repetition frame, built as the transmitter does: it lasts the NEC frame period and the NEC FSM of the receiver reports it as a repetition.
+/// @param p_fsm_nec Pointer to the NEC FSM of the receiver.
+/// @return int Number of errors.
+static int _check_repetition(fsm_t *p_fsm_nec)
+{
+    uint16_t durations[NEC_TX_REPEAT_DURATIONS] = {NEC_TX_PROLOGUE_TICKS_ON, NEC_TX_REPEAT_TICKS_OFF, NEC_TX_EPILOGUE_TICKS_ON, NEC_TX_EPILOGUE_TICKS_OFF};
+    int errors = 0;
+    ir_encoder_set_gap(ir_encoder_get_protocol(IR_PROTOCOL_NEC), durations, NEC_TX_REPEAT_DURATIONS, NEC_TX_GAP_MIN);
+    uint32_t ticks = _schedule_ticks(durations, NEC_TX_REPEAT_DURATIONS);
+    if (ticks != NEC_TX_FRAME_PERIOD_TICKS)
+    {
+        printf("NEC repetition: frame of %u ticks, period %u ticks\n", (unsigned)ticks, NEC_TX_FRAME_PERIOD_TICKS);
+        errors++;
+    }
+    uint32_t code = 0;
+    uint32_t num_edges = _schedule_to_edges(durations, NEC_TX_REPEAT_DURATIONS, 0);
+    if (!fsm_rx_NEC_parse_code(p_fsm_nec, edges_arr, num_edges, &code))
+    {
+        printf("NEC repetition: not decoded as a repetition\n");
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t stretches_us[] = {0, 100}; /* Ideal edges, and the bursts of a typical demodulator */
+    uint32_t num_codes = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_CODES;
+    if (num_codes == 0)
+    {
+        printf("The number of codes must be at least 1\n");
+        return 1;
+    }
+
+    fsm_t *p_fsm_nec = fsm_rx_NEC_new();
+    int errors = 0;
+    for (uint32_t p = 0; p < IR_PROTOCOL_NUM; p++)
+    {
+        const ir_protocol_desc_t *p_desc = ir_encoder_get_protocol((ir_protocol_t)p);
+        uint32_t mask = (code_bits_arr[p] == 32) ? 0xFFFFFFFFUL : ((1UL << code_bits_arr[p]) - 1);
+        int protocol_errors = 0;
+        for (uint32_t n = 0; n < num_codes; n++)
+        {
+            uint32_t code = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & mask;
+            if (n < 2)
+            {
+                code = (n == 0) ? mask : (0xA5A5A5A5UL & mask); /* All ones (longest frame) and a fixed pattern */
+            }
+            for (uint32_t s = 0; s < sizeof(stretches_us) / sizeof(stretches_us[0]); s++)
+            {
+                protocol_errors += _roundtrip(p_fsm_nec, (ir_protocol_t)p, code, stretches_us[s]);
+            }
+            if (n < 2)
+            {
+                protocol_errors += _check_gaps((ir_protocol_t)p, code);
+            }
+        }
+        printf("%-8s %u codes, %d errors, frame period %u ticks (%.1f ms), minimum gap %u ticks (%.2f ms)\n", protocol_names[p], (unsigned)num_codes, protocol_errors,
+               (unsigned)p_desc->frame_period, (p_desc->frame_period * NEC_TX_TIMER_TICK_BASE_NS) / 1e6, (unsigned)p_desc->gap_min, (p_desc->gap_min * NEC_TX_TIMER_TICK_BASE_NS) / 1e6);
+        errors += protocol_errors;
+    }
+    errors += _check_repetition(p_fsm_nec);
+    fsm_destroy(p_fsm_nec);
+
+    printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}
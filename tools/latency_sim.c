@@ -0,0 +1,215 @@
+/**
+ * @file latency_sim.c
+ * @brief Host simulation of the TX->RX loopback latency benchmark: the transmitter, receiver and NEC FSMs and the latency instrumentation run as in `make LATENCY_BENCH=1`, against a stub of the port that replays each burst schedule as the edges of the receiver, at the time of each switch of the PWM. The commands are sent as the benchmark of the retina does, the next one as soon as the previous one has been executed, and the report has the same percentiles.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -DLATENCY_BENCH=1 -Itools/host -Icommon/include -Iport/nucleo_stm32f446re/include tools/latency_sim.c common/src/fsm_tx.c common/src/fsm_rx.c common/src/fsm_rx_nec.c common/src/ir_encoder.c common/src/latency.c common/src/fsm.c -o latency_sim
+ *   ./latency_sim [number of commands] [time of a pass of the main loop in us]
+ *
+ * Each pass of the main loop lasts a random time between half and one and a half times the one given. The interrupts of the edges are taken at once. Sleep modes and clock changes are not simulated. It returns 0 if every command is executed with the code sent.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "fsm_tx.h"
+#include "fsm_rx.h"
+#include "fsm_rx_nec.h"
+#include "port_tx.h"
+#include "port_rx.h"
+#include "port_system.h"
+#include "latency.h"
+#include "commands.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define DEFAULT_COMMANDS 200 /*!< Commands sent by default, as #BENCH_NUM_COMMANDS of the retina */
+#define DEFAULT_LOOP_US 20   /*!< Time of a pass of the main loop by default */
+#define BENCH_TIMEOUT_US 1000000 /*!< Time to wait for a command to be executed before sending the next one, as #BENCH_TIMEOUT_MS of the retina */
+
+/* Global variables ------------------------------------------------------------*/
+static uint64_t now_us = 0;                        /*!< Time of the simulation */
+static const uint16_t *p_schedule = NULL;          /*!< Burst schedule on air */
+static uint32_t schedule_len = 0;                  /*!< Number of durations of the burst schedule on air */
+static uint32_t schedule_idx = 0;                  /*!< Next duration whose start is an edge */
+static uint64_t schedule_next_ns = 0;              /*!< Time of the next edge, in ns */
+static uint16_t edge_ticks_arr[NEC_FRAME_EDGES];   /*!< Edges of the receiver, in its ticks */
+static uint32_t num_edges = 0;                     /*!< Number of edges of the receiver */
+static uint64_t last_edge_us = 0;                  /*!< Time of the last edge of the receiver */
+
+/* Stub of the port */
+
+uint64_t port_system_get_micros64(void)
+{
+    return now_us;
+}
+
+void port_tx_init(uint8_t tx_id, bool status)
+{
+    (void)tx_id;
+    (void)status;
+}
+
+void port_tx_set_carrier(uint8_t tx_id, uint32_t freq_hz, uint8_t duty_percent)
+{
+    (void)tx_id;
+    (void)freq_hz;
+    (void)duty_percent;
+}
+
+void port_tx_send_bursts(uint8_t tx_id, const uint16_t *p_durations, uint32_t num_durations)
+{
+    (void)tx_id;
+    p_schedule = p_durations;
+    schedule_len = num_durations;
+    schedule_idx = 0;
+    schedule_next_ns = now_us * 1000U;
+    LATENCY_MARK(LATENCY_FIRST_BURST);
+}
+
+bool port_tx_is_busy(uint8_t tx_id)
+{
+    (void)tx_id;
+    return (p_schedule != NULL);
+}
+
+void port_rx_init(uint8_t rx_id)
+{
+    (void)rx_id;
+}
+
+void port_rx_en(uint8_t rx_id, bool interr_en)
+{
+    (void)interr_en;
+    port_rx_clean_buffer(rx_id);
+}
+
+void port_rx_tmr_start(void)
+{
+}
+
+void port_rx_tmr_stop(void)
+{
+}
+
+uint32_t port_rx_get_num_edges(uint8_t rx_id)
+{
+    (void)rx_id;
+    return num_edges;
+}
+
+uint16_t *port_rx_get_buffer_edges(uint8_t rx_id)
+{
+    (void)rx_id;
+    return edge_ticks_arr;
+}
+
+void port_rx_clean_buffer(uint8_t rx_id)
+{
+    (void)rx_id;
+    num_edges = 0;
+}
+
+uint64_t port_rx_get_last_edge_us(uint8_t rx_id)
+{
+    (void)rx_id;
+    return last_edge_us;
+}
+
+/* Private functions */
+
+/// @brief Take the interrupts of the symbol timer up to the current time: each duration of the burst schedule on air starts with an edge stored by the receiver at that time, as in loopback mode. The schedule ends after its last duration.
+static void _run_interrupts(void)
+{
+    uint64_t loop_us = now_us;
+    while ((p_schedule != NULL) && ((schedule_next_ns / 1000U) <= loop_us))
+    {
+        now_us = schedule_next_ns / 1000U;
+        if (schedule_idx == schedule_len)
+        {
+            p_schedule = NULL;
+            break;
+        }
+        if (num_edges < NEC_FRAME_EDGES)
+        {
+            edge_ticks_arr[num_edges++] = (uint16_t)(now_us / NEC_RX_TIMER_TICK_BASE_US);
+            last_edge_us = now_us;
+            LATENCY_MARK(LATENCY_LAST_EDGE);
+        }
+        schedule_next_ns += (uint64_t)p_schedule[schedule_idx++] * NEC_TX_TIMER_TICK_BASE_NS;
+    }
+    now_us = loop_us;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *stage_names[LATENCY_NUM_STAGES] = {"set_code", "first_burst", "last_edge", "decoded", "executed"};
+    uint32_t num_commands = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_COMMANDS;
+    uint32_t loop_us = (argc > 2) ? (uint32_t)atoi(argv[2]) : DEFAULT_LOOP_US;
+    if ((num_commands == 0) || (loop_us == 0))
+    {
+        printf("The number of commands and the time of the main loop must be at least 1\n");
+        return 1;
+    }
+
+    fsm_t *p_fsm_tx = fsm_tx_new(0);
+    fsm_t *p_fsm_rx = fsm_rx_new(0);
+    latency_init();
+
+    uint32_t sent = 0;
+    uint32_t errors = 0;
+    uint32_t expected_code = 0;
+    uint64_t sent_us = 0;
+    bool done = true;
+    while (true)
+    {
+        now_us += (loop_us / 2) + ((uint32_t)rand() % (loop_us + 1));
+        _run_interrupts();
+        if (done || ((now_us - sent_us) >= BENCH_TIMEOUT_US))
+        {
+            if (!done)
+            {
+                errors++; /* Lost */
+            }
+            if (sent == num_commands)
+            {
+                break;
+            }
+            expected_code = (sent & 1) ? LIL_RED_BUTTON : LIL_GREEN_BUTTON;
+            fsm_tx_set_code(p_fsm_tx, expected_code);
+            sent++;
+            sent_us = now_us;
+            done = false;
+        }
+        fsm_fire(p_fsm_tx);
+        fsm_fire(p_fsm_rx);
+        uint32_t code = fsm_rx_get_code(p_fsm_rx);
+        if (code != 0x00) /* The retina executes the code */
+        {
+            LATENCY_MARK(LATENCY_EXECUTED);
+            errors += (code != expected_code);
+            done = true;
+        }
+        if ((code != 0x00) || fsm_rx_get_repetition(p_fsm_rx) || fsm_rx_get_error_code(p_fsm_rx))
+        {
+            fsm_rx_reset_code(p_fsm_rx);
+        }
+    }
+
+    uint32_t measured = latency_get_num_commands();
+    printf("Main loop %u us (+-50%%)\n", (unsigned)loop_us);
+    printf("Loopback: %lu/%lu commands, %lu commands/min\n", (unsigned long)measured, (unsigned long)sent, (unsigned long)latency_get_commands_per_min());
+    for (uint8_t i = LATENCY_FIRST_BURST; i < LATENCY_NUM_STAGES; i++)
+    {
+        printf("  %-12s p50 %6lu us  p90 %6lu us  p99 %6lu us  max %6lu us\n", stage_names[i],
+               (unsigned long)latency_get_percentile_us(i, 50), (unsigned long)latency_get_percentile_us(i, 90),
+               (unsigned long)latency_get_percentile_us(i, 99), (unsigned long)latency_get_percentile_us(i, 100));
+    }
+    errors += (measured != sent);
+    fsm_destroy(p_fsm_tx);
+    fsm_destroy(p_fsm_rx);
+    printf("%s: %u errors\n", errors ? "FAIL" : "PASS", (unsigned)errors);
+    return errors ? 1 : 0;
+}
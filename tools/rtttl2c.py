@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Convert RTTTL ringtones into the packed melody format of the buzzer FSM.
+
+Usage: python3 tools/rtttl2c.py tools/melodies.rtttl
+
+It writes common/include/melodies.h and common/src/melodies.c, one melody per
+RTTTL line, and prints the size of each melody compared with a table of
+fsm_buzzer note structures (4 bytes per note). The packed format is described
+in common/include/fsm_buzzer.h.
+"""
+
+import os
+import re
+import sys
+
+NOTES = {"p": 0, "c": 1, "c#": 2, "d": 3, "d#": 4, "e": 5, "f": 6, "f#": 7,
+         "g": 8, "g#": 9, "a": 10, "a#": 11, "b": 12}
+DURATIONS = (1, 2, 4, 8, 16, 32)
+OCTAVE_MIN = 4
+OCTAVE_MAX = 7
+NOTE_POS = 4
+OCTAVE_POS = 2
+DOTTED_MSK = 0x02
+DURATION_MSK = 0x01
+NOTE_STRUCT_SIZE = 4
+
+NOTE_RE = re.compile(r"^(\d*)([a-gp]#?)(\.?)(\d?)(\.?)$")
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+HEADER_PATH = os.path.join(ROOT, "common", "include", "melodies.h")
+SOURCE_PATH = os.path.join(ROOT, "common", "src", "melodies.c")
+
+
+def parse_rtttl(line):
+    """Return (name, bpm, default_duration, packed bytes, number of notes)."""
+    name, settings, notes = [field.strip() for field in line.split(":")]
+    defaults = {"d": 4, "o": 6, "b": 63}
+    for setting in settings.split(","):
+        if setting.strip():
+            key, value = setting.strip().split("=")
+            defaults[key.strip().lower()] = int(value)
+    if defaults["d"] not in DURATIONS:
+        raise ValueError(f"{name}: invalid default duration {defaults['d']}")
+
+    data = []
+    num_notes = 0
+    for token in notes.lower().replace(" ", "").split(","):
+        match = NOTE_RE.match(token)
+        if not match:
+            raise ValueError(f"{name}: invalid note '{token}'")
+        duration, note, dot1, octave, dot2 = match.groups()
+        duration = int(duration) if duration else defaults["d"]
+        octave = int(octave) if octave else defaults["o"]
+        if duration not in DURATIONS:
+            raise ValueError(f"{name}: invalid duration in '{token}'")
+        if note == "p":
+            octave = OCTAVE_MIN
+        if not OCTAVE_MIN <= octave <= OCTAVE_MAX:
+            raise ValueError(f"{name}: octave out of range in '{token}'")
+
+        packed = (NOTES[note] << NOTE_POS) | ((octave - OCTAVE_MIN) << OCTAVE_POS)
+        if dot1 or dot2:
+            packed |= DOTTED_MSK
+        if duration != defaults["d"]:
+            packed |= DURATION_MSK
+        data.append(packed)
+        if duration != defaults["d"]:
+            data.append(duration)
+        num_notes += 1
+    return name.lower(), defaults["b"], defaults["d"], data, num_notes
+
+
+def write_header(melodies):
+    enum = "\n".join(f"    MELODY_{m[0].upper()}{' = 0' if i == 0 else ''}, /*!< Melody `{m[0]}` */"
+                     for i, m in enumerate(melodies))
+    with open(HEADER_PATH, "w") as f:
+        f.write(f"""/**
+ * @file melodies.h
+ * @brief Header for melodies.c file. Generated by tools/rtttl2c.py from tools/melodies.rtttl, do not edit.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+#ifndef MELODIES_H_
+#define MELODIES_H_
+
+/* Includes ------------------------------------------------------------------*/
+/* Other includes */
+#include "fsm_buzzer.h"
+
+/* Defines and enums ----------------------------------------------------------*/
+/* Enums */
+/// @brief Melodies stored in flash.
+typedef enum
+{{
+{enum}
+    MELODY_NUM /*!< Number of melodies */
+}} melody_id_t;
+
+/* Function prototypes and explanation ----------------------------------------*/
+
+/// @brief Return a melody stored in flash.
+/// @param melody_id Melody identifier.
+/// @return Pointer to the melody, NULL if the identifier is not valid.
+const fsm_buzzer_melody_t *melodies_get(melody_id_t melody_id);
+
+#endif
+""")
+
+
+def write_source(melodies):
+    arrays = []
+    for name, bpm, duration, data, num_notes in melodies:
+        rows = []
+        for i in range(0, len(data), 16):
+            rows.append("    " + ", ".join(f"0x{b:02X}" for b in data[i:i + 16]) + ",")
+        rows = "\n".join(rows)
+        arrays.append(f"""/// @brief Packed notes of the melody `{name}`: {num_notes} notes in {len(data)} bytes.
+static const uint8_t {name}_data_arr[] = {{
+{rows}
+}};
+""")
+    entries = "\n".join(f"    [MELODY_{name.upper()}] = {{.p_data = {name}_data_arr, .size = sizeof({name}_data_arr), .bpm = {bpm}, .default_duration = {duration}}},"
+                        for name, bpm, duration, _, _ in melodies)
+    arrays = "\n".join(arrays)
+    with open(SOURCE_PATH, "w") as f:
+        f.write(f"""/**
+ * @file melodies.c
+ * @brief Melodies of the buzzer in the packed format. Generated by tools/rtttl2c.py from tools/melodies.rtttl, do not edit.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "melodies.h"
+#include <stdlib.h>
+
+/* Global variables ------------------------------------------------------------*/
+
+{arrays}
+/// @brief Array of elements that describes each melody.
+static const fsm_buzzer_melody_t melodies_arr[] = {{
+{entries}
+}};
+
+/* Public functions */
+
+const fsm_buzzer_melody_t *melodies_get(melody_id_t melody_id)
+{{
+    if (melody_id >= MELODY_NUM)
+    {{
+        return NULL;
+    }}
+    return &melodies_arr[melody_id];
+}}
+""")
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    melodies = []
+    with open(sys.argv[1]) as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith("#"):
+                melodies.append(parse_rtttl(line))
+    write_header(melodies)
+    write_source(melodies)
+
+    total_packed = total_table = 0
+    for name, _, _, data, num_notes in melodies:
+        table = num_notes * NOTE_STRUCT_SIZE
+        total_packed += len(data)
+        total_table += table
+        print(f"{name:16s} {num_notes:4d} notes {len(data):5d} B packed {table:5d} B as note table")
+    print(f"{'total':16s} {'':10s} {total_packed:5d} B packed {total_table:5d} B as note table")
+
+
+if __name__ == "__main__":
+    main()
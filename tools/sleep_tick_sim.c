@@ -0,0 +1,179 @@
+/**
+ * @file sleep_tick_sim.c
+ * @brief Host simulation of the time base across the sleeps: the millisecond tick and the microsecond clock of the port are kept as `port_system_sleep()` and `port_system_sleep_until()` keep them, with the RTC on the LSE and the HSI running 0.5 % fast. The system runs between 0.1 and 50 ms, then sleeps until a random interrupt or a deadline, and the sleep starts at any time within a tick of the RTC, as in the port. The wakeup timer of the RTC may fire up to one of its counts early, since its prescaler is not reset when it is started.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Itools/host -Iport/nucleo_stm32f446re/include tools/sleep_tick_sim.c -o sleep_tick_sim
+ *   ./sleep_tick_sim [number of sleeps]
+ *
+ * It returns 0 if the millisecond tick stays within #MAX_MILLIS_ERROR_MS of the real time, the microsecond clock within #MAX_MICROS_ERROR_US and never goes back, and no wakeup of a deadline comes before it.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "port_system.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define DEFAULT_SLEEPS 100000                          /*!< Sleeps simulated by default */
+#define TICK_HZ (RTC_LSE_HZ / (RTC_PREDIV_A + 1))      /*!< Frequency of the subsecond counter of the RTC */
+#define WAKEUP_HZ (RTC_LSE_HZ / 16U)                   /*!< Frequency of the counts of the wakeup timer */
+#define HSI_NOMINAL_HZ 16000000ULL                     /*!< Clock assumed by the port */
+#define HSI_REAL_HZ 16080000ULL                        /*!< Clock of the simulation: the HSI 0.5 % fast */
+#define MAX_MILLIS_ERROR_MS 2                          /*!< Largest error of the millisecond tick accepted */
+#define MAX_MICROS_ERROR_US 1000                       /*!< Largest error of the microsecond clock accepted */
+#define NS_PER_S 1000000000ULL                         /*!< Nanoseconds in a second */
+
+/* Global variables ------------------------------------------------------------*/
+static uint64_t now_ns = 0;             /*!< Real time of the simulation */
+static uint64_t rtc_phase_ns = 0;       /*!< Phase of the ticks of the RTC */
+static uint32_t ms_ticks = 0;           /*!< Millisecond tick, as `msTicks` */
+static uint64_t systick_cycles = 0;     /*!< Cycles of the millisecond in progress counted by the SysTick */
+static uint64_t base_us = 0;            /*!< Base of the microsecond clock */
+static uint64_t base_ns = 0;            /*!< Real time of the base, where the cycle counter is taken */
+static uint64_t rtc_sync_ticks = 0;     /*!< As in the port */
+static uint64_t rtc_sync_us = 0;        /*!< As in the port */
+static uint32_t micros_remainder = 0;   /*!< As in the port */
+static uint32_t tick_remainder_ns = 0;  /*!< As in the port */
+
+/* Private functions */
+
+/// @brief Return a random number in a range.
+/// @param min Lowest value.
+/// @param max Highest value.
+/// @return uint64_t Random number.
+static uint64_t _random(uint64_t min, uint64_t max)
+{
+    uint64_t r = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+    return min + (r % (max - min + 1));
+}
+
+/// @brief Return the ticks of the subsecond counter of the RTC at a time.
+/// @param t_ns Real time.
+/// @return uint64_t Ticks since the start of the simulation.
+static uint64_t _rtc_ticks(uint64_t t_ns)
+{
+    return ((t_ns + rtc_phase_ns) * TICK_HZ) / NS_PER_S;
+}
+
+/// @brief Return the time of the start of a tick of the RTC.
+/// @param ticks Tick.
+/// @return uint64_t Real time.
+static uint64_t _rtc_edge_ns(uint64_t ticks)
+{
+    return ((ticks * NS_PER_S) + TICK_HZ - 1) / TICK_HZ - rtc_phase_ns;
+}
+
+/// @brief Return the cycles of the HSI counted up to a time.
+/// @param t_ns Real time.
+/// @return uint64_t Cycles.
+static uint64_t _cycles(uint64_t t_ns)
+{
+    return ((t_ns / NS_PER_S) * HSI_REAL_HZ) + (((t_ns % NS_PER_S) * HSI_REAL_HZ) / NS_PER_S); /* In two parts, so the product does not overflow */
+}
+
+/// @brief Return the microsecond clock, as `port_system_get_micros64()`: the base plus the cycles counted since then at the nominal rate.
+/// @return uint64_t Time in us.
+static uint64_t _micros(void)
+{
+    return base_us + ((_cycles(now_ns) - _cycles(base_ns)) / (HSI_NOMINAL_HZ / 1000000U));
+}
+
+/// @brief Return the microsecond clock in ns, as `_micros_get_ns()` of the port.
+/// @return uint64_t Time in ns.
+static uint64_t _micros_ns(void)
+{
+    return (base_us * 1000U) + (((_cycles(now_ns) - _cycles(base_ns)) * 1000U) / (HSI_NOMINAL_HZ / 1000000U));
+}
+
+/// @brief Run the system, with the SysTick counting the millisecond tick.
+/// @param run_ns Time awake.
+static void _run(uint64_t run_ns)
+{
+    systick_cycles += _cycles(now_ns + run_ns) - _cycles(now_ns);
+    ms_ticks += (uint32_t)(systick_cycles / (HSI_NOMINAL_HZ / 1000U));
+    systick_cycles %= (HSI_NOMINAL_HZ / 1000U);
+    now_ns += run_ns;
+}
+
+/// @brief Sleep as `_sleep()` of the port, until an interrupt or a deadline, and synchronize the time base with the RTC on wakeup.
+/// @param irq_ns Time from now to the interrupt.
+/// @param has_deadline true to program the wakeup timer.
+/// @param deadline_ms Millisecond tick of the deadline.
+/// @return int 1 if the wakeup of the deadline came before it, 0 if not.
+static int _sleep(uint64_t irq_ns, bool has_deadline, uint32_t deadline_ms)
+{
+    uint64_t event_ns = now_ns + irq_ns;
+    bool deadline_first = false;
+    if (has_deadline)
+    {
+        int32_t left_ms = (int32_t)(deadline_ms - ms_ticks);
+        if (left_ms <= 0)
+        {
+            return 0;
+        }
+        uint64_t counts = ((((uint64_t)left_ms * TICK_HZ) + (1000U * RTC_WAKEUP_TICKS) - 1) / (1000U * RTC_WAKEUP_TICKS)) + 2; /* As `_rtc_wakeup_start()` */
+        uint64_t deadline_ns = now_ns + (((counts * NS_PER_S) - _random(0, NS_PER_S - 1)) / WAKEUP_HZ); /* The first count may be short */
+        if (deadline_ns < event_ns)
+        {
+            event_ns = deadline_ns;
+            deadline_first = true;
+        }
+    }
+    uint64_t start_ns = _micros_ns();
+    uint64_t edge = _rtc_ticks(event_ns) + 1; /* The only wait, for the next tick of the RTC */
+    now_ns = _rtc_edge_ns(edge);
+
+    uint64_t total = ((edge - rtc_sync_ticks) * 1000000U) + micros_remainder;
+    micros_remainder = (uint32_t)(total % TICK_HZ);
+    rtc_sync_ticks = edge;
+    rtc_sync_us += total / TICK_HZ;
+    uint64_t wake_ns = ((rtc_sync_us * 1000U) > start_ns) ? (rtc_sync_us * 1000U) : start_ns;
+    base_us = wake_ns / 1000U;
+    base_ns = now_ns;
+
+    total = (wake_ns - start_ns) + tick_remainder_ns;
+    ms_ticks += (uint32_t)(total / 1000000U);
+    tick_remainder_ns = (uint32_t)(total % 1000000U);
+    return (deadline_first && ((int32_t)(ms_ticks - deadline_ms) < 0)) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t num_sleeps = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_SLEEPS;
+    srand(1);
+    rtc_phase_ns = _random(0, NS_PER_S / TICK_HZ);
+    now_ns = _rtc_edge_ns(_rtc_ticks(_random(0, NS_PER_S)) + 1); /* The RTC is started at the edge of a tick */
+    uint64_t start_ns = now_ns;
+    rtc_sync_ticks = _rtc_ticks(now_ns);
+    base_ns = now_ns;
+
+    int early = 0;
+    int64_t max_millis_error = 0;
+    int64_t max_micros_error = 0;
+    int backwards = 0;
+    uint64_t last_us = 0;
+    for (uint32_t i = 0; i < num_sleeps; i++)
+    {
+        _run(_random(100000, 50000000));
+        bool has_deadline = (rand() & 1) != 0;
+        uint32_t deadline_ms = ms_ticks + (uint32_t)_random(1, 2000);
+        early += _sleep(_random(100000, 2000000000), has_deadline, deadline_ms);
+
+        uint64_t real_us = (now_ns - start_ns) / 1000U;
+        int64_t millis_error = (int64_t)ms_ticks - (int64_t)(real_us / 1000U);
+        int64_t micros_error = (int64_t)_micros() - (int64_t)real_us;
+        max_millis_error = (llabs(millis_error) > max_millis_error) ? llabs(millis_error) : max_millis_error;
+        max_micros_error = (llabs(micros_error) > max_micros_error) ? llabs(micros_error) : max_micros_error;
+        backwards += (_micros() < last_us);
+        last_us = _micros();
+    }
+    int errors = early + backwards + (max_millis_error > MAX_MILLIS_ERROR_MS) + (max_micros_error > MAX_MICROS_ERROR_US);
+    printf("%lu sleeps over %.1f h: millis error max %lld ms, micros error max %lld us, %d early wakeups, %d steps back\n", (unsigned long)num_sleeps,
+           (double)(now_ns - start_ns) / (3600.0 * NS_PER_S), (long long)max_millis_error, (long long)max_micros_error, early, backwards);
+    printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file synth_wav.c
+ * @brief Host renderer of the DAC audio backend: it plays the melodies stored in flash through the wavetable synthesizer and writes WAV files, so the output can be checked without hardware.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Icommon/include tools/synth_wav.c common/src/synth.c common/src/melodies.c -o synth_wav
+ *   ./synth_wav [output directory]
+ *
+ * It writes melody_<id>.wav for each melody (one voice, as the buzzer FSM plays them) and chord.wav (C major chord on the four voices, then released).
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 07/05/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "synth.h"
+#include "melodies.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define BLOCK_SAMPLES 64       /*!< Samples rendered per call, as the DMA half buffer of the target */
+#define MAX_SECONDS 120        /*!< Maximum length of a file */
+#define TAIL_MS 200            /*!< Time rendered after the last note off, to hear the release */
+#define NOTES_PER_OCTAVE 12    /*!< Notes of an octave */
+
+/* Global variables ------------------------------------------------------------*/
+static int16_t wav_arr[MAX_SECONDS * SYNTH_SAMPLE_RATE_HZ]; /*!< Samples of the file */
+static uint32_t num_samples;                               /*!< Samples rendered */
+
+/* Private functions */
+
+/// @brief Render the synthesizer for some milliseconds and append the samples to the file, converted from 12-bit unsigned to 16-bit signed.
+/// @param ms Milliseconds to render.
+static void _render_ms(uint32_t ms)
+{
+    uint32_t n = (ms * SYNTH_SAMPLE_RATE_HZ) / 1000;
+    uint16_t block[BLOCK_SAMPLES];
+    while ((n > 0) && (num_samples < (sizeof(wav_arr) / sizeof(wav_arr[0]))))
+    {
+        uint32_t len = (n < BLOCK_SAMPLES) ? n : BLOCK_SAMPLES;
+        synth_render(block, len);
+        for (uint32_t i = 0; (i < len) && (num_samples < (sizeof(wav_arr) / sizeof(wav_arr[0]))); i++)
+        {
+            wav_arr[num_samples++] = (int16_t)(((int32_t)block[i] - SYNTH_SAMPLE_MID) * 16);
+        }
+        n -= len;
+    }
+}
+
+/// @brief Write a 16-bit mono WAV file with the samples rendered.
+/// @param p_path Path of the file.
+/// @return 0 if the file has been written.
+static int _write_wav(const char *p_path)
+{
+    FILE *p_file = fopen(p_path, "wb");
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return 1;
+    }
+    uint32_t data_bytes = num_samples * 2;
+    uint32_t byte_rate = SYNTH_SAMPLE_RATE_HZ * 2;
+    uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+                          0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 16, 0, 'd', 'a', 't', 'a', 0, 0, 0, 0};
+    uint32_t fields[][2] = {{4, 36 + data_bytes}, {24, SYNTH_SAMPLE_RATE_HZ}, {28, byte_rate}, {40, data_bytes}};
+    for (uint32_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        for (uint32_t b = 0; b < 4; b++)
+        {
+            header[fields[f][0] + b] = (uint8_t)(fields[f][1] >> (8 * b));
+        }
+    }
+    fwrite(header, 1, sizeof(header), p_file);
+    for (uint32_t i = 0; i < num_samples; i++)
+    {
+        uint8_t sample[2] = {(uint8_t)wav_arr[i], (uint8_t)((uint16_t)wav_arr[i] >> 8)};
+        fwrite(sample, 1, 2, p_file);
+    }
+    fclose(p_file);
+    printf("%s: %u samples (%u ms)\n", p_path, (unsigned)num_samples, (unsigned)((num_samples * 1000ULL) / SYNTH_SAMPLE_RATE_HZ));
+    return 0;
+}
+
+/// @brief Play a melody in the packed format of the buzzer FSM with one voice, as `fsm_buzzer` and the DAC backend do on the target.
+/// @param p_melody Pointer to the melody.
+static void _play_melody(const fsm_buzzer_melody_t *p_melody)
+{
+    uint16_t idx = 0;
+    while (idx < p_melody->size)
+    {
+        uint8_t packed = p_melody->p_data[idx++];
+        uint8_t note = (packed & BUZZER_NOTE_MSK) >> BUZZER_NOTE_POS;
+        uint8_t octave = BUZZER_OCTAVE_MIN + ((packed & BUZZER_OCTAVE_MSK) >> BUZZER_OCTAVE_POS);
+        uint8_t divisor = p_melody->default_duration;
+        if ((packed & BUZZER_DURATION_MSK) && (idx < p_melody->size))
+        {
+            divisor = p_melody->p_data[idx++];
+        }
+        uint32_t duration_ms = (4 * 60000U) / ((uint32_t)p_melody->bpm * divisor);
+        if (packed & BUZZER_DOTTED_MSK)
+        {
+            duration_ms += duration_ms / 2;
+        }
+        if ((note != BUZZER_NOTE_REST) && (note <= NOTES_PER_OCTAVE))
+        {
+            synth_note_on(0, (octave - BUZZER_OCTAVE_MIN) * NOTES_PER_OCTAVE + (note - 1), SYNTH_VOLUME_MAX);
+        }
+        else
+        {
+            synth_note_off(0);
+        }
+        _render_ms(duration_ms);
+    }
+    synth_note_off(0);
+    _render_ms(TAIL_MS);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *p_dir = (argc > 1) ? argv[1] : ".";
+    char path[512];
+    int rc = 0;
+
+    for (uint32_t id = 0; id < MELODY_NUM; id++)
+    {
+        synth_init();
+        num_samples = 0;
+        _play_melody(melodies_get((melody_id_t)id));
+        snprintf(path, sizeof(path), "%s/melody_%u.wav", p_dir, (unsigned)id);
+        rc |= _write_wav(path);
+    }
+
+    synth_init();
+    num_samples = 0;
+    synth_note_on(0, 0, SYNTH_VOLUME_MAX);   /* C4 */
+    synth_note_on(1, 4, SYNTH_VOLUME_MAX);   /* E4 */
+    synth_note_on(2, 7, SYNTH_VOLUME_MAX);   /* G4 */
+    synth_note_on(3, 12, SYNTH_VOLUME_MAX / 2); /* C5 */
+    _render_ms(1000);
+    for (uint8_t voice = 0; voice < SYNTH_NUM_VOICES; voice++)
+    {
+        synth_note_off(voice);
+    }
+    _render_ms(TAIL_MS);
+    snprintf(path, sizeof(path), "%s/chord.wav", p_dir);
+    rc |= _write_wav(path);
+    return rc;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file tx_queue_test.c
+ * @brief Host test of the queue of frames of the infrared transmitter: the transmitter FSM runs against a stub of the port whose symbol timer advances one tick each time the FSM polls it. It checks the OVERWRITE, DROP and BLOCK policies, the depth and drop counters, the order of the frames sent, the carrier reloads and the time between the start of two frames, padded to the frame period or with an explicit gap, and reports the throughput.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Itools/host -Icommon/include -Iport/nucleo_stm32f446re/include tools/tx_queue_test.c common/src/fsm_tx.c common/src/ir_encoder.c common/src/fsm.c -o tx_queue_test
+ *   ./tx_queue_test
+ *
+ * It returns 0 if every check passes.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 30/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "fsm_tx.h"
+#include "port_tx.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define MAX_SENT 64         /*!< Frames recorded by the stub of the port */
+#define NUM_EXTRA 3         /*!< Frames queued beyond the size of the queue to test the policies */
+#define EXPLICIT_GAP 400    /*!< Explicit inter-frame gap tested, in ticks of the symbol timer */
+#define CODE_BASE 0x00FF0000UL /*!< Base of the NEC codes queued: address 0x00, command given by the low byte */
+
+/* Typedefs --------------------------------------------------------------------*/
+/// @brief Structure to record a frame sent by the stub of the port.
+typedef struct
+{
+    uint64_t start_tick;    /*!< Tick of the symbol timer when the frame started */
+    uint32_t ticks;         /*!< Length of the frame and its gap */
+    uint32_t code;          /*!< NEC code of the frame, 0 for a repetition frame or another protocol */
+    uint32_t num_durations; /*!< Number of durations of the burst schedule */
+} sent_frame_t;
+
+/* Global variables ------------------------------------------------------------*/
+static uint64_t now_tick = 0;          /*!< Time of the stub, in ticks of the symbol timer */
+static uint64_t busy_until_tick = 0;   /*!< End of the frame on air */
+static sent_frame_t sent_arr[MAX_SENT]; /*!< Frames sent */
+static uint32_t num_sent = 0;          /*!< Number of frames sent */
+static uint32_t num_carriers = 0;      /*!< Number of reloads of the carrier */
+static int errors = 0;                 /*!< Number of failed checks */
+
+/* Stub of the port */
+
+void port_tx_init(uint8_t tx_id, bool status)
+{
+    (void)tx_id;
+    (void)status;
+}
+
+void port_tx_set_carrier(uint8_t tx_id, uint32_t freq_hz, uint8_t duty_percent)
+{
+    (void)tx_id;
+    (void)freq_hz;
+    (void)duty_percent;
+    num_carriers++;
+}
+
+void port_tx_send_bursts(uint8_t tx_id, const uint16_t *p_durations, uint32_t num_durations)
+{
+    (void)tx_id;
+    sent_frame_t frame = {.start_tick = now_tick, .ticks = 0, .code = 0, .num_durations = num_durations};
+    for (uint32_t i = 0; i < num_durations; i++)
+    {
+        frame.ticks += p_durations[i];
+    }
+    if (num_durations == IR_ENCODER_MAX_DURATIONS) /* NEC frame: the silence after each bit burst tells the bit */
+    {
+        for (uint32_t i = 0; i < 32; i++)
+        {
+            frame.code = (frame.code << 1) | (p_durations[3 + (2 * i)] == NEC_TX_SYM_1_TICKS_OFF);
+        }
+    }
+    busy_until_tick = now_tick + frame.ticks;
+    if (num_sent < MAX_SENT)
+    {
+        sent_arr[num_sent++] = frame;
+    }
+}
+
+bool port_tx_is_busy(uint8_t tx_id)
+{
+    (void)tx_id;
+    now_tick++; /* Each poll of the main loop lasts a tick */
+    return now_tick < busy_until_tick;
+}
+
+/* Private functions */
+
+/// @brief Check a condition and print it if it fails.
+/// @param ok Condition.
+/// @param p_msg Description of the check.
+/// @param value Value printed with the description.
+static void _check(bool ok, const char *p_msg, uint32_t value)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s (%u)\n", p_msg, (unsigned)value);
+        errors++;
+    }
+}
+
+/// @brief Create a transmitter FSM and reset the stub of the port.
+/// @param policy Policy of the queue.
+/// @return fsm_t* Pointer to the transmitter FSM.
+static fsm_t *_new_tx(fsm_tx_queue_policy_t policy)
+{
+    now_tick = 0;
+    busy_until_tick = 0;
+    num_sent = 0;
+    num_carriers = 0;
+    fsm_t *p_fsm_tx = fsm_tx_new(0);
+    fsm_tx_set_queue_policy(p_fsm_tx, policy);
+    return p_fsm_tx;
+}
+
+/// @brief Fire the transmitter FSM, as the main loop, until the queue is empty and the last frame has been sent.
+/// @param p_fsm_tx Pointer to the transmitter FSM.
+static void _run(fsm_t *p_fsm_tx)
+{
+    do
+    {
+        fsm_fire(p_fsm_tx);
+    } while (fsm_tx_check_activity(p_fsm_tx) || (fsm_tx_get_queue_depth(p_fsm_tx) > 0));
+}
+
+/// @brief Return the ticks of a NEC frame before its gap.
+/// @param code Code of the frame.
+/// @return uint32_t Ticks from the start of the frame to the end of its last burst.
+static uint32_t _frame_ticks(uint32_t code)
+{
+    uint16_t durations[IR_ENCODER_MAX_DURATIONS];
+    uint32_t num_durations = ir_encoder_build_schedule(IR_PROTOCOL_NEC, code, durations);
+    uint32_t ticks = 0;
+    for (uint32_t i = 0; (i + 1) < num_durations; i++)
+    {
+        ticks += durations[i];
+    }
+    return ticks;
+}
+
+/// @brief Check the time between the start of consecutive frames sent.
+/// @param first Index of the first frame checked.
+/// @param last Index of the last frame checked.
+/// @param period_ticks Expected time between starts, or 0 to use the length of each frame before its gap plus #EXPLICIT_GAP.
+/// @param p_name Name of the test.
+static void _check_spacing(uint32_t first, uint32_t last, uint32_t period_ticks, const char *p_name)
+{
+    for (uint32_t i = first; (i < last) && (i + 1 < num_sent); i++)
+    {
+        uint32_t expected = period_ticks ? period_ticks : (_frame_ticks(sent_arr[i].code) + EXPLICIT_GAP);
+        uint32_t spacing = (uint32_t)(sent_arr[i + 1].start_tick - sent_arr[i].start_tick);
+        if (spacing != expected)
+        {
+            printf("FAIL: %s: frames %u and %u start %u ticks apart, expected %u\n", p_name, (unsigned)i, (unsigned)(i + 1), (unsigned)spacing, (unsigned)expected);
+            errors++;
+        }
+    }
+}
+
+/// @brief Send a burst of frames padded to the frame period, half of them cached, and a burst of repetition frames, and report the throughput.
+static void _test_period(void)
+{
+    fsm_t *p_fsm_tx = _new_tx(TX_QUEUE_DROP);
+    for (uint8_t slot = 0; slot < NEC_TX_QUEUE_SIZE / 2; slot++)
+    {
+        fsm_tx_cache_code(p_fsm_tx, slot, CODE_BASE | slot);
+    }
+    for (uint32_t i = 0; i < NEC_TX_QUEUE_SIZE; i++)
+    {
+        _check(fsm_tx_queue_code(p_fsm_tx, CODE_BASE | i, NEC_TX_GAP_MIN), "period: frame queued", i);
+    }
+    _check(fsm_tx_get_queue_depth(p_fsm_tx) == NEC_TX_QUEUE_SIZE, "period: depth with the queue full", fsm_tx_get_queue_depth(p_fsm_tx));
+    _run(p_fsm_tx);
+    for (uint32_t i = 0; i < NEC_TX_QUEUE_SIZE; i++) /* The cached codes again, with the schedules kept from the first send */
+    {
+        fsm_tx_queue_code(p_fsm_tx, CODE_BASE | (i % (NEC_TX_QUEUE_SIZE / 2)), NEC_TX_GAP_MIN);
+    }
+    _run(p_fsm_tx);
+    for (uint32_t i = 0; i < NEC_TX_QUEUE_SIZE; i++)
+    {
+        fsm_tx_queue_repetition(p_fsm_tx, NEC_TX_GAP_MIN);
+    }
+    _run(p_fsm_tx);
+
+    _check(num_sent == 3 * NEC_TX_QUEUE_SIZE, "period: frames sent", num_sent);
+    for (uint32_t i = 0; i < NEC_TX_QUEUE_SIZE; i++)
+    {
+        _check(sent_arr[i].code == (CODE_BASE | i), "period: order of the frames", i);
+        _check(sent_arr[i + (2 * NEC_TX_QUEUE_SIZE)].num_durations == NEC_TX_REPEAT_DURATIONS, "period: repetition frame", i);
+    }
+    for (uint32_t i = 0; i < num_sent; i++)
+    {
+        _check(sent_arr[i].ticks == NEC_TX_FRAME_PERIOD_TICKS, "period: frame padded to the NEC period", sent_arr[i].ticks);
+    }
+    _check_spacing(0, NEC_TX_QUEUE_SIZE - 1, NEC_TX_FRAME_PERIOD_TICKS, "period");
+    _check_spacing(NEC_TX_QUEUE_SIZE, (3 * NEC_TX_QUEUE_SIZE) - 1, NEC_TX_FRAME_PERIOD_TICKS, "period, cached and repetitions");
+    _check(fsm_tx_get_queue_max_depth(p_fsm_tx) == NEC_TX_QUEUE_SIZE, "period: maximum depth", fsm_tx_get_queue_max_depth(p_fsm_tx));
+    _check(fsm_tx_get_queue_drops(p_fsm_tx) == 0, "period: drops", fsm_tx_get_queue_drops(p_fsm_tx));
+
+    uint32_t span_ticks = (uint32_t)(sent_arr[num_sent - 1].start_tick + sent_arr[num_sent - 1].ticks - sent_arr[0].start_tick);
+    double span_s = ((double)span_ticks * NEC_TX_TIMER_TICK_BASE_NS) / 1e9;
+    printf("Frame period: %u frames in %.3f s, %.2f frames/s (%.2f expected at 108 ms)\n", (unsigned)num_sent, span_s, num_sent / span_s, 1e9 / ((double)NEC_TX_FRAME_PERIOD_TICKS * NEC_TX_TIMER_TICK_BASE_NS));
+    fsm_destroy(p_fsm_tx);
+}
+
+/// @brief Send frames with an explicit gap, shorter than the padding to the frame period, and check that the next frame starts right after it.
+static void _test_explicit_gap(void)
+{
+    fsm_t *p_fsm_tx = _new_tx(TX_QUEUE_DROP);
+    static const uint32_t codes_arr[] = {0x00FF00FF, 0xFFFFFFFF, 0x00000001, 0x12345678};
+    for (uint32_t i = 0; i < sizeof(codes_arr) / sizeof(codes_arr[0]); i++)
+    {
+        fsm_tx_queue_code(p_fsm_tx, codes_arr[i], EXPLICIT_GAP);
+    }
+    _run(p_fsm_tx);
+    _check(num_sent == sizeof(codes_arr) / sizeof(codes_arr[0]), "gap: frames sent", num_sent);
+    _check_spacing(0, num_sent - 1, 0, "gap");
+    double span_s = ((double)(sent_arr[num_sent - 1].start_tick + sent_arr[num_sent - 1].ticks) * NEC_TX_TIMER_TICK_BASE_NS) / 1e9;
+    printf("Gap of %u ticks: %u frames in %.3f s, %.2f frames/s\n", EXPLICIT_GAP, (unsigned)num_sent, span_s, num_sent / span_s);
+    fsm_destroy(p_fsm_tx);
+}
+
+/// @brief Start a frame, then queue more frames than the queue holds while it is on air, and check the frames sent and the counters of the policy.
+/// @param policy Policy of the queue.
+/// @param p_name Name of the policy.
+static void _test_policy(fsm_tx_queue_policy_t policy, const char *p_name)
+{
+    fsm_t *p_fsm_tx = _new_tx(policy);
+    uint32_t num_queued = NEC_TX_QUEUE_SIZE + NUM_EXTRA;
+    uint32_t num_accepted = 0;
+    fsm_tx_queue_code(p_fsm_tx, CODE_BASE | 0xFF, NEC_TX_GAP_MIN);
+    fsm_fire(p_fsm_tx); /* The first frame is on air */
+    for (uint32_t i = 0; i < num_queued; i++)
+    {
+        num_accepted += fsm_tx_queue_code(p_fsm_tx, CODE_BASE | i, NEC_TX_GAP_MIN);
+    }
+    uint32_t depth = fsm_tx_get_queue_depth(p_fsm_tx);
+    uint32_t sent_while_queuing = num_sent;
+    _run(p_fsm_tx);
+
+    uint32_t expected_drops = (policy == TX_QUEUE_BLOCK) ? 0 : NUM_EXTRA;
+    uint32_t first_code = (policy == TX_QUEUE_OVERWRITE) ? NUM_EXTRA : 0; /* OVERWRITE keeps the newest frames, DROP the oldest ones */
+    uint32_t expected_sent = 1 + ((policy == TX_QUEUE_BLOCK) ? num_queued : NEC_TX_QUEUE_SIZE);
+    printf("%-9s %u frames queued while one is on air: %u accepted, depth %u, maximum depth %u, %u drops, %u frames sent\n", p_name, (unsigned)num_queued, (unsigned)num_accepted,
+           (unsigned)depth, (unsigned)fsm_tx_get_queue_max_depth(p_fsm_tx), (unsigned)fsm_tx_get_queue_drops(p_fsm_tx), (unsigned)num_sent);
+
+    _check(num_accepted == ((policy == TX_QUEUE_DROP) ? NEC_TX_QUEUE_SIZE : num_queued), "policy: frames accepted", num_accepted);
+    _check(depth == NEC_TX_QUEUE_SIZE, "policy: depth after queuing", depth);
+    _check(fsm_tx_get_queue_max_depth(p_fsm_tx) == NEC_TX_QUEUE_SIZE, "policy: maximum depth", fsm_tx_get_queue_max_depth(p_fsm_tx));
+    _check(fsm_tx_get_queue_drops(p_fsm_tx) == expected_drops, "policy: drops", fsm_tx_get_queue_drops(p_fsm_tx));
+    _check(num_sent == expected_sent, "policy: frames sent", num_sent);
+    _check((policy == TX_QUEUE_BLOCK) ? (sent_while_queuing == 1 + NUM_EXTRA) : (sent_while_queuing == 1), "policy: frames sent while queuing", sent_while_queuing);
+    _check(sent_arr[0].code == (CODE_BASE | 0xFF), "policy: frame on air kept", sent_arr[0].code);
+    for (uint32_t i = 1; i < num_sent; i++)
+    {
+        _check(sent_arr[i].code == (CODE_BASE | (first_code + i - 1)), "policy: order of the frames", i);
+    }
+    _check_spacing(0, num_sent - 1, NEC_TX_FRAME_PERIOD_TICKS, p_name);
+    fsm_destroy(p_fsm_tx);
+}
+
+/// @brief Send frames of several protocols and check that the carrier is only reloaded when the protocol changes.
+static void _test_carrier(void)
+{
+    fsm_t *p_fsm_tx = _new_tx(TX_QUEUE_DROP);
+    fsm_tx_queue_code(p_fsm_tx, CODE_BASE, NEC_TX_GAP_MIN);
+    fsm_tx_queue_protocol_code(p_fsm_tx, IR_PROTOCOL_RC5, 0x1ABC, NEC_TX_GAP_MIN);
+    fsm_tx_queue_protocol_code(p_fsm_tx, IR_PROTOCOL_RC5, 0x0123, NEC_TX_GAP_MIN);
+    fsm_tx_queue_code(p_fsm_tx, CODE_BASE, NEC_TX_GAP_MIN);
+    _run(p_fsm_tx);
+    _check(num_sent == 4, "carrier: frames sent", num_sent);
+    _check(num_carriers == 2, "carrier: reloads", num_carriers);
+    _check(sent_arr[1].ticks == ir_encoder_get_protocol(IR_PROTOCOL_RC5)->frame_period, "carrier: RC5 frame padded to the RC5 period", sent_arr[1].ticks);
+    fsm_destroy(p_fsm_tx);
+}
+
+int main(void)
+{
+    _test_period();
+    _test_explicit_gap();
+    _test_policy(TX_QUEUE_OVERWRITE, "OVERWRITE");
+    _test_policy(TX_QUEUE_DROP, "DROP");
+    _test_policy(TX_QUEUE_BLOCK, "BLOCK");
+    _test_carrier();
+    printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}
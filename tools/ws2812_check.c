@@ -0,0 +1,171 @@
+/**
+ * @file ws2812_check.c
+ * @brief Host check of the encoder of the WS2812/SK6812 bitstream: it encodes a full frame, turns the SPI bytes into the waveform of the data line and checks the timings of every bit and of the reset against the datasheet, decodes the colors back, and reports the CPU time of a full-strip refresh.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -std=gnu17 -O2 -Icommon/include tools/ws2812_check.c common/src/ws2812.c -o ws2812_check
+ *   ./ws2812_check [number of LEDs]
+ *
+ * It returns 0 if all the timings are within the limits of the WS2812B datasheet.
+ * @author Hernán García Quijano
+ * @author Ángel Rodrigo Pérez Iglesias
+ * @date 18/04/2023
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ws2812.h"
+
+/* Defines --------------------------------------------------------------------*/
+#define MAX_LEDS 1024          /*!< Maximum number of LEDs of the frame */
+#define DEFAULT_LEDS 8         /*!< LEDs of the frame by default, as the chain of the port */
+#define NS_PER_SPI_BIT (1000000000U / WS2812_SPI_CLOCK_HZ) /*!< Duration of a bit of the SPI in ns */
+#define T0H_MIN_NS 250         /*!< Limits of the high and low times of the bits 0 and 1 (WS2812B: 400/850 ns and 800/450 ns, +-150 ns) */
+#define T0H_MAX_NS 550
+#define T0L_MIN_NS 700
+#define T0L_MAX_NS 1000
+#define T1H_MIN_NS 650
+#define T1H_MAX_NS 950
+#define T1L_MIN_NS 300
+#define T1L_MAX_NS 600
+#define RESET_MIN_NS 280000    /*!< Minimum low time of the reset (WS2812B, SK6812) */
+#define BENCH_REFRESHES 100000 /*!< Refreshes encoded to measure the CPU time */
+
+/* Global variables ------------------------------------------------------------*/
+static uint8_t frame_arr[WS2812_RESET_BYTES + (MAX_LEDS * WS2812_BYTES_PER_LED)]; /*!< Frame buffer, as in the port */
+static uint8_t colors_arr[MAX_LEDS][3];                                          /*!< Colors encoded (R, G, B) */
+
+/* Private functions */
+
+/// @brief Return a bit of the frame buffer, MSB first as the SPI sends it.
+/// @param idx Index of the bit.
+/// @return int Value of the bit.
+static int _get_bit(uint32_t idx)
+{
+    return (frame_arr[idx / 8] >> (7 - (idx % 8))) & 1;
+}
+
+/// @brief Check that a duration is within limits and print it if not.
+/// @param p_name Name of the duration.
+/// @param led Index of the LED.
+/// @param bit Index of the bit in the LED.
+/// @param ns Duration in ns.
+/// @param min_ns Minimum duration.
+/// @param max_ns Maximum duration.
+/// @return int 0 if the duration is within limits, 1 otherwise.
+static int _check(const char *p_name, uint32_t led, uint32_t bit, uint32_t ns, uint32_t min_ns, uint32_t max_ns)
+{
+    if ((ns < min_ns) || (ns > max_ns))
+    {
+        printf("LED %u bit %u: %s %u ns out of [%u, %u] ns\n", (unsigned)led, (unsigned)bit, p_name, (unsigned)ns, (unsigned)min_ns, (unsigned)max_ns);
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Walk the waveform of the frame: check the reset, then measure the high and low times of each bit of the LEDs and decode it.
+/// @param num_leds Number of LEDs of the frame.
+/// @return int Number of errors.
+static int _check_waveform(uint32_t num_leds)
+{
+    int errors = 0;
+    uint32_t idx = 0;
+    while ((idx < WS2812_RESET_BYTES * 8) && !_get_bit(idx))
+    {
+        idx++;
+    }
+    errors += _check("reset", 0, 0, idx * NS_PER_SPI_BIT, RESET_MIN_NS, 0xFFFFFFFF);
+
+    uint32_t total_bits = (WS2812_RESET_BYTES + (num_leds * WS2812_BYTES_PER_LED)) * 8;
+    for (uint32_t led = 0; led < num_leds; led++)
+    {
+        uint8_t grb[3] = {0, 0, 0};
+        for (uint32_t bit = 0; bit < WS2812_BITS_PER_LED; bit++)
+        {
+            uint32_t high = 0;
+            uint32_t low = 0;
+            while ((idx < total_bits) && _get_bit(idx))
+            {
+                high++;
+                idx++;
+            }
+            while ((idx < total_bits) && !_get_bit(idx) && ((high + low) < WS2812_SPI_BITS_PER_BIT))
+            {
+                low++;
+                idx++;
+            }
+            uint32_t high_ns = high * NS_PER_SPI_BIT;
+            uint32_t low_ns = low * NS_PER_SPI_BIT;
+            int value = (high_ns > ((T0H_MAX_NS + T1H_MIN_NS) / 2)); /* The LED samples the line between both high times */
+            if (value)
+            {
+                errors += _check("T1H", led, bit, high_ns, T1H_MIN_NS, T1H_MAX_NS);
+                errors += _check("T1L", led, bit, low_ns, T1L_MIN_NS, T1L_MAX_NS);
+            }
+            else
+            {
+                errors += _check("T0H", led, bit, high_ns, T0H_MIN_NS, T0H_MAX_NS);
+                errors += _check("T0L", led, bit, low_ns, T0L_MIN_NS, T0L_MAX_NS);
+            }
+            grb[bit / 8] = (uint8_t)((grb[bit / 8] << 1) | value);
+        }
+        if ((grb[0] != colors_arr[led][1]) || (grb[1] != colors_arr[led][0]) || (grb[2] != colors_arr[led][2]))
+        {
+            printf("LED %u: decoded %02X%02X%02X (GRB), encoded %02X%02X%02X\n", (unsigned)led, grb[0], grb[1], grb[2], colors_arr[led][1], colors_arr[led][0], colors_arr[led][2]);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/// @brief Encode all the LEDs into the frame buffer, as the port does for a refresh.
+/// @param num_leds Number of LEDs of the frame.
+static void _encode_frame(uint32_t num_leds)
+{
+    for (uint32_t i = 0; i < num_leds; i++)
+    {
+        ws2812_encode_led(&frame_arr[WS2812_RESET_BYTES + (i * WS2812_BYTES_PER_LED)], colors_arr[i][0], colors_arr[i][1], colors_arr[i][2]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t num_leds = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_LEDS;
+    if ((num_leds == 0) || (num_leds > MAX_LEDS))
+    {
+        printf("The number of LEDs must be between 1 and %u\n", MAX_LEDS);
+        return 1;
+    }
+
+    int errors = 0;
+    static const uint8_t patterns_arr[][3] = {{0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF}, {0xA5, 0x5A, 0x0F}, {0x80, 0x01, 0x7E}};
+    for (uint32_t p = 0; p <= sizeof(patterns_arr) / sizeof(patterns_arr[0]); p++)
+    {
+        for (uint32_t i = 0; i < num_leds; i++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                colors_arr[i][c] = (p < sizeof(patterns_arr) / sizeof(patterns_arr[0])) ? patterns_arr[p][c] : (uint8_t)rand(); /* The last frame is random */
+            }
+        }
+        _encode_frame(num_leds);
+        errors += _check_waveform(num_leds);
+    }
+
+    clock_t start = clock();
+    for (uint32_t n = 0; n < BENCH_REFRESHES; n++)
+    {
+        colors_arr[n % num_leds][n % 3] = (uint8_t)n;
+        _encode_frame(num_leds);
+    }
+    double refresh_us = (1e6 * (double)(clock() - start) / CLOCKS_PER_SEC) / BENCH_REFRESHES;
+
+    uint32_t frame_bytes = WS2812_RESET_BYTES + (num_leds * WS2812_BYTES_PER_LED);
+    printf("%u LEDs: %u bytes of frame buffer, %u us of DMA per refresh (%u us of reset)\n", (unsigned)num_leds, (unsigned)frame_bytes,
+           (unsigned)((frame_bytes * 8ULL * 1000000) / WS2812_SPI_CLOCK_HZ), (unsigned)((WS2812_RESET_BYTES * 8ULL * 1000000) / WS2812_SPI_CLOCK_HZ));
+    printf("Encoding of a full refresh on this host: %.3f us (%.1f ns per LED)\n", refresh_us, (1000.0 * refresh_us) / num_leds);
+    printf("%s: %d timing errors\n", errors ? "FAIL" : "PASS", errors);
+    return errors ? 1 : 0;
+}